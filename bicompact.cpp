@@ -0,0 +1,475 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <omp.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <wordexp.h>
+
+#include "history.h"
+
+using namespace history;
+using namespace std;
+
+// Path to the binary data file containing historical trading data.
+string history_path = "$HOME/.bitrader/history.dat";
+
+// The smallest read buffer of a merged run: smaller reads would not keep
+// the disk streaming at its bandwidth.
+const size_t minBufferSize = 1024 * 1024;
+
+// Sorted records in a file: the temporary run, or the compacted prefix
+// of the history file itself.
+struct Run
+{
+	string path;
+	uint64_t offset, count;
+	bool temporary;
+
+	Run() : offset(0), count(0), temporary(false) { }
+
+	Run(const string& path_, uint64_t offset_, uint64_t count_, bool temporary_) :
+		path(path_), offset(offset_), count(count_), temporary(temporary_) { }
+};
+
+static bool isLess(const Trade& a, const Trade& b)
+{
+	if (a.symbol != b.symbol) return a.symbol < b.symbol;
+	return a.id < b.id;
+}
+
+static bool isSame(const Trade& a, const Trade& b)
+{
+	return (a.symbol == b.symbol) && (a.id == b.id);
+}
+
+static void readFully(int fd, void* data, size_t size, uint64_t offset, const string& path)
+{
+	for (char* p = (char*)data; size; )
+	{
+		const ssize_t n = pread(fd, p, size, offset);
+		if (n <= 0)
+		{
+			fprintf(stderr, "Cannot read %s\n", path.c_str());
+			exit(1);
+		}
+		p += n;
+		offset += n;
+		size -= n;
+	}
+}
+
+static void writeFully(int fd, const void* data, size_t size, const string& path)
+{
+	for (const char* p = (const char*)data; size; )
+	{
+		const ssize_t n = write(fd, p, size);
+		if (n <= 0)
+		{
+			fprintf(stderr, "Cannot write %s\n", path.c_str());
+			exit(1);
+		}
+		p += n;
+		size -= n;
+	}
+}
+
+static int openForWriting(const string& path)
+{
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Cannot create %s\n", path.c_str());
+		exit(1);
+	}
+
+	return fd;
+}
+
+// Buffered sequential reader of the run.
+class Reader
+{
+	string path;
+	int fd;
+	uint64_t offset, remaining;
+	vector<Trade> buffer;
+	size_t position, size;
+
+	void fill()
+	{
+		position = 0;
+		size = min((uint64_t)buffer.size(), remaining);
+		if (!size) return;
+
+		readFully(fd, &buffer[0], size * sizeof(Trade), offset, path);
+		offset += size * sizeof(Trade);
+		remaining -= size;
+	}
+
+public :
+
+	Reader(const Run& run, size_t capacity) : path(run.path), offset(run.offset), remaining(run.count),
+		buffer(max(capacity, (size_t)1)), position(0), size(0)
+	{
+		fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			fprintf(stderr, "Cannot open %s\n", path.c_str());
+			exit(1);
+		}
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+		fill();
+	}
+
+	~Reader() { ::close(fd); }
+
+	// The current record, or NULL at the end of the run.
+	const Trade* get() const { return (position < size) ? &buffer[position] : NULL; }
+
+	void next()
+	{
+		if (++position == size) fill();
+	}
+};
+
+// Buffered writer of the merged records, dropping the duplicate ids and
+// indexing the symbols on the way.
+class Writer
+{
+	string path;
+	int fd;
+	vector<Trade> buffer;
+	size_t size;
+	Index* index;
+
+	// The last flushed record, for the duplicates across the buffers.
+	Trade last;
+
+public :
+
+	uint64_t count;
+
+	Writer(const string& path_, int fd_, size_t capacity, Index* index_) : path(path_), fd(fd_),
+		buffer(max(capacity, (size_t)1)), size(0), index(index_), count(0) { }
+
+	void write(const Trade& trade)
+	{
+		if ((size || count) && isSame(trade, size ? buffer[size - 1] : last))
+			return;
+
+		if (index)
+		{
+			if (index->symbols.size() <= trade.symbol)
+				index->symbols.resize(trade.symbol + 1, Index::Entry());
+
+			Index::Entry& entry = index->symbols[trade.symbol];
+			if (!entry.count)
+			{
+				entry.first = count;
+				entry.firstId = trade.id;
+				entry.firstTime = trade.time;
+			}
+			entry.count++;
+			entry.lastId = trade.id;
+			entry.lastTime = trade.time;
+		}
+
+		buffer[size++] = trade;
+		count++;
+		if (size == buffer.size()) flush();
+	}
+
+	void flush()
+	{
+		if (!size) return;
+
+		last = buffer[size - 1];
+		writeFully(fd, &buffer[0], size * sizeof(Trade), path);
+		size = 0;
+	}
+};
+
+// Merge the sorted runs into the writer.
+static void merge(const vector<Run>& runs, size_t bufferSize, Writer& writer)
+{
+	vector<Reader*> readers;
+	for (int i = 0; i < runs.size(); i++)
+		readers.push_back(new Reader(runs[i], bufferSize / sizeof(Trade)));
+
+	// Min-heap of the readers by their current records.
+	struct Greater
+	{
+		const vector<Reader*>& readers;
+
+		Greater(const vector<Reader*>& readers_) : readers(readers_) { }
+
+		bool operator()(int a, int b) const { return isLess(*readers[b]->get(), *readers[a]->get()); }
+	};
+
+	Greater greater(readers);
+	vector<int> heap;
+	for (int i = 0; i < readers.size(); i++)
+		if (readers[i]->get()) heap.push_back(i);
+	make_heap(heap.begin(), heap.end(), greater);
+
+	while (heap.size())
+	{
+		pop_heap(heap.begin(), heap.end(), greater);
+		Reader* reader = readers[heap.back()];
+
+		// Take the records of the reader, as long as it stays the smallest one.
+		const Trade* next = heap.size() > 1 ? readers[heap.front()]->get() : NULL;
+		const Trade* trade = reader->get();
+		do
+		{
+			writer.write(*trade);
+			reader->next();
+			trade = reader->get();
+		}
+		while (trade && (!next || !isLess(*next, *trade)));
+
+		if (trade)
+			push_heap(heap.begin(), heap.end(), greater);
+		else
+			heap.pop_back();
+	}
+
+	writer.flush();
+
+	for (int i = 0; i < readers.size(); i++)
+		delete readers[i];
+}
+
+static void removeRuns(const vector<Run>& runs)
+{
+	for (int i = 0; i < runs.size(); i++)
+		if (runs[i].temporary)
+			remove(runs[i].path.c_str());
+}
+
+static void syncFile(int fd, const string& path)
+{
+	if (fsync(fd))
+	{
+		fprintf(stderr, "Cannot sync %s\n", path.c_str());
+		exit(1);
+	}
+}
+
+// Rewrite the history file sorted by the symbol and trade id, without the duplicate
+// trades, by the external merge sort within the memory budget: the chunks of the records
+// are sorted into the temporary runs in parallel, and the runs are merged into the new
+// file, which replaces the old one atomically, with the offsets of the symbols in
+// <history>.index. The prefix compacted before is taken as a sorted run as it is.
+int main(int argc, char* argv[])
+{
+	size_t memory = 1024;
+	string tmpdir;
+	for (int i = 1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		if ((arg == "--history") && (i + 1 < argc))
+			history_path = argv[++i];
+		else if ((arg == "--memory") && (i + 1 < argc))
+			memory = atol(argv[++i]);
+		else if ((arg == "--tmpdir") && (i + 1 < argc))
+			tmpdir = argv[++i];
+		else
+			memory = 0;
+	}
+	if (memory < 16)
+	{
+		fprintf(stderr, "Usage: %s [--history <history.dat>] [--memory <MB, at least 16>] [--tmpdir <dir>]\n", argv[0]);
+		exit(1);
+	}
+	const size_t budget = memory * 1024 * 1024;
+
+	{
+		wordexp_t p;
+		char** w;
+		wordexp(history_path.c_str(), &p, 0);
+		w = p.we_wordv;
+		history_path = w[0];
+		wordfree(&p);
+	}
+
+	const size_t slash = history_path.rfind('/');
+	const string directory = (slash == string::npos) ? "." : history_path.substr(0, slash);
+	if (tmpdir == "")
+		tmpdir = directory;
+	const string runPrefix = tmpdir + "/" + history_path.substr(slash + 1) + ".run.";
+
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	struct stat st;
+	if (stat(history_path.c_str(), &st))
+	{
+		fprintf(stderr, "Cannot find the history file %s\n", history_path.c_str());
+		exit(1);
+	}
+
+	// The lock is held until the compacted file replaces the old one.
+	File history(history_path);
+	HISTORY_ERR_CHECK(history.open());
+	historyError_t status = history.lock();
+	if (status == historyErrorLocked)
+	{
+		fprintf(stderr, "The history file %s is in use, stop bihistorian before compacting it\n", history_path.c_str());
+		exit(1);
+	}
+	HISTORY_ERR_CHECK(status);
+
+	const size_t nsymbols = history.getDictionary().size();
+	const uint64_t nrecords = history.getRecordsCount();
+
+	Index previous;
+	if (previous.load(history_path) != historySuccess)
+		previous = Index();
+	if (previous.nrecords == nrecords)
+	{
+		cout << "The history file is compacted already" << endl;
+		return 0;
+	}
+
+	const int nthreads = omp_get_max_threads();
+
+	// Each thread sorts its own chunk, so that the chunks take the whole budget.
+	const uint64_t ntail = nrecords - previous.nrecords;
+	const size_t chunkSize = max(budget / sizeof(Trade) / nthreads, (size_t)1024);
+	const size_t nchunks = (ntail + chunkSize - 1) / chunkSize;
+
+	cout << "Sorting " << ntail << " trades of " << nsymbols << " symbols into " << nchunks << " runs, " <<
+		previous.nrecords << " trades compacted before ..." << endl;
+
+	vector<Run> runs(nchunks);
+	#pragma omp parallel num_threads(nthreads)
+	{
+		vector<Trade> chunk(min((uint64_t)chunkSize, ntail));
+
+		int fd = ::open(history_path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			fprintf(stderr, "Cannot open %s\n", history_path.c_str());
+			exit(1);
+		}
+
+		#pragma omp for schedule(dynamic)
+		for (size_t c = 0; c < nchunks; c++)
+		{
+			const uint64_t first = previous.nrecords + c * chunkSize;
+			const size_t count = min((uint64_t)chunkSize, nrecords - first);
+			readFully(fd, &chunk[0], count * sizeof(Trade), File::dataOffset + first * sizeof(Trade), history_path);
+
+			sort(chunk.begin(), chunk.begin() + count, isLess);
+			const size_t nunique = unique(chunk.begin(), chunk.begin() + count, isSame) - chunk.begin();
+
+			const string path = runPrefix + to_string(c);
+			int out = openForWriting(path);
+			writeFully(out, &chunk[0], nunique * sizeof(Trade), path);
+			::close(out);
+
+			runs[c] = Run(path, 0, nunique, true);
+		}
+
+		::close(fd);
+	}
+
+	if (previous.nrecords)
+		runs.push_back(Run(history_path, File::dataOffset, previous.nrecords, false));
+
+	// Merge the runs in the passes, as many at once as the budget gives
+	// the buffers of a sensible size.
+	const size_t fanIn = max(budget / minBufferSize - 1, (size_t)2);
+	for (int pass = 0; runs.size() > fanIn; pass++)
+	{
+		cout << "Merging " << runs.size() << " runs ..." << endl;
+
+		vector<Run> merged;
+		for (size_t i = 0; i < runs.size(); i += fanIn)
+		{
+			const vector<Run> group(runs.begin() + i, runs.begin() + min(i + fanIn, runs.size()));
+			const string path = runPrefix + to_string(pass) + "." + to_string(merged.size());
+
+			int fd = openForWriting(path);
+			Writer writer(path, fd, minBufferSize / sizeof(Trade), NULL);
+			merge(group, (budget - minBufferSize) / group.size(), writer);
+			::close(fd);
+
+			removeRuns(group);
+			merged.push_back(Run(path, 0, writer.count, true));
+		}
+		runs.swap(merged);
+	}
+
+	cout << "Writing " << runs.size() << " runs into the compacted file ..." << endl;
+
+	// The header and the dictionary are taken as they are.
+	const string compacted = history_path + ".compacting";
+	int fd = openForWriting(compacted);
+	{
+		vector<char> header(File::dataOffset);
+		int in = ::open(history_path.c_str(), O_RDONLY);
+		if (in < 0)
+		{
+			fprintf(stderr, "Cannot open %s\n", history_path.c_str());
+			exit(1);
+		}
+		readFully(in, &header[0], header.size(), 0, history_path);
+		::close(in);
+
+		writeFully(fd, &header[0], header.size(), compacted);
+	}
+
+	Index index;
+	index.symbols.resize(nsymbols, Index::Entry());
+	const size_t bufferSize = budget / (runs.size() + 1);
+	Writer writer(compacted, fd, bufferSize / sizeof(Trade), &index);
+	merge(runs, bufferSize, writer);
+	syncFile(fd, compacted);
+	::close(fd);
+
+	// The index goes first: should the replacement not happen, it refers to the inode of
+	// the compacted file, and is not taken for the old one.
+	if (stat(compacted.c_str(), &st))
+	{
+		fprintf(stderr, "Cannot find %s\n", compacted.c_str());
+		exit(1);
+	}
+	index.inode = st.st_ino;
+	index.nrecords = writer.count;
+	HISTORY_ERR_CHECK(index.save(history_path));
+
+	if (rename(compacted.c_str(), history_path.c_str()))
+	{
+		fprintf(stderr, "Cannot replace %s\n", history_path.c_str());
+		exit(1);
+	}
+
+	fd = ::open(directory.c_str(), O_RDONLY);
+	if (fd >= 0)
+	{
+		fsync(fd);
+		::close(fd);
+	}
+
+	removeRuns(runs);
+	history.close();
+
+	size_t nindexed = 0;
+	for (int i = 0; i < index.symbols.size(); i++)
+		nindexed += (index.symbols[i].count > 0);
+
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << "Compacted " << nrecords << " trades into " << writer.count << " of " << nindexed << " symbols, " <<
+		nrecords - writer.count << " duplicates dropped, in " << seconds << " s (" <<
+		nrecords * sizeof(Trade) / seconds / 1e6 << " MB/s)" << endl;
+
+	return 0;
+}
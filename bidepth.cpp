@@ -0,0 +1,170 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <jsoncpp/json/json.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "binance.h"
+#include "http.h"
+#include "orderbook.h"
+
+using namespace binance;
+using namespace orderbook;
+using namespace std;
+
+// Record the depth snapshots and diff events of the given symbols into the journal.
+static int record(const string& filename, const vector<string>& symbols)
+{
+	ofstream journal(filename.c_str());
+	if (!journal.is_open())
+	{
+		fprintf(stderr, "Cannot open depth journal for writing: %s\n", filename.c_str());
+		return 1;
+	}
+
+	Server server;
+	Market market(server);
+
+	// The books are kept in the ticks of the price filters, recorded with the snapshots.
+	Feed feed(symbols, &journal);
+	{
+		http::Client client(server.getHostname());
+		Json::Value exchangeInfo;
+		bool parsed = false;
+		client.get("/api/v3/exchangeInfo", [&](http::Response& response)
+		{
+			Json::Reader reader;
+			parsed = (response.status == http::httpSuccess) && reader.parse(response.body, exchangeInfo);
+		});
+		client.wait();
+
+		orderbookError_t status = parsed ? feed.setTickSizes(exchangeInfo) : orderbookErrorInvalidMessage;
+		if (status != orderbookSuccess)
+		{
+			fprintf(stderr, "Cannot take the tick sizes of the symbols: %s\n", orderbookGetErrorString(status));
+			return 1;
+		}
+	}
+	feed.start();
+
+	// Let the events buffer for a while, as it happens for the live books.
+	this_thread::sleep_for(chrono::seconds(5));
+
+	while (1)
+	{
+		for (int i = 0; i < symbols.size(); i++)
+		{
+			const string& symbol = symbols[i];
+			if (!feed.synchronize(market, symbol)) continue;
+
+			Feed::Quote quote;
+			if (!feed.getQuote(symbol, 10, quote)) continue;
+
+			cout << symbol << " : " << quote.bestBid << " / " << quote.bestAsk <<
+				" spread " << quote.spread << " imbalance " << quote.imbalance << endl;
+		}
+
+		this_thread::sleep_for(chrono::seconds(1));
+	}
+
+	return 0;
+}
+
+// Replay the recorded journal into the local books and report the
+// final state of each book together with the update rate.
+static int replay(const string& filename)
+{
+	ifstream journal(filename.c_str());
+	if (!journal.is_open())
+	{
+		fprintf(stderr, "Cannot open depth journal for reading: %s\n", filename.c_str());
+		return 1;
+	}
+
+	// Parse all messages up front, so that only the book updates are timed.
+	vector<Json::Value> messages;
+	Json::Reader reader;
+	string line;
+	while (getline(journal, line))
+	{
+		if (line.empty()) continue;
+
+		Json::Value message;
+		if (!reader.parse(line, message))
+		{
+			fprintf(stderr, "Malformed depth journal message: %s\n", line.c_str());
+			return 1;
+		}
+		messages.push_back(message);
+	}
+
+	map<string, Book> books;
+	size_t nupdates = 0, nerrors = 0;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	for (int i = 0; i < messages.size(); i++)
+	{
+		const Json::Value& message = messages[i];
+		Book& book = books[message["s"].asString()];
+
+		// Snapshot resets the book; the diff events before the first
+		// snapshot are ignored, as in the live feed.
+		orderbookError_t status;
+		if (message.isMember("lastUpdateId"))
+			status = book.applySnapshot(message);
+		else if (book.isSynchronized())
+			status = book.applyUpdate(message);
+		else
+			continue;
+
+		if (status != orderbookSuccess)
+		{
+			fprintf(stderr, "%s : %s\n", message["s"].asCString(), orderbookGetErrorString(status));
+			nerrors++;
+		}
+
+		nupdates++;
+	}
+
+	chrono::steady_clock::time_point finish = chrono::steady_clock::now();
+
+	for (map<string, Book>::const_iterator i = books.begin(), e = books.end(); i != e; i++)
+	{
+		const Book& book = i->second;
+		if (!book.isSynchronized() || !book.hasBid() || !book.hasAsk())
+		{
+			cout << i->first << " : not synchronized" << endl;
+			continue;
+		}
+
+		cout << i->first << " : " << book.getBestBid() << " / " << book.getBestAsk() <<
+			" spread " << book.getSpread() << " imbalance " << book.getImbalance(10) << endl;
+	}
+
+	const double seconds = chrono::duration<double>(finish - start).count();
+	cout << "Replayed " << nupdates << " messages of " << books.size() << " symbols in " <<
+		seconds << " sec (" << nupdates / seconds << " messages/sec), " << nerrors << " errors" << endl;
+
+	return nerrors ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if ((argc >= 4) && (string(argv[1]) == "record"))
+		return record(argv[2], vector<string>(argv + 3, argv + argc));
+
+	if ((argc == 3) && (string(argv[1]) == "replay"))
+		return replay(argv[2]);
+
+	fprintf(stderr, "Usage: %s record <journal> <symbol> [<symbol> ...]\n", argv[0]);
+	fprintf(stderr, "       %s replay <journal>\n", argv[0]);
+
+	return 1;
+}
+
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <omp.h>
+#include <parquet/arrow/writer.h>
+#include <queue>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <wordexp.h>
+
+#include "history.h"
+
+using namespace history;
+using namespace std;
+
+#define ARROW_ERR_CHECK(x) \
+do { \
+	arrow::Status status = x; \
+	if (!status.ok()) \
+	{ \
+		fprintf(stderr, "%s:%d: arrow error: %s\n", __FILE__, __LINE__, status.ToString().c_str()); \
+		exit(1); \
+	} \
+} while (0)
+
+// Path to the binary data file containing historical trading data.
+string history_path = "$HOME/.bitrader/history.dat";
+
+// Rows of the record batch and the Parquet row group: the partition
+// is written batch by batch, and never held as a whole.
+const int64_t batchSize = 64 * 1024;
+
+const int64_t msPerDay = 24 * 60 * 60 * 1000;
+
+// Consecutive records of a symbol and day, in the id order.
+struct Run
+{
+	uint16_t symbol;
+	int64_t day;
+	int64_t firstId;
+	size_t first, count;
+
+	bool operator<(const Run& other) const
+	{
+		if (symbol != other.symbol) return symbol < other.symbol;
+		if (day != other.day) return day < other.day;
+		return firstId < other.firstId;
+	}
+};
+
+// Runs of the symbol and day, written to the files of their own.
+struct Partition
+{
+	size_t first, count;
+	int64_t ntrades;
+};
+
+// Merges the runs of a partition by the ids, as the pages of trades synced more
+// than once overlap, dropping the duplicate ids. The trades of the current run
+// are taken as long as they precede the other runs, so the disjoint runs cost
+// no heap operations.
+class Merger
+{
+	struct Cursor
+	{
+		const Trade* trade;
+		const Trade* end;
+
+		// The heap top is the smallest id.
+		bool operator<(const Cursor& other) const { return trade->id > other.trade->id; }
+	};
+
+	priority_queue<Cursor> cursors;
+	Cursor current;
+	int64_t lastId;
+
+public :
+
+	Merger(const Trade* trades, const vector<Run>& runs, const Partition& partition) : lastId(INT64_MIN)
+	{
+		current.trade = current.end = NULL;
+		for (size_t i = partition.first; i < partition.first + partition.count; i++)
+		{
+			Cursor cursor;
+			cursor.trade = trades + runs[i].first;
+			cursor.end = cursor.trade + runs[i].count;
+			cursors.push(cursor);
+		}
+	}
+
+	// The next trade in the id order, or NULL after the last one.
+	const Trade* next()
+	{
+		while (1)
+		{
+			if (current.trade == current.end)
+			{
+				if (cursors.empty()) return NULL;
+				current = cursors.top();
+				cursors.pop();
+			}
+			else if (!cursors.empty() && (cursors.top().trade->id < current.trade->id))
+			{
+				cursors.push(current);
+				current = cursors.top();
+				cursors.pop();
+			}
+
+			const Trade* trade = current.trade++;
+			if (trade->id <= lastId) continue;
+
+			lastId = trade->id;
+			return trade;
+		}
+	}
+};
+
+static string getDate(int64_t day)
+{
+	const time_t seconds = day * (msPerDay / 1000);
+	tm date;
+	gmtime_r(&seconds, &date);
+
+	char buffer[16];
+	strftime(buffer, sizeof(buffer), "%Y-%m-%d", &date);
+
+	return buffer;
+}
+
+static void makeDirectories(const string& path)
+{
+	for (size_t i = 1; i <= path.size(); i++)
+		if ((i == path.size()) || (path[i] == '/'))
+			mkdir(path.substr(0, i).c_str(), 0755);
+}
+
+static shared_ptr<arrow::Buffer> allocate(int64_t size)
+{
+	arrow::Result<unique_ptr<arrow::Buffer> > buffer = arrow::AllocateBuffer(size);
+	ARROW_ERR_CHECK(buffer.status());
+
+	return shared_ptr<arrow::Buffer>(std::move(buffer).ValueOrDie());
+}
+
+// Transpose up to the given number of the merged records into the columns of the batch,
+// or return NULL after the last record.
+static shared_ptr<arrow::RecordBatch> makeBatch(const shared_ptr<arrow::Schema>& schema, Merger& merger, int64_t nrows)
+{
+	shared_ptr<arrow::Buffer> ids = allocate(nrows * sizeof(int64_t));
+	shared_ptr<arrow::Buffer> times = allocate(nrows * sizeof(int64_t));
+	shared_ptr<arrow::Buffer> prices = allocate(nrows * sizeof(double));
+	shared_ptr<arrow::Buffer> qtys = allocate(nrows * sizeof(double));
+	shared_ptr<arrow::Buffer> buyerMakers = allocate((nrows + 7) / 8);
+	shared_ptr<arrow::Buffer> bestMatches = allocate((nrows + 7) / 8);
+
+	int64_t* id = (int64_t*)ids->mutable_data();
+	int64_t* time = (int64_t*)times->mutable_data();
+	double* price = (double*)prices->mutable_data();
+	double* qty = (double*)qtys->mutable_data();
+	uint8_t* buyerMaker = buyerMakers->mutable_data();
+	uint8_t* bestMatch = bestMatches->mutable_data();
+	memset(buyerMaker, 0, buyerMakers->size());
+	memset(bestMatch, 0, bestMatches->size());
+
+	int64_t row = 0;
+	for (const Trade* trade; (row < nrows) && ((trade = merger.next()) != NULL); row++)
+	{
+		id[row] = trade->id;
+		time[row] = trade->time;
+		price[row] = trade->price;
+		qty[row] = trade->qty;
+		buyerMaker[row >> 3] |= trade->isBuyerMaker << (row & 7);
+		bestMatch[row >> 3] |= trade->isBestMatch << (row & 7);
+	}
+	if (!row) return NULL;
+	nrows = row;
+
+	vector<shared_ptr<arrow::Array> > columns;
+	columns.push_back(arrow::MakeArray(arrow::ArrayData::Make(schema->field(0)->type(), nrows, { nullptr, ids }, 0)));
+	columns.push_back(arrow::MakeArray(arrow::ArrayData::Make(schema->field(1)->type(), nrows, { nullptr, times }, 0)));
+	columns.push_back(arrow::MakeArray(arrow::ArrayData::Make(schema->field(2)->type(), nrows, { nullptr, prices }, 0)));
+	columns.push_back(arrow::MakeArray(arrow::ArrayData::Make(schema->field(3)->type(), nrows, { nullptr, qtys }, 0)));
+	columns.push_back(arrow::MakeArray(arrow::ArrayData::Make(schema->field(4)->type(), nrows, { nullptr, buyerMakers }, 0)));
+	columns.push_back(arrow::MakeArray(arrow::ArrayData::Make(schema->field(5)->type(), nrows, { nullptr, bestMatches }, 0)));
+
+	return arrow::RecordBatch::Make(schema, nrows, columns);
+}
+
+// Write the partition into the Arrow IPC and/or Parquet files of its directory
+// under the root of each format, returning the number of the trades written.
+static int64_t exportPartition(const string& outdir, const string& dir, const shared_ptr<arrow::Schema>& schema,
+	const Trade* trades, const vector<Run>& runs, const Partition& partition, bool toArrow, bool toParquet)
+{
+	shared_ptr<arrow::ipc::RecordBatchWriter> arrowWriter;
+	shared_ptr<arrow::io::FileOutputStream> arrowFile;
+	if (toArrow)
+	{
+		makeDirectories(outdir + "/arrow/" + dir);
+
+		arrow::Result<shared_ptr<arrow::io::FileOutputStream> > file = arrow::io::FileOutputStream::Open(outdir + "/arrow/" + dir + "/trades.arrow");
+		ARROW_ERR_CHECK(file.status());
+		arrowFile = *file;
+
+		arrow::Result<shared_ptr<arrow::ipc::RecordBatchWriter> > writer = arrow::ipc::MakeFileWriter(arrowFile, schema);
+		ARROW_ERR_CHECK(writer.status());
+		arrowWriter = *writer;
+	}
+
+	unique_ptr<parquet::arrow::FileWriter> parquetWriter;
+	shared_ptr<arrow::io::FileOutputStream> parquetFile;
+	if (toParquet)
+	{
+		makeDirectories(outdir + "/parquet/" + dir);
+
+		arrow::Result<shared_ptr<arrow::io::FileOutputStream> > file = arrow::io::FileOutputStream::Open(outdir + "/parquet/" + dir + "/trades.parquet");
+		ARROW_ERR_CHECK(file.status());
+		parquetFile = *file;
+
+		// Ids and times are nearly regular, and compress well with the delta encoding.
+		shared_ptr<parquet::WriterProperties> properties = parquet::WriterProperties::Builder()
+			.compression(parquet::Compression::ZSTD)
+			->disable_dictionary("id")
+			->encoding("id", parquet::Encoding::DELTA_BINARY_PACKED)
+			->disable_dictionary("time")
+			->encoding("time", parquet::Encoding::DELTA_BINARY_PACKED)
+			->max_row_group_length(batchSize)
+			->build();
+
+		arrow::Result<unique_ptr<parquet::arrow::FileWriter> > writer = parquet::arrow::FileWriter::Open(
+			*schema, arrow::default_memory_pool(), parquetFile, properties);
+		ARROW_ERR_CHECK(writer.status());
+		parquetWriter = std::move(writer).ValueOrDie();
+	}
+
+	Merger merger(trades, runs, partition);
+	int64_t ntrades = 0;
+	for (shared_ptr<arrow::RecordBatch> batch; (batch = makeBatch(schema, merger, batchSize)) != NULL; )
+	{
+		ntrades += batch->num_rows();
+
+		if (arrowWriter)
+			ARROW_ERR_CHECK(arrowWriter->WriteRecordBatch(*batch));
+		if (parquetWriter)
+			ARROW_ERR_CHECK(parquetWriter->WriteRecordBatch(*batch));
+	}
+
+	if (arrowWriter)
+	{
+		ARROW_ERR_CHECK(arrowWriter->Close());
+		ARROW_ERR_CHECK(arrowFile->Close());
+	}
+	if (parquetWriter)
+	{
+		ARROW_ERR_CHECK(parquetWriter->Close());
+		ARROW_ERR_CHECK(parquetFile->Close());
+	}
+
+	return ntrades;
+}
+
+// Export the history file into the Arrow IPC and Parquet files, partitioned as
+// <outdir>/{arrow,parquet}/symbol=<symbol>/date=<YYYY-MM-DD>/trades.{arrow,parquet},
+// for the dataframe tools to read each format directory as a single dataset.
+int main(int argc, char* argv[])
+{
+	string outdir;
+	bool toArrow = true, toParquet = true;
+	for (int i = 1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		if ((arg == "--format") && (i + 1 < argc))
+		{
+			const string format = argv[++i];
+			toArrow = (format == "arrow") || (format == "both");
+			toParquet = (format == "parquet") || (format == "both");
+		}
+		else if ((arg == "--history") && (i + 1 < argc))
+			history_path = argv[++i];
+		else if (outdir == "")
+			outdir = arg;
+		else
+			outdir = "";
+	}
+	if ((outdir == "") || (!toArrow && !toParquet))
+	{
+		fprintf(stderr, "Usage: %s [--history <history.dat>] [--format arrow|parquet|both] <outdir>\n", argv[0]);
+		exit(1);
+	}
+
+	{
+		wordexp_t p;
+		char** w;
+		wordexp(history_path.c_str(), &p, 0);
+		w = p.we_wordv;
+		history_path = w[0];
+		wordfree(&p);
+	}
+
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	// The dictionary comes from the header, the records are mapped in place.
+	struct stat st;
+	if (stat(history_path.c_str(), &st))
+	{
+		fprintf(stderr, "Cannot find the history file %s\n", history_path.c_str());
+		exit(1);
+	}
+
+	File history(history_path);
+	HISTORY_ERR_CHECK(history.open());
+	const SymbolDictionary dictionary = history.getDictionary();
+	const size_t nrecords = history.getRecordsCount();
+	history.close();
+
+	int fd = ::open(history_path.c_str(), O_RDONLY);
+	const size_t length = File::dataOffset + nrecords * sizeof(Trade);
+	void* data = (fd < 0) ? MAP_FAILED : mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED)
+	{
+		fprintf(stderr, "Cannot map the history file %s\n", history_path.c_str());
+		exit(1);
+	}
+	::close(fd);
+	madvise(data, length, MADV_SEQUENTIAL);
+
+	const Trade* trades = (const Trade*)((const char*)data + File::dataOffset);
+
+	cout << "Indexing " << nrecords << " trades of " << dictionary.size() << " symbols ..." << endl;
+
+	// Split the records into the runs in parallel, by the file chunks.
+	const int nthreads = omp_get_max_threads();
+	vector<vector<Run> > chunkRuns(nthreads);
+	#pragma omp parallel num_threads(nthreads)
+	{
+		const int t = omp_get_thread_num();
+		const size_t first = nrecords * t / nthreads, last = nrecords * (t + 1) / nthreads;
+
+		vector<Run>& runs = chunkRuns[t];
+		for (size_t i = first; i < last; i++)
+		{
+			const Trade& trade = trades[i];
+			const int64_t day = trade.time / msPerDay;
+			if (runs.size())
+			{
+				Run& run = runs.back();
+				if ((run.symbol == trade.symbol) && (run.day == day) && (trades[i - 1].id < trade.id))
+				{
+					run.count++;
+					continue;
+				}
+			}
+
+			Run run;
+			run.symbol = trade.symbol;
+			run.day = day;
+			run.firstId = trade.id;
+			run.first = i;
+			run.count = 1;
+			runs.push_back(run);
+		}
+	}
+
+	vector<Run> runs;
+	for (int t = 0; t < nthreads; t++)
+		runs.insert(runs.end(), chunkRuns[t].begin(), chunkRuns[t].end());
+	chunkRuns.clear();
+
+	// The pages of trades are appended in the order of the sync, not the ids, and
+	// may overlap: the runs of a partition are merged by the ids, when exported.
+	sort(runs.begin(), runs.end());
+
+	vector<Partition> partitions;
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		if (!i || (runs[i].symbol != runs[i - 1].symbol) || (runs[i].day != runs[i - 1].day))
+		{
+			Partition partition;
+			partition.first = i;
+			partition.count = 0;
+			partition.ntrades = 0;
+			partitions.push_back(partition);
+		}
+		partitions.back().count++;
+		partitions.back().ntrades += runs[i].count;
+	}
+
+	cout << "Exporting " << partitions.size() << " symbol days in " << runs.size() << " runs into " << outdir << " ..." << endl;
+
+	shared_ptr<arrow::Schema> schema = arrow::schema({
+		arrow::field("id", arrow::int64(), false),
+		arrow::field("time", arrow::timestamp(arrow::TimeUnit::MILLI, "UTC"), false),
+		arrow::field("price", arrow::float64(), false),
+		arrow::field("qty", arrow::float64(), false),
+		arrow::field("is_buyer_maker", arrow::boolean(), false),
+		arrow::field("is_best_match", arrow::boolean(), false)
+	});
+
+	// The largest partitions go first, for the threads to finish together.
+	vector<size_t> order(partitions.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	sort(order.begin(), order.end(), [&](size_t a, size_t b) { return partitions[a].ntrades > partitions[b].ntrades; });
+
+	int64_t nexported = 0;
+	#pragma omp parallel for num_threads(nthreads) schedule(dynamic) reduction(+:nexported)
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const Partition& partition = partitions[order[i]];
+		const Run& run = runs[partition.first];
+
+		const string dir = "symbol=" + dictionary.getName(run.symbol) + "/date=" + getDate(run.day);
+		nexported += exportPartition(outdir, dir, schema, trades, runs, partition, toArrow, toParquet);
+	}
+
+	munmap(data, length);
+
+	const double seconds = chrono::duration_cast<chrono::duration<double> >(chrono::steady_clock::now() - start).count();
+	cout << "Exported " << nexported << " trades, " << (int64_t)nrecords - nexported << " duplicates dropped, in " <<
+		seconds << " s (" << (seconds > 0 ? nrecords / seconds / 1e6 : 0) << " M trades/s)" << endl;
+
+	return 0;
+}
+
@@ -1,20 +1,37 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
 #include <cstdlib>
 #include <ctime>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <jsoncpp/json/json.h>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 #include <wordexp.h>
 
 #include "binance.h"
+#include "bus.h"
+#include "history.h"
+#include "http.h"
+#include "pool.h"
 
 using namespace binance;
+using namespace history;
+using namespace pool;
 using namespace std;
 
-struct Trade
+// Trade record of the legacy history file, which had no header
+// and kept symbol names truncated to 7 chars.
+struct LegacyTrade
 {
 	char symbol[8];
 	double price;
@@ -27,6 +44,9 @@ struct Trade
 // Path to the binary data file containing historical trading data.
 string history_path = "$HOME/.bitrader/history.dat";
 
+// Batches of the trades read from the history file or decoded from the pages.
+Pool tradeBatches(1024 * sizeof(Trade));
+
 string msSinceEpochToDate(long milliseconds)
 {
 	long seconds = milliseconds / 1000;
@@ -45,8 +65,211 @@ string msSinceEpochToDate(long milliseconds)
 	return result.str();
 }
 
-int main()
+// Number of trades per historical trades page.
+const long pageSize = 500;
+
+// Range of the consecutive trade ids, incl. the both ends.
+struct Range
+{
+	long first, last;
+
+	Range(long first_, long last_) : first(first_), last(last_) { }
+
+	bool operator<(const Range& other) const { return first < other.first; }
+};
+
+// Sort the ranges and join the overlapping or adjacent ones.
+static void mergeRanges(vector<Range>& ranges)
+{
+	if (ranges.empty()) return;
+
+	sort(ranges.begin(), ranges.end());
+
+	size_t n = 0;
+	for (size_t j = 1; j < ranges.size(); j++)
+	{
+		if (ranges[j].first <= ranges[n].last + 1)
+			ranges[n].last = max(ranges[n].last, ranges[j].last);
+		else
+			ranges[++n] = ranges[j];
+	}
+	ranges.erase(ranges.begin() + n + 1, ranges.end());
+}
+
+// Check if the id is in one of the merged ranges.
+static bool isStored(const vector<Range>& ranges, long id)
+{
+	vector<Range>::const_iterator range = upper_bound(ranges.begin(), ranges.end(), Range(id, id));
+	if (range == ranges.begin()) return false;
+	range--;
+	return id <= range->last;
+}
+
+// Download of the trade ids [fromId, toId) of a pair.
+struct Task
+{
+	enum Type
+	{
+		// The newest page of a pair without data, then continued backward.
+		Latest,
+
+		// Pages from the high watermark up, until the newest trade.
+		Forward,
+
+		// Pages from toId down to fromId, filling a gap.
+		Backward,
+	};
+
+	int i;
+	Type type;
+	long fromId, toId;
+
+	Task(int i_, Type type_, long fromId_, long toId_) : i(i_), type(type_), fromId(fromId_), toId(toId_) { }
+
+	// Ids range of the next page to request.
+	void getPage(long& first, long& last) const
+	{
+		if (type == Backward)
+		{
+			first = max(fromId, toId - pageSize);
+			last = toId;
+		}
+		else
+		{
+			first = fromId;
+			last = toId;
+		}
+	}
+};
+
+// Convert the legacy history file into the current format. Truncated names
+// are resolved against the current pairs; records, which names are ambiguous
+// or no longer listed, are dropped.
+static void upgradeLegacyHistory(const string& path, const vector<string>& pairs)
+{
+	ifstream legacy(path.c_str(), ifstream::binary);
+	if (!legacy.is_open())
+	{
+		fprintf(stderr, "Cannot open history file for reading: %s\n", path.c_str());
+		exit(1);
+	}
+
+	legacy.seekg(0, legacy.end);
+	size_t length = legacy.tellg();
+	if (length % sizeof(LegacyTrade))
+	{
+		fprintf(stderr, "File length %zu is not a multiply of the legacy trade record size %zu\n",
+			length, sizeof(LegacyTrade));
+		fprintf(stderr, "malformed history data file or invalid format?\n");
+		exit(-1);
+	}
+	legacy.seekg(0, legacy.beg);
+
+	cout << "Upgrading legacy historical data file ..." << endl;
+
+	// Empty string marks the truncated name shared by multiple pairs.
+	map<string, string> names;
+	for (int i = 0; i < pairs.size(); i++)
+	{
+		const string& symbol = pairs[i];
+		const string truncated = symbol.substr(0, sizeof(LegacyTrade().symbol) - 1);
+		map<string, string>::iterator name = names.find(truncated);
+		if (name == names.end())
+			names[truncated] = symbol;
+		else if (name->second != symbol)
+			name->second = "";
+	}
+
+	const string upgradedPath = path + ".upgrade";
+	remove(upgradedPath.c_str());
+	File upgraded(upgradedPath);
+	HISTORY_ERR_CHECK(upgraded.open());
+
+	size_t ndropped = 0;
+	const size_t szbatch = 1024;
+	vector<LegacyTrade> batch(szbatch);
+	vector<Trade> trades;
+	for (size_t j = 0, je = length / sizeof(LegacyTrade); j < je; j += szbatch)
+	{
+		const size_t size = min(szbatch, je - j);
+		legacy.read((char*)&batch[0], sizeof(LegacyTrade) * size);
+		if (!legacy.good())
+		{
+			fprintf(stderr, "Error reading legacy historical data file\n");
+			exit(1);
+		}
+
+		trades.clear();
+		for (size_t k = 0; k < size; k++)
+		{
+			const LegacyTrade& legacyTrade = batch[k];
+
+			map<string, string>::const_iterator name = names.find(
+				string(legacyTrade.symbol, strnlen(legacyTrade.symbol, sizeof(legacyTrade.symbol))));
+			if ((name == names.end()) || (name->second == ""))
+			{
+				ndropped++;
+				continue;
+			}
+
+			Trade trade;
+			HISTORY_ERR_CHECK(upgraded.addSymbol(name->second, trade.symbol));
+			trade.price = legacyTrade.price;
+			trade.qty = legacyTrade.qty;
+			trade.id = legacyTrade.id;
+			trade.time = legacyTrade.time;
+			trade.isBestMatch = legacyTrade.isBestMatch;
+			trade.isBuyerMaker = legacyTrade.isBuyerMaker;
+			trades.push_back(trade);
+		}
+
+		HISTORY_ERR_CHECK(upgraded.append(trades.data(), trades.size()));
+	}
+
+	legacy.close();
+	upgraded.close();
+
+	if (rename(upgradedPath.c_str(), path.c_str()))
+	{
+		fprintf(stderr, "Cannot replace history file %s with upgraded %s\n", path.c_str(), upgradedPath.c_str());
+		exit(1);
+	}
+
+	if (ndropped)
+		cout << "Dropped " << ndropped << " trades with ambiguous or unlisted symbols" << endl;
+}
+
+static string readKey(const string& path)
+{
+	string key;
+
+	wordexp_t p;
+	char** w;
+	wordexp(path.c_str(), &p, 0);
+	w = p.we_wordv;
+	ifstream file(w[0]);
+	if (file.is_open())
+	{
+		file >> key;
+		file.close();
+	}
+	wordfree(&p);
+
+	return key;
+}
+
+int main(int argc, char* argv[])
 {
+	// With --bus, the trades published by biingest are persisted after the sync.
+	bool follow = false;
+	if ((argc == 2) && (string(argv[1]) == "--bus"))
+		follow = true;
+	else if (argc != 1)
+	{
+		fprintf(stderr, "Usage: %s [--bus]\n", argv[0]);
+		exit(1);
+	}
+
 	cout << "Initializing ..." << endl;
 
 	{
@@ -77,7 +300,6 @@ int main()
 	cout << "Getting all trading pairs ..." << endl;
 
 	vector<string> pairs;
-	map<string, int> pairsmap;
 
 	// Get all pairs.
 	{
@@ -86,163 +308,438 @@ int main()
 		
 		pairs.resize(symbols.size());
 		for (Json::Value::ArrayIndex i = 0; i < pairs.size(); i++)
-		{
-			const string& symbol = symbols[i]["symbol"].asString();
-			
-			pairs[i] = symbol;
-			
-			// Trim symbol to 8 chars max (incl. '\0'), as we have in our database.
-			Trade trade;
-			pairsmap[string(symbol.c_str(), symbol.c_str() + min(symbol.size(), sizeof(trade.symbol) - 1))] = i + 1;
-		}
+			pairs[i] = symbols[i]["symbol"].asString();
 	}
-	
-	vector<long> minIds(pairs.size());
-	vector<long> minTimes(pairs.size());
-	for (int i = 0; i < pairs.size(); i++)
-		minIds[i] = numeric_limits<long>::max();
 
-	ifstream history(history_path.c_str(), ifstream::binary);
-	if (history.is_open())
+	File history(history_path);
+	historyError_t status = history.open();
+	if (status == historyErrorInvalidFormat)
 	{
-		history.seekg(0, history.end);
-		size_t length = history.tellg();
-	    
-		if (length % sizeof(Trade))
-		{
-			fprintf(stderr, "File length %zu is not a multiply of the trade record size %zu\n", 
-				length, sizeof(Trade));
-			fprintf(stderr, "malformed history data file or invalid format?\n");
-			exit(-1);
-		}
+		history.close();
+		upgradeLegacyHistory(history_path, pairs);
+		status = history.open();
+	}
+	HISTORY_ERR_CHECK(status);
+
+	// Hold the file for the whole run, so that bicompact does not replace it meanwhile.
+	status = history.lock();
+	if (status == historyErrorLocked)
+	{
+		fprintf(stderr, "The history file %s is in use by another bihistorian or bicompact\n", history_path.c_str());
+		exit(1);
+	}
+	HISTORY_ERR_CHECK(status);
+
+	// Register all pairs in the file dictionary up front, so that
+	// the parallel download below does not modify it.
+	vector<uint16_t> pairSymbols(pairs.size());
+	for (int i = 0; i < pairs.size(); i++)
+		HISTORY_ERR_CHECK(history.addSymbol(pairs[i], pairSymbols[i]));
+
+	// Dictionary id to pair index, or -1 for symbols no longer listed.
+	vector<int> symbolPairs(history.getDictionary().size(), -1);
+	for (int i = 0; i < pairs.size(); i++)
+		symbolPairs[pairSymbols[i]] = i;
 	
+	// Stored id ranges of each pair. The pages are appended in the id order,
+	// so the consecutive trades of a pair mostly extend the last range.
+	vector<vector<Range> > ranges(pairs.size());
+	vector<long> minTimes(pairs.size()), maxTimes(pairs.size());
+
+	{
 		cout << "Reading existing historical data file ..." << endl;
 
-		history.seekg(0, history.beg);
+		// The watermarks are the lowest and the highest ids, with their times.
+		vector<long> minIds(pairs.size(), numeric_limits<long>::max()), maxIds(pairs.size(), -1);
 
-		const size_t szbatch = 1024;
-		for (size_t j = 0, je = length / sizeof(Trade); j < je; j += szbatch)
+		Buffer<Trade> trades(tradeBatches);
+		const size_t szbatch = trades.capacity();
+		function<void(uint64_t, uint64_t)> readRecords = [&](uint64_t first, uint64_t last)
 		{
-			vector<Trade> trades(szbatch);
-			history.read((char*)&trades[0], sizeof(Trade) * min(szbatch, je - j));
-			if (history.rdstate())
-			{
-				fprintf(stderr, "Error reading historical data file: ");
-				if ((history.rdstate() & ifstream::eofbit) != 0)
-					fprintf(stderr, "End-of-File reached on input operation\n");
-				else if ((history.rdstate() & ifstream::failbit) != 0)
-					fprintf(stderr, "Logical error on i/o operation\n");
-				else if ((history.rdstate() & ifstream::badbit) != 0)
-					fprintf(stderr, "Read/writing error on i/o operation\n");
-				exit(1);
-			}
-			
-			for (int k = 0, ke = min(szbatch, je - j); k < ke; k++)
+			for (uint64_t j = first; j < last; j += szbatch)
 			{
-				const Trade& trade = trades[k];
-				
-				int i = pairsmap[trade.symbol] - 1;
-				if (i == -1)
-				{
-					fprintf(stderr, "Cannot find symbol \"%s\" in pairsmap\n", trade.symbol);
-					exit(1);
-				}
-
-				long& minTime = minTimes[i];
-				long& minId = minIds[i];
+				const size_t size = min((uint64_t)szbatch, last - j);
+				HISTORY_ERR_CHECK(history.read(j, size, &trades[0]));
 
-				if (minId > trade.id)
+				for (int k = 0; k < size; k++)
 				{
-					minId = trade.id;
-					minTime = trade.time;
+					const Trade& trade = trades[k];
+
+					int i = symbolPairs[trade.symbol];
+					if (i == -1) continue;
+
+					vector<Range>& pairRanges = ranges[i];
+					if (pairRanges.size() && (pairRanges.back().last + 1 == trade.id))
+						pairRanges.back().last = trade.id;
+					else
+						pairRanges.push_back(Range(trade.id, trade.id));
+
+					if (trade.id < minIds[i])
+					{
+						minIds[i] = trade.id;
+						minTimes[i] = trade.time;
+					}
+					if (trade.id > maxIds[i])
+					{
+						maxIds[i] = trade.id;
+						maxTimes[i] = trade.time;
+					}
 				}
 			}
+		};
+
+		// The compacted part of the file is taken from its index: the trades of each symbol
+		// are contiguous and unique there, so only the symbols with the gaps are read,
+		// and then the records appended since the compaction.
+		Index index;
+		if ((index.load(history_path) != historySuccess) || (index.nrecords > history.getRecordsCount()))
+			index = Index();
+		for (int s = 0; s < index.symbols.size(); s++)
+		{
+			const Index::Entry& entry = index.symbols[s];
+			if (!entry.count || (s >= symbolPairs.size()) || (symbolPairs[s] == -1)) continue;
+
+			if ((uint64_t)(entry.lastId - entry.firstId + 1) != entry.count)
+			{
+				readRecords(entry.first, entry.first + entry.count);
+				continue;
+			}
+
+			const int i = symbolPairs[s];
+			ranges[i].push_back(Range(entry.firstId, entry.lastId));
+			minIds[i] = entry.firstId;
+			minTimes[i] = entry.firstTime;
+			maxIds[i] = entry.lastId;
+			maxTimes[i] = entry.lastTime;
 		}
+		if (index.nrecords)
+			cout << "Reading " << history.getRecordsCount() - index.nrecords << " trades appended since the compaction ..." << endl;
+		readRecords(index.nrecords, history.getRecordsCount());
 
-		history.close();
+		for (int i = 0; i < pairs.size(); i++)
+			mergeRanges(ranges[i]);
 
 		for (int i = 0; i < pairs.size(); i++)
 		{
 			const string& symbol = pairs[i];
+			const vector<Range>& pairRanges = ranges[i];
 
-			const long& minTime = minTimes[i];
-			const long& minId = minIds[i];
-
-			if (minId == numeric_limits<long>::max())
+			if (pairRanges.empty())
+			{
 				cout << symbol << " : no data" << endl;
-			else
-				cout << symbol << " : " << minId << " (" << msSinceEpochToDate(minTime) << ")" << endl;
+				continue;
+			}
+
+			long nmissing = pairRanges.front().first;
+			for (int j = 1; j < pairRanges.size(); j++)
+				nmissing += pairRanges[j].first - pairRanges[j - 1].last - 1;
+
+			cout << symbol << " : " << pairRanges.front().first << " (" << msSinceEpochToDate(minTimes[i]) << ") - " <<
+				pairRanges.back().last << " (" << msSinceEpochToDate(maxTimes[i]) << "), " <<
+				pairRanges.size() - 1 << " gaps, " << nmissing << " trades missing" << endl;
 		}
 		
 		cout << "OK" << endl;
 	}
 
-	cout << "Retrieving historical trades ..." << endl;
+	// Sync tasks: each pair is fetched forward from its high watermark, while
+	// the gaps down to the very first trade are backfilled, newest pages first.
+	// Gaps closer than a page are backfilled together, skipping the stored trades.
+	vector<Task> tasks;
+	for (int i = 0; i < pairs.size(); i++)
+	{
+		const vector<Range>& pairRanges = ranges[i];
+
+		if (pairRanges.empty())
+		{
+			tasks.push_back(Task(i, Task::Latest, 0, 0));
+			continue;
+		}
+
+		tasks.push_back(Task(i, Task::Forward, pairRanges.back().last + 1, numeric_limits<long>::max()));
+
+		for (int j = pairRanges.size() - 1; j >= 0; j--)
+		{
+			const long first = j ? pairRanges[j - 1].last + 1 : 0;
+			const long last = pairRanges[j].first;
+			if (first == last) continue;
+
+			Task& task = tasks.back();
+			if ((task.type == Task::Backward) && (task.i == i) && (task.toId - first <= pageSize))
+				task.fromId = first;
+			else
+				tasks.push_back(Task(i, Task::Backward, first, last));
+		}
+	}
+
+	// Subscribe before the sync, so that the trades published meanwhile are kept.
+	vector<unique_ptr<bus::Subscriber> > subscribers;
+	if (follow)
+	{
+		for (int g = 0; g < bus::defaultGroups; g++)
+		{
+			subscribers.push_back(unique_ptr<bus::Subscriber>(new bus::Subscriber(g)));
+			BUS_ERR_CHECK(subscribers.back()->open());
+		}
+	}
 
-	// Get historical trades for all *BTC pairs.
-	#pragma omp parallel for num_threads(6) schedule(dynamic, 1)
+	// The newest stored id of each pair, to drop the trades of the bus already synced.
+	vector<long> highIds(pairs.size(), -1);
 	for (int i = 0; i < pairs.size(); i++)
+		if (ranges[i].size())
+			highIds[i] = ranges[i].back().last;
+
+	cout << "Retrieving historical trades ..." << endl;
+
+	// Pages of all tasks are requested concurrently over the pooled connections.
+	// Each task has one page in flight: the next page is requested as soon as
+	// the previous one is decoded. Failed pages are requested again by the
+	// decoding thread, which alone owns the tasks, with the backoff, and the
+	// task is skipped after too many failures in a row: its gap is backfilled
+	// by the next sync. The rate limited pages wait for the client to resume.
+	struct Completion
 	{
-		const string& symbol = pairs[i];
+		int t;
+		http::httpError_t status;
+		string body;
+	};
+
+	// The historical trades are requested with the account API key.
+	const vector<string> headers(1, "X-MBX-APIKEY: " + readKey(binance::Account::default_api_key_path));
+	http::Client client(server.getHostname(), 8, 64, headers);
+	Recycler<string> bodies;
+	mutex completedMutex;
+	condition_variable completedReady;
+	deque<Completion> completed;
+
+	function<void(int, int64_t)> requestPage = [&](int t, int64_t delayMs)
+	{
+		const Task& task = tasks[t];
 
-		long& minId = minIds[i];
-		while (minId > 0)
+		stringstream path;
+		path << "/api/v3/historicalTrades?symbol=" << pairs[task.i];
+		if (task.type == Task::Latest)
+			path << "&limit=" << pageSize;
+		else
 		{
-			Json::Value result;
-			while (1)
+			long first, last;
+			task.getPage(first, last);
+			path << "&fromId=" << first << "&limit=" << min(last - first, pageSize);
+		}
+
+		client.get(path.str(), [&, t](http::Response& response)
+		{
+			const bool failed = (response.status != http::httpSuccess);
+			if (failed && (response.status != http::httpErrorRateLimited))
 			{
-				binanceError_t status = binanceSuccess;
-				
-				if (minId != numeric_limits<long>::max())
-					status = account.getHistoricalTrades(result, symbol.c_str(), max(0L, minId - 500 - 1));
-				else
-					status = account.getHistoricalTrades(result, symbol.c_str());
-
-				if (status == binanceErrorEmptyServerResponse) continue;
-			
-				BINANCE_ERR_CHECK(status);
-			
-				break;
+				fprintf(stderr, "%s : %s %ld %s\n", pairs[tasks[t].i].c_str(),
+					http::httpGetErrorString(response.status), response.code, response.body.c_str());
 			}
 
-			long minTime;
-			vector<Trade> trades(result.size());
-			for (Json::Value::ArrayIndex j = 0; j < result.size(); j++)
 			{
-				Trade& trade = trades[j];
-
-				memcpy(&trade.symbol[0], symbol.c_str(), min(sizeof(trade.symbol), symbol.size() + 1));
-				trade.symbol[7] = '\0';
-				trade.id = atol(result[j]["id"].asString().c_str());
-				trade.isBestMatch = result[j]["isBestMatch"].asString() == "true";
-				trade.isBuyerMaker = result[j]["isBuyerMaker"].asString() == "true";
-				trade.price = atof(result[j]["price"].asString().c_str());
-				trade.qty = atof(result[j]["qty"].asString().c_str());			
-				trade.time = atol(result[j]["time"].asString().c_str());
-			
-				if (minId > trade.id)
+				lock_guard<mutex> lock(completedMutex);
+				completed.push_back(Completion());
+				completed.back().t = t;
+				completed.back().status = response.status;
+
+				// Leave the transfer a spare body, which keeps its capacity.
+				if (!failed)
 				{
-					minId = trade.id;
-					minTime = trade.time;
+					bodies.acquire(completed.back().body);
+					completed.back().body.swap(response.body);
 				}
 			}
+			completedReady.notify_one();
+		},
+		true, delayMs);
+	};
+
+	int nactive = tasks.size();
+	vector<int> failures(tasks.size());
+	for (int t = 0; t < tasks.size(); t++)
+		requestPage(t, 0);
+
+	Json::Value result;
+	Json::Reader reader;
+	while (nactive)
+	{
+		Completion completion;
+		{
+			unique_lock<mutex> lock(completedMutex);
+			completedReady.wait(lock, [&]() { return !completed.empty(); });
+			completion.t = completed.front().t;
+			completion.status = completed.front().status;
+			completion.body.swap(completed.front().body);
+			completed.pop_front();
+		}
+
+		const int t = completion.t;
+		Task& task = tasks[t];
+		const int i = task.i;
+		const string& symbol = pairs[i];
+
+		if (completion.status == http::httpErrorRateLimited)
+		{
+			requestPage(t, 0);
+			continue;
+		}
+
+		bool parsed = false;
+		if (completion.status == http::httpSuccess)
+		{
+			parsed = reader.parse(completion.body, result) && result.isArray();
+			bodies.release(completion.body);
+			if (!parsed)
+				fprintf(stderr, "%s : malformed historical trades response\n", symbol.c_str());
+		}
+		if (!parsed)
+		{
+			if (++failures[t] > http::Client::maxRetries)
+			{
+				fprintf(stderr, "%s : skipped after %d failures, to be backfilled by the next sync\n",
+					symbol.c_str(), failures[t]);
+				nactive--;
+				continue;
+			}
 
-			#pragma omp critical
+			requestPage(t, http::Client::getRetryDelay(failures[t]));
+			continue;
+		}
+		failures[t] = 0;
+
+		// Only the trades of the requested page are taken, except the stored ones.
+		long first = 0, last = numeric_limits<long>::max();
+		if (task.type != Task::Latest)
+			task.getPage(first, last);
+
+		long minId = numeric_limits<long>::max(), maxId = -1;
+		long minTime = 0, maxTime = 0;
+		Buffer<Trade> trades(tradeBatches);
+		size_t ntrades = 0;
+		for (Json::Value::ArrayIndex j = 0, je = min((size_t)result.size(), trades.capacity()); j < je; j++)
+		{
+			Trade& trade = trades[ntrades];
+
+			trade.symbol = pairSymbols[i];
+			trade.id = atol(result[j]["id"].asString().c_str());
+			trade.isBestMatch = result[j]["isBestMatch"].asString() == "true";
+			trade.isBuyerMaker = result[j]["isBuyerMaker"].asString() == "true";
+			trade.price = atof(result[j]["price"].asString().c_str());
+			trade.qty = atof(result[j]["qty"].asString().c_str());			
+			trade.time = atol(result[j]["time"].asString().c_str());
+
+			if ((trade.id < first) || (trade.id >= last)) continue;
+			if ((task.type == Task::Backward) && isStored(ranges[i], trade.id)) continue;
+
+			if (minId > trade.id)
+			{
+				minId = trade.id;
+				minTime = trade.time;
+			}
+			if (maxId < trade.id)
 			{
-				ofstream history(history_path.c_str(), ofstream::binary | ifstream::app);
-				if (!history.is_open())
+				maxId = trade.id;
+				maxTime = trade.time;
+			}
+
+			ntrades++;
+		}
+
+		HISTORY_ERR_CHECK(history.append(trades.data(), ntrades));
+		highIds[i] = max(highIds[i], maxId);
+
+		if (ntrades)
+		{
+			cout << symbol << " : " << minId << " (" << msSinceEpochToDate(minTime) << ") - " <<
+				maxId << " (" << msSinceEpochToDate(maxTime) << ")" << endl;
+		}
+
+		bool done = false;
+		switch (task.type)
+		{
+		case Task::Latest :
+			// Continue with the older trades.
+			done = (ntrades == 0) || (minId == 0);
+			task = Task(i, Task::Backward, 0, minId);
+			break;
+		case Task::Forward :
+			// Caught up with the newest trade.
+			done = (ntrades == 0) || (result.size() < min(last - first, pageSize));
+			task.fromId = maxId + 1;
+			break;
+		case Task::Backward :
+			// The page is done, even if some of its ids are missing on the exchange.
+			task.toId = first;
+			done = (task.toId <= task.fromId) || (result.size() == 0);
+			break;
+		}
+
+		if (done)
+			nactive--;
+		else
+			requestPage(t, 0);
+	}
+
+	if (follow)
+	{
+		cout << "Following the market data bus ..." << endl;
+
+		map<string, int> pairIndexes;
+		for (int i = 0; i < pairs.size(); i++)
+			pairIndexes[pairs[i]] = i;
+
+		// Pair indexes by the bus symbol ids, resolved on the first trade.
+		vector<int> bySymbol(bus::maxSymbols, -2);
+
+		Buffer<Trade> trades(tradeBatches);
+		uint64_t nlost = 0;
+		while (1)
+		{
+			size_t npolled = 0;
+			for (int g = 0; g < subscribers.size(); g++)
+			{
+				bus::Subscriber& subscriber = *subscribers[g];
+
+				// The lost trades are backfilled by the gap scan of the next sync.
+				const uint64_t nlostBefore = nlost;
+				const size_t count = subscriber.poll(trades.data(), trades.capacity(), nlost);
+				if (nlost != nlostBefore)
+					fprintf(stderr, "Bus group %d : %lu trades lost\n", g, (unsigned long)(nlost - nlostBefore));
+				npolled += count;
+
+				size_t ntrades = 0;
+				for (size_t j = 0; j < count; j++)
 				{
-					fprintf(stderr, "Cannot open history file for writing: %s\n", history_path.c_str());
-					exit(1);
+					Trade trade = trades[j];
+
+					int& i = bySymbol[trade.symbol];
+					if (i == -2)
+					{
+						map<string, int>::const_iterator index = pairIndexes.find(subscriber.getSymbol(trade.symbol));
+						i = (index == pairIndexes.end()) ? -1 : index->second;
+					}
+					if (i == -1) continue;
+					if (trade.id <= highIds[i]) continue;
+					highIds[i] = trade.id;
+
+					// Translate into the history file dictionary, in place.
+					trade.symbol = pairSymbols[i];
+					trades[ntrades++] = trade;
 				}
-				history.write((char*)&trades[0], sizeof(Trade) * trades.size());
-				history.close();
+
+				if (ntrades)
+					HISTORY_ERR_CHECK(history.append(trades.data(), ntrades));
 			}
-		
-			cout << symbol << " : " << minId << " (" << msSinceEpochToDate(minTime) << ")" << endl;
+
+			if (!npolled)
+				this_thread::sleep_for(chrono::milliseconds(1));
 		}
 	}
 
+	history.close();
+
+	cout << "Trade batches: " << tradeBatches.getAllocated() << " allocated, " << tradeBatches.getReused() << " reused" << endl;
+	cout << "Response bodies: " << bodies.getCreated() << " allocated, " << bodies.getReused() << " reused" << endl;
+
 	return 0;
 }
-
@@ -0,0 +1,458 @@
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <omp.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <wordexp.h>
+
+#include "candles.h"
+
+using namespace candles;
+using namespace std;
+
+// Path to the directory containing per-symbol historical data.
+string historyPath = "$HOME/.bitrader/history";
+
+// Minute snapshot row: "SYMBOL" epoch_ms price
+struct Row
+{
+	uint32_t symbol;
+	int64_t time;
+	double price;
+};
+
+// Symbol names seen by a single parsing thread. Names are not copied,
+// but point straight into the mapped file.
+class SymbolTable
+{
+	struct Entry
+	{
+		const char* name;
+		uint32_t length;
+		uint32_t id;
+	};
+
+	vector<Entry> entries;
+	vector<Entry> names;
+
+	static uint32_t hash(const char* name, uint32_t length)
+	{
+		uint32_t h = 2166136261u;
+		for (uint32_t i = 0; i < length; i++)
+			h = (h ^ (uint8_t)name[i]) * 16777619u;
+		return h;
+	}
+
+	void grow()
+	{
+		vector<Entry> old;
+		old.swap(entries);
+		entries.resize(old.size() * 2);
+		for (size_t i = 0; i < entries.size(); i++)
+			entries[i].name = NULL;
+
+		for (size_t i = 0; i < old.size(); i++)
+		{
+			if (!old[i].name) continue;
+
+			size_t mask = entries.size() - 1;
+			for (size_t j = hash(old[i].name, old[i].length) & mask; ; j = (j + 1) & mask)
+				if (!entries[j].name)
+				{
+					entries[j] = old[i];
+					break;
+				}
+		}
+	}
+
+public :
+
+	size_t size() const { return names.size(); }
+
+	string getName(uint32_t id) const { return string(names[id].name, names[id].length); }
+
+	uint32_t insert(const char* name, uint32_t length)
+	{
+		if (names.size() * 2 >= entries.size())
+			grow();
+
+		size_t mask = entries.size() - 1;
+		for (size_t j = hash(name, length) & mask; ; j = (j + 1) & mask)
+		{
+			Entry& entry = entries[j];
+			if (!entry.name)
+			{
+				entry.name = name;
+				entry.length = length;
+				entry.id = names.size();
+				names.push_back(entry);
+				return entry.id;
+			}
+
+			if ((entry.length == length) && !memcmp(entry.name, name, length))
+				return entry.id;
+		}
+	}
+
+	SymbolTable() : entries(256)
+	{
+		for (size_t i = 0; i < entries.size(); i++)
+			entries[i].name = NULL;
+	}
+};
+
+static const char* skipSpaces(const char* p, const char* end)
+{
+	while ((p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\r')))
+		p++;
+	return p;
+}
+
+// Parse a decimal integer without allocations. Returns NULL on error.
+static const char* parseInteger(const char* p, const char* end, int64_t& value)
+{
+	bool negative = false;
+	if ((p < end) && (*p == '-'))
+	{
+		negative = true;
+		p++;
+	}
+
+	const char* begin = p;
+	value = 0;
+	for ( ; (p < end) && (*p >= '0') && (*p <= '9'); p++)
+		value = value * 10 + (*p - '0');
+
+	if (p == begin)
+		return NULL;
+
+	if (negative)
+		value = -value;
+
+	return p;
+}
+
+// Parse a decimal floating-point number without allocations. Returns NULL on error.
+// Numbers with up to 19 significant digits and small exponents (which covers prices)
+// are converted exactly as long as the mantissa fits 53 bits; otherwise the result
+// may differ from strtod() in the last bit.
+static const char* parseDouble(const char* p, const char* end, double& value)
+{
+	static const double powers[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	bool negative = false;
+	if ((p < end) && ((*p == '-') || (*p == '+')))
+	{
+		negative = (*p == '-');
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int exponent = 0, ndigits = 0;
+	bool digits = false;
+
+	for ( ; (p < end) && (*p >= '0') && (*p <= '9'); p++)
+	{
+		digits = true;
+		if (ndigits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa) ndigits++;
+		}
+		else
+			exponent++;
+	}
+
+	if ((p < end) && (*p == '.'))
+	{
+		for (p++; (p < end) && (*p >= '0') && (*p <= '9'); p++)
+		{
+			digits = true;
+			if (ndigits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa) ndigits++;
+				exponent--;
+			}
+		}
+	}
+
+	if (!digits)
+		return NULL;
+
+	if ((p < end) && ((*p == 'e') || (*p == 'E')))
+	{
+		int64_t e;
+		p = parseInteger(p + (((p + 1 < end) && (p[1] == '+')) ? 2 : 1), end, e);
+		if (!p)
+			return NULL;
+		exponent += e;
+	}
+
+	value = mantissa;
+	if ((exponent >= -22) && (exponent <= 22))
+	{
+		if (exponent < 0)
+			value /= powers[-exponent];
+		else
+			value *= powers[exponent];
+	}
+	else
+		value *= pow(10.0, exponent);
+
+	if (negative)
+		value = -value;
+
+	return p;
+}
+
+// Create the directory along with its parents, an existing one being fine.
+static bool makeDirectories(const string& path)
+{
+	for (size_t i = 1; i <= path.size(); i++)
+		if ((i == path.size()) || (path[i] == '/'))
+			if (mkdir(path.substr(0, i).c_str(), 0755) && (errno != EEXIST))
+				return false;
+
+	struct stat st;
+	if (stat(path.c_str(), &st))
+		return false;
+	if (!S_ISDIR(st.st_mode))
+	{
+		errno = ENOTDIR;
+		return false;
+	}
+
+	return true;
+}
+
+// Parse the [begin, end) chunk of lines. Malformed lines are counted and skipped.
+static void parseChunk(const char* begin, const char* end, SymbolTable& symbols, vector<Row>& rows, size_t& nmalformed)
+{
+	for (const char* p = begin; p < end; )
+	{
+		const char* eol = (const char*)memchr(p, '\n', end - p);
+		if (!eol) eol = end;
+
+		const char* q = skipSpaces(p, eol);
+		if (q == eol)
+		{
+			p = eol + 1;
+			continue;
+		}
+
+		Row row;
+		bool valid = false;
+		if (*q == '"')
+		{
+			const char* name = q + 1;
+			const char* nameEnd = (const char*)memchr(name, '"', eol - name);
+			if (nameEnd && (nameEnd > name))
+			{
+				q = skipSpaces(nameEnd + 1, eol);
+				q = parseInteger(q, eol, row.time);
+				if (q)
+				{
+					q = parseDouble(skipSpaces(q, eol), eol, row.price);
+					if (q && (skipSpaces(q, eol) == eol))
+					{
+						row.symbol = symbols.insert(name, nameEnd - name);
+						valid = true;
+					}
+				}
+			}
+		}
+
+		if (valid)
+			rows.push_back(row);
+		else
+			nmalformed++;
+
+		p = eol + 1;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <trades.dat> [<trades.dat> ...]\n", argv[0]);
+		fprintf(stderr, "Imports minute snapshots of \"SYMBOL\" epoch_ms price rows into candles\n");
+		exit(1);
+	}
+
+	// Expand the history path.
+	{
+		wordexp_t p;
+		char** w;
+		wordexp(historyPath.c_str(), &p, 0);
+		w = p.we_wordv;
+		historyPath = w[0];
+		wordfree(&p);
+	}
+
+	if (!makeDirectories(historyPath))
+	{
+		fprintf(stderr, "Cannot create the history directory %s: %s\n", historyPath.c_str(), strerror(errno));
+		exit(1);
+	}
+
+	map<string, Series> series;
+
+	// Watermarks of the candles stored before this import.
+	map<string, int64_t> watermarks;
+	size_t totalBytes = 0, totalRows = 0, totalMalformed = 0;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* filename = argv[i];
+
+		int fd = open(filename, O_RDONLY);
+		if (fd == -1)
+		{
+			fprintf(stderr, "Cannot open snapshots file %s\n", filename);
+			exit(1);
+		}
+
+		struct stat st;
+		fstat(fd, &st);
+		const size_t length = st.st_size;
+		if (length == 0)
+		{
+			close(fd);
+			continue;
+		}
+
+		const char* data = (const char*)mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			fprintf(stderr, "Cannot map snapshots file %s\n", filename);
+			exit(1);
+		}
+		madvise((void*)data, length, MADV_SEQUENTIAL);
+		madvise((void*)data, length, MADV_WILLNEED);
+
+		cout << "Importing " << filename << " ..." << endl;
+
+		// Split the file into per-thread chunks on line boundaries.
+		const int nthreads = omp_get_max_threads();
+		vector<const char*> bounds(nthreads + 1);
+		bounds[0] = data;
+		bounds[nthreads] = data + length;
+		for (int t = 1; t < nthreads; t++)
+		{
+			const char* bound = max(bounds[t - 1], data + length * t / nthreads);
+			const char* eol = (const char*)memchr(bound, '\n', data + length - bound);
+			bounds[t] = eol ? eol + 1 : data + length;
+		}
+
+		vector<SymbolTable> symbols(nthreads);
+		vector<vector<Row> > rows(nthreads);
+		vector<size_t> nmalformed(nthreads);
+
+		#pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+		for (int t = 0; t < nthreads; t++)
+		{
+			// Rows are roughly 40 bytes long.
+			rows[t].reserve((bounds[t + 1] - bounds[t]) / 32);
+			parseChunk(bounds[t], bounds[t + 1], symbols[t], rows[t], nmalformed[t]);
+		}
+
+		// Resolve the thread-local symbol ids into series, keeping the file order.
+		for (int t = 0; t < nthreads; t++)
+		{
+			vector<Series*> local(symbols[t].size());
+			vector<int64_t> localWatermarks(symbols[t].size());
+			for (uint32_t j = 0; j < local.size(); j++)
+			{
+				const string name = symbols[t].getName(j);
+				map<string, Series>::iterator s = series.find(name);
+				if (s == series.end())
+				{
+					s = series.insert(make_pair(name, Series())).first;
+
+					// Continue the existing candles, if any.
+					candlesError_t status = s->second.load(getPath(historyPath, name, s->second.getTimeframe()));
+					if ((status != candlesSuccess) && (status != candlesErrorOpenFailed))
+					{
+						fprintf(stderr, "Cannot continue existing candles of %s: %s, starting over\n",
+							name.c_str(), candlesGetErrorString(status));
+						s->second = Series();
+					}
+
+					watermarks[name] = s->second.size() ? s->second.getWatermark() : numeric_limits<int64_t>::min();
+
+					// Marked, so that the candles built from the archive merge with them.
+					s->second.setImported(true);
+				}
+				local[j] = &s->second;
+				localWatermarks[j] = watermarks[name];
+			}
+
+			for (size_t j = 0, je = rows[t].size(); j < je; j++)
+			{
+				const Row& row = rows[t][j];
+
+				// Snapshots already folded in by a previous import are skipped.
+				if (row.time <= localWatermarks[row.symbol]) continue;
+
+				local[row.symbol]->add(row.time, row.price, 0);
+			}
+
+			totalRows += rows[t].size();
+			totalMalformed += nmalformed[t];
+		}
+
+		munmap((void*)data, length);
+		close(fd);
+
+		totalBytes += length;
+	}
+
+	chrono::steady_clock::time_point parsed = chrono::steady_clock::now();
+
+	cout << "Writing candles of " << series.size() << " symbols ..." << endl;
+
+	vector<map<string, Series>::const_iterator> items;
+	for (map<string, Series>::const_iterator s = series.begin(), se = series.end(); s != se; s++)
+		items.push_back(s);
+
+	#pragma omp parallel for
+	for (int j = 0; j < items.size(); j++)
+	{
+		const string& name = items[j]->first;
+		const Series& s = items[j]->second;
+		CANDLES_ERR_CHECK(saveTimeframes(historyPath, name, s));
+	}
+
+	chrono::steady_clock::time_point finish = chrono::steady_clock::now();
+
+	const double parseSeconds = chrono::duration<double>(parsed - start).count();
+	const double totalSeconds = chrono::duration<double>(finish - start).count();
+
+	cout << "Imported " << totalRows << " rows (" << totalBytes / (1024.0 * 1024.0) << " MB) in " <<
+		totalSeconds << " sec, parsing at " << totalBytes / (1024.0 * 1024.0) / parseSeconds << " MB/s" << endl;
+	if (totalMalformed)
+		cout << "Skipped " << totalMalformed << " malformed rows" << endl;
+
+	return 0;
+}
+
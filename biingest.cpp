@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <jsoncpp/json/json.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "binance.h"
+#include "bus.h"
+#include "http.h"
+#include "pool.h"
+
+using namespace binance;
+using namespace pool;
+using namespace std;
+
+using history::Trade;
+
+// Recent trades requested per pair per sweep.
+#define TRADES_LIMIT 1000
+
+// Minimal duration of the sweep over all pairs.
+#define SWEEP_INTERVAL_MS 1000
+
+// Batches of the trades decoded from a response.
+Pool tradeBatches(TRADES_LIMIT * sizeof(Trade));
+
+static bool compareIds(const Trade& a, const Trade& b)
+{
+	return a.id < b.id;
+}
+
+// Single ingest of the recent trades of all pairs, published into the shared
+// memory bus for bitrader, bihistorian and biviewer to consume, so that the
+// trades are fetched and decoded once.
+int main(int argc, char* argv[])
+{
+	string serverUrl;
+	if (argc == 3 && string(argv[1]) == "--server")
+		serverUrl = argv[2];
+	else if (argc != 1)
+	{
+		fprintf(stderr, "Usage: %s [--server <url>]\n", argv[0]);
+		exit(1);
+	}
+
+	cout << "Initializing ..." << endl;
+
+	Server server = (serverUrl != "") ? Server(serverUrl.c_str()) : Server();
+
+	Market market(server);
+
+	cout << "Getting all trading pairs ..." << endl;
+
+	vector<string> pairs;
+	{
+		Json::Value symbols;
+		BINANCE_ERR_CHECK(market.getAllPrices(symbols));
+
+		for (Json::Value::ArrayIndex i = 0; i < symbols.size(); i++)
+			pairs.push_back(symbols[i]["symbol"].asString());
+	}
+	if (pairs.size() > bus::maxSymbols)
+	{
+		fprintf(stderr, "Too many pairs for the bus: %zu > %u\n", pairs.size(), bus::maxSymbols);
+		exit(1);
+	}
+
+	// The bus symbol ids are the pair indexes, spread over the groups.
+	cout << "Publishing " << pairs.size() << " pairs in " << bus::defaultGroups << " groups ..." << endl;
+
+	vector<unique_ptr<bus::Publisher> > publishers;
+	for (int g = 0; g < bus::defaultGroups; g++)
+	{
+		publishers.push_back(unique_ptr<bus::Publisher>(new bus::Publisher(g)));
+		BUS_ERR_CHECK(publishers.back()->open());
+	}
+	for (int i = 0; i < pairs.size(); i++)
+		BUS_ERR_CHECK(publishers[i % bus::defaultGroups]->addSymbol(i, pairs[i]));
+
+	// The failed requests are retried with the backoff by the transfer thread,
+	// which alone owns the failure counts, and the pair is skipped for the sweep
+	// after too many failures in a row. The rate limited requests wait for the
+	// client to resume, and are not counted.
+	struct Completion
+	{
+		int i;
+		bool failed;
+		string body;
+	};
+
+	http::Client client(server.getHostname());
+	Recycler<string> bodies;
+	mutex completedMutex;
+	condition_variable completedReady;
+	deque<Completion> completed;
+	vector<int> failures(pairs.size());
+
+	function<void(int, int64_t)> requestTrades = [&](int i, int64_t delayMs)
+	{
+		client.get("/api/v3/trades?symbol=" + pairs[i] + "&limit=" + to_string(TRADES_LIMIT), [&, i](http::Response& response)
+		{
+			const bool failed = (response.status != http::httpSuccess);
+			if (response.status == http::httpErrorRateLimited)
+			{
+				requestTrades(i, 0);
+				return;
+			}
+			if (failed)
+			{
+				fprintf(stderr, "%s : %s %ld\n", pairs[i].c_str(),
+					http::httpGetErrorString(response.status), response.code);
+
+				if (++failures[i] <= http::Client::maxRetries)
+				{
+					requestTrades(i, http::Client::getRetryDelay(failures[i]));
+					return;
+				}
+
+				fprintf(stderr, "%s : skipped for the sweep after %d failures\n", pairs[i].c_str(), failures[i]);
+			}
+			failures[i] = 0;
+
+			{
+				lock_guard<mutex> lock(completedMutex);
+				completed.push_back(Completion());
+				completed.back().i = i;
+				completed.back().failed = failed;
+
+				// Leave the transfer a spare body, which keeps its capacity.
+				if (!failed)
+				{
+					bodies.acquire(completed.back().body);
+					completed.back().body.swap(response.body);
+				}
+			}
+			completedReady.notify_one();
+		},
+		false, delayMs);
+	};
+
+	// The newest published id of each pair: only the newer trades are published.
+	vector<long> lastIds(pairs.size(), -1);
+	size_t npublished = 0, nmissed = 0;
+
+	Json::Value result;
+	Json::Reader reader;
+	while (1)
+	{
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		for (int i = 0; i < pairs.size(); i++)
+			requestTrades(i, 0);
+
+		for (size_t ntaken = 0; ntaken < pairs.size(); ntaken++)
+		{
+			Completion completion;
+			{
+				unique_lock<mutex> lock(completedMutex);
+				completedReady.wait(lock, [&]() { return !completed.empty(); });
+				completion.i = completed.front().i;
+				completion.failed = completed.front().failed;
+				completion.body.swap(completed.front().body);
+				completed.pop_front();
+			}
+
+			const int i = completion.i;
+			if (completion.failed) continue;
+
+			const bool parsed = reader.parse(completion.body, result);
+			bodies.release(completion.body);
+			if (!parsed || !result.isArray())
+			{
+				fprintf(stderr, "%s : malformed trades response\n", pairs[i].c_str());
+				continue;
+			}
+
+			Buffer<Trade> trades(tradeBatches);
+			size_t ntrades = 0;
+			for (Json::Value::ArrayIndex j = 0, je = min((size_t)result.size(), trades.capacity()); j < je; j++)
+			{
+				Trade& trade = trades[ntrades];
+
+				trade.id = result[j]["id"].asInt64();
+				if (trade.id <= lastIds[i]) continue;
+
+				trade.symbol = i;
+				trade.time = result[j]["time"].asInt64();
+				trade.price = atof(result[j]["price"].asString().c_str());
+				trade.qty = atof(result[j]["qty"].asString().c_str());
+				trade.isBuyerMaker = result[j]["isBuyerMaker"].asBool();
+				trade.isBestMatch = result[j]["isBestMatch"].asBool();
+				ntrades++;
+			}
+			if (!ntrades) continue;
+
+			sort(trades.data(), trades.data() + ntrades, compareIds);
+
+			// More trades than a response holds took place since the last sweep;
+			// the consumers persisting the trades backfill such gaps on their own.
+			if ((lastIds[i] >= 0) && (trades[0].id > lastIds[i] + 1))
+				nmissed += trades[0].id - lastIds[i] - 1;
+			lastIds[i] = trades[ntrades - 1].id;
+
+			publishers[i % bus::defaultGroups]->publish(trades.data(), ntrades);
+			npublished += ntrades;
+		}
+
+		cout << "Published " << npublished << " trades, " << nmissed << " missed between the sweeps" << endl;
+
+		this_thread::sleep_until(start + chrono::milliseconds(SWEEP_INTERVAL_MS));
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,680 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <jsoncpp/json/json.h>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "binance.h"
+#include "execution.h"
+#include "http.h"
+
+using namespace execution;
+using namespace std;
+
+// Local stand-in of the Binance REST API, serving a synthetic *BTC market
+// over plain HTTP. It is enough to run several bitrader instances against it:
+// bitrader --server http://localhost:<port> ...
+// Prices follow random walks with occasional pumps, so the alerts fire.
+// The IOC limit orders are matched against the synthetic book, and
+// "bimarket test" tests the order execution against this matching engine.
+// "bimarket bench" benchmarks the HTTP client on the trades requests.
+
+// Chance of a pump start per symbol per second, and the pump step.
+#define PUMP_PROBABILITY 0.001
+#define PUMP_STEP 1.01
+#define PUMP_SECONDS 5
+
+// Levels of each side of the synthetic book, their relative price step
+// from the last price, and the quantity of each level.
+#define BOOK_LEVELS 20
+#define BOOK_STEP 1e-3
+#define BOOK_QTY 100
+
+struct SyntheticTrade
+{
+	long id, time;
+	double price, qty;
+	bool isBuyerMaker;
+};
+
+struct Symbol
+{
+	string name;
+	double price;
+	double rate;
+	long nextId;
+	int pumping;
+	long updated;
+	deque<SyntheticTrade> trades;
+};
+
+static const size_t maxTrades = 1000;
+
+// Requests served per second at most, 0 for no limit; the requests over the limit
+// are refused with HTTP 429, as the exchange does, to test the clients backing off.
+static int rateLimit = 0;
+static mutex rateMutex;
+static long rateSecond = 0;
+static int rateCount = 0;
+
+static bool isRateLimited()
+{
+	if (!rateLimit) return false;
+
+	lock_guard<mutex> lock(rateMutex);
+	const long second = chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	if (second != rateSecond)
+	{
+		rateSecond = second;
+		rateCount = 0;
+	}
+
+	return ++rateCount > rateLimit;
+}
+
+static mutex marketMutex;
+static vector<Symbol> symbols;
+static map<string, int> symbolIndexes;
+static mt19937_64 generator(0);
+static long nextOrderId = 1;
+
+static long now()
+{
+	return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Generate the trades of the symbol up to the current time, second by second.
+static void advance(Symbol& symbol, long time)
+{
+	uniform_real_distribution<double> uniform(0.0, 1.0);
+	normal_distribution<double> normal(0.0, 1e-3);
+
+	for ( ; symbol.updated + 1000 <= time; symbol.updated += 1000)
+	{
+		if (symbol.pumping)
+		{
+			symbol.price *= PUMP_STEP;
+			symbol.pumping--;
+		}
+		else if (uniform(generator) < PUMP_PROBABILITY)
+			symbol.pumping = PUMP_SECONDS;
+
+		poisson_distribution<int> count(symbol.pumping ? symbol.rate * 10 : symbol.rate);
+		const int n = count(generator);
+		for (int i = 0; i < n; i++)
+		{
+			symbol.price *= 1 + normal(generator);
+
+			SyntheticTrade trade;
+			trade.id = symbol.nextId++;
+			trade.time = symbol.updated + i * 1000 / n;
+			trade.price = symbol.price;
+			trade.qty = 1 + uniform(generator) * 100;
+			trade.isBuyerMaker = uniform(generator) < 0.5;
+			symbol.trades.push_back(trade);
+		}
+
+		while (symbol.trades.size() > maxTrades)
+			symbol.trades.pop_front();
+	}
+}
+
+static string getParameter(const string& query, const string& name)
+{
+	const string key = name + "=";
+	size_t i = 0;
+	while ((i = query.find(key, i)) != string::npos)
+	{
+		if ((i == 0) || (query[i - 1] == '&') || (query[i - 1] == '?'))
+		{
+			i += key.size();
+			return query.substr(i, query.find('&', i) - i);
+		}
+		i++;
+	}
+
+	return "";
+}
+
+static string toString(double value)
+{
+	stringstream result;
+	result.precision(8);
+	result << fixed << value;
+	return result.str();
+}
+
+// Price of the level of the synthetic book, from 1 at the top, as quoted.
+static double getLevelPrice(const Symbol& symbol, bool bid, int level)
+{
+	return atof(toString(symbol.price * (bid ? 1 - level * BOOK_STEP : 1 + level * BOOK_STEP)).c_str());
+}
+
+// Match the IOC limit order against the synthetic book: the order takes the levels
+// up to its limit price, at their prices, and the rest expires. The book is not
+// changed by the orders.
+static int match(const string& params, Json::Value& result)
+{
+	const string side = getParameter(params, "side");
+	const double qty = atof(getParameter(params, "quantity").c_str());
+	const double price = atof(getParameter(params, "price").c_str());
+	if (((side != "BUY") && (side != "SELL")) || (getParameter(params, "type") != "LIMIT") ||
+		(getParameter(params, "timeInForce") != "IOC") || (qty <= 0) || (price <= 0) ||
+		(getParameter(params, "signature") == ""))
+	{
+		result["code"] = -1102;
+		result["msg"] = "Only the signed IOC limit orders are supported by the stand-in.";
+		return 400;
+	}
+
+	lock_guard<mutex> lock(marketMutex);
+	map<string, int>::const_iterator index = symbolIndexes.find(getParameter(params, "symbol"));
+	if (index == symbolIndexes.end())
+	{
+		result["code"] = -1121;
+		result["msg"] = "Invalid symbol.";
+		return 400;
+	}
+
+	Symbol& symbol = symbols[index->second];
+	advance(symbol, now());
+
+	const bool buy = (side == "BUY");
+	double executed = 0, quoteQty = 0;
+	result["fills"] = Json::Value(Json::arrayValue);
+	for (int j = 1; (j <= BOOK_LEVELS) && (executed < qty); j++)
+	{
+		const double level = getLevelPrice(symbol, !buy, j);
+		if (buy ? (level > price) : (level < price)) break;
+
+		const double taken = min((double)BOOK_QTY, qty - executed);
+		executed += taken;
+		quoteQty += taken * level;
+
+		Json::Value fill;
+		fill["price"] = toString(level);
+		fill["qty"] = toString(taken);
+		result["fills"].append(fill);
+	}
+
+	result["symbol"] = symbol.name;
+	result["orderId"] = (Json::Int64)nextOrderId++;
+	result["transactTime"] = (Json::Int64)now();
+	result["status"] = (executed >= qty) ? "FILLED" : "EXPIRED";
+	result["type"] = "LIMIT";
+	result["side"] = side;
+	result["timeInForce"] = "IOC";
+	result["price"] = toString(price);
+	result["origQty"] = toString(qty);
+	result["executedQty"] = toString(executed);
+	result["cummulativeQuoteQty"] = toString(quoteQty);
+
+	return 200;
+}
+
+// Respond to the request with the JSON body; returns the HTTP status code.
+// The parameters of the POST requests are in their content.
+static int respond(const string& method, const string& target, const string& content, string& body)
+{
+	const size_t q = target.find('?');
+	const string path = target.substr(0, q);
+	const string query = (q == string::npos) ? "" : target.substr(q + 1);
+
+	const long time = now();
+
+	Json::Value result;
+	int code = 200;
+	if ((path.find("ticker/price") != string::npos) || (path.find("allPrices") != string::npos))
+	{
+		lock_guard<mutex> lock(marketMutex);
+		result = Json::Value(Json::arrayValue);
+		for (int i = 0; i < symbols.size(); i++)
+		{
+			advance(symbols[i], time);
+
+			Json::Value price;
+			price["symbol"] = symbols[i].name;
+			price["price"] = toString(symbols[i].price);
+			result.append(price);
+		}
+	}
+	else if ((path == "/api/v3/trades") || (path == "/api/v3/historicalTrades"))
+	{
+		lock_guard<mutex> lock(marketMutex);
+		map<string, int>::const_iterator index = symbolIndexes.find(getParameter(query, "symbol"));
+		if (index == symbolIndexes.end())
+		{
+			code = 400;
+			result["code"] = -1121;
+			result["msg"] = "Invalid symbol.";
+		}
+		else
+		{
+			Symbol& symbol = symbols[index->second];
+			advance(symbol, time);
+
+			const string limitParameter = getParameter(query, "limit");
+			const size_t limit = min((size_t)(limitParameter != "" ? atol(limitParameter.c_str()) : 500), maxTrades);
+
+			result = Json::Value(Json::arrayValue);
+			for (size_t j = symbol.trades.size() - min(limit, symbol.trades.size()); j < symbol.trades.size(); j++)
+			{
+				const SyntheticTrade& trade = symbol.trades[j];
+
+				Json::Value value;
+				value["id"] = (Json::Int64)trade.id;
+				value["price"] = toString(trade.price);
+				value["qty"] = toString(trade.qty);
+				value["time"] = (Json::Int64)trade.time;
+				value["isBuyerMaker"] = trade.isBuyerMaker;
+				value["isBestMatch"] = true;
+				result.append(value);
+			}
+		}
+	}
+	else if (path == "/api/v3/depth")
+	{
+		lock_guard<mutex> lock(marketMutex);
+		map<string, int>::const_iterator index = symbolIndexes.find(getParameter(query, "symbol"));
+		if (index == symbolIndexes.end())
+		{
+			code = 400;
+			result["code"] = -1121;
+			result["msg"] = "Invalid symbol.";
+		}
+		else
+		{
+			Symbol& symbol = symbols[index->second];
+			advance(symbol, time);
+
+			result["lastUpdateId"] = (Json::Int64)symbol.nextId;
+			result["bids"] = Json::Value(Json::arrayValue);
+			result["asks"] = Json::Value(Json::arrayValue);
+			for (int j = 1; j <= BOOK_LEVELS; j++)
+			{
+				Json::Value bid(Json::arrayValue), ask(Json::arrayValue);
+				bid.append(toString(getLevelPrice(symbol, true, j)));
+				bid.append(toString(BOOK_QTY));
+				ask.append(toString(getLevelPrice(symbol, false, j)));
+				ask.append(toString(BOOK_QTY));
+				result["bids"].append(bid);
+				result["asks"].append(ask);
+			}
+		}
+	}
+	else if ((path == "/api/v3/time") || (path == "/api/v1/time"))
+		result["serverTime"] = (Json::Int64)time;
+	else if (path == "/api/v3/account")
+		result["balances"] = Json::Value(Json::arrayValue);
+	else if ((path == "/api/v3/openOrders") || (path == "/api/v3/allOrders"))
+		result = Json::Value(Json::arrayValue);
+	else if (path == "/api/v3/exchangeInfo")
+	{
+		// All synthetic symbols are quoted in BTC, with the price filter of 8 decimals only.
+		result["symbols"] = Json::Value(Json::arrayValue);
+		for (int i = 0; i < symbols.size(); i++)
+		{
+			const string& name = symbols[i].name;
+
+			Json::Value symbol;
+			symbol["symbol"] = name;
+			symbol["status"] = "TRADING";
+			symbol["baseAsset"] = name.substr(0, name.size() - 3);
+			symbol["quoteAsset"] = "BTC";
+
+			Json::Value filter;
+			filter["filterType"] = "PRICE_FILTER";
+			filter["tickSize"] = "0.00000001";
+			symbol["filters"].append(filter);
+			result["symbols"].append(symbol);
+		}
+	}
+	else if ((method == "POST") && (path == "/api/v3/order"))
+		code = match(content, result);
+	else
+	{
+		code = 404;
+		result["code"] = -1;
+		result["msg"] = "Not supported by the stand-in.";
+	}
+
+	Json::FastWriter writer;
+	body = writer.write(result);
+	return code;
+}
+
+// Serve the keep-alive HTTP/1.1 connection.
+static void serve(int fd)
+{
+	string buffer;
+	char data[4096];
+	while (1)
+	{
+		size_t end;
+		while ((end = buffer.find("\r\n\r\n")) == string::npos)
+		{
+			ssize_t n = read(fd, data, sizeof(data));
+			if (n <= 0)
+			{
+				close(fd);
+				return;
+			}
+			buffer.append(data, n);
+		}
+
+		const string head = buffer.substr(0, end);
+		buffer.erase(0, end + 4);
+
+		// Take the request content, if any.
+		size_t length = 0;
+		const string contentLength = "\r\ncontent-length:";
+		string lowerHead = head;
+		for (int i = 0; i < lowerHead.size(); i++)
+			lowerHead[i] = tolower(lowerHead[i]);
+		size_t i = lowerHead.find(contentLength);
+		if (i != string::npos)
+			length = atol(head.c_str() + i + contentLength.size());
+		while (buffer.size() < length)
+		{
+			ssize_t n = read(fd, data, sizeof(data));
+			if (n <= 0)
+			{
+				close(fd);
+				return;
+			}
+			buffer.append(data, n);
+		}
+		const string content = buffer.substr(0, length);
+		buffer.erase(0, length);
+
+		// Request line: METHOD TARGET VERSION
+		stringstream requestLine(head.substr(0, head.find("\r\n")));
+		string method, target;
+		requestLine >> method >> target;
+
+		string body;
+		const bool limited = isRateLimited();
+		const int code = limited ? 429 : respond(method, target, content, body);
+		if (limited)
+			body = "{\"code\":-1003,\"msg\":\"Too many requests.\"}";
+
+		stringstream response;
+		response << "HTTP/1.1 " << code << ((code == 200) ? " OK" : " Error") << "\r\n";
+		response << "Content-Type: application/json\r\n";
+		if (limited)
+			response << "Retry-After: 1\r\n";
+		response << "Content-Length: " << body.size() << "\r\n\r\n";
+		response << body;
+
+		const string bytes = response.str();
+		if (send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL) != bytes.size())
+		{
+			close(fd);
+			return;
+		}
+	}
+}
+
+// Synthetic symbols, with the history of the last minute.
+static void initialize(int nsymbols)
+{
+	const long time = now();
+	uniform_real_distribution<double> uniform(0.0, 1.0);
+	symbols.resize(nsymbols);
+	for (int i = 0; i < nsymbols; i++)
+	{
+		Symbol& symbol = symbols[i];
+
+		// Synthetic names, which do not clash with the listed pairs.
+		char name[16];
+		snprintf(name, sizeof(name), "X%04dBTC", i);
+		symbol.name = name;
+		symbol.price = 1e-6 * exp(uniform(generator) * 10);
+		symbol.rate = 0.5 + uniform(generator) * 5;
+		symbol.nextId = 1;
+		symbol.pumping = 0;
+		symbol.updated = time - 60 * 1000;
+		symbolIndexes[symbol.name] = i;
+	}
+}
+
+// Listen on the loopback port, any free one for zero; returns the port.
+static int listenOn(int port, int& listener)
+{
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	sockaddr_in addr;
+	socklen_t length = sizeof(addr);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if ((listener < 0) || bind(listener, (sockaddr*)&addr, sizeof(addr)) || listen(listener, 256) ||
+		getsockname(listener, (sockaddr*)&addr, &length))
+	{
+		fprintf(stderr, "Cannot listen on port %d\n", port);
+		exit(1);
+	}
+
+	return ntohs(addr.sin_port);
+}
+
+static void run(int listener)
+{
+	while (1)
+	{
+		int fd = accept(listener, NULL, NULL);
+		if (fd < 0) continue;
+
+		thread(serve, fd).detach();
+	}
+}
+
+static int nfailures = 0;
+
+static void check(bool passed, const char* name, executionError_t status, const Fill& fill)
+{
+	printf("%s %s: %s, %g @ %.8f\n", passed ? "PASSED" : "FAILED", name,
+		executionGetErrorString(status), fill.qty, fill.price);
+	if (!passed) nfailures++;
+}
+
+// Test the order execution against the matching engine: the orders within
+// the book are filled at the book prices, the orders outside of it are
+// not filled, and the order is written out in under a millisecond.
+static int test()
+{
+	initialize(1);
+
+	int listener;
+	const int port = listenOn(0, listener);
+	thread(run, listener).detach();
+
+	// The executor takes the order value from the config in the home.
+	char home[] = "/tmp/bimarket.XXXXXX";
+	if (!mkdtemp(home))
+	{
+		fprintf(stderr, "Cannot create the temporary home\n");
+		exit(1);
+	}
+	const string config = string(home) + "/.bitrader";
+	mkdir(config.c_str(), 0700);
+	{
+		ofstream file((config + "/execution").c_str());
+		file << "0.001" << endl;
+	}
+	setenv("HOME", home, 1);
+
+	const string url = "http://localhost:" + to_string(port);
+	Executor executor(binance::Server(url.c_str()), "key", "secret");
+	executionError_t status = executor.initialize();
+
+	remove((config + "/execution").c_str());
+	rmdir(config.c_str());
+	rmdir(home);
+
+	if (status != executionSuccess)
+	{
+		fprintf(stderr, "Cannot initialize the execution: %s\n", executionGetErrorString(status));
+		return 1;
+	}
+
+	const string name = symbols[0].name;
+	double price;
+	{
+		lock_guard<mutex> lock(marketMutex);
+		advance(symbols[0], now());
+		price = symbols[0].price;
+	}
+
+	// The price of the synthetic book stays within a percent of the last price.
+	Fill fill = Fill();
+	status = executor.buy(name, price * 1.05, fill);
+	check((status == executionSuccess) && (fill.qty > 0) && (fill.price <= price * 1.05), "buy within the book", status, fill);
+
+	fill = Fill();
+	status = executor.buy(name, price * 0.9, fill);
+	check((status == executionErrorNotFilled) && (fill.qty == 0), "buy below the asks", status, fill);
+
+	fill = Fill();
+	status = executor.sell(name, 5, price * 0.95, fill);
+	check((status == executionSuccess) && (fill.qty == 5) && (fill.price >= price * 0.95), "sell within the book", status, fill);
+
+	fill = Fill();
+	status = executor.sell(name, 5, price * 1.1, fill);
+	check((status == executionErrorNotFilled) && (fill.qty == 0), "sell above the bids", status, fill);
+
+	fill = Fill();
+	status = executor.buy("UNKNOWNBTC", price, fill);
+	check(status == executionErrorUnknownSymbol, "unknown symbol", status, fill);
+
+	// The latency of the orders on the open connection.
+	const int norders = 100;
+	vector<double> latencies;
+	for (int i = 0; i < norders; i++)
+	{
+		fill = Fill();
+		status = executor.sell(name, 1, price * 0.95, fill);
+		if (status == executionSuccess)
+			latencies.push_back(fill.latency);
+	}
+	sort(latencies.begin(), latencies.end());
+	const double median = latencies.size() ? latencies[latencies.size() / 2] : 0;
+	const bool passed = (latencies.size() == norders) && (median < 1000);
+	printf("%s latency: %d of %d orders filled, median %.0f us\n", passed ? "PASSED" : "FAILED",
+		(int)latencies.size(), norders, median);
+	if (!passed) nfailures++;
+
+	return nfailures ? 1 : 0;
+}
+
+// Request the trades of the symbols in turn, as many requests in total, by the
+// multiplexed client, and by the blocking requests on the given threads, each
+// on a connection of its own, as the REST layer did before. Returns the number
+// of the requests failed by the client.
+static int bench(int nrequests, int nthreads)
+{
+	const int nsymbols = 200;
+	initialize(nsymbols);
+
+	int listener;
+	const int port = listenOn(0, listener);
+	thread(run, listener).detach();
+
+	const string url = "http://localhost:" + to_string(port);
+	const string path = "/api/v3/trades?limit=10&symbol=";
+
+	atomic<int> nfailed(0);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	{
+		http::Client client(url);
+		for (int i = 0; i < nrequests; i++)
+			client.get(path + symbols[i % nsymbols].name, [&](http::Response& response)
+			{
+				if (response.status != http::httpSuccess) nfailed++;
+			});
+		client.wait();
+	}
+	const double multiplexed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	printf("multiplexed: %d requests in %.3f s, %.0f requests/s, %d failed\n",
+		nrequests, multiplexed, nrequests / multiplexed, (int)nfailed);
+
+	atomic<int> next(0), nblockingFailed(0);
+	start = chrono::steady_clock::now();
+	{
+		vector<thread> threads;
+		for (int t = 0; t < nthreads; t++)
+			threads.push_back(thread([&]()
+			{
+				string body;
+				for (int i = next++; i < nrequests; i = next++)
+				{
+					CURL* curl = curl_easy_init();
+					const string target = url + path + symbols[i % nsymbols].name;
+					curl_easy_setopt(curl, CURLOPT_URL, target.c_str());
+					curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, (size_t (*)(char*, size_t, size_t, void*))
+						[](char* data, size_t size, size_t nmemb, void* user) -> size_t
+					{
+						((string*)user)->append(data, size * nmemb);
+						return size * nmemb;
+					});
+					curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+					body.clear();
+					if (curl_easy_perform(curl) != CURLE_OK) nblockingFailed++;
+					curl_easy_cleanup(curl);
+				}
+			}));
+		for (int t = 0; t < nthreads; t++)
+			threads[t].join();
+	}
+	const double blocking = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	printf("blocking on %d threads: %d requests in %.3f s, %.0f requests/s, %d failed\n",
+		nthreads, nrequests, blocking, nrequests / blocking, (int)nblockingFailed);
+
+	return nfailed;
+}
+
+int main(int argc, char* argv[])
+{
+	if ((argc > 1) && (string(argv[1]) == "test"))
+		return test();
+	if ((argc > 1) && (string(argv[1]) == "bench"))
+		return bench((argc > 2) ? atoi(argv[2]) : 2000, (argc > 3) ? atoi(argv[3]) : 2) ? 1 : 0;
+
+	const int port = (argc > 1) ? atoi(argv[1]) : 8080;
+	const int nsymbols = (argc > 2) ? atoi(argv[2]) : 200;
+	rateLimit = (argc > 3) ? atoi(argv[3]) : 0;
+
+	initialize(nsymbols);
+
+	int listener;
+	listenOn(port, listener);
+
+	cout << "Serving " << nsymbols << " synthetic symbols on http://localhost:" << port;
+	if (rateLimit)
+		cout << ", " << rateLimit << " requests per second at most";
+	cout << endl;
+
+	run(listener);
+
+	return 0;
+}
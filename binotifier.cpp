@@ -0,0 +1,231 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <poll.h>
+#include <set>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+#include <wordexp.h>
+
+#include "runtime.h"
+#include "shard.h"
+#include "telegram.h"
+
+using namespace shard;
+using namespace std;
+using namespace telegram;
+
+// Signals of the same key (the pair) from the different instances are delivered
+// at most once per window, as the pair could be briefly watched by two instances
+// while the ring rebalances.
+#define DEDUP_WINDOW_SEC 60
+
+// The longest wait for the rest of the message being read
+#define RECEIVE_TIMEOUT_SEC 5
+
+// Members of the ring: the connected instances by socket.
+static map<int, string> names;
+
+static void broadcastMembers()
+{
+	// The same name could be connected twice during a restart.
+	set<string> unique;
+	for (map<int, string>::const_iterator i = names.begin(), e = names.end(); i != e; i++)
+		if (i->second != "")
+			unique.insert(i->second);
+
+	Message members;
+	members.type = Message::Members;
+	members.fields.assign(unique.begin(), unique.end());
+
+	cout << "Members :";
+	for (int i = 0; i < members.fields.size(); i++)
+		cout << " " << members.fields[i];
+	cout << endl;
+
+	for (map<int, string>::const_iterator i = names.begin(), e = names.end(); i != e; i++)
+		if (i->second != "")
+			writeMessage(i->first, members);
+}
+
+int main(int argc, char* argv[])
+{
+	string path = (argc > 1) ? argv[1] : default_socket_path;
+	{
+		wordexp_t p;
+		char** w;
+		wordexp(path.c_str(), &p, 0);
+		w = p.we_wordv;
+		path = w[0];
+		wordfree(&p);
+	}
+
+	Bot telegram;
+	if (!telegram.keysAreSet())
+	{
+		fprintf(stderr, "\nCannot find the token/chatid keys pair for Telegram account!\n");
+		fprintf(stderr, "The user should either provide them to Telegram constructor,\n");
+		fprintf(stderr, "or in the following files: %s, %s\n\n",
+			telegram::Bot::default_token_path.c_str(),
+			telegram::Bot::default_chatid_path.c_str());
+
+		exit(1);
+	}
+
+	// The uploads are sent by their own thread, so that a slow one does not
+	// hold the alerts of all instances from being read.
+	runtime::Serial uploads;
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+	{
+		fprintf(stderr, "Cannot create notifier socket\n");
+		exit(1);
+	}
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	unlink(path.c_str());
+	if (bind(listener, (sockaddr*)&addr, sizeof(addr)) || listen(listener, 64))
+	{
+		fprintf(stderr, "Cannot listen on notifier socket %s\n", path.c_str());
+		exit(1);
+	}
+
+	cout << "Listening on " << path << " ..." << endl;
+
+	// Time and sender of the last delivered signal by key.
+	map<string, pair<chrono::steady_clock::time_point, string> > delivered;
+
+	// Sequence number of the last alert by sender, for the alerts sent twice.
+	map<string, uint64_t> sequences;
+	size_t nsent = 0, nsuppressed = 0;
+
+	vector<pollfd> fds;
+	while (1)
+	{
+		fds.resize(1);
+		fds[0].fd = listener;
+		fds[0].events = POLLIN;
+		for (map<int, string>::const_iterator i = names.begin(), e = names.end(); i != e; i++)
+		{
+			pollfd fd;
+			fd.fd = i->first;
+			fd.events = POLLIN;
+			fds.push_back(fd);
+		}
+
+		if (poll(&fds[0], fds.size(), -1) < 0)
+			continue;
+
+		if (fds[0].revents & POLLIN)
+		{
+			int fd = accept(listener, NULL, NULL);
+			if (fd >= 0)
+			{
+				// The message is read at once, so the client stuck in the middle
+				// of it is dropped, not to stall the others.
+				timeval timeout = { RECEIVE_TIMEOUT_SEC, 0 };
+				setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+				names[fd] = "";
+			}
+		}
+
+		bool changed = false;
+		for (int i = 1; i < fds.size(); i++)
+		{
+			if (!fds[i].revents) continue;
+
+			const int fd = fds[i].fd;
+
+			// The messages are small and come from the local instances,
+			// so they are read at once.
+			Message message;
+			shardError_t status = readMessage(fd, message);
+			if (status != shardSuccess)
+			{
+				if (status == shardErrorInvalidMessage)
+					fprintf(stderr, "Dropping the connection of %s: %s\n", names[fd].c_str(), shardGetErrorString(status));
+				if (names[fd] != "")
+				{
+					cout << names[fd] << " left" << endl;
+					changed = true;
+				}
+				close(fd);
+				names.erase(fd);
+				continue;
+			}
+
+			if ((message.type == Message::Hello) && (message.fields.size() == 1))
+			{
+				names[fd] = message.fields[0];
+				cout << names[fd] << " joined" << endl;
+				changed = true;
+			}
+			else if ((message.type == Message::Alert) && (message.fields.size() == 6))
+			{
+				const string& key = message.fields[0];
+				const int kind = atoi(message.fields[1].c_str());
+				const string& sender = message.fields[2];
+				const uint64_t sequence = strtoull(message.fields[3].c_str(), NULL, 10);
+				const string& caption = message.fields[4];
+				const string& png = message.fields[5];
+
+				map<string, uint64_t>::iterator last = sequences.find(sender);
+				if ((last != sequences.end()) && (sequence <= last->second))
+				{
+					nsuppressed++;
+					cout << key << " : alert " << sequence << " from " << sender << " sent again, suppressed" << endl;
+					continue;
+				}
+				sequences[sender] = sequence;
+
+				// Only the signals of the pair from another instance are the duplicates.
+				if (kind == SignalAlert)
+				{
+					const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+					map<string, pair<chrono::steady_clock::time_point, string> >::iterator signal = delivered.find(key);
+					if ((signal != delivered.end()) && (signal->second.second != sender) &&
+						(now - signal->second.first < chrono::seconds(DEDUP_WINDOW_SEC)))
+					{
+						nsuppressed++;
+						cout << key << " : duplicate signal from " << sender << " suppressed" << endl;
+						continue;
+					}
+					delivered[key] = make_pair(now, sender);
+				}
+
+				// The photo not sent is queued by the bot as the message.
+				function<void()> send = [&telegram, png, caption]()
+				{
+					if (png != "")
+						telegram.sendPhoto(png, caption);
+					else
+						telegram.sendMessage(caption);
+				};
+				uploads.post(send);
+				nsent++;
+
+				cout << key << " : alert from " << sender << " sent (" <<
+					nsent << " sent, " << nsuppressed << " suppressed)" << endl;
+			}
+			else
+				fprintf(stderr, "Unexpected message type %u from %s\n", message.type, names[fd].c_str());
+		}
+
+		if (changed)
+			broadcastMembers();
+	}
+
+	return 0;
+}
+
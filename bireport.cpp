@@ -0,0 +1,105 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+#include <wordexp.h>
+
+#include "candles.h"
+#include "chart.h"
+
+using namespace candles;
+using namespace chart;
+using namespace std;
+
+// Path to the directory containing per-symbol historical data.
+string historyPath = "$HOME/.bitrader/history";
+
+// Timeframe and size of the report charts: 96 candles of 15min cover the last day.
+const int64_t timeframe = 15 * 60 * 1000;
+const uint32_t width = 96 * CandleDrawer::CANDLE_WIDTH;
+const uint32_t height = 480;
+
+int main(int argc, char* argv[])
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: %s <output directory>\n", argv[0]);
+		exit(1);
+	}
+
+	const string outputPath = argv[1];
+	mkdir(outputPath.c_str(), 0755);
+
+	// Expand the history path.
+	{
+		wordexp_t p;
+		char** w;
+		wordexp(historyPath.c_str(), &p, 0);
+		w = p.we_wordv;
+		historyPath = w[0];
+		wordfree(&p);
+	}
+
+	// Find the symbols having the candles of the report timeframe.
+	const string extension = "." + getTimeframeName(timeframe) + ".candles";
+	vector<string> names;
+	DIR* dir = opendir(historyPath.c_str());
+	if (!dir)
+	{
+		fprintf(stderr, "Cannot open history directory %s\n", historyPath.c_str());
+		exit(1);
+	}
+	while (dirent* dirEntry = readdir(dir))
+	{
+		const string name(dirEntry->d_name);
+		if ((name.size() > extension.size()) &&
+			(name.compare(name.size() - extension.size(), extension.size(), extension) == 0))
+			names.push_back(name.substr(0, name.size() - extension.size()));
+	}
+	closedir(dir);
+
+	cout << "Rendering charts of " << names.size() << " symbols ..." << endl;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	// Each chart is rendered on its own image surface, so the symbols
+	// are rendered independently on all cores.
+	int nrendered = 0;
+	#pragma omp parallel for schedule(dynamic) reduction(+:nrendered)
+	for (int i = 0; i < names.size(); i++)
+	{
+		const string& name = names[i];
+
+		Mapping mapping;
+		candlesError_t status = mapping.open(getPath(historyPath, name, timeframe), timeframe);
+		if (status != candlesSuccess)
+		{
+			fprintf(stderr, "Cannot map candles of %s: %s\n", name.c_str(), candlesGetErrorString(status));
+			continue;
+		}
+
+		Candles candles(mapping.getCandles(), mapping.size(), mapping.getWatermark());
+		chartError_t error = writePNG(candles, width, height, name, outputPath + "/" + name + ".png");
+		if (error != chartSuccess)
+		{
+			fprintf(stderr, "Cannot write chart of %s: %s\n", name.c_str(), chartGetErrorString(error));
+			continue;
+		}
+
+		nrendered++;
+	}
+
+	chrono::steady_clock::time_point finish = chrono::steady_clock::now();
+
+	const double totalSeconds = chrono::duration<double>(finish - start).count();
+
+	cout << "Rendered " << nrendered << " charts in " << totalSeconds << " sec (" <<
+		(nrendered ? totalSeconds * 1000 / nrendered : 0) << " ms per chart)" << endl;
+
+	return 0;
+}
+
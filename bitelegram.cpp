@@ -0,0 +1,260 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <jsoncpp/json/json.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+// Local stand-in of the Telegram Bot API, serving getUpdates and sendMessage
+// over plain HTTP, for the bitrader commands to be tried without a real bot:
+// bitrader --commands --telegram http://localhost:<port> ...
+// The lines typed into stdin come as the messages of the chat, and the replies
+// are printed to stdout.
+
+// Keep the confirmed updates no longer than that.
+static const size_t maxUpdates = 1000;
+
+static mutex updatesMutex;
+static condition_variable updatesReady;
+static deque<Json::Value> updates;
+static int64_t nextUpdateId = 1;
+
+static int64_t chatid = 1;
+
+static long now()
+{
+	return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static string getParameter(const string& query, const string& name)
+{
+	const string key = name + "=";
+	size_t i = 0;
+	while ((i = query.find(key, i)) != string::npos)
+	{
+		if ((i == 0) || (query[i - 1] == '&') || (query[i - 1] == '?'))
+		{
+			i += key.size();
+			return query.substr(i, query.find('&', i) - i);
+		}
+		i++;
+	}
+
+	return "";
+}
+
+static string unescape(const string& value)
+{
+	string result;
+	for (size_t i = 0; i < value.size(); i++)
+	{
+		if ((value[i] == '%') && (i + 2 < value.size()))
+		{
+			result += (char)strtol(value.substr(i + 1, 2).c_str(), NULL, 16);
+			i += 2;
+		}
+		else
+			result += (value[i] == '+') ? ' ' : value[i];
+	}
+
+	return result;
+}
+
+// Queue the line typed as the message of the chat.
+static void addMessage(const string& text)
+{
+	lock_guard<mutex> lock(updatesMutex);
+
+	Json::Value update;
+	update["update_id"] = (Json::Int64)nextUpdateId;
+	Json::Value& message = update["message"];
+	message["message_id"] = (Json::Int64)nextUpdateId;
+	message["date"] = (Json::Int64)(now() / 1000);
+	message["chat"]["id"] = (Json::Int64)chatid;
+	message["chat"]["type"] = "private";
+	message["text"] = text;
+	updates.push_back(update);
+	nextUpdateId++;
+
+	while (updates.size() > maxUpdates)
+		updates.pop_front();
+
+	updatesReady.notify_all();
+}
+
+// Respond to the request target with the JSON body; returns the HTTP status code.
+static int respond(const string& target, string& body)
+{
+	const size_t q = target.find('?');
+	const string path = target.substr(0, q);
+	const string query = (q == string::npos) ? "" : target.substr(q + 1);
+
+	// Any token is accepted: /bot<token>/<method>
+	const string method = path.substr(path.rfind('/') + 1);
+
+	Json::Value result;
+	int code = 200;
+	if ((path.compare(0, 4, "/bot") == 0) && (method == "getUpdates"))
+	{
+		const int64_t offset = atol(getParameter(query, "offset").c_str());
+		const int timeout = atoi(getParameter(query, "timeout").c_str());
+
+		// Long poll: wait for the updates not confirmed by the offset yet.
+		unique_lock<mutex> lock(updatesMutex);
+		while (updates.size() && (updates.front()["update_id"].asInt64() < offset))
+			updates.pop_front();
+		updatesReady.wait_for(lock, chrono::seconds(timeout), [&]()
+		{
+			return updates.size() && (updates.back()["update_id"].asInt64() >= offset);
+		});
+
+		result["ok"] = true;
+		result["result"] = Json::Value(Json::arrayValue);
+		for (int i = 0; i < updates.size(); i++)
+			if (updates[i]["update_id"].asInt64() >= offset)
+				result["result"].append(updates[i]);
+	}
+	else if ((path.compare(0, 4, "/bot") == 0) && (method == "sendMessage"))
+	{
+		const string text = unescape(getParameter(query, "text"));
+		cout << "[" << unescape(getParameter(query, "chat_id")) << "] " << text << endl;
+
+		result["ok"] = true;
+		result["result"]["message_id"] = (Json::Int64)now();
+		result["result"]["chat"]["id"] = (Json::Int64)chatid;
+		result["result"]["text"] = text;
+	}
+	else
+	{
+		code = 404;
+		result["ok"] = false;
+		result["error_code"] = 404;
+		result["description"] = "Not supported by the stand-in.";
+	}
+
+	Json::FastWriter writer;
+	body = writer.write(result);
+	return code;
+}
+
+// Serve the keep-alive HTTP/1.1 connection.
+static void serve(int fd)
+{
+	string buffer;
+	char data[4096];
+	while (1)
+	{
+		size_t end;
+		while ((end = buffer.find("\r\n\r\n")) == string::npos)
+		{
+			ssize_t n = read(fd, data, sizeof(data));
+			if (n <= 0)
+			{
+				close(fd);
+				return;
+			}
+			buffer.append(data, n);
+		}
+
+		const string head = buffer.substr(0, end);
+		buffer.erase(0, end + 4);
+
+		// Skip the request body, if any.
+		size_t length = 0;
+		const string contentLength = "\r\ncontent-length:";
+		string lowerHead = head;
+		for (int i = 0; i < lowerHead.size(); i++)
+			lowerHead[i] = tolower(lowerHead[i]);
+		size_t i = lowerHead.find(contentLength);
+		if (i != string::npos)
+			length = atol(head.c_str() + i + contentLength.size());
+		while (buffer.size() < length)
+		{
+			ssize_t n = read(fd, data, sizeof(data));
+			if (n <= 0)
+			{
+				close(fd);
+				return;
+			}
+			buffer.append(data, n);
+		}
+		buffer.erase(0, length);
+
+		// Request line: METHOD TARGET VERSION
+		stringstream requestLine(head.substr(0, head.find("\r\n")));
+		string method, target;
+		requestLine >> method >> target;
+
+		string body;
+		const int code = respond(target, body);
+
+		stringstream response;
+		response << "HTTP/1.1 " << code << ((code == 200) ? " OK" : " Error") << "\r\n";
+		response << "Content-Type: application/json\r\n";
+		response << "Content-Length: " << body.size() << "\r\n\r\n";
+		response << body;
+
+		const string bytes = response.str();
+		if (send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL) != bytes.size())
+		{
+			close(fd);
+			return;
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int port = (argc > 1) ? atoi(argv[1]) : 8081;
+	if (argc > 2)
+		chatid = atol(argv[2]);
+
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if ((listener < 0) || bind(listener, (sockaddr*)&addr, sizeof(addr)) || listen(listener, 16))
+	{
+		fprintf(stderr, "Cannot listen on port %d\n", port);
+		exit(1);
+	}
+
+	cout << "Serving the bot API for chat " << chatid << " on http://localhost:" << port << endl;
+
+	thread([listener]()
+	{
+		while (1)
+		{
+			int fd = accept(listener, NULL, NULL);
+			if (fd < 0) continue;
+
+			thread(serve, fd).detach();
+		}
+	}).detach();
+
+	for (string line; getline(cin, line); )
+		if (line != "")
+			addMessage(line);
+
+	// Keep serving after the end of the input, e.g. the commands piped in.
+	while (1)
+		this_thread::sleep_for(chrono::seconds(60));
+
+	return 0;
+}
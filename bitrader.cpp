@@ -1,27 +1,601 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <jsoncpp/json/json.h>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
+#include <wordexp.h>
 
 #include "binance.h"
+#include "bus.h"
+#include "cache.h"
+#include "candles.h"
+#include "chart.h"
+#include "execution.h"
+#include "history.h"
+#include "http.h"
+#include "indicators.h"
+#include "orderbook.h"
+#include "pool.h"
+#include "portfolio.h"
+#include "runtime.h"
+#include "scorer.h"
+#include "shard.h"
+#include "snapshot.h"
 #include "telegram.h"
+#include "triggers.h"
+#include "universe.h"
 
 // Pumping threshold
 #define THRESHOLD 1.02
 #define THRESHOLD_ROCKET 1.04
 
+// Order book levels accounted in the bid/ask imbalance
+#define DEPTH_LEVELS 10
+
+// Minimal bid/ask imbalance to confirm the pump
+#define IMBALANCE_MIN -0.2
+
+// Minimal pump probability by the model to recommend BUY
+#define PUMP_PROBABILITY 0.5
+
+// Maximal relative price deviation of the executed orders from the signal
+#define SLIPPAGE 0.005
+
+// Recent trades per pair, the signal is computed on
+#define TRADES_WINDOW 500
+
+// Period of the requests and the evaluations of each pair
+#define EVALUATION_MS 1000
+
+// Messages of each producer queued to a worker at least, the bus trades
+// waiting for the worker, while the queue is full
+#define QUEUE_CAPACITY 4096
+
+// Pause of the pair requests, after they failed too many times in a row
+#define SKIP_MS (10 * 60 * 1000)
+
+// Lookback of the raw trades kept in memory for all pairs
+#define LOOKBACK_MS (24 * 60 * 60 * 1000)
+
+// Period of the RSI of the minute candles, added to the alerts
+#define RSI_PERIOD 14
+
+// Lookback of the price change in the universe mode
+#define UNIVERSE_LOOKBACK_MS (60 * 1000)
+
+// Size of the chart attached to the alerts
+#define CHART_WIDTH 640
+#define CHART_HEIGHT 360
+
+// Pairs listed by the /top command by default, and at most
+#define TOP_PAIRS 10
+#define TOP_PAIRS_MAX 50
+
 using namespace binance;
+using namespace execution;
+using namespace orderbook;
+using namespace pool;
 using namespace std;
 using namespace telegram;
 
-int main()
+using history::Trade;
+
+// Batches of the recent trades of a pair, decoded or taken from the bus.
+Pool tradeBatches(TRADES_WINDOW * sizeof(Trade));
+
+// State of the pair after its last evaluation, as the commands see it.
+struct PairState
+{
+	double avgPrice, change;
+
+	// Position in the currency, its purchase value, and the last price traded.
+	double amount, value, price;
+
+	long idMax, alertTime;
+
+	// Time of the last evaluation, 0 if none yet.
+	int64_t evaluated;
+
+	// Pump probability by the model, negative if not scored.
+	float probability;
+
+	bool hot, owned;
+};
+
+// State of the trading workers, published by each of them once a second for
+// its own pairs, so that the commands are answered from it without ever
+// stopping the workers.
+struct TradingState
+{
+	int64_t time, started;
+	size_t nevaluations, nalerts;
+
+	// Recent trades kept in memory and their compressed size.
+	size_t ntrades, szmemory;
+
+	// Positions marked to the last prices.
+	portfolio::Totals totals;
+
+	bool executing;
+	vector<PairState> pairs;
+};
+
+static vector<unique_ptr<snapshot::Snapshots<TradingState> > > tradingStates;
+
+// Merge the states published by the workers; false, if some worker
+// has published nothing yet.
+static bool readTradingState(TradingState& result)
+{
+	const int nworkers = tradingStates.size();
+	for (int w = 0; w < nworkers; w++)
+	{
+		const bool published = tradingStates[w]->read([&](const TradingState& state)
+		{
+			if (w == 0)
+			{
+				result = state;
+				return;
+			}
+
+			result.time = max(result.time, state.time);
+			result.nevaluations += state.nevaluations;
+			result.nalerts += state.nalerts;
+			result.ntrades += state.ntrades;
+			result.szmemory += state.szmemory;
+			result.totals.value += state.totals.value;
+			result.totals.marked += state.totals.marked;
+			result.totals.npositions += state.totals.npositions;
+			for (int i = w; i < state.pairs.size(); i += nworkers)
+				result.pairs[i] = state.pairs[i];
+		});
+		if (!published) return false;
+	}
+
+	return nworkers > 0;
+}
+
+static string formatChange(double ratio)
+{
+	stringstream result;
+	result.precision(2);
+	result << fixed << ((ratio >= 1) ? "+" : "") << (ratio * 100 - 100) << "%";
+	return result.str();
+}
+
+static void answerStatus(const TradingState& state, stringstream& answer)
+{
+	// The stalest of the watched pairs tells, if the workers keep up.
+	size_t nowned = 0;
+	int64_t oldest = state.time;
+	for (int i = 0; i < state.pairs.size(); i++)
+	{
+		const PairState& pair = state.pairs[i];
+		nowned += pair.owned;
+		if (pair.owned && pair.evaluated)
+			oldest = min(oldest, pair.evaluated);
+	}
+
+	const int64_t uptime = (state.time - state.started) / 1000;
+	answer << "<b>Status</b>\n";
+	answer << "Up " << uptime / 3600 << "h " << uptime % 3600 / 60 << "m, " << state.nevaluations << " evaluations, the oldest " <<
+		(state.time - oldest) / 1000.0 << " s ago\n";
+	answer << "Watching " << nowned << " of " << state.pairs.size() << " pairs, " << state.nalerts << " alerts\n";
+	answer << "Portfolio: " << state.totals.npositions << " positions, " << state.totals.marked << " BTC";
+	if (state.totals.value > 0)
+		answer << " (" << formatChange(state.totals.marked / state.totals.value) << ")";
+	answer << "\n";
+	answer << "Thresholds: " << formatChange(THRESHOLD) << ", rocket " << formatChange(THRESHOLD_ROCKET) <<
+		", book imbalance " << IMBALANCE_MIN * 100 << "%\n";
+	answer << "Orders execution: " << (state.executing ? "on" : "off");
+}
+
+static void answerTop(const TradingState& state, const vector<string>& pairs, int n, stringstream& answer)
+{
+	vector<pair<double, int> > changes;
+	for (int i = 0; i < state.pairs.size(); i++)
+		if (state.pairs[i].owned && (state.pairs[i].change > 0))
+			changes.push_back(make_pair(-state.pairs[i].change, i));
+
+	n = min(n, (int)changes.size());
+	partial_sort(changes.begin(), changes.begin() + n, changes.end());
+
+	answer << "<b>Top " << n << " pairs</b> by the last sweep change\n";
+	for (int j = 0; j < n; j++)
+	{
+		const PairState& pair = state.pairs[changes[j].second];
+		answer << pairs[changes[j].second] << " " << formatChange(pair.change) << " " << pair.avgPrice;
+		if (pair.probability >= 0) answer << " P " << (int)(pair.probability * 100) << "%";
+		if (pair.hot) answer << " 🔥";
+		answer << "\n";
+	}
+}
+
+static void answerPositions(const TradingState& state, const vector<string>& pairs, stringstream& answer)
+{
+	answer << "<b>Positions</b>\n";
+	for (int i = 0; i < state.pairs.size(); i++)
+	{
+		const PairState& pair = state.pairs[i];
+		if (pair.amount == 0) continue;
+
+		const string currency(pairs[i].c_str(), pairs[i].size() - 3);
+		answer << currency << " : " << pair.amount << ", " << pair.value << " BTC";
+		if ((pair.price > 0) && (pair.value > 0))
+		{
+			const double actualValue = pair.amount * pair.price;
+			answer << " now " << actualValue << " BTC (" << formatChange(actualValue / pair.value) << ")";
+		}
+		answer << "\n";
+	}
+
+	// The totals are kept by the workers, as the prices change.
+	const portfolio::Totals& totals = state.totals;
+	if (totals.value > 0)
+		answer << "Total : " << totals.value << " BTC now " << totals.marked << " BTC (" <<
+			formatChange(totals.marked / totals.value) << ")";
+	else
+		answer << "No priced positions";
+}
+
+static void answerSymbol(const TradingState& state, const vector<string>& pairs, string name, stringstream& answer)
+{
+	// The name is echoed back as HTML, so only the letters and digits are kept.
+	string upper;
+	for (int i = 0; i < name.size(); i++)
+		if (isalnum(name[i]))
+			upper += toupper(name[i]);
+	name = upper;
+	if ((name.size() <= 3) || (name.compare(name.size() - 3, 3, "BTC") != 0))
+		name += "BTC";
+
+	const int i = find(pairs.begin(), pairs.end(), name) - pairs.begin();
+	if (i == pairs.size())
+	{
+		answer << "No pair " << name;
+		return;
+	}
+
+	const PairState& pair = state.pairs[i];
+	answer << "<b>" << name << "</b>\n";
+	if (!pair.owned)
+	{
+		answer << "Watched by another instance";
+		return;
+	}
+	answer << "Price " << pair.avgPrice << " (" << formatChange(pair.change) << "), last trade " << pair.idMax;
+	if (pair.hot) answer << " 🔥";
+	answer << "\n";
+	if (pair.probability >= 0)
+		answer << "Pump probability " << (int)(pair.probability * 100) << "%\n";
+	if (pair.alertTime)
+		answer << "Last alert " << (state.time - pair.alertTime) / 60000 << " min ago\n";
+	if (pair.amount != 0)
+	{
+		answer << "Position " << pair.amount << ", " << pair.value << " BTC";
+		if ((pair.price > 0) && (pair.value > 0))
+			answer << " now " << pair.amount * pair.price << " BTC (" << formatChange(pair.amount * pair.price / pair.value) << ")";
+	}
+}
+
+// Answer the commands of the chat from the published trading state.
+static void serveCommands(Commands* commands, const vector<string>* pairs)
+{
+	while (1)
+	{
+		vector<Command> received;
+		telegramError_t status = commands->receive(received);
+		if (status != telegramSuccess)
+		{
+			fprintf(stderr, "Cannot receive commands: %s\n", telegramGetErrorString(status));
+			this_thread::sleep_for(chrono::seconds(5));
+			continue;
+		}
+
+		for (int c = 0; c < received.size(); c++)
+		{
+			const Command& command = received[c];
+
+			stringstream answer;
+			answer.precision(8);
+			TradingState state;
+			if (!readTradingState(state))
+				answer << "Starting up, no state yet";
+			else
+			{
+				if (command.name == "status")
+					answerStatus(state, answer);
+				else if (command.name == "top")
+				{
+					const int n = command.args.size() ? atoi(command.args[0].c_str()) : TOP_PAIRS;
+					answerTop(state, *pairs, max(1, min(n, TOP_PAIRS_MAX)), answer);
+				}
+				else if (command.name == "positions")
+					answerPositions(state, *pairs, answer);
+				else if ((command.name == "symbol") && command.args.size())
+					answerSymbol(state, *pairs, command.args[0], answer);
+				else
+					answer << "/status, /top [N], /positions, /symbol &lt;currency&gt;";
+			}
+
+			status = commands->reply(answer.str());
+			if (status != telegramSuccess)
+				fprintf(stderr, "Cannot reply to /%s: %s\n", command.name.c_str(), telegramGetErrorString(status));
+		}
+	}
+}
+
+// User data stream events not yet taken by the trading loop: the balances
+// changed by the orders, the deposits and the withdrawals.
+static mutex accountMutex;
+static vector<Json::Value> accountEvents;
+
+static int onAccount(Json::Value& message)
+{
+	if (message["e"].asString() != "outboundAccountPosition")
+		return 0;
+
+	lock_guard<mutex> lock(accountMutex);
+	accountEvents.push_back(Json::Value());
+	accountEvents.back().swap(message);
+
+	return 0;
+}
+
+// Render the candles of the recent trades, to be attached to the alert.
+static bool renderTradesChart(const string& pair, const Trade* trades, size_t ntrades, string& png)
+{
+	int64_t timeMin = numeric_limits<int64_t>::max(), timeMax = 0;
+	for (size_t j = 0; j < ntrades; j++)
+	{
+		int64_t time = trades[j].time;
+		timeMin = min(timeMin, time);
+		timeMax = max(timeMax, time);
+	}
+	if (timeMax < timeMin) return false;
+
+	// Fit the trades into the chart width, with candles of whole seconds.
+	const int64_t ncandles = CHART_WIDTH / chart::CandleDrawer::CANDLE_WIDTH - 1;
+	const int64_t timeframe = ((timeMax - timeMin) / ncandles / 1000 + 1) * 1000;
+
+	candles::Series series(timeframe);
+	for (size_t j = 0; j < ntrades; j++)
+		series.add(trades[j].time, trades[j].price, trades[j].qty);
+
+	chart::Candles candles(&series.getCandles()[0], series.size(), series.getWatermark());
+	chart::chartError_t status = chart::renderPNG(candles, CHART_WIDTH, CHART_HEIGHT, pair, png);
+	if (status != chart::chartSuccess)
+	{
+		fprintf(stderr, "%s : cannot render chart: %s\n", pair.c_str(), chart::chartGetErrorString(status));
+		return false;
+	}
+
+	return true;
+}
+
+// Get the JSON document over the pooled connection, waiting for it.
+static bool getJson(http::Client& client, const string& path, Json::Value& result)
+{
+	bool parsed = false;
+	client.get(path, [&](http::Response& response)
+	{
+		if (response.status != http::httpSuccess)
+		{
+			fprintf(stderr, "%s : %s %ld\n", path.c_str(),
+				http::httpGetErrorString(response.status), response.code);
+			return;
+		}
+
+		Json::Reader reader;
+		parsed = reader.parse(response.body, result);
+		if (!parsed)
+			fprintf(stderr, "%s : malformed response\n", path.c_str());
+	});
+	client.wait();
+
+	return parsed;
+}
+
+// Ticker stream events not yet taken by the universe watcher: each event
+// is the array of the tickers changed within the last second.
+static mutex tickersMutex;
+static vector<Json::Value> tickers;
+
+static int onTickers(Json::Value& message)
+{
+	lock_guard<mutex> lock(tickersMutex);
+	tickers.push_back(Json::Value());
+	tickers.back().swap(message);
+
+	return 0;
+}
+
+// Watch all trading pairs of all quote assets, with the prices normalized
+// to BTC. The prices are seeded from the snapshot, then only the changed
+// ones come from the ticker stream and are evaluated, so the tick cost does
+// not grow with the pairs count. The stream-less server is polled for the
+// snapshot of all prices on every tick instead, still in a single request.
+static void watchUniverse(Server& server, bool stream, Bot& telegram, shard::Client* notifier, const string& shardName)
+{
+	http::Client client(server.getHostname());
+
+	cout << "Getting all trading pairs ..." << endl;
+
+	Json::Value result;
+	while (!getJson(client, "/api/v3/exchangeInfo", result))
+		this_thread::sleep_for(chrono::seconds(1));
+
+	universe::Universe markets("BTC", "USDT", UNIVERSE_LOOKBACK_MS);
+	UNIVERSE_ERR_CHECK(markets.load(result));
+
+	cout << "Watching " << markets.size() << " pairs, normalized to " << markets.getReference() << endl;
+
+	// Pairs watched by this instance: all, unless sharded.
+	vector<char> owned(markets.size(), !notifier);
+	shard::Ring ring;
+	uint64_t membersVersion = 0;
+
+	// The newest alert time of each base asset: the asset pumping in all
+	// of its quotes at once is reported once.
+	map<string, int64_t> alerted;
+
+	if (stream)
+	{
+		cout << "Subscribing to the tickers of all pairs ..." << endl;
+
+		Websocket::init();
+		Websocket::connect_endpoint(onTickers, "/ws/!miniTicker@arr");
+		thread([]() { Websocket::enter_event_loop(); }).detach();
+	}
+
+	vector<int> changed;
+	vector<Json::Value> events;
+	bool seeded = false;
+	while (1)
+	{
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		vector<string> members;
+		if (notifier && notifier->getMembers(membersVersion, members))
+		{
+			ring.setMembers(members);
+
+			size_t nowned = 0;
+			for (int i = 0; i < markets.size(); i++)
+				nowned += owned[i] = (ring.getOwner(markets[i].symbol) == shardName);
+
+			cout << "Watching " << nowned << " of " << markets.size() << " pairs, " <<
+				members.size() << " instances in the ring" << endl;
+		}
+
+		const int64_t time = chrono::duration_cast<chrono::milliseconds>(
+			chrono::system_clock::now().time_since_epoch()).count();
+
+		changed.clear();
+		if (stream && seeded)
+		{
+			{
+				lock_guard<mutex> lock(tickersMutex);
+				events.swap(tickers);
+			}
+			for (int j = 0; j < events.size(); j++)
+				markets.update(events[j], time, changed, "s", "c");
+			events.clear();
+		}
+		else if (getJson(client, "/api/v3/ticker/price", result) && result.isArray())
+		{
+			markets.update(result, time, changed);
+			seeded = true;
+		}
+
+		for (int j = 0; j < changed.size(); j++)
+		{
+			const int i = changed[j];
+			if (!owned[i]) continue;
+
+			const double change = markets.getChange(i, time);
+			if (change < THRESHOLD) continue;
+
+			const universe::Market& market = markets[i];
+			int64_t& last = alerted[market.base];
+			if (time - last < UNIVERSE_LOOKBACK_MS) continue;
+			last = time;
+
+			stringstream msg;
+			msg << "<a href=\"https://www.binance.com/tradeDetail.html?symbol=" << market.base << "_" << market.quote << "\">" <<
+				market.symbol << "</a> +" << (change * 100.0 - 100) << "% vs " << markets.getReference() << " 📈";
+			if (change >= THRESHOLD_ROCKET)
+				msg << " 🚀";
+			msg << " PRICE: " << markets.getNormalizedPrice(i) << " " << markets.getReference();
+
+			cout << msg.str() << endl;
+
+			if (notifier)
+			{
+				shard::shardError_t status = notifier->sendAlert(market.base, shard::SignalAlert, msg.str(), "");
+				if (status != shard::shardSuccess)
+					fprintf(stderr, "%s : cannot send alert: %s\n", market.symbol.c_str(), shard::shardGetErrorString(status));
+			}
+			else
+				telegram.sendMessage(msg.str());
+		}
+
+		this_thread::sleep_until(start + chrono::seconds(1));
+	}
+}
+
+int main(int argc, char* argv[])
 {
+	// In the sharded mode, each instance watches its own partition of the pairs,
+	// and sends the alerts through the shared notifier (see binotifier).
+	// With --bus, the trades are taken from the bus published by biingest.
+	// With --universe, the prices of all quote assets are watched instead
+	// of the *BTC trades, with no orders execution. With --commands, the
+	// chat commands are answered (the bot API server could be a stand-in).
+	// The pairs are watched by --workers threads pinned to the cores, one less
+	// than the cores available by default.
+	string shardName, notifierPath = shard::default_socket_path, serverUrl, telegramUrl = Commands::default_server;
+	bool useBus = false, useUniverse = false, useCommands = false;
+	int nworkers = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		if ((arg == "--shard") && (i + 1 < argc))
+			shardName = argv[++i];
+		else if ((arg == "--notifier") && (i + 1 < argc))
+			notifierPath = argv[++i];
+		else if ((arg == "--server") && (i + 1 < argc))
+			serverUrl = argv[++i];
+		else if (arg == "--bus")
+			useBus = true;
+		else if (arg == "--universe")
+			useUniverse = true;
+		else if (arg == "--commands")
+			useCommands = true;
+		else if ((arg == "--telegram") && (i + 1 < argc))
+			telegramUrl = argv[++i];
+		else if ((arg == "--workers") && (i + 1 < argc))
+			nworkers = atoi(argv[++i]);
+		else
+		{
+			fprintf(stderr, "Usage: %s [--shard <name> [--notifier <socket>]] [--server <url>] [--bus | --universe] "
+				"[--commands [--telegram <url>]] [--workers <n>]\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (useBus && useUniverse)
+	{
+		fprintf(stderr, "The universe mode takes the prices, not the trades from the bus\n");
+		exit(1);
+	}
+	const bool sharded = (shardName != "");
+	if (useCommands && (sharded || useUniverse))
+	{
+		fprintf(stderr, "The commands are answered by the single instance watching the trades\n");
+		exit(1);
+	}
+
+	{
+		wordexp_t p;
+		char** w;
+		wordexp(notifierPath.c_str(), &p, 0);
+		w = p.we_wordv;
+		notifierPath = w[0];
+		wordfree(&p);
+	}
+
 	cout << "Initializing ..." << endl;
 
-	Server server;
+	Server server = (serverUrl != "") ? Server(serverUrl.c_str()) : Server();
 
 	Account account(server);
 	if (!account.keysAreSet())
@@ -36,7 +610,7 @@ int main()
 	}
 
 	Bot telegram;
-	if (!telegram.keysAreSet())
+	if (!sharded && !telegram.keysAreSet())
 	{
 		fprintf(stderr, "\nCannot find the token/chatid keys pair for Telegram account!\n");
 		fprintf(stderr, "The user should either provide them to Telegram constructor,\n");
@@ -47,6 +621,22 @@ int main()
 		exit(1);
 	}
 
+	// Executing recommendations is opt-in, by the order value in the config file.
+	Executor executor(server);
+	if (executor.isEnabled())
+	{
+		cout << "Initializing orders execution ..." << endl;
+
+		executionError_t status = executor.initialize();
+		if (status != executionSuccess)
+		{
+			fprintf(stderr, "Cannot initialize orders execution: %s\n", executionGetErrorString(status));
+			exit(1);
+		}
+
+		cout << "Executing BUY/SELL recommendations for " << executor.getOrderValue() << " BTC per order" << endl;
+	}
+
 	Market market(server);
 	
 	cout << "Getting all *BTC pairs ..." << endl;
@@ -66,21 +656,64 @@ int main()
 			btcPairs.push_back(pair);
 	}
 
+	unique_ptr<shard::Client> notifier;
+	shard::Ring ring;
+	uint64_t membersVersion = 0;
+	if (sharded)
+	{
+		cout << "Joining the ring as " << shardName << " via " << notifierPath << " ..." << endl;
+
+		notifier.reset(new shard::Client(notifierPath, shardName));
+		SHARD_ERR_CHECK(notifier->start());
+	}
+
+	if (useUniverse)
+	{
+		watchUniverse(server, serverUrl == "", telegram, notifier.get(), shardName);
+		return 0;
+	}
+
+	cout << "Subscribing to order book updates ..." << endl;
+
+	// Books are synchronized lazily, only for the pumping pairs,
+	// in the ticks of the price filters of the exchange info.
+	Feed depth(btcPairs);
+	{
+		http::Client client(server.getHostname());
+		while (!getJson(client, "/api/v3/exchangeInfo", result))
+			this_thread::sleep_for(chrono::seconds(1));
+
+		orderbookError_t status = depth.setTickSizes(result);
+		if (status != orderbookSuccess)
+		{
+			fprintf(stderr, "Cannot take the tick sizes of the pairs: %s\n", orderbookGetErrorString(status));
+			exit(1);
+		}
+	}
+
+	// Balances are refreshed by the user data stream, served by the same event loop.
+	// The stream is started before the balances are taken, not to miss a change.
+	string listenKey;
+	{
+		binanceError_t status = account.startUserDataStream(result);
+		if (status == binanceSuccess)
+		{
+			listenKey = result["listenKey"].asString();
+			depth.addEndpoint(onAccount, "/ws/" + listenKey);
+		}
+		else
+			fprintf(stderr, "Cannot start the user data stream, the balances will not be refreshed: %s\n",
+				binanceGetErrorString(status));
+	}
+
+	depth.start();
+
 	cout << "Finding current positions ..." << endl;
 	
 	// Get account info.
 	BINANCE_ERR_CHECK(account.getInfo(result));
 
-	struct Position
-	{
-		// Amount in currency.
-		double amount;
-		
-		// The purchase value of amount, according to trading history.
-		double value;
-	};
-
-	map<string, Position> positions;
+	map<string, portfolio::Position> positions;
 	
 	// Get amounts for all positions in accout.
 	const Json::Value balances = result["balances"];
@@ -115,7 +748,7 @@ int main()
 		positions[currency].amount += origQty - executedQty;
 	}
 
-	for (map<string, Position>::iterator i = positions.begin(), ie = positions.end(); i != ie; i++)
+	for (map<string, portfolio::Position>::iterator i = positions.begin(), ie = positions.end(); i != ie; i++)
 		cout << i->first << " : " << i->second.amount << endl;
 
 	cout << "Finding positions purchase values ..." << endl;
@@ -123,7 +756,7 @@ int main()
 	// Get all orders for currencies we are in position for
 	// and calculate the purchase price (in BTC) of the available amount.
 	double totalValue = 0;
-	for (map<string, Position>::iterator i = positions.begin(), ie = positions.end(); i != ie; i++)
+	for (map<string, portfolio::Position>::iterator i = positions.begin(), ie = positions.end(); i != ie; i++)
 	{
 		const string& currency = i->first;
 
@@ -234,6 +867,23 @@ int main()
 
 	cout << "Finding positions actual values ..." << endl;
 
+	const int ncores = runtime::getCores();
+	if (nworkers <= 0)
+		nworkers = max(1, ncores - 1);
+
+	// Positions of the pairs, marked to the last prices by the owners of the pairs.
+	portfolio::Book book(btcPairs.size(), nworkers);
+	map<string, int> pairIndexes;
+	for (int i = 0; i < btcPairs.size(); i++)
+	{
+		pairIndexes[btcPairs[i]] = i;
+
+		map<string, portfolio::Position>::const_iterator position =
+			positions.find(string(btcPairs[i].c_str(), btcPairs[i].size() - 3));
+		if (position != positions.end())
+			book.seed(i, position->second.amount, position->second.value);
+	}
+
 	double totalActualValue = 0;
 	BINANCE_ERR_CHECK(market.getAllPrices(result)); 
 	for (Json::Value::ArrayIndex i = 0; i < result.size(); i++)
@@ -243,6 +893,10 @@ int main()
 		if (!std::equal(btc.rbegin(), btc.rend(), pair.rbegin()))
 			continue;
 
+		map<string, int>::const_iterator index = pairIndexes.find(pair);
+		if (index != pairIndexes.end())
+			book.mark(index->second, atof(result[i]["price"].asString().c_str()));
+
 		const string currency(pair.c_str(), pair.size() - 3);
 		if (positions.find(currency) != positions.end())
 		{
@@ -273,165 +927,1005 @@ int main()
 		double totalQty;
 		double avgPrice;
 		bool hot;
+
+		// The frame is recorded, so the next frames are compared to it.
+		bool seen;
+
+		// Change of the average price against the previous frame, and the time of the last alert.
+		double change;
+		long alertTime;
 	};
 	
-	bool initial = true;	
+	// Each worker owns a fixed shard of the pairs: their frames, recent trades
+	// and windows are touched by it only. Each pair is requested and evaluated on
+	// its own timer, so a slow or retried pair delays only itself, not a sweep.
+	// The responses and the bus trades are routed to the owners by the queues.
+	// The failed requests are retried with the backoff, and the pair is skipped
+	// for a while after too many failures in a row; the rate limited ones wait
+	// for the client to resume, and are not counted. The orders are left to the
+	// order thread, which returns them by the queues, and the blocking work of
+	// the alerts to the notification thread.
+	enum Producer { fromHttp, fromBus, fromMain, fromOrders, nproducers };
+
+	struct Message
+	{
+		enum Type { Start, Own, Disown, Trades, Failed, RateLimited, BusTrade, Triggers, Balance, Executed };
+
+		Type type;
+		string body;
+		Trade trade;
+		unique_ptr<triggers::Levels> levels;
+		double balance;
+
+		// Time of the account update of the balance, in ms.
+		int64_t time;
+
+		// The order of the pair done by the order thread, and its fill, if filled.
+		bool buy, filled;
+		Fill fill;
+	};
+
+	// The queues hold at least the responses of all pairs of a worker at once,
+	// while the bus trades and the messages of the main thread wait for room.
+	const size_t capacity = max((size_t)QUEUE_CAPACITY, 2 * ((btcPairs.size() + nworkers - 1) / nworkers));
+	runtime::Runtime<Message> workers(nworkers, nproducers, capacity);
+
 	vector<TradingFrame> frames(btcPairs.size());
+	mutex telegramMutex;
 
-	while (1)
+	// Send the alert of the pair, with the chart, if rendered.
+	function<void(const string&, shard::AlertKind, const string&, const string&)> sendAlert = [&](
+		const string& pair, shard::AlertKind kind, const string& text, const string& png)
 	{
-		#pragma omp parallel for num_threads(2)
-		for (int i = 0; i < btcPairs.size(); i++)
+		if (sharded)
 		{
-			const string& pair = btcPairs[i];
+			// The notifier drops the duplicate signals, while the pair moves between instances.
+			shard::shardError_t status = notifier->sendAlert(pair, kind, text, png);
+			if (status != shard::shardSuccess)
+				fprintf(stderr, "%s : cannot send alert: %s\n", pair.c_str(), shard::shardGetErrorString(status));
+		}
+		else
+		{
+			// The bot keeps the queue of the unsent messages, sent by its own thread.
+			lock_guard<mutex> lock(telegramMutex);
+			if (png != "")
+				telegram.sendPhoto(png, text);
+			else
+				telegram.sendMessage(text);
+		}
+	};
 
-			if (pair == "BNB_BTC") continue;
+	// The orders and the alerts block for the round trips, so the workers post
+	// them to the threads, which do them in turn. The orders have their own thread,
+	// not to wait behind the book snapshots, the charts and the Telegram uploads.
+	runtime::Serial orders, notifications;
 
-			// Use thread-private result container.
-			Json::Value result;
+	// Orders of the pairs in the order thread, one at a time, so that the position
+	// is not sold twice, written by their owners only.
+	vector<char> executing(btcPairs.size());
 
-			// Get last 500 trades for each "*BTC" pair.
-			while (1)
-			{
-				binanceError_t status = account.getTrades(result, pair.c_str());
-				
-				if (status == binanceSuccess) break;
-				
-				fprintf(stderr, "%s\n", binanceGetErrorString(status));
-			}
-			
-			// Get the newest id across recent trades.
-			long idMax = 0, timeMax;
-			for (Json::Value::ArrayIndex j = 0; j < result.size(); j++)
+	// Transaction times of the last fills of the pairs. The balances of the account
+	// are taken after the fills only, as the fill and the balance it changed
+	// come by the different producers, in any order.
+	vector<int64_t> filledTimes(btcPairs.size());
+
+	// Return the order done by the order thread to the owner of the pair, which updates the book.
+	function<void(int, bool, bool, const Fill&)> returnOrder = [&](int i, bool buy, bool filled, const Fill& fill)
+	{
+		Message message;
+		message.type = Message::Executed;
+		message.buy = buy;
+		message.filled = filled;
+		message.fill = fill;
+		workers.send(fromOrders, i, message);
+	};
+
+	// Stop-loss and take-profit levels of the pairs, checked by their owners.
+	triggers::Index triggersFile;
+	TRIGGERS_ERR_CHECK(triggersFile.load(triggers::Index::default_path, btcPairs, btc));
+	vector<triggers::Levels> levels(btcPairs.size());
+
+	// Levels of the pairs fired, by the kind and the price, so that the reloaded
+	// file does not arm them again, while their lines are still there.
+	vector<set<pair<int, double> > > firedLevels(btcPairs.size());
+	size_t ntriggers = 0;
+	for (int i = 0; i < btcPairs.size(); i++)
+	{
+		levels[i].swap(triggersFile[i]);
+		ntriggers += levels[i].size();
+	}
+	if (ntriggers)
+		cout << "Watching " << ntriggers << " price triggers" << endl;
+
+	// Pump probability model trained by bitrain; without it, BUY
+	// is recommended on the second hot frame in a row.
+	scorer::Model model;
+	{
+		scorer::scorerError_t status = model.load(scorer::Model::default_path);
+		if (status == scorer::scorerSuccess)
+			cout << "Recommending BUY on the pump probability of " << PUMP_PROBABILITY * 100 << "% within " <<
+				model.getHorizon() / 60000 << " min" << endl;
+		else if (status == scorer::scorerErrorOpenFailed)
+			cout << "No pump model at " << scorer::Model::default_path << ", recommending BUY on two hot frames" << endl;
+		else
+			SCORER_ERR_CHECK(status);
+	}
+
+	// Activity of the pairs, and the features of the pairs of each worker by the
+	// rows i / nworkers. The batch of the worker is scored at once, when the
+	// decision or the publishing needs a probability after the features changed.
+	struct Scores
+	{
+		scorer::Batch features;
+		vector<float> probabilities;
+		bool stale;
+
+		Scores(size_t nrows) : features(nrows), probabilities(nrows), stale(false) { }
+	};
+	vector<scorer::Activity> activity(btcPairs.size());
+	vector<Scores> scores(nworkers, Scores((btcPairs.size() + nworkers - 1) / nworkers));
+	vector<char> scored(btcPairs.size());
+
+	// Pump probability of the pair from the batch of its owner, negative if not scored.
+	function<float(int)> getProbability = [&](int i)
+	{
+		if (!scored[i]) return -1.0f;
+
+		Scores& batch = scores[i % nworkers];
+		if (batch.stale)
+		{
+			model.score(batch.features, 0, batch.features.size(), batch.probabilities.data());
+			batch.stale = false;
+		}
+
+		return batch.probabilities[i / nworkers];
+	};
+
+	// Fire the triggers crossed by the prices traded: alert and sell the position.
+	function<void(int, double, double)> checkTriggers = [&](int i, double low, double high)
+	{
+		vector<triggers::Trigger> fired;
+		levels[i].check(low, high, fired);
+		if (fired.empty()) return;
+
+		const string& pair = btcPairs[i];
+		const portfolio::Position& position = book[i];
+		for (int t = 0; t < fired.size(); t++)
+		{
+			const triggers::Trigger& trigger = fired[t];
+			const bool stop = (trigger.kind == triggers::StopLoss);
+			firedLevels[i].insert(make_pair((int)trigger.kind, trigger.price));
+			const double price = stop ? low : high;
+
+			stringstream msg;
+			msg << pair << (stop ? " STOP-LOSS " : " TAKE-PROFIT ") << trigger.price << " (line " << trigger.line <<
+				"): traded at " << price << (stop ? " 📉" : " 📈");
+
+			const double amount = position.amount;
+			bool execute = false;
+			if (amount > 0)
 			{
-				long id = result[j]["id"].asInt64();
-				if (id > idMax)
+				msg << " POSITION: " << amount;
+				if (position.value > 0)
+					msg << " " << (price * amount / position.value * 100 - 100) << "%";
+
+				if (executor.isEnabled())
 				{
-					idMax = id;
-					timeMax = result[j]["time"].asInt64();
+					execute = !executing[i];
+					if (execute)
+						executing[i] = true;
+					else
+						msg << " ORDER PENDING";
 				}
 			}
 
-			// Get the average price across last minute trades.
-			double avgPrice = 0, totalQty = 0;
-			for (Json::Value::ArrayIndex j = 0; j < result.size(); j++)
+			// The trigger is keyed apart from the signals of the pair.
+			const string key = pair + ":trigger:" + to_string(trigger.line);
+			const string text = msg.str();
+			const Executor::Time signaled = chrono::steady_clock::now();
+			function<void()> action = [&, i, key, text, amount, price, execute, signaled]()
 			{
-				long time = result[j]["time"].asInt64();
-				if (timeMax - 60 * 1000 > time) continue;
+				stringstream msg;
+				msg << text;
 
-				double price = atof(result[j]["price"].asString().c_str());
-				double qty = atof(result[j]["qty"].asString().c_str());
+				if (execute)
+				{
+					Fill fill;
+					executionError_t status = executor.sell(btcPairs[i], amount, price * (1 - SLIPPAGE), fill, signaled);
+					if (status == executionSuccess)
+						msg << " SOLD: " << fill.qty << " @ " << fill.price << " (" << fill.latency << " us)";
+					else if (status == executionErrorNotFilled)
+						msg << " NOT FILLED";
+					else
+						msg << " SELL FAILED: " << executionGetErrorString(status);
+					returnOrder(i, false, status == executionSuccess, fill);
+				}
 
-				totalQty += qty;
-				avgPrice += price * qty;
-			}
-			
-			if (totalQty > 0)
-				avgPrice /= totalQty;
-			
-			// If we are on initial step, just record the result.
-			if (initial)
-			{
-				frames[i] = { idMax, totalQty, avgPrice, false };
+				const string alert = msg.str();
+				function<void()> notification = [&, key, alert]()
+				{
+					cout << alert << endl;
+					sendAlert(key, shard::TriggerAlert, alert, "");
+				};
+				notifications.post(notification);
+			};
+
+			// The sell goes by the order path, not to wait behind the alerts.
+			if (execute)
+				orders.post(action);
+			else
+				action();
+		}
+	};
 
-				cout << pair << " : " << frames[i].idMax << " : " << frames[i].avgPrice << endl;
+	// Raw trades of the lookback period, compressed in memory.
+	vector<cache::Series> recent;
+	for (int i = 0; i < btcPairs.size(); i++)
+		recent.push_back(cache::Series(i, LOOKBACK_MS));
 
-				continue;
-			}
-			
-			// Re-calculate the average price, accounting only trades
-			// that took place after the last seen frame's idMax.
-			idMax = 0;
-			long idMin = frames[i].idMax;
-			avgPrice = 0; totalQty = 0;
-			bool nonzero = false;
-			for (Json::Value::ArrayIndex j = 0; j < result.size(); j++)
+	// Signal of the pair on its recent trades, in the id order; true, if the alert is sent.
+	function<bool(int, const Trade*, size_t)> trade = [&](int i, const Trade* trades, size_t ntrades)
+	{
+		const string& pair = btcPairs[i];
+
+		// Keep the new trades for the lookback, and check the triggers on their prices.
+		// On the first batch, only the newest price is current.
+		cache::Series& series = recent[i];
+		const bool first = !series.size();
+		double low = numeric_limits<double>::max(), high = 0;
+		for (size_t j = 0; j < ntrades; j++)
+			if (trades[j].id > series.getLastId())
 			{
-				long id = result[j]["id"].asInt64();
-				if (id <= idMin) continue;
+				series.append(trades[j]);
+				activity[i].add(trades[j]);
+				if (first && (j + 1 < ntrades)) continue;
+				low = min(low, trades[j].price);
+				high = max(high, trades[j].price);
+			}
+		if (high > 0)
+			checkTriggers(i, low, high);
 
-				idMax = max(id, idMax);
+		// The position is marked to the newest price, in the id order.
+		if (ntrades)
+			book.mark(i, trades[ntrades - 1].price);
 
-				double price = atof(result[j]["price"].asString().c_str());
-				double qty = atof(result[j]["qty"].asString().c_str());
+		// The features of the activity of the pair, once it is seen long enough.
+		float pairFeatures[scorer::nfeatures];
+		scored[i] = model.is_loaded() && activity[i].getFeatures(pairFeatures);
+		if (scored[i])
+		{
+			scores[i % nworkers].features.set(i / nworkers, pairFeatures);
+			scores[i % nworkers].stale = true;
+		}
 
-				totalQty += qty;
-				avgPrice += price * qty;
-				nonzero = true;
+		// Get the newest id across recent trades.
+		long idMax = 0, timeMax;
+		for (size_t j = 0; j < ntrades; j++)
+		{
+			long id = trades[j].id;
+			if (id > idMax)
+			{
+				idMax = id;
+				timeMax = trades[j].time;
 			}
+		}
 
-			if (!nonzero) continue;
-			
+		// Get the average price across last minute trades.
+		double avgPrice = 0, totalQty = 0;
+		for (size_t j = 0; j < ntrades; j++)
+		{
+			long time = trades[j].time;
+			if (timeMax - 60 * 1000 > time) continue;
+
+			double price = trades[j].price;
+			double qty = trades[j].qty;
+
+			totalQty += qty;
+			avgPrice += price * qty;
+		}
+		
+		if (totalQty > 0)
 			avgPrice /= totalQty;
-			
-			// Find update for the current time stamp.
-			int buy = -1;
-			bool hot = false;
-			if (avgPrice >= THRESHOLD * frames[i].avgPrice)
+		
+		// If we are on initial step, just record the result.
+		if (!frames[i].seen)
+		{
+			frames[i] = { idMax, totalQty, avgPrice, false, true };
+
+			cout << pair << " : " << frames[i].idMax << " : " << frames[i].avgPrice << endl;
+
+			return false;
+		}
+		
+		// Re-calculate the average price, accounting only trades
+		// that took place after the last seen frame's idMax.
+		idMax = 0;
+		long idMin = frames[i].idMax;
+		avgPrice = 0; totalQty = 0;
+		bool nonzero = false;
+		for (size_t j = 0; j < ntrades; j++)
+		{
+			long id = trades[j].id;
+			if (id <= idMin) continue;
+
+			idMax = max(id, idMax);
+
+			double price = trades[j].price;
+			double qty = trades[j].qty;
+
+			totalQty += qty;
+			avgPrice += price * qty;
+			nonzero = true;
+		}
+
+		if (!nonzero) return false;
+		
+		avgPrice /= totalQty;
+		frames[i].change = avgPrice / frames[i].avgPrice;
+		
+		// Find update for the current time stamp.
+		int buy = -1;
+		bool hot = false;
+		if (avgPrice >= THRESHOLD * frames[i].avgPrice)
+		{
+			buy++;
+
+			stringstream msg;
+			const string currency(pair.c_str(), pair.size() - 3);
+			const string symbol = currency + "_BTC";
+
+			msg << "<a href=\"https://www.binance.com/tradeDetail.html?symbol=" << symbol << "\">" << pair << "</a> +" <<
+				(avgPrice / frames[i].avgPrice * 100.0 - 100) << "% 📈";
+
+			// Rocket high?
+			if (avgPrice >= THRESHOLD_ROCKET * frames[i].avgPrice)
+				 msg << " 🚀";
+
+			// Change and volume over the lookback, as much of it as seen.
+			double firstPrice = 0, volume = 0;
+			int64_t firstTime = timeMax;
+			candles::Series minutes;
+			series.scan(timeMax - LOOKBACK_MS, timeMax + 1, [&](const Trade* lookback, size_t nlookback)
+			{
+				if (firstTime == timeMax)
+				{
+					firstPrice = lookback[0].price;
+					firstTime = lookback[0].time;
+				}
+				for (size_t j = 0; j < nlookback; j++)
+				{
+					volume += lookback[j].price * lookback[j].qty;
+					minutes.add(lookback[j].time, lookback[j].price, lookback[j].qty);
+				}
+			});
+			if (firstPrice > 0)
+			{
+				msg << " " << (timeMax - firstTime + 30 * 60 * 1000) / (60 * 60 * 1000) << "H: ";
+				if (avgPrice > firstPrice) msg << "+";
+				msg << (avgPrice / firstPrice * 100.0 - 100) << "% VOL: " << volume << " BTC";
+			}
+
+			// Overbought pumps are late to buy.
+			if (minutes.size() > RSI_PERIOD)
+			{
+				vector<double> closes(minutes.size()), rsi(minutes.size());
+				indicators::getColumn(minutes, 0, minutes.size(), indicators::Close, &closes[0]);
+				indicators::rsi(&closes[0], closes.size(), RSI_PERIOD, &rsi[0]);
+				if (!std::isnan(rsi.back()))
+					msg << " RSI: " << (int)rsi.back();
+			}
+
+			const float probability = getProbability(i);
+			if (probability >= 0)
+				msg << " P: " << (int)(probability * 100) << "%";
+
+			// The position and the recommendation are taken by the owner.
+			const portfolio::Position& position = book[i];
+			const double amount = position.amount, value = position.value;
+			if (amount == 0)
 			{
-				buy++;
+				// The model recommends on the probability, or else the second hot frame in a row does.
+				if (model.is_loaded() ? (probability >= PUMP_PROBABILITY) : frames[i].hot) buy++;
+			}
+			const bool execute = executor.isEnabled() && !executing[i];
+			if (execute)
+				executing[i] = true;
+
+			// Make BUY on the next round more attractive if the currently seen value
+			// is above the threshold (i.e. a hot candle).
+			hot = true;
 
+			frames[i].alertTime = timeMax;
+
+			// The order is left to the order thread, and the chart and the alert
+			// to the notification thread. The order latency counts from now.
+			const string text = msg.str();
+			const vector<Trade> chartTrades(trades, trades + ntrades);
+			const Executor::Time signaled = chrono::steady_clock::now();
+			function<void()> action = [&, i, text, chartTrades, avgPrice, amount, value, buy, execute, signaled]()
+			{
+				const string& pair = btcPairs[i];
 				stringstream msg;
-				const string currency(pair.c_str(), pair.size() - 3);
-				const string symbol = currency + "_BTC";
+				msg << text;
 
-				msg << "<a href=\"https://www.binance.com/tradeDetail.html?symbol=" << symbol << "\">" << pair << "</a> +" <<
-					(avgPrice / frames[i].avgPrice * 100.0 - 100) << "% 📈";
+				// The alert reports the order executed, so it is not a duplicate signal.
+				bool executed = false, bought = false, filled = false;
+				Fill fill;
+
+				// Look at the order book: trades alone are easy to fake. The order does not
+				// wait for a snapshot: the local book is taken as it is, if synchronized.
+				Feed::Quote quote;
+				bool hasQuote = depth.getQuote(pair, DEPTH_LEVELS, quote);
+				if (hasQuote)
+				{
+					msg << " BOOK: ";
+					if (quote.imbalance > 0) msg << "+";
+					msg << quote.imbalance * 100 << "%";
+				}
 
-				// Rocket high?
-				if (avgPrice >= THRESHOLD_ROCKET * frames[i].avgPrice)
-					 msg << " 🚀";
-					
 				// Add a note, if we are in position for this currency.
-				if (positions.find(currency) != positions.end())
+				if (amount != 0)
 				{
-					double amount = positions[currency].amount;
-					if (amount != 0)
+					msg << " POSITION: " << amount;
+
+					if (avgPrice * amount > THRESHOLD * value)
 					{
-						msg << " POSITION: " << amount;
-						
-						if (avgPrice * amount > THRESHOLD * positions[currency].value)
+						double profit = avgPrice * amount / value * 100 - 100;
+						msg << " RECOM: SELL +" << profit << "%";
+
+						if (execute)
 						{
-							double profit = avgPrice * amount / positions[currency].value * 100 - 100;
-							msg << " RECOM: SELL +" << profit << "%";
+							double price = hasQuote ? quote.bestBid : avgPrice;
+
+							executionError_t status = executor.sell(pair, amount, price * (1 - SLIPPAGE), fill, signaled);
+							executed = true;
+							filled = (status == executionSuccess);
+							if (filled)
+								msg << " SOLD: " << fill.qty << " @ " << fill.price << " (" << fill.latency << " us)";
+							else if (status == executionErrorNotFilled)
+								msg << " NOT FILLED";
+							else
+								msg << " SELL FAILED: " << executionGetErrorString(status);
 						}
-						else
-							msg << " RECOM: HOLD";
+						else if (executor.isEnabled())
+							msg << " ORDER PENDING";
 					}
+					else
+						msg << " RECOM: HOLD";
 				}
-				else
+				else if (buy >= 1)
 				{
-					if (frames[i].hot) buy++;
-					if (buy >= 1) msg << " RECOM: <b>BUY</b>";
+					// Asks wall on top of the book would likely stop the pump.
+					if (hasQuote && (quote.imbalance < IMBALANCE_MIN))
+						msg << " RECOM: HOLD (ASKS WALL)";
+					else
+					{
+						msg << " RECOM: <b>BUY</b>";
+
+						if (execute)
+						{
+							double price = hasQuote ? quote.bestAsk : avgPrice;
+
+							executionError_t status = executor.buy(pair, price * (1 + SLIPPAGE), fill, signaled);
+							executed = true;
+							bought = true;
+							filled = (status == executionSuccess);
+							if (filled)
+								msg << " BOUGHT: " << fill.qty << " @ " << fill.price << " (" << fill.latency << " us)";
+							else if (status == executionErrorNotFilled)
+								msg << " NOT FILLED";
+							else
+								msg << " BUY FAILED: " << executionGetErrorString(status);
+						}
+						else if (executor.isEnabled())
+							msg << " ORDER PENDING";
+					}
 				}
 
-				// Make BUY on the next round more attractive if the currently seen value
-				// is above the threshold (i.e. a hot candle).
-				hot = true;
+				// The owner updates the book by the fill, and takes the orders of the pair again.
+				if (execute)
+					returnOrder(i, bought, filled, fill);
 
-				// Communicate the result over the Telegram.
-				telegram.sendMessage(msg.str());
+				// Communicate the result over the Telegram, with the chart of the recent trades.
+				const string text = msg.str();
+				function<void()> notification = [&, i, text, chartTrades, executed]()
+				{
+					// The book of the pair is synchronized for its next alerts.
+					const string& pair = btcPairs[i];
+					depth.synchronize(market, pair);
+
+					string png;
+					const bool rendered = renderTradesChart(pair, chartTrades.data(), chartTrades.size(), png);
+					sendAlert(pair, executed ? shard::ExecutionAlert : shard::SignalAlert, text, rendered ? png : "");
+				};
+				notifications.post(notification);
+			};
+			orders.post(action);
+		}
+		else
+		{
+			if (avgPrice < frames[i].avgPrice)
+			{
+				buy = -INT_MAX;
+				hot = false;
+			}
+		}
+
+		frames[i].idMax = idMax;
+		frames[i].totalQty = totalQty;
+		frames[i].avgPrice = avgPrice;
+		frames[i].hot = hot;
+	
+		cout << pair << " : " << frames[i].idMax << " : " << frames[i].avgPrice << endl;
+
+		return hot;
+	};
+
+	// State of the pairs, written by their owners only.
+	const size_t npairs = btcPairs.size();
+	vector<char> watched(npairs), requested(npairs), scheduled(npairs);
+	vector<chrono::steady_clock::time_point> requestTimes(npairs);
+	vector<int> failures(npairs);
+	vector<int64_t> evaluated(npairs);
+	vector<deque<Trade> > windows(npairs);
+
+	struct Shard
+	{
+		Json::Reader reader;
+		Json::Value result;
+		size_t nevaluations, nalerts;
+
+		Shard() : nevaluations(0), nalerts(0) { }
+	};
+	vector<Shard> shards(nworkers);
+
+	const int64_t started = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+	for (int w = 0; w < nworkers; w++)
+		tradingStates.push_back(unique_ptr<snapshot::Snapshots<TradingState> >(new snapshot::Snapshots<TradingState>()));
+
+	// Publish the state of the shard for the commands and the reports.
+	function<void(int)> publish = [&](int w)
+	{
+		Shard& shard = shards[w];
+
+		tradingStates[w]->publish([&](TradingState& state)
+		{
+			state.time = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+			state.started = started;
+			state.nevaluations = shard.nevaluations;
+			state.nalerts = shard.nalerts;
+			state.ntrades = 0;
+			state.szmemory = 0;
+			state.executing = executor.isEnabled();
+			state.totals = book.getTotals(w);
+			state.pairs.resize(npairs);
+			for (int i = w; i < npairs; i += nworkers)
+			{
+				const TradingFrame& frame = frames[i];
+				const portfolio::Position& position = book[i];
+
+				PairState& pair = state.pairs[i];
+				pair.avgPrice = frame.seen ? frame.avgPrice : 0;
+				pair.change = frame.seen ? frame.change : 0;
+				pair.amount = position.amount;
+				pair.value = position.value;
+				pair.price = position.price;
+				pair.idMax = frame.idMax;
+				pair.alertTime = frame.alertTime;
+				pair.evaluated = evaluated[i];
+				pair.probability = getProbability(i);
+				pair.hot = frame.hot;
+				pair.owned = watched[i];
+
+				state.ntrades += recent[i].size();
+				state.szmemory += recent[i].getMemory();
+			}
+		});
+	};
+
+	http::Client client(server.getHostname());
+
+	// Request the recent trades of the pair, from its owner.
+	function<void(int)> requestTrades = [&](int i)
+	{
+		requested[i] = true;
+		requestTimes[i] = chrono::steady_clock::now();
+
+		client.get("/api/v3/trades?symbol=" + btcPairs[i] + "&limit=" + to_string(TRADES_WINDOW), [&, i](http::Response& response)
+		{
+			Message message;
+			if (response.status == http::httpSuccess)
+				message.type = Message::Trades;
+			else if (response.status == http::httpErrorRateLimited)
+				message.type = Message::RateLimited;
+			else
+			{
+				fprintf(stderr, "%s : %s %ld\n", btcPairs[i].c_str(),
+					http::httpGetErrorString(response.status), response.code);
+				message.type = Message::Failed;
+			}
+
+			// The transfer gets back the spare body, which keeps its capacity.
+			message.body.swap(response.body);
+			workers.send(fromHttp, i, message);
+			response.body.swap(message.body);
+		});
+	};
+
+	// The next request or evaluation of the pair, a period after the last one,
+	// or the delay after the last response, if longer.
+	function<void(int, int, int64_t)> scheduleNext = [&](int w, int i, int64_t delayMs)
+	{
+		scheduled[i] = true;
+		const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		workers.schedule(w, max(now + chrono::milliseconds(delayMs), requestTimes[i] + chrono::milliseconds(EVALUATION_MS)), i);
+	};
+
+	function<void(int, int, bool)> evaluate = [&](int w, int i, bool alert)
+	{
+		evaluated[i] = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+		shards[w].nevaluations++;
+		shards[w].nalerts += alert;
+	};
+
+	function<void(int, int, Message&)> onMessage = [&](int w, int i, Message& message)
+	{
+		switch (message.type)
+		{
+		case Message::Start :
+			workers.schedule(w, chrono::steady_clock::now(), -1);
+			break;
+		case Message::Own :
+			watched[i] = true;
+			if (scheduled[i] || requested[i]) break;
+			if (useBus)
+			{
+				requestTimes[i] = chrono::steady_clock::now();
+				scheduleNext(w, i, 0);
 			}
 			else
+				requestTrades(i);
+			break;
+		case Message::Disown :
+			// Pairs taken over again start from a new frame.
+			watched[i] = false;
+			frames[i].seen = false;
+			recent[i] = cache::Series(i, LOOKBACK_MS);
+			windows[i].clear();
+			activity[i].clear();
+			scored[i] = false;
+			break;
+		case Message::Trades :
+		case Message::Failed :
+		case Message::RateLimited :
+			requested[i] = false;
+			if (!watched[i]) break;
+			if (message.type == Message::RateLimited)
+			{
+				scheduleNext(w, i, 0);
+				break;
+			}
+			if (message.type == Message::Trades)
+			{
+				Shard& shard = shards[w];
+				if (!shard.reader.parse(message.body, shard.result) || !shard.result.isArray())
+				{
+					fprintf(stderr, "%s : malformed trades response\n", btcPairs[i].c_str());
+					message.type = Message::Failed;
+				}
+			}
+			if (message.type == Message::Failed)
 			{
-				if (avgPrice < frames[i].avgPrice)
+				if (++failures[i] > http::Client::maxRetries)
 				{
-					buy = -INT_MAX;
-					hot = false;
+					fprintf(stderr, "%s : skipped for %d s after %d failures\n", btcPairs[i].c_str(),
+						SKIP_MS / 1000, failures[i]);
+					failures[i] = 0;
+					scheduleNext(w, i, SKIP_MS);
 				}
+				else
+					scheduleNext(w, i, http::Client::getRetryDelay(failures[i]));
+				break;
 			}
+			failures[i] = 0;
+			{
+				const Json::Value& result = shards[w].result;
+				Buffer<Trade> trades(tradeBatches);
+				const size_t ntrades = min((size_t)result.size(), trades.capacity());
+				for (Json::Value::ArrayIndex j = 0; j < ntrades; j++)
+				{
+					Trade& trade = trades[j];
 
-			frames[i].idMax = idMax;
-			frames[i].totalQty = totalQty;
-			frames[i].avgPrice = avgPrice;
-			frames[i].hot = hot;
-		
-			cout << pair << " : " << frames[i].idMax << " : " << frames[i].avgPrice << endl;
+					trade.id = result[j]["id"].asInt64();
+					trade.time = result[j]["time"].asInt64();
+					trade.price = atof(result[j]["price"].asString().c_str());
+					trade.qty = atof(result[j]["qty"].asString().c_str());
+					trade.isBuyerMaker = result[j]["isBuyerMaker"].asBool();
+					trade.isBestMatch = result[j]["isBestMatch"].asBool();
+				}
+
+				evaluate(w, i, trade(i, trades.data(), ntrades));
+			}
+			scheduleNext(w, i, 0);
+			break;
+		case Message::Triggers :
+			{
+				// The levels fired stay fired, and are forgotten, once their lines are removed.
+				set<pair<int, double> >& fired = firedLevels[i];
+				for (set<pair<int, double> >::iterator l = fired.begin(); l != fired.end(); )
+				{
+					if (message.levels->remove((triggers::Kind)l->first, l->second))
+						l++;
+					else
+						fired.erase(l++);
+				}
+				levels[i].swap(*message.levels);
+			}
+			break;
+		case Message::Executed :
+			// The book is updated, even if the pair is given away meanwhile.
+			executing[i] = false;
+			if (!message.filled) break;
+			filledTimes[i] = max(filledTimes[i], message.fill.time);
+			if (message.buy)
+				book.buy(i, message.fill.qty, message.fill.quoteQty);
+			else
+			{
+				// Release the purchase value proportionally to the amount sold.
+				book.sell(i, message.fill.qty);
+			}
+			break;
+		case Message::Balance :
+			// The balance older than the last fill, or taken during the order,
+			// would account the fill twice; the next balance takes the rest.
+			if (executing[i] || (message.time < filledTimes[i])) break;
+			book.update(i, message.balance);
+			break;
+		case Message::BusTrade :
+			book.mark(i, message.trade.price);
+			if (!watched[i]) break;
+			windows[i].push_back(message.trade);
+			if (windows[i].size() > TRADES_WINDOW)
+				windows[i].pop_front();
+			break;
 		}
-	
-		initial = false;
+	};
+
+	function<void(int, int)> onTimer = [&](int w, int i)
+	{
+		if (i < 0)
+		{
+			publish(w);
+			workers.schedule(w, chrono::steady_clock::now() + chrono::seconds(1), -1);
+			return;
+		}
+
+		scheduled[i] = false;
+		if (!watched[i]) return;
+		if (!useBus)
+		{
+			requestTrades(i);
+			return;
+		}
+
+		requestTimes[i] = chrono::steady_clock::now();
+		const deque<Trade>& window = windows[i];
+		if (window.size())
+		{
+			Buffer<Trade> trades(tradeBatches);
+			const size_t ntrades = min(window.size(), trades.capacity());
+			copy(window.end() - ntrades, window.end(), trades.data());
+
+			evaluate(w, i, trade(i, trades.data(), ntrades));
+		}
+		scheduleNext(w, i, 0);
+	};
+
+	// The first core is left to the HTTP event loop and the bus reader.
+	cout << "Starting " << nworkers << " workers on " << ncores << " cores ..." << endl;
+	workers.start(onMessage, onTimer, (ncores > 1) ? 1 : 0);
+	for (int w = 0; w < nworkers; w++)
+	{
+		Message start;
+		start.type = Message::Start;
+		workers.send(fromMain, w, start);
+	}
+
+	unique_ptr<Commands> commands;
+	if (useCommands)
+	{
+		cout << "Answering the chat commands via " << telegramUrl << " ..." << endl;
+
+		commands.reset(new Commands(telegram, telegramUrl));
+		thread(serveCommands, commands.get(), &btcPairs).detach();
+	}
+
+	vector<unique_ptr<bus::Subscriber> > subscribers;
+	if (useBus)
+	{
+		cout << "Subscribing to the market data bus ..." << endl;
+
+		for (int g = 0; g < bus::defaultGroups; g++)
+		{
+			subscribers.push_back(unique_ptr<bus::Subscriber>(new bus::Subscriber(g)));
+			BUS_ERR_CHECK(subscribers.back()->open());
+		}
+
+		// The trades of the bus are routed to the owners of their pairs,
+		// which keep the recent trades windows.
+		thread reader([&]()
+		{
+			// Pair indexes by the bus symbol ids, resolved on the first trade.
+			vector<int> bySymbol(bus::maxSymbols, -2);
+
+			Buffer<Trade> trades(tradeBatches);
+			Message message;
+			message.type = Message::BusTrade;
+			uint64_t nlost = 0;
+			while (1)
+			{
+				size_t npolled = 0;
+				for (int g = 0; g < subscribers.size(); g++)
+				{
+					bus::Subscriber& subscriber = *subscribers[g];
+
+					const uint64_t nlostBefore = nlost;
+					const size_t ntrades = subscriber.poll(trades.data(), trades.capacity(), nlost);
+					if (nlost != nlostBefore)
+						fprintf(stderr, "Bus group %d : %lu trades lost\n", g, (unsigned long)(nlost - nlostBefore));
+
+					for (size_t j = 0; j < ntrades; j++)
+					{
+						int& i = bySymbol[trades[j].symbol];
+						if (i == -2)
+						{
+							map<string, int>::const_iterator index = pairIndexes.find(subscriber.getSymbol(trades[j].symbol));
+							i = (index == pairIndexes.end()) ? -1 : index->second;
+						}
+						if (i == -1) continue;
+
+						message.trade = trades[j];
+						workers.send(fromBus, i, message);
+						message.type = Message::BusTrade;
+					}
+					npolled += ntrades;
+				}
+
+				if (!npolled)
+					this_thread::sleep_for(chrono::milliseconds(1));
+			}
+		});
+		reader.detach();
+	}
+
+	// Take over the pairs of the instances left, and give away the pairs
+	// to the instances joined, by the messages to their owners.
+	vector<char> owned(npairs);
+	function<void()> rebalance = [&]()
+	{
+		vector<string> members;
+		if (sharded)
+		{
+			if (!notifier->getMembers(membersVersion, members))
+				return;
+			ring.setMembers(members);
+		}
+
+		size_t nowned = 0;
+		for (int i = 0; i < npairs; i++)
+		{
+			const bool owns = (btcPairs[i] != "BNB_BTC") && (!sharded || (ring.getOwner(btcPairs[i]) == shardName));
+			nowned += owns;
+			if (owns == (bool)owned[i]) continue;
+			owned[i] = owns;
+
+			Message message;
+			message.type = owns ? Message::Own : Message::Disown;
+			workers.send(fromMain, i, message);
+		}
+
+		if (sharded)
+			cout << "Watching " << nowned << " of " << npairs << " pairs, " <<
+				members.size() << " instances in the ring" << endl;
+	};
+
+	// Report the memory held by the recent trades and the portfolio value once a minute.
+	chrono::steady_clock::time_point reported = chrono::steady_clock::now();
+	function<void()> reportCache = [&]()
+	{
+		const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (now - reported < chrono::minutes(1)) return;
+		reported = now;
+
+		TradingState state;
+		if (!readTradingState(state)) return;
+
+		cout << "Recent trades: " << state.ntrades << " in " << state.szmemory / 1024 / 1024 << " MiB (" <<
+			(state.szmemory ? (double)state.ntrades * sizeof(Trade) / state.szmemory : 0) << "x compression), " <<
+			state.nevaluations << " evaluations" << endl;
+		cout << "Portfolio: " << state.totals.npositions << " positions, " << state.totals.marked << " BTC of " <<
+			state.totals.value << " BTC purchased" << endl;
+	};
+
+	// Hand the triggers over to the owners of their pairs, once the file is changed.
+	// The triggers fired are dropped, until the file is changed again.
+	function<void()> reloadTriggers = [&]()
+	{
+		if (!triggersFile.isModified(triggers::Index::default_path)) return;
+
+		triggers::triggersError_t status = triggersFile.load(triggers::Index::default_path, btcPairs, btc);
+		if (status != triggers::triggersSuccess)
+		{
+			fprintf(stderr, "Keeping the price triggers: %s\n", triggers::triggersGetErrorString(status));
+			return;
+		}
+
+		size_t ntriggers = 0;
+		for (int i = 0; i < npairs; i++)
+		{
+			Message message;
+			message.type = Message::Triggers;
+			ntriggers += triggersFile[i].size();
+			message.levels.reset(new triggers::Levels());
+			message.levels->swap(triggersFile[i]);
+			workers.send(fromMain, i, message);
+		}
+
+		cout << "Watching " << ntriggers << " price triggers" << endl;
+	};
+
+	// Hand the balances changed over to the owners of their pairs, and keep
+	// the user data stream alive: it is closed without a keepalive in an hour.
+	chrono::steady_clock::time_point keptAlive = chrono::steady_clock::now();
+	vector<Json::Value> events;
+	function<void()> updateBalances = [&]()
+	{
+		if (listenKey == "") return;
+
+		const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (now - keptAlive >= chrono::minutes(30))
+		{
+			binanceError_t status = account.keepUserDataStream(listenKey.c_str());
+			if (status != binanceSuccess)
+				fprintf(stderr, "Cannot keep the user data stream alive: %s\n", binanceGetErrorString(status));
+			keptAlive = now;
+		}
+
+		{
+			lock_guard<mutex> lock(accountMutex);
+			events.swap(accountEvents);
+		}
+
+		Message message;
+		message.type = Message::Balance;
+		for (int e = 0; e < events.size(); e++)
+		{
+			message.time = events[e]["u"].asInt64();
+			const Json::Value& balances = events[e]["B"];
+			for (Json::Value::ArrayIndex j = 0; j < balances.size(); j++)
+			{
+				map<string, int>::const_iterator index = pairIndexes.find(balances[j]["a"].asString() + btc);
+				if (index == pairIndexes.end()) continue;
+
+				// The amount locked by the open orders is still in the position.
+				message.type = Message::Balance;
+				message.balance = atof(balances[j]["f"].asString().c_str()) + atof(balances[j]["l"].asString().c_str());
+				workers.send(fromMain, index->second, message);
+			}
+		}
+		events.clear();
+	};
+
+	rebalance();
+	while (1)
+	{
+		this_thread::sleep_for(chrono::seconds(1));
+
+		rebalance();
+		reloadTriggers();
+		updateBalances();
+		reportCache();
 	}
 
 	return 0;
 }
-
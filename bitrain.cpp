@@ -0,0 +1,410 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <wordexp.h>
+
+#include "history.h"
+#include "scorer.h"
+
+using namespace history;
+using namespace scorer;
+using namespace std;
+
+// Path to the binary data file containing historical trading data.
+string history_path = "$HOME/.bitrader/history.dat";
+
+// Trades of a symbol read at once.
+const size_t chunkSize = 1024 * 1024;
+
+// The L2 penalty of the weights, and the convergence of the fit.
+const double penalty = 1.0;
+const double tolerance = 1e-6;
+const int maxIterations = 50;
+
+// Features as of a trade, and whether the price has gained within the horizon after it.
+struct Sample
+{
+	int64_t time;
+	float features[nfeatures];
+	bool pump;
+};
+
+static void readFully(int fd, void* data, size_t size, uint64_t offset, const string& path)
+{
+	for (char* p = (char*)data; size; )
+	{
+		const ssize_t n = pread(fd, p, size, offset);
+		if (n <= 0)
+		{
+			fprintf(stderr, "Cannot read %s\n", path.c_str());
+			exit(1);
+		}
+		p += n;
+		offset += n;
+		size -= n;
+	}
+}
+
+// Replay the trades of the symbol through the activity, taking a sample at the first
+// trade of each period, and label the samples, as the trades of their horizon come.
+// The samples of the last horizon, not seen through, are dropped.
+static void extract(int fd, const Index::Entry& entry, int64_t period, int64_t horizon, double gain,
+	vector<Trade>& chunk, vector<Sample>& samples)
+{
+	struct Pending
+	{
+		size_t sample;
+		int64_t expires;
+		double target;
+	};
+
+	Activity activity;
+	deque<Pending> pending;
+	int64_t nextSample = 0;
+	for (uint64_t done = 0; done < entry.count; )
+	{
+		const size_t count = min((uint64_t)chunk.size(), entry.count - done);
+		readFully(fd, &chunk[0], count * sizeof(Trade), File::dataOffset + (entry.first + done) * sizeof(Trade), history_path);
+		done += count;
+
+		for (size_t k = 0; k < count; k++)
+		{
+			const Trade& trade = chunk[k];
+
+			while (pending.size() && (pending.front().expires < trade.time))
+				pending.pop_front();
+			for (deque<Pending>::const_iterator p = pending.begin(), e = pending.end(); p != e; p++)
+				if (trade.price >= p->target)
+					samples[p->sample].pump = true;
+
+			activity.add(trade);
+			if (trade.time < nextSample) continue;
+			nextSample = trade.time - trade.time % period + period;
+
+			Sample sample;
+			sample.time = trade.time;
+			sample.pump = false;
+			if (!activity.getFeatures(sample.features)) continue;
+
+			Pending next = { samples.size(), trade.time + horizon, trade.price * (1 + gain) };
+			samples.push_back(sample);
+			pending.push_back(next);
+		}
+	}
+
+	// The pending samples are the last ones of the symbol.
+	if (pending.size())
+		samples.resize(pending.front().sample);
+}
+
+// Solve the symmetric positive definite system in place by the Cholesky decomposition.
+static void solve(vector<double>& a, vector<double>& b, int n)
+{
+	for (int j = 0; j < n; j++)
+	{
+		for (int k = 0; k < j; k++)
+			a[j * n + j] -= a[j * n + k] * a[j * n + k];
+		a[j * n + j] = sqrt(a[j * n + j]);
+		for (int i = j + 1; i < n; i++)
+		{
+			for (int k = 0; k < j; k++)
+				a[i * n + j] -= a[i * n + k] * a[j * n + k];
+			a[i * n + j] /= a[j * n + j];
+		}
+	}
+	for (int i = 0; i < n; i++)
+	{
+		for (int k = 0; k < i; k++)
+			b[i] -= a[i * n + k] * b[k];
+		b[i] /= a[i * n + i];
+	}
+	for (int i = n - 1; i >= 0; i--)
+	{
+		for (int k = i + 1; k < n; k++)
+			b[i] -= a[k * n + i] * b[k];
+		b[i] /= a[i * n + i];
+	}
+}
+
+// Fit the logistic regression on the standardized features by the Newton's method,
+// the gradient and the Hessian of the log-loss summed over the samples in parallel.
+static void fit(const Sample* samples, size_t nsamples, float* mean, float* scale, float* weights, float& bias)
+{
+	vector<double> sum(nfeatures), sum2(nfeatures);
+	for (size_t i = 0; i < nsamples; i++)
+		for (int f = 0; f < nfeatures; f++)
+		{
+			sum[f] += samples[i].features[f];
+			sum2[f] += (double)samples[i].features[f] * samples[i].features[f];
+		}
+	for (int f = 0; f < nfeatures; f++)
+	{
+		mean[f] = sum[f] / nsamples;
+		const double variance = sum2[f] / nsamples - (double)mean[f] * mean[f];
+		scale[f] = (variance > 0) ? sqrt(variance) : 1;
+	}
+
+	// The weights, and the bias last.
+	const int n = nfeatures + 1;
+	vector<double> theta(n);
+	for (int iteration = 0; iteration < maxIterations; iteration++)
+	{
+		vector<double> gradient(n), hessian(n * n);
+		double loss = 0;
+
+		#pragma omp parallel
+		{
+			vector<double> g(n), h(n * n);
+			double l = 0;
+			double x[n];
+			x[n - 1] = 1;
+
+			#pragma omp for
+			for (size_t i = 0; i < nsamples; i++)
+			{
+				const Sample& sample = samples[i];
+				double z = theta[n - 1];
+				for (int f = 0; f < nfeatures; f++)
+				{
+					x[f] = (sample.features[f] - mean[f]) / scale[f];
+					z += theta[f] * x[f];
+				}
+
+				const double p = 1 / (1 + exp(-z));
+				const double r = p - sample.pump;
+				const double w = max(p * (1 - p), 1e-12);
+				l -= log(max(sample.pump ? p : 1 - p, 1e-15));
+				for (int j = 0; j < n; j++)
+				{
+					g[j] += r * x[j];
+					for (int k = 0; k <= j; k++)
+						h[j * n + k] += w * x[j] * x[k];
+				}
+			}
+
+			#pragma omp critical
+			{
+				for (int j = 0; j < n; j++)
+					gradient[j] += g[j];
+				for (int j = 0; j < n * n; j++)
+					hessian[j] += h[j];
+				loss += l;
+			}
+		}
+
+		for (int j = 0; j < nfeatures; j++)
+		{
+			gradient[j] += penalty * theta[j];
+			hessian[j * n + j] += penalty;
+		}
+		hessian[(n - 1) * n + (n - 1)] += 1e-9;
+
+		solve(hessian, gradient, n);
+		double step = 0;
+		for (int j = 0; j < n; j++)
+		{
+			theta[j] -= gradient[j];
+			step = max(step, fabs(gradient[j]));
+		}
+
+		cout << "Iteration " << iteration << " : log-loss " << loss / nsamples << endl;
+		if (step < tolerance) break;
+	}
+
+	for (int f = 0; f < nfeatures; f++)
+		weights[f] = theta[f];
+	bias = theta[n - 1];
+}
+
+// Score the held out samples by the model, as bitrader does, and report the log-loss
+// against the base rate, and the calibration: the observed pump rate by the predicted one.
+static void evaluate(const Model& model, const Sample* samples, size_t nsamples, double baseRate)
+{
+	Batch batch(nsamples);
+	for (size_t i = 0; i < nsamples; i++)
+		batch.set(i, samples[i].features);
+
+	vector<float> probabilities(nsamples);
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	model.score(batch, 0, nsamples, &probabilities[0]);
+	const double elapsed = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+	const int nbins = 10;
+	vector<size_t> counts(nbins), pumps(nbins);
+	vector<double> predicted(nbins);
+	double loss = 0, baseLoss = 0;
+	for (size_t i = 0; i < nsamples; i++)
+	{
+		const double p = probabilities[i];
+		const bool pump = samples[i].pump;
+		loss -= log(max(pump ? p : 1 - p, 1e-15));
+		baseLoss -= log(max(pump ? baseRate : 1 - baseRate, 1e-15));
+
+		const int bin = min((int)(p * nbins), nbins - 1);
+		counts[bin]++;
+		pumps[bin] += pump;
+		predicted[bin] += p;
+	}
+
+	cout << "Scored " << nsamples << " held out samples in " << elapsed << " us" << endl;
+	cout << "Log-loss " << loss / nsamples << ", base rate " << baseLoss / nsamples << endl;
+	cout << "Predicted\tObserved\tSamples" << endl;
+	for (int bin = 0; bin < nbins; bin++)
+		if (counts[bin])
+			cout << predicted[bin] / counts[bin] << "\t" << (double)pumps[bin] / counts[bin] << "\t" << counts[bin] << endl;
+}
+
+// Train the pump probability model of bitrader on the compacted history: the features of
+// the symbols are extracted in parallel, each symbol replayed by a thread, the logistic
+// regression is fitted on the older samples, and checked on the newest ones.
+int main(int argc, char* argv[])
+{
+	string model_path = Model::default_path;
+	string quote = "BTC";
+	double horizon = 15, gain = 3, period = 60, holdout = 20;
+	bool usage = false;
+	for (int i = 1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		if ((arg == "--history") && (i + 1 < argc))
+			history_path = argv[++i];
+		else if ((arg == "--model") && (i + 1 < argc))
+			model_path = argv[++i];
+		else if ((arg == "--quote") && (i + 1 < argc))
+			quote = argv[++i];
+		else if ((arg == "--horizon") && (i + 1 < argc))
+			horizon = atof(argv[++i]);
+		else if ((arg == "--gain") && (i + 1 < argc))
+			gain = atof(argv[++i]);
+		else if ((arg == "--sample") && (i + 1 < argc))
+			period = atof(argv[++i]);
+		else if ((arg == "--holdout") && (i + 1 < argc))
+			holdout = atof(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || (horizon <= 0) || (gain <= 0) || (period <= 0) || (holdout < 0) || (holdout >= 100))
+	{
+		fprintf(stderr, "Usage: %s [--history <history.dat>] [--model <path>] [--quote <asset>] "
+			"[--horizon <minutes>] [--gain <%%>] [--sample <seconds>] [--holdout <%%>]\n", argv[0]);
+		exit(1);
+	}
+
+	{
+		wordexp_t p;
+		char** w;
+		wordexp(history_path.c_str(), &p, 0);
+		w = p.we_wordv;
+		history_path = w[0];
+		wordfree(&p);
+	}
+
+	File history(history_path);
+	HISTORY_ERR_CHECK(history.open());
+
+	// The trades of each symbol are contiguous in the compacted file.
+	Index index;
+	if (index.load(history_path) != historySuccess)
+	{
+		fprintf(stderr, "The history file %s is not compacted, run bicompact first\n", history_path.c_str());
+		exit(1);
+	}
+	const uint64_t nrecords = history.getRecordsCount();
+	if (nrecords > index.nrecords)
+		cout << "Skipping " << nrecords - index.nrecords << " trades appended since the compaction" << endl;
+
+	const SymbolDictionary& dictionary = history.getDictionary();
+	vector<int> symbols;
+	for (int s = 0; s < index.symbols.size(); s++)
+	{
+		const string& name = dictionary.getName(s);
+		if (index.symbols[s].count && (name.size() > quote.size()) &&
+			!name.compare(name.size() - quote.size(), quote.size(), quote))
+			symbols.push_back(s);
+	}
+
+	const int64_t horizonMs = horizon * 60 * 1000;
+	cout << "Extracting the features of " << symbols.size() << " *" << quote << " symbols, the pump is +" <<
+		gain << "% within " << horizon << " min ..." << endl;
+
+	vector<Sample> samples;
+	#pragma omp parallel
+	{
+		vector<Trade> chunk(chunkSize);
+		vector<Sample> partial;
+
+		int fd = ::open(history_path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			fprintf(stderr, "Cannot open %s\n", history_path.c_str());
+			exit(1);
+		}
+
+		#pragma omp for schedule(dynamic)
+		for (int j = 0; j < symbols.size(); j++)
+			extract(fd, index.symbols[symbols[j]], period * 1000, horizonMs, gain / 100, chunk, partial);
+
+		::close(fd);
+
+		#pragma omp critical
+		samples.insert(samples.end(), partial.begin(), partial.end());
+	}
+	if (samples.empty())
+	{
+		fprintf(stderr, "No samples: the history is shorter than the warmup and the horizon\n");
+		exit(1);
+	}
+
+	// The newest samples are held out, as the model is to score the future.
+	int64_t minTime = samples[0].time, maxTime = samples[0].time;
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		minTime = min(minTime, samples[i].time);
+		maxTime = max(maxTime, samples[i].time);
+	}
+	const int64_t cut = maxTime - (maxTime - minTime) * holdout / 100;
+	struct Older
+	{
+		int64_t cut;
+
+		bool operator()(const Sample& sample) const { return sample.time <= cut; }
+	};
+	Older older = { cut };
+	const size_t ntrain = partition(samples.begin(), samples.end(), older) - samples.begin();
+
+	size_t npumps = 0;
+	for (size_t i = 0; i < ntrain; i++)
+		npumps += samples[i].pump;
+	const double baseRate = (double)npumps / ntrain;
+	cout << "Fitting on " << ntrain << " samples, " << npumps << " pumps (" << baseRate * 100 << "%) ..." << endl;
+	if (!npumps || (npumps == ntrain))
+	{
+		fprintf(stderr, "Cannot fit: the samples are of the single class\n");
+		exit(1);
+	}
+
+	float mean[nfeatures], scale[nfeatures], weights[nfeatures], bias;
+	fit(&samples[0], ntrain, mean, scale, weights, bias);
+
+	Model model;
+	model.set(mean, scale, weights, bias, horizonMs, gain / 100);
+	for (int f = 0; f < nfeatures; f++)
+		cout << featureNames[f] << " : " << weights[f] << endl;
+
+	if (ntrain < samples.size())
+		evaluate(model, &samples[ntrain], samples.size() - ntrain, baseRate);
+
+	SCORER_ERR_CHECK(model.save(model_path));
+	cout << "Saved the model to " << model_path << endl;
+
+	return 0;
+}
+
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <jsoncpp/json/json.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "universe.h"
+
+using namespace std;
+
+// Symbols counts of the benchmark universes.
+static const int sizes[] = { 100, 250, 500, 1000, 2000, 4000 };
+
+// Quote assets of the synthetic universe, and their prices in BTC.
+static const char* quotes[] = { "BTC", "ETH", "BNB", "USDT", "TRY" };
+static const double quotePrices[] = { 1.0, 0.05, 0.008, 1.0 / 60000, 1.0 / 60000 / 30 };
+
+// Symbols changing their prices on each tick, regardless of the universe size.
+#define NCHANGED 50
+
+#define NTICKS 1000
+
+#define THRESHOLD 1.02
+
+static double now()
+{
+	return chrono::duration_cast<chrono::duration<double, micro> >(
+		chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void addSymbol(Json::Value& symbols, const string& base, const string& quote)
+{
+	Json::Value symbol;
+	symbol["symbol"] = base + quote;
+	symbol["status"] = "TRADING";
+	symbol["baseAsset"] = base;
+	symbol["quoteAsset"] = quote;
+	symbols.append(symbol);
+}
+
+// Measure the per-tick cost of the universe of each size with the same activity:
+// parsing the REST snapshot of all prices, applying it, and evaluating the changed
+// ones, against the whole cost of the ticker stream event of the changed only.
+static void bench()
+{
+	mt19937_64 generator(0);
+	uniform_real_distribution<double> uniform(0.0, 1.0);
+
+	const int nquotes = sizeof(quotes) / sizeof(quotes[0]);
+
+	// The snapshot columns grow with the universe, the stream one should not.
+	printf("%8s %12s %12s %12s %12s\n", "symbols", "parse, us", "apply, us", "eval, us", "stream, us");
+	for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		const int nsymbols = sizes[s];
+
+		// The quote assets against BTC, then the synthetic bases spread over the quotes.
+		Json::Value exchangeInfo;
+		Json::Value& symbols = exchangeInfo["symbols"];
+		vector<double> prices;
+		for (int q = 1; q < nquotes; q++)
+		{
+			addSymbol(symbols, quotes[q], "BTC");
+			prices.push_back(quotePrices[q]);
+		}
+		for (int i = (int)prices.size(); i < nsymbols; i++)
+		{
+			char base[16];
+			snprintf(base, sizeof(base), "X%04d", i);
+			const int q = i % nquotes;
+			addSymbol(symbols, base, quotes[q]);
+			prices.push_back(1e-6 * exp(uniform(generator) * 10) / quotePrices[q]);
+		}
+
+		universe::Universe markets;
+		UNIVERSE_ERR_CHECK(markets.load(exchangeInfo));
+
+		Json::Value snapshot(Json::arrayValue);
+		for (int i = 0; i < nsymbols; i++)
+		{
+			Json::Value price;
+			price["symbol"] = symbols[i]["symbol"];
+			price["price"] = to_string(prices[i]);
+			snapshot.append(price);
+		}
+
+		Json::FastWriter writer;
+		Json::Reader reader;
+		Json::Value parsed, parsedEvents;
+		vector<int> changed;
+		double parseTime = 0, applyTime = 0, evalTime = 0, streamTime = 0;
+		size_t npumps = 0;
+		for (int t = 0; t < NTICKS; t++)
+		{
+			const int64_t time = t * 1000;
+
+			Json::Value events(Json::arrayValue);
+			for (int k = 0; k < NCHANGED; k++)
+			{
+				const int i = generator() % nsymbols;
+				prices[i] *= 1 + (uniform(generator) - 0.49) * 0.01;
+				snapshot[i]["price"] = to_string(prices[i]);
+
+				Json::Value event;
+				event["s"] = snapshot[i]["symbol"];
+				event["c"] = to_string(prices[i] * 1.001);
+				events.append(event);
+			}
+			const string body = writer.write(snapshot);
+			const string message = writer.write(events);
+
+			// The REST snapshot of all prices, once per tick.
+			double start = now();
+			reader.parse(body, parsed);
+			parseTime += now() - start;
+
+			start = now();
+			changed.clear();
+			markets.update(parsed, time, changed);
+			applyTime += now() - start;
+
+			start = now();
+			for (int j = 0; j < changed.size(); j++)
+				npumps += (markets.getChange(changed[j], time) >= THRESHOLD);
+			evalTime += now() - start;
+
+			// The changed prices only, as the ticker stream delivers them.
+			start = now();
+			reader.parse(message, parsedEvents);
+			changed.clear();
+			markets.update(parsedEvents, time + 500, changed, "s", "c");
+			for (int j = 0; j < changed.size(); j++)
+				npumps += (markets.getChange(changed[j], time + 500) >= THRESHOLD);
+			streamTime += now() - start;
+		}
+
+		printf("%8d %12.1f %12.1f %12.1f %12.1f\n", nsymbols,
+			parseTime / NTICKS, applyTime / NTICKS, evalTime / NTICKS, streamTime / NTICKS);
+		if (!npumps)
+			fprintf(stderr, "No pumps found for %d symbols\n", nsymbols);
+	}
+}
+
+// Show the universe of the exchange and the cross rates of its quote assets.
+int main(int argc, char* argv[])
+{
+	if ((argc == 2) && (string(argv[1]) == "bench"))
+	{
+		bench();
+		return 0;
+	}
+
+	if ((argc != 3) || (string(argv[1]) != "show"))
+	{
+		fprintf(stderr, "Usage: %s bench | show <exchangeInfo.json> < <prices.json>\n", argv[0]);
+		exit(1);
+	}
+
+	Json::Reader reader;
+	Json::Value exchangeInfo, prices;
+	FILE* file = fopen(argv[2], "r");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", argv[2]);
+		exit(1);
+	}
+	string body;
+	char buffer[65536];
+	for (size_t size; (size = fread(buffer, 1, sizeof(buffer), file)) > 0; )
+		body.append(buffer, size);
+	fclose(file);
+
+	if (!reader.parse(body, exchangeInfo) || !reader.parse(cin, prices) || !prices.isArray())
+	{
+		fprintf(stderr, "Malformed exchange info or prices\n");
+		exit(1);
+	}
+
+	universe::Universe markets;
+	UNIVERSE_ERR_CHECK(markets.load(exchangeInfo));
+
+	vector<int> changed;
+	markets.update(prices, 0, changed);
+
+	cout << markets.size() << " pairs, " << changed.size() << " priced" << endl;
+
+	// Pairs of the same base asset in all quotes should come to close prices.
+	vector<pair<string, int> > bases;
+	for (int i = 0; i < markets.size(); i++)
+		bases.push_back(make_pair(markets[i].base, i));
+	sort(bases.begin(), bases.end());
+	for (int j = 0; j < bases.size(); j++)
+	{
+		const int i = bases[j].second;
+		const double price = markets.getNormalizedPrice(i);
+		if (price > 0)
+			printf("%-12s %-6s %.10f %s\n", markets[i].symbol.c_str(), markets[i].quote.c_str(), price, markets.getReference().c_str());
+	}
+
+	return 0;
+}
+
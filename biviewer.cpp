@@ -1,18 +1,43 @@
 #include <archive.h>
 #include <archive_entry.h>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <gtk/gtk.h>
 #include <iostream>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <tuple>
 #include <vector>
 #include <wordexp.h>
 
+#include "bus.h"
+#include "candles.h"
+#include "chart.h"
+#include "history.h"
+#include "indicators.h"
+#include "pool.h"
+#include "profile.h"
+
+using namespace candles;
+using namespace chart;
+using namespace pool;
 using namespace std;
 
 // Path to the binary data file containing historical trading data.
 string historyPath = "$HOME/.bitrader/history";
 
+// Path to the history file appended by bihistorian, followed in live mode.
+string liveHistoryPath = "$HOME/.bitrader/history.dat";
+
 struct Trade
 {
 	double price;
@@ -22,369 +47,1684 @@ struct Trade
 	bool isBuyerMaker;
 };
 
-struct OHLC
+// Batches of the trades decompressed from the archives, reused across the archives.
+Pool tradeBatches(1024 * 1024 * sizeof(Trade), true);
+
+struct Symbol
+{
+	// Memory-mapped candles for each timeframe.
+	map<int64_t, Mapping> candles;
+
+	// In live mode, the candles continuing the mapped ones, starting
+	// from the last mapped candle, which may be still open.
+	map<int64_t, Series> tails;
+
+	// Guards the tails against the rendering threads.
+	mutable mutex tailsMutex;
+
+	// Memory-mapped ticks of the history, for the volume by price.
+	profile::Mapping ticks;
+
+	// In live mode, the ticks continuing the mapped ones. Guarded by the tails mutex.
+	vector<profile::Tick> liveTicks;
+};
+
+map<string, Symbol> symbols;
+
+// Bollinger bands overlaid on the charts, computed once per candle for all tiles.
+indicators::Cache overlays;
+const indicators::Parameters bandsParameters(indicators::Parameters::Bollinger, 20, 2);
+
+// Candles of the symbol timeframe: the mapped candles continued by the live tail.
+// Valid while the symbol tails mutex is held.
+static Candles getCandles(const Symbol& symbol, int64_t timeframe)
+{
+	const Mapping& mapping = symbol.candles.find(timeframe)->second;
+	Candles candles(mapping.getCandles(), mapping.size(), mapping.getWatermark());
+
+	map<int64_t, Series>::const_iterator i = symbol.tails.find(timeframe);
+	if ((i == symbol.tails.end()) || !i->second.size()) return candles;
+
+	const Series& series = i->second;
+	if (candles.szmapped) candles.szmapped--;
+	candles.tail = &series.getCandles()[0];
+	candles.sztail = series.size();
+	candles.watermark = max(candles.watermark, series.getWatermark());
+
+	return candles;
+}
+
+// Start time of the first candle of the symbol timeframe.
+// Valid while the symbol tails mutex is held.
+static int64_t getStartTime(const Symbol& symbol, int64_t timeframe)
+{
+	const Mapping& mapping = symbol.candles.find(timeframe)->second;
+	if (mapping.size()) return mapping.getStartTime();
+
+	map<int64_t, Series>::const_iterator i = symbol.tails.find(timeframe);
+	return (i == symbol.tails.end()) ? 0 : i->second.getStartTime();
+}
+
+// Make the price range a bit wider and aligned, so that the view range stays
+// the same while scrolling through the similar prices.
+static void alignRange(double& minval, double& maxval)
+{
+	if (!isfinite(minval) || !isfinite(maxval))
+	{
+		minval = 0;
+		maxval = 1;
+		return;
+	}
+
+	double span = maxval - minval;
+	if (span <= 0)
+		span = fmax(fabs(maxval) * 1e-3, 1e-8);
+
+	const double step = exp2(ceil(log2(span))) / 8;
+	minval = floor(minval / step) * step;
+	maxval = ceil(maxval / step) * step;
+	if (maxval <= minval)
+		maxval = minval + step;
+}
+
+// Cache of the pre-rendered fixed-width chart tiles, to scroll the charts
+// by compositing the tiles instead of drawing every candle on every motion event.
+// Missing tiles are rendered on the worker threads, the visible ones first, and
+// the least recently used tiles are evicted over the memory capacity. Each tile
+// is rendered at the fixed height over the price range of its own candles, so
+// it does not depend on the view: the view range is applied by compositing.
+class TileCache
 {
-	double open;
-	double high;
-	double low;
-	double close;
+public :
+
+	// Number of candles in a tile, and the pixel rows of its price range.
+	static const uint32_t TILE_CANDLES = 64;
+	static const uint32_t TILE_HEIGHT = 1024;
+
+	struct Key
+	{
+		string symbol;
+		int64_t timeframe;
+
+		// Candle width in pixels.
+		uint32_t zoom;
+
+		int64_t index;
+
+		// The Bollinger bands are overlaid.
+		bool bands;
+
+		// The volume heatmap is underlaid.
+		bool heatmap;
+
+		bool operator<(const Key& other) const
+		{
+			return tie(symbol, timeframe, zoom, index, bands, heatmap) <
+				tie(other.symbol, other.timeframe, other.zoom, other.index, other.bands, other.heatmap);
+		}
+	};
+
+private :
+
+	struct Entry
+	{
+		cairo_surface_t* surface;
+
+		// The price range of the tile rows.
+		double minval, maxval;
+
+		// Volumes of the heatmap by the candles and the pixel rows, kept for the profile.
+		vector<float> volumes;
+
+		size_t size;
+		list<Key>::iterator lru;
+	};
+
+	struct Job
+	{
+		Key key;
+		const Symbol* symbol;
+	};
+
+	// Limit of the queued tiles, so that the tiles scrolled away
+	// long ago are dropped rather than rendered.
+	static const size_t MAX_JOBS = 64;
+
+	mutex cacheMutex;
+	condition_variable jobsAvailable;
+
+	map<Key, Entry> entries;
+	list<Key> lru;
+	size_t size, capacity;
+
+	deque<Job> jobs;
+	set<Key> queued;
+	bool stopping;
+
+	// Incremented by the invalidation, to drop the tiles being rendered meanwhile.
+	uint64_t generation;
+
+	// An idle callback has been already scheduled to redraw the widgets.
+	bool redrawScheduled;
+
+	// Widgets to redraw, once new tiles are rendered. Accessed on the main thread only.
+	set<GtkWidget*> widgets;
+
+	vector<thread> workers;
+
+	static gboolean onRendered(gpointer data)
+	{
+		TileCache* cache = (TileCache*)data;
+
+		{
+			lock_guard<mutex> lock(cache->cacheMutex);
+			cache->redrawScheduled = false;
+		}
+		for (set<GtkWidget*>::iterator i = cache->widgets.begin(), e = cache->widgets.end(); i != e; i++)
+			gtk_widget_queue_draw(*i);
+
+		return G_SOURCE_REMOVE;
+	}
+
+	// Bin the volumes of the tile candles by the pixel rows of their prices,
+	// over the stored ticks and then over the live ones.
+	static void getHeatmap(const Job& job, int64_t startTime, size_t szcandles, double minval, double maxval,
+		vector<float>& volumes)
+	{
+		const Key& key = job.key;
+		const Symbol& symbol = *job.symbol;
+		const int64_t endTime = startTime + szcandles * key.timeframe;
+
+		// The stored ticks are binned without holding the tails, not to stall the live updates.
+		const profile::Tick* ticks = symbol.ticks.getTicks();
+		const size_t from = profile::find(ticks, symbol.ticks.size(), startTime);
+		const size_t to = profile::find(ticks, symbol.ticks.size(), endTime);
+		profile::getHeatmap(ticks + from, to - from, startTime, key.timeframe, szcandles,
+			minval, maxval, TILE_HEIGHT, volumes);
+
+		vector<float> live;
+		{
+			lock_guard<mutex> lock(symbol.tailsMutex);
+			const vector<profile::Tick>& ticks = symbol.liveTicks;
+			if (ticks.empty()) return;
+
+			const size_t from = profile::find(&ticks[0], ticks.size(), startTime);
+			const size_t to = profile::find(&ticks[0], ticks.size(), endTime);
+			if (from == to) return;
+
+			profile::getHeatmap(&ticks[from], to - from, startTime, key.timeframe, szcandles,
+				minval, maxval, TILE_HEIGHT, live);
+		}
+		for (size_t i = 0; i < volumes.size(); i++)
+			volumes[i] += live[i];
+	}
+
+	// Render the tile over the price range of its candles and bands, transparent,
+	// to be composited over the background of the view.
+	static cairo_surface_t* render(const Job& job, double& minval, double& maxval, vector<float>& volumes)
+	{
+		const Key& key = job.key;
+
+		int64_t startTime;
+		size_t first, szcandles, from = 0, to = 0;
+		vector<double> values;
+		{
+			lock_guard<mutex> lock(job.symbol->tailsMutex);
+			Candles candles = getCandles(*job.symbol, key.timeframe);
+
+			first = key.index * TILE_CANDLES;
+			szcandles = (first < candles.size()) ? min((size_t)TILE_CANDLES, candles.size() - first) : 0;
+			startTime = getStartTime(*job.symbol, key.timeframe) + (int64_t)first * key.timeframe;
+			ChartDrawer::getRange(candles, first, szcandles, minval, maxval);
+
+			if (key.bands && szcandles)
+			{
+				// Take the neighbour candles too, to join the lines across the tiles.
+				from = first ? first - 1 : 0;
+				to = min(candles.size(), first + szcandles + 1);
+				overlays.get(key.symbol, key.timeframe, bandsParameters, candles, from, to - from, values);
+				for (size_t k = 0; k < values.size(); k++)
+					if (!std::isnan(values[k]))
+					{
+						minval = fmin(minval, values[k]);
+						maxval = fmax(maxval, values[k]);
+					}
+			}
+		}
+		alignRange(minval, maxval);
+
+		Viewport viewport(TILE_CANDLES * key.zoom, TILE_HEIGHT);
+		cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, viewport.width, viewport.height);
+		cairo_t* cr = cairo_create(surface);
+
+		ChartDrawer chartDrawer(viewport);
+
+		// The heatmap is written into the pixels of the tile at once, under the candles.
+		if (key.heatmap)
+			getHeatmap(job, startTime, szcandles, minval, maxval, volumes);
+		if (volumes.size())
+		{
+			cairo_surface_flush(surface);
+			profile::renderHeatmap(&volumes[0], volumes.size() / TILE_HEIGHT, TILE_HEIGHT, key.zoom,
+				cairo_image_surface_get_data(surface), cairo_image_surface_get_stride(surface));
+			cairo_surface_mark_dirty(surface);
+		}
+
+		{
+			lock_guard<mutex> lock(job.symbol->tailsMutex);
+			Candles candles = getCandles(*job.symbol, key.timeframe);
+
+			szcandles = (first < candles.size()) ? min(szcandles, candles.size() - first) : 0;
+			chartDrawer.drawCandles(cr, candles, first, szcandles, minval, maxval, key.zoom);
+		}
+		for (int k = 0; k < 3 && values.size(); k++)
+			chartDrawer.drawOverlay(cr, &values[k * (to - from)], (int64_t)from - (int64_t)first, to - from,
+				minval, maxval, key.zoom);
+
+		cairo_destroy(cr);
+		cairo_surface_flush(surface);
+
+		return surface;
+	}
+
+	void run()
+	{
+		unique_lock<mutex> lock(cacheMutex);
+		while (1)
+		{
+			jobsAvailable.wait(lock, [this]() { return stopping || jobs.size(); });
+			if (stopping) break;
+			
+			Job job = jobs.front();
+			jobs.pop_front();
+
+			const uint64_t started = generation;
+			lock.unlock();
+			vector<float> volumes;
+			double minval, maxval;
+			cairo_surface_t* surface = render(job, minval, maxval, volumes);
+			lock.lock();
+
+			queued.erase(job.key);
+
+			if (started != generation)
+				cairo_surface_destroy(surface);
+			else
+			{
+				lru.push_front(job.key);
+				Entry& entry = entries[job.key];
+				entry.surface = surface;
+				entry.minval = minval;
+				entry.maxval = maxval;
+				entry.volumes.swap(volumes);
+				entry.size = (size_t)cairo_image_surface_get_width(surface) * cairo_image_surface_get_height(surface) * 4 +
+					entry.volumes.size() * sizeof(float);
+				entry.lru = lru.begin();
+				size += entry.size;
+
+				while ((size > capacity) && (lru.size() > 1))
+				{
+					map<Key, Entry>::iterator evicted = entries.find(lru.back());
+					size -= evicted->second.size;
+					cairo_surface_destroy(evicted->second.surface);
+					entries.erase(evicted);
+					lru.pop_back();
+				}
+			}
+			
+			if (!redrawScheduled)
+			{
+				redrawScheduled = true;
+				gdk_threads_add_idle(onRendered, this);
+			}
+		}
+	}
+
+	void enqueue(const Key& key, const Symbol& symbol, bool visible)
+	{
+		if (queued.count(key)) return;
+
+		Job job;
+		job.key = key;
+		job.symbol = &symbol;
+		if (visible)
+			jobs.push_front(job);
+		else
+			jobs.push_back(job);
+		queued.insert(key);
+
+		if (jobs.size() > MAX_JOBS)
+		{
+			queued.erase(jobs.back().key);
+			jobs.pop_back();
+		}
+
+		jobsAvailable.notify_one();
+	}
+
+public :
+
+	// Get the tile surface, to be released with cairo_surface_destroy(), and the price
+	// range of its rows, or NULL, if the tile is not rendered yet: then it is queued for rendering.
+	cairo_surface_t* get(const Key& key, const Symbol& symbol, double& minval, double& maxval)
+	{
+		lock_guard<mutex> lock(cacheMutex);
+
+		map<Key, Entry>::iterator i = entries.find(key);
+		if (i == entries.end())
+		{
+			enqueue(key, symbol, true);
+			return NULL;
+		}
+
+		lru.splice(lru.begin(), lru, i->second.lru);
+		minval = i->second.minval;
+		maxval = i->second.maxval;
+		return cairo_surface_reference(i->second.surface);
+	}
+
+	// Add the volumes by price of the candles of the rendered heatmap tile into
+	// the volumes over the given price range; false, if the tile is not rendered yet.
+	bool addProfile(const Key& key, size_t first, size_t szcandles, double minval, double maxval, vector<double>& volumes)
+	{
+		lock_guard<mutex> lock(cacheMutex);
+
+		map<Key, Entry>::iterator i = entries.find(key);
+		if (i == entries.end()) return false;
+
+		const Entry& entry = i->second;
+		const vector<float>& heatmap = entry.volumes;
+		const size_t ncolumns = heatmap.size() / TILE_HEIGHT;
+		if (first >= ncolumns) return true;
+
+		profile::addProfile(&heatmap[first * TILE_HEIGHT], min(szcandles, ncolumns - first), TILE_HEIGHT,
+			entry.minval, entry.maxval, minval, maxval, volumes);
+		return true;
+	}
+
+	// Queue the tile for rendering ahead of time, if it is not cached.
+	void prefetch(const Key& key, const Symbol& symbol)
+	{
+		lock_guard<mutex> lock(cacheMutex);
+
+		if (entries.count(key)) return;
+
+		enqueue(key, symbol, false);
+	}
+
+	// Drop the tiles of the symbol timeframe from the given tile index on,
+	// as their candles have been updated.
+	void invalidate(const string& symbol, int64_t timeframe, int64_t index)
+	{
+		lock_guard<mutex> lock(cacheMutex);
+
+		generation++;
+		for (map<Key, Entry>::iterator i = entries.begin(); i != entries.end(); )
+		{
+			const Key& key = i->first;
+			if ((key.symbol != symbol) || (key.timeframe != timeframe) || (key.index < index))
+			{
+				i++;
+				continue;
+			}
+
+			size -= i->second.size;
+			cairo_surface_destroy(i->second.surface);
+			lru.erase(i->second.lru);
+			entries.erase(i++);
+		}
+	}
+
+	void attach(GtkWidget* widget) { widgets.insert(widget); }
+
+	void detach(GtkWidget* widget) { widgets.erase(widget); }
+
+	TileCache(size_t capacity_ = 128 * 1024 * 1024, int nworkers = 2) :
+		size(0), capacity(capacity_), stopping(false), generation(0), redrawScheduled(false)
+	{
+		for (int i = 0; i < nworkers; i++)
+			workers.push_back(thread(&TileCache::run, this));
+	}
+
+	~TileCache()
+	{
+		{
+			lock_guard<mutex> lock(cacheMutex);
+			stopping = true;
+		}
+		jobsAvailable.notify_all();
+		for (int i = 0; i < workers.size(); i++)
+			workers[i].join();
+
+		for (map<Key, Entry>::iterator i = entries.begin(), e = entries.end(); i != e; i++)
+			cairo_surface_destroy(i->second.surface);
+	}
+};
+
+// Select the timeframe by the number key, from 1min to 1day.
+static bool getTimeframe(const GdkEventKey* event, int64_t& timeframe)
+{
+	const vector<int64_t>& timeframes = getTimeframes();
+	if ((event->keyval < GDK_KEY_1) || (event->keyval >= GDK_KEY_1 + timeframes.size()))
+		return false;
+
+	timeframe = timeframes[event->keyval - GDK_KEY_1];
+
+	return true;
+}
+
+class ChartObject
+{
+	const string name;
+	const Symbol& symbol;
+	TileCache& tileCache;
+	GtkWidget* widget;
+	int64_t timeframe;
+	bool isScrolling;
+	gdouble start;
+
+	// Scroll offset of the right edge from the newest candle, in pixels.
+	int64_t offset;
+
+	// Candle width in pixels.
+	uint32_t zoom;
+
+	// Scroll direction of the last motion: 1 into the history, -1 back.
+	int direction;
+
+	// The left edge and the price range of the last drawn view.
+	int64_t left;
+	double minval, maxval;
+
+	// The Bollinger bands are overlaid, toggled by the B key.
+	bool bands;
+
+	// The volume heatmap is underlaid with the volume profile
+	// of the visible candles, toggled by the H key.
+	bool heatmap;
+
+	// Width of the volume profile at most.
+	static const int PROFILE_WIDTH = 160;
+
+	// Number of tiles to prefetch in the scroll direction.
+	static const int PREFETCH_TILES = 4;
+
+	// Charts to be updated in live mode.
+	static set<ChartObject*> charts;
+
+	// Get the left edge and the price range of the view for the current offset,
+	// returning the number of candles.
+	size_t getView(int64_t width, int64_t& left, double& minval, double& maxval)
+	{
+		lock_guard<mutex> lock(symbol.tailsMutex);
+		Candles candles = getCandles(symbol, timeframe);
+		const size_t szcandles = candles.size();
+
+		// Do not allow offset to shrink the last right-most visible candles window.
+		const int64_t length = szcandles * zoom;
+		offset = max((int64_t)0, min(offset, length - width));
+		left = max((int64_t)0, length - offset - width);
+
+		// The price range of the visible candles.
+		const size_t first = left / zoom;
+		const size_t last = min(szcandles, (size_t)((left + width + zoom - 1) / zoom));
+		ChartDrawer::getRange(candles, first, last - first, minval, maxval);
+		alignRange(minval, maxval);
+
+		return szcandles;
+	}
+
+	// Draw the volume profile of the visible candles at the right edge, summed over the
+	// heatmaps of the visible tiles, as a single image. The profile is drawn only once
+	// all the visible tiles are rendered, not to show the partial volumes: the tiles
+	// redraw the chart, as they are.
+	void drawProfile(cairo_t* cr, TileCache::Key key, int64_t firstTile, int64_t lastTile, int width, int height)
+	{
+		const int64_t tileWidth = TileCache::TILE_CANDLES * zoom;
+		vector<double> volumes(height);
+		for (int64_t i = firstTile; i < lastTile; i++)
+		{
+			key.index = i;
+
+			const int64_t from = max(left, i * tileWidth), to = min(left + width, (i + 1) * tileWidth);
+			const size_t first = (from - i * tileWidth) / zoom;
+			const size_t last = (to - i * tileWidth + zoom - 1) / zoom;
+			if (!tileCache.addProfile(key, first, last - first, minval, maxval, volumes))
+				return;
+		}
+
+		const int profileWidth = min(PROFILE_WIDTH, width / 4);
+		if (profileWidth <= 0) return;
+
+		cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, profileWidth, height);
+		cairo_surface_flush(surface);
+		profile::renderProfile(volumes, profileWidth,
+			cairo_image_surface_get_data(surface), cairo_image_surface_get_stride(surface));
+		cairo_surface_mark_dirty(surface);
+
+		cairo_set_source_surface(cr, surface, width - profileWidth, 0);
+		cairo_paint(cr);
+		cairo_surface_destroy(surface);
+	}
+
+	static gboolean onDraw(GtkWidget* widget, cairo_t* cr, gpointer data)
+	{
+		ChartObject* chart = (ChartObject*)data;
+
+		guint width = gtk_widget_get_allocated_width(widget);
+		guint height = gtk_widget_get_allocated_height(widget);
+		Viewport viewport(width, height);
+
+		ChartDrawer chartDrawer(viewport);
+		chartDrawer.drawBackground(cr);
+
+		int64_t left;
+		double minval, maxval;
+		const size_t szcandles = chart->getView(width, left, minval, maxval);
+		chart->left = left;
+		chart->minval = minval;
+		chart->maxval = maxval;
+
+		const int64_t zoom = chart->zoom;
+
+		TileCache::Key key;
+		key.symbol = chart->name;
+		key.timeframe = chart->timeframe;
+		key.zoom = zoom;
+		key.bands = chart->bands;
+		key.heatmap = chart->heatmap;
+
+		const int64_t tileWidth = TileCache::TILE_CANDLES * zoom;
+		const int64_t ntiles = (szcandles + TileCache::TILE_CANDLES - 1) / TileCache::TILE_CANDLES;
+		const int64_t firstTile = left / tileWidth;
+		const int64_t lastTile = min(ntiles, (left + width + tileWidth - 1) / tileWidth);
+		const double scale = height / (maxval - minval);
+		for (int64_t i = firstTile; i < lastTile; i++)
+		{
+			key.index = i;
+			double tileMin, tileMax;
+			cairo_surface_t* surface = chart->tileCache.get(key, chart->symbol, tileMin, tileMax);
+			if (!surface) continue;
+
+			// The price range of the tile is mapped onto the one of the view.
+			cairo_save(cr);
+			cairo_rectangle(cr, i * tileWidth - left, 0, tileWidth, height);
+			cairo_clip(cr);
+			cairo_translate(cr, i * tileWidth - left, (maxval - tileMax) * scale);
+			cairo_scale(cr, 1, (tileMax - tileMin) * scale / TileCache::TILE_HEIGHT);
+			cairo_set_source_surface(cr, surface, 0, 0);
+			cairo_paint(cr);
+			cairo_restore(cr);
+			cairo_surface_destroy(surface);
+		}
+
+		if (chart->heatmap)
+			chart->drawProfile(cr, key, firstTile, lastTile, width, height);
+
+		// Older tiles are to the left, newer tiles are to the right.
+		for (int i = 1; i <= PREFETCH_TILES; i++)
+		{
+			key.index = (chart->direction > 0) ? firstTile - i : lastTile - 1 + i;
+			if ((key.index < 0) || (key.index >= ntiles)) break;
+			
+			chart->tileCache.prefetch(key, chart->symbol);
+		}
+
+		chartDrawer.drawFrame(cr);
+
+		return FALSE;
+	}
+
+	static gboolean onMouse(GtkWidget *widget, GdkEventButton* event, gpointer data)
+	{
+		if (event->button == 1)
+		{
+			ChartObject* chart = (ChartObject*)data;
+
+			if (event->type == GDK_BUTTON_PRESS)		
+			{
+				chart->isScrolling = true;
+				chart->start = event->x;
+			}
+			else if (event->type = GDK_BUTTON_RELEASE)
+			{
+				chart->isScrolling = false;
+			}
+		}
+		
+		return TRUE;
+	}
+
+	// Zoom by the mouse wheel, keeping the right edge in place.
+	static gboolean onScroll(GtkWidget *widget, GdkEventScroll* event, gpointer data)
+	{
+		ChartObject* chart = (ChartObject*)data;
+
+		uint32_t zoom = chart->zoom;
+		if (event->direction == GDK_SCROLL_UP)
+			zoom = min(zoom + 1, 40u);
+		else if (event->direction == GDK_SCROLL_DOWN)
+			zoom = max(zoom - 1, 2u);
+		else
+			return FALSE;
+		
+		chart->offset = chart->offset * zoom / chart->zoom;
+		chart->zoom = zoom;
+		gtk_widget_queue_draw(widget);
+
+		return TRUE;
+	}
+
+	// Switch the timeframe by the number keys, from 1min to 1day,
+	// and the overlays by the letter keys.
+	static gboolean onKey(GtkWidget *widget, GdkEventKey* event, gpointer data)
+	{
+		ChartObject* chart = (ChartObject*)data;
+
+		if ((event->keyval == GDK_KEY_b) || (event->keyval == GDK_KEY_B))
+		{
+			chart->bands = !chart->bands;
+			gtk_widget_queue_draw(chart->widget);
+
+			return TRUE;
+		}
+
+		if ((event->keyval == GDK_KEY_h) || (event->keyval == GDK_KEY_H))
+		{
+			chart->heatmap = !chart->heatmap;
+			gtk_widget_queue_draw(chart->widget);
+
+			return TRUE;
+		}
+
+		if (!getTimeframe(event, chart->timeframe))
+			return FALSE;
+
+		chart->offset = 0;
+		gtk_widget_queue_draw(chart->widget);
+
+		return TRUE;
+	}
+
+	static gboolean onMove(GtkWidget *widget, GdkEventMotion* event, gpointer data)
+	{
+		ChartObject* chart = (ChartObject*)data;
+		
+		if (chart->isScrolling)
+		{
+			const int64_t delta = event->x - chart->start;
+			if (delta == 0) return TRUE;
+			
+			chart->offset = max((int64_t)0, chart->offset + delta);
+			chart->direction = (delta > 0) ? 1 : -1;
+				
+			chart->start = event->x;		
+			gtk_widget_queue_draw(widget);
+		}
+	
+		return TRUE;
+	}
+
+	static void onDestroy(GtkWidget* window, gpointer data)
+	{
+		delete (ChartObject*)data;
+	}
 	
-	OHLC() : open(HUGE_VAL), high(-HUGE_VAL), low(HUGE_VAL) { }
+public :
+
+	static const set<ChartObject*>& getCharts() { return charts; }
+
+	// Invalidate the area of the updated candles, from the given index on,
+	// or the whole chart, if the view has to be moved or rescaled.
+	void update(const Symbol& updated, int64_t timeframe_, size_t first, size_t added)
+	{
+		if ((&updated != &symbol) || (timeframe_ != timeframe)) return;
+
+		// Keep the view scrolled into the history in place.
+		if (offset > 0)
+			offset += added * zoom;
+
+		const int width = gtk_widget_get_allocated_width(widget);
+		const int height = gtk_widget_get_allocated_height(widget);
+
+		int64_t left;
+		double minval, maxval;
+		getView(width, left, minval, maxval);
+		if ((left != this->left) || (minval != this->minval) || (maxval != this->maxval))
+		{
+			gtk_widget_queue_draw(widget);
+			return;
+		}
+
+		const int64_t x = max((int64_t)0, (int64_t)first * zoom - left);
+		if (x < width)
+			gtk_widget_queue_draw_area(widget, x, 0, width - x, height);
+	}
+
+	ChartObject(GtkWidget* window, const string& name_, const Symbol& symbol_, TileCache& tileCache_) :
+		name(name_), symbol(symbol_), tileCache(tileCache_), timeframe(30 * 60 * 1000),
+		isScrolling(false), offset(0), zoom(CandleDrawer::CANDLE_WIDTH), direction(1), left(0), minval(0), maxval(0), bands(false), heatmap(false)
+	{
+		charts.insert(this);
+
+		GtkWidget* drawing_area = gtk_drawing_area_new();
+		widget = drawing_area;
+		gtk_container_add(GTK_CONTAINER(window), drawing_area);
+		gtk_widget_set_size_request(drawing_area, 800, 600);
+		tileCache.attach(widget);
+
+		gtk_widget_set_events(GTK_WIDGET(drawing_area), GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_POINTER_MOTION_MASK | GDK_SCROLL_MASK);
+		g_signal_connect(G_OBJECT(drawing_area), "draw", G_CALLBACK(ChartObject::onDraw), this);
+		g_signal_connect(G_OBJECT(drawing_area), "button_press_event", G_CALLBACK(ChartObject::onMouse), this);
+		g_signal_connect(G_OBJECT(drawing_area), "button_release_event", G_CALLBACK(ChartObject::onMouse), this);
+		g_signal_connect(G_OBJECT(drawing_area), "motion_notify_event", G_CALLBACK(ChartObject::onMove), this);
+		g_signal_connect(G_OBJECT(drawing_area), "scroll_event", G_CALLBACK(ChartObject::onScroll), this);
+		g_signal_connect(G_OBJECT(window), "key_press_event", G_CALLBACK(ChartObject::onKey), this);
+		g_signal_connect(G_OBJECT(window), "destroy", G_CALLBACK(ChartObject::onDestroy), this);
+	}
+
+	~ChartObject()
+	{
+		tileCache.detach(widget);
+		charts.erase(this);
+	}
+};
+
+set<ChartObject*> ChartObject::charts;
+
+// Renders the mini-charts of the dashboard on the worker threads into
+// image surfaces, which are only composited on the GTK main thread.
+class TileRenderer
+{
+public :
+
+	struct Tile
+	{
+		string name;
+		const Symbol* symbol;
+
+		// The rendered surface and the parameters it has been rendered with.
+		cairo_surface_t* surface;
+		int width, height;
+		int64_t timeframe, watermark;
+
+		// The tile is waiting for the worker threads.
+		bool queued;
+		
+		Tile(const string& name_, const Symbol* symbol_) : name(name_), symbol(symbol_), surface(NULL),
+			width(0), height(0), timeframe(0), watermark(0), queued(false) { }
+	};
+
+private :
+
+	struct Job
+	{
+		Tile* tile;
+		int width, height;
+		int64_t timeframe;
+	};
+
+	GtkWidget* widget;
+
+	mutex tilesMutex;
+	condition_variable jobsAvailable;
+	deque<Job> jobs;
+	bool stopping;
+
+	// An idle callback has been already scheduled to redraw the widget.
+	bool redrawScheduled;
+
+	vector<thread> workers;
+
+	static gboolean onRendered(gpointer data)
+	{
+		TileRenderer* renderer = (TileRenderer*)data;
+
+		{
+			lock_guard<mutex> lock(renderer->tilesMutex);
+			renderer->redrawScheduled = false;
+		}
+		gtk_widget_queue_draw(renderer->widget);
+
+		return G_SOURCE_REMOVE;
+	}
+
+	static cairo_surface_t* render(const Job& job, int64_t& watermark)
+	{
+		cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, job.width, job.height);
+		cairo_t* cr = cairo_create(surface);
+
+		Viewport viewport(job.width, job.height);
+		ChartDrawer chartDrawer(viewport);
+		{
+			lock_guard<mutex> lock(job.tile->symbol->tailsMutex);
+			Candles candles = getCandles(*job.tile->symbol, job.timeframe);
+			watermark = candles.watermark;
+
+			size_t position = 0;
+			chartDrawer.draw(cr, position, candles);
+		}
+		chartDrawer.drawTitle(cr, job.tile->name);
+
+		cairo_destroy(cr);
+		cairo_surface_flush(surface);
+
+		return surface;
+	}
+
+	void run()
+	{
+		unique_lock<mutex> lock(tilesMutex);
+		while (1)
+		{
+			jobsAvailable.wait(lock, [this]() { return stopping || jobs.size(); });
+			if (stopping) break;
+			
+			Job job = jobs.front();
+			jobs.pop_front();
+
+			lock.unlock();
+			int64_t watermark;
+			cairo_surface_t* surface = render(job, watermark);
+			lock.lock();
+
+			Tile& tile = *job.tile;
+			if (tile.surface)
+				cairo_surface_destroy(tile.surface);
+			tile.surface = surface;
+			tile.width = job.width;
+			tile.height = job.height;
+			tile.timeframe = job.timeframe;
+			tile.watermark = watermark;
+			tile.queued = false;
+			
+			if (!redrawScheduled)
+			{
+				redrawScheduled = true;
+				gdk_threads_add_idle(onRendered, this);
+			}
+		}
+	}
+
+public :
+
+	// Composite the tile, if it is rendered, and queue its rendering, if the
+	// rendered surface is missing or outdated. Called on the main thread.
+	void draw(cairo_t* cr, Tile& tile, int x, int y, int width, int height, int64_t timeframe)
+	{
+		lock_guard<mutex> lock(tilesMutex);
+		
+		if (tile.surface)
+		{
+			cairo_set_source_surface(cr, tile.surface, x, y);
+			cairo_rectangle(cr, x, y, min(width, tile.width), min(height, tile.height));
+			cairo_fill(cr);
+		}
+
+		if (tile.queued) return;
+
+		int64_t watermark;
+		{
+			lock_guard<mutex> lock(tile.symbol->tailsMutex);
+			watermark = getCandles(*tile.symbol, timeframe).watermark;
+		}
+		if (tile.surface && (tile.width == width) && (tile.height == height) &&
+			(tile.timeframe == timeframe) && (tile.watermark == watermark))
+			return;
+		
+		Job job;
+		job.tile = &tile;
+		job.width = width;
+		job.height = height;
+		job.timeframe = timeframe;
+		jobs.push_back(job);
+		tile.queued = true;
+
+		jobsAvailable.notify_one();
+	}
+
+	TileRenderer(GtkWidget* widget_) : widget(widget_), stopping(false), redrawScheduled(false)
+	{
+		int nworkers = max(1u, thread::hardware_concurrency());
+		for (int i = 0; i < nworkers; i++)
+			workers.push_back(thread(&TileRenderer::run, this));
+	}
+
+	// Stop the worker threads, before the tiles are released.
+	void stop()
+	{
+		{
+			lock_guard<mutex> lock(tilesMutex);
+			stopping = true;
+		}
+		jobsAvailable.notify_all();
+		for (int i = 0; i < workers.size(); i++)
+			workers[i].join();
+		workers.clear();
+	}
+
+	~TileRenderer()
+	{
+		stop();
+	}
 };
 
-struct Viewport
+// Grid of mini-charts for all loaded symbols. Click on the mini-chart
+// opens the full chart of the symbol.
+class DashboardObject
 {
-	uint32_t width, height;
+	static const int TILE_WIDTH = 240;
+	static const int TILE_HEIGHT = 160;
 	
-	Viewport(uint32_t width_, uint32_t height_) : width(width_), height(height_) { }
+	GtkWidget* widget;
+	int64_t timeframe;
+	
+	vector<TileRenderer::Tile> tiles;
+	TileRenderer renderer;
+
+	// Tiles of the full charts opened from the dashboard.
+	TileCache tileCache;
+	
+	int getColumns() const
+	{
+		return max(1, gtk_widget_get_allocated_width(widget) / TILE_WIDTH);
+	}
+
+	static gboolean onDraw(GtkWidget* widget, cairo_t* cr, gpointer data)
+	{
+		DashboardObject* dashboard = (DashboardObject*)data;
+
+		const int ncolumns = dashboard->getColumns();
+		const int width = gtk_widget_get_allocated_width(widget) / ncolumns;
+
+		// Only the tiles in the exposed area are composited and rendered.
+		double left, top, right, bottom;
+		cairo_clip_extents(cr, &left, &top, &right, &bottom);
+
+		for (int i = 0; i < dashboard->tiles.size(); i++)
+		{
+			const int x = (i % ncolumns) * width, y = (i / ncolumns) * TILE_HEIGHT;
+			if ((x + width <= left) || (x >= right) || (y + TILE_HEIGHT <= top) || (y >= bottom))
+				continue;
+			
+			dashboard->renderer.draw(cr, dashboard->tiles[i], x, y, width, TILE_HEIGHT, dashboard->timeframe);
+		}
+
+		return FALSE;
+	}
+
+	static void onResize(GtkWidget* widget, GdkRectangle* allocation, gpointer data)
+	{
+		DashboardObject* dashboard = (DashboardObject*)data;
+		
+		const int ncolumns = dashboard->getColumns();
+		const int nrows = (dashboard->tiles.size() + ncolumns - 1) / ncolumns;
+		gtk_widget_set_size_request(widget, TILE_WIDTH, nrows * TILE_HEIGHT);
+	}
+
+	static gboolean onMouse(GtkWidget* widget, GdkEventButton* event, gpointer data)
+	{
+		DashboardObject* dashboard = (DashboardObject*)data;
+
+		if ((event->button != 1) || (event->type != GDK_BUTTON_PRESS))
+			return FALSE;
+		
+		const int ncolumns = dashboard->getColumns();
+		const int width = gtk_widget_get_allocated_width(widget) / ncolumns;
+		const int column = event->x / width, row = event->y / TILE_HEIGHT;
+		const int i = row * ncolumns + column;
+		if ((column >= ncolumns) || (i >= dashboard->tiles.size()))
+			return FALSE;
+		
+		const TileRenderer::Tile& tile = dashboard->tiles[i];
+
+		GtkWidget* window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+		gtk_window_set_title(GTK_WINDOW(window), tile.name.c_str());
+		gtk_window_set_icon_name(GTK_WINDOW(window), "binance");
+
+		// Deleted along with the window.
+		new ChartObject(window, tile.name, *tile.symbol, dashboard->tileCache);
+
+		gtk_widget_show_all(window);
+
+		return TRUE;
+	}
+
+	// Switch the timeframe by the number keys, from 1min to 1day.
+	static gboolean onKey(GtkWidget* widget, GdkEventKey* event, gpointer data)
+	{
+		DashboardObject* dashboard = (DashboardObject*)data;
+
+		if (!getTimeframe(event, dashboard->timeframe))
+			return FALSE;
+
+		gtk_widget_queue_draw(dashboard->widget);
+
+		return TRUE;
+	}
+
+	static GtkWidget* createWidget(GtkWidget* window)
+	{
+		GtkWidget* scrolled = gtk_scrolled_window_new(NULL, NULL);
+		gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+		gtk_container_add(GTK_CONTAINER(window), scrolled);
+		gtk_widget_set_size_request(scrolled, 4 * TILE_WIDTH, 4 * TILE_HEIGHT);
+
+		GtkWidget* drawing_area = gtk_drawing_area_new();
+		gtk_container_add(GTK_CONTAINER(scrolled), drawing_area);
+		
+		return drawing_area;
+	}
+	
+public :
+
+	DashboardObject(GtkWidget* window) : widget(createWidget(window)), timeframe(30 * 60 * 1000), renderer(widget)
+	{
+		for (map<string, Symbol>::const_iterator i = symbols.begin(), e = symbols.end(); i != e; i++)
+			tiles.push_back(TileRenderer::Tile(i->first, &i->second));
+
+		gtk_widget_set_events(GTK_WIDGET(widget), GDK_BUTTON_PRESS_MASK);
+		g_signal_connect(G_OBJECT(widget), "draw", G_CALLBACK(DashboardObject::onDraw), this);
+		g_signal_connect(G_OBJECT(widget), "size-allocate", G_CALLBACK(DashboardObject::onResize), this);
+		g_signal_connect(G_OBJECT(widget), "button_press_event", G_CALLBACK(DashboardObject::onMouse), this);
+		g_signal_connect(G_OBJECT(window), "key_press_event", G_CALLBACK(DashboardObject::onKey), this);
+	}
+	
+	// Redraw the mini-chart of the updated symbol timeframe, drop the outdated
+	// tiles of the full charts and invalidate the updated area of the full charts.
+	void update(const string& name, const Symbol& symbol, int64_t timeframe, size_t first, size_t added)
+	{
+		tileCache.invalidate(name, timeframe, first / TileCache::TILE_CANDLES);
+
+		for (set<ChartObject*>::const_iterator i = ChartObject::getCharts().begin(),
+			e = ChartObject::getCharts().end(); i != e; i++)
+			(*i)->update(symbol, timeframe, first, added);
+
+		if (timeframe != this->timeframe) return;
+
+		const int ncolumns = getColumns();
+		const int width = gtk_widget_get_allocated_width(widget) / ncolumns;
+		for (int i = 0; i < tiles.size(); i++)
+		{
+			if (tiles[i].symbol != &symbol) continue;
+
+			gtk_widget_queue_draw_area(widget, (i % ncolumns) * width, (i / ncolumns) * TILE_HEIGHT, width, TILE_HEIGHT);
+			break;
+		}
+	}
+
+	~DashboardObject()
+	{
+		renderer.stop();
+
+		for (int i = 0; i < tiles.size(); i++)
+			if (tiles[i].surface)
+				cairo_surface_destroy(tiles[i].surface);
+	}
 };
 
-struct Symbol
+class Archive
 {
-	map<string, vector<OHLC> > candles;
-	long startTime;
-	size_t maxSecond;
+	archive* a;
+	bool isOpen;
+
+public :
+
+	bool is_open() const { return isOpen; }
+
+	bool readNextHeader()
+	{
+		struct archive_entry *entry;
+		int r = archive_read_next_header(a, &entry);
+		cout << "Found entry " << archive_entry_pathname(entry) << endl;
+		return (r == ARCHIVE_OK);
+	}
+
+	ssize_t readData(char* buffer, size_t szbuffer)
+	{
+		return archive_read_data(a, buffer, szbuffer);
+	}
+
+	Archive(const string& filename) : a(archive_read_new()), isOpen(false)
+	{
+		archive_read_support_format_tar(a);
+		archive_read_support_filter_bzip2(a); // TODO
+		int r = archive_read_open_filename(a, filename.c_str(), 16384);
+		isOpen = (r == ARCHIVE_OK);
+	}
+	
+	~Archive()
+	{
+		archive_read_free(a);
+	}
 };
 
-map<string, Symbol> symbols;
+// Follows the history file appended by bihistorian, and folds the new trades
+// into the live tails of the candles of all timeframes. Only the areas showing
+// the updated candles are redrawn. Once the file is caught up, the trades
+// are taken from the market data bus instead, if biingest is running.
+class LiveTail
+{
+	history::File file;
+	size_t nrecords;
+
+	DashboardObject& dashboard;
+
+	// Symbols by the history file dictionary ids, NULL for the symbols not shown.
+	vector<pair<const string*, Symbol*> > symbolsById;
+
+	vector<history::Trade> trades;
+
+	// Symbols of the trades in the batch, NULL for the symbols not shown.
+	vector<Symbol*> tradeSymbols;
+
+	// Subscribers of all bus groups, empty if the bus is not available,
+	// and the symbols by the bus ids, resolved on the first trade.
+	vector<unique_ptr<bus::Subscriber> > subscribers;
+	vector<pair<bool, Symbol*> > symbolsByBusId;
+	bool onBus;
+
+	// The newest folded trade id per symbol, to skip the trades
+	// of the bus already read from the file.
+	map<Symbol*, int64_t> lastIds;
+
+	// The history is read in batches, for at most the time slice per call,
+	// so that the catching up does not block the UI.
+	static const size_t szbatch = 64 * 1024;
+	static const int TIME_SLICE_MS = 20;
+	static const int POLL_INTERVAL_MS = 1000;
+
+	bool catchingUp;
+
+	// The update of the symbol timeframe tail in a batch.
+	struct Change
+	{
+		size_t first;
+		size_t size;
+	};
+
+	void resolveSymbols()
+	{
+		const history::SymbolDictionary& dictionary = file.getDictionary();
+		symbolsById.assign(dictionary.size(), pair<const string*, Symbol*>(NULL, NULL));
+		for (int i = 0; i < dictionary.size(); i++)
+		{
+			map<string, Symbol>::iterator symbol = symbols.find(dictionary.getName(i));
+			if (symbol == symbols.end()) continue;
+
+			symbolsById[i] = make_pair(&symbol->first, &symbol->second);
+		}
+	}
+
+	// Fold the trades of the batch into the tails of their symbols.
+	void fold()
+	{
+		const vector<int64_t>& timeframes = getTimeframes();
+		map<pair<Symbol*, int64_t>, Change> changes;
+		for (int i = 0; i < trades.size(); i++)
+		{
+			const history::Trade& trade = trades[i];
+
+			Symbol* symbol = tradeSymbols[i];
+			if (!symbol) continue;
+
+			int64_t& lastId = lastIds[symbol];
+			lastId = max(lastId, trade.id);
+
+			// Skip the trades already in the mapped candles.
+			if (trade.time <= symbol->candles[timeframes[0]].getWatermark()) continue;
+
+			lock_guard<mutex> lock(symbol->tailsMutex);
+			profile::Tick tick;
+			tick.time = trade.time;
+			tick.price = trade.price;
+			tick.qty = trade.qty;
+			symbol->liveTicks.push_back(tick);
+
+			for (int j = 0; j < timeframes.size(); j++)
+			{
+				const int64_t timeframe = timeframes[j];
+				Series& tail = symbol->tails[timeframe];
+
+				map<pair<Symbol*, int64_t>, Change>::iterator change = changes.find(make_pair(symbol, timeframe));
+				if (change == changes.end())
+				{
+					Change initial;
+					initial.first = tail.size();
+					initial.size = tail.size();
+					change = changes.insert(make_pair(make_pair(symbol, timeframe), initial)).first;
+				}
+
+				tail.add(trade.time, trade.price, trade.qty);
+
+				const size_t index = (trade.time - trade.time % timeframe - tail.getStartTime()) / timeframe;
+				change->second.first = min(change->second.first, index);
+			}
+		}
 
-class BinanceColorScheme
-{
-	GdkRGBA backgroundColor;
-	GdkRGBA gridColor;
-	GdkRGBA candleColor;
+		for (map<pair<Symbol*, int64_t>, Change>::iterator i = changes.begin(), e = changes.end(); i != e; i++)
+		{
+			Symbol& symbol = *i->first.first;
+			const int64_t timeframe = i->first.second;
 
-public :
+			size_t first, added;
+			{
+				lock_guard<mutex> lock(symbol.tailsMutex);
+				Candles candles = getCandles(symbol, timeframe);
+				first = candles.szmapped + i->second.first;
+				added = candles.sztail - i->second.size;
+			}
 
-	const GdkRGBA& getBackgroundColor() const { return backgroundColor; }
+			const string* name = NULL;
+			for (map<string, Symbol>::iterator j = symbols.begin(), je = symbols.end(); j != je; j++)
+				if (&j->second == &symbol)
+					name = &j->first;
 
-	const GdkRGBA& getGridColor() const { return gridColor; }
+			dashboard.update(*name, symbol, timeframe, first, added);
+		}
+	}
 
-	const GdkRGBA& getCandleColor() const { return candleColor; }
-	
-	BinanceColorScheme()
+	// Fold the next batch of trades, returning true, if there are more to read.
+	bool readBatch()
 	{
-		backgroundColor.red = 21 / 256.0;
-		backgroundColor.green = 26 / 256.0;
-		backgroundColor.blue = 29 / 256.0;
-		backgroundColor.alpha = 1.0;
+		const size_t count = file.getRecordsCount();
+		if (count <= nrecords) return false;
 
-		gridColor.red = 49 / 256.0;
-		gridColor.green = 58 / 256.0;
-		gridColor.blue = 66 / 256.0;
-		gridColor.alpha = 1.0;
+		trades.resize(min(count - nrecords, szbatch));
+		history::historyError_t status = file.read(nrecords, trades.size(), &trades[0]);
+		if (status != history::historySuccess)
+		{
+			fprintf(stderr, "Cannot read history file %s: %s\n", liveHistoryPath.c_str(),
+				history::historyGetErrorString(status));
+			return false;
+		}
+		nrecords += trades.size();
 
-		candleColor.red = 240 / 256.0;
-		candleColor.green = 184 / 256.0;
-		candleColor.blue = 12 / 256.0;
-		candleColor.alpha = 1.0;
-	}
-};
+		tradeSymbols.resize(trades.size());
+		for (int i = 0; i < trades.size(); i++)
+		{
+			const history::Trade& trade = trades[i];
 
-class AppliedParallelComputingColorScheme
-{
-	GdkRGBA backgroundColor;
-	GdkRGBA gridColor;
-	GdkRGBA candleColor;
+			// New symbols have been added to the dictionary since.
+			if (trade.symbol >= symbolsById.size())
+			{
+				file.close();
+				if (file.open() != history::historySuccess) return false;
+				resolveSymbols();
+			}
 
-public :
+			tradeSymbols[i] = (trade.symbol < symbolsById.size()) ? symbolsById[trade.symbol].second : NULL;
+		}
 
-	const GdkRGBA& getBackgroundColor() const { return backgroundColor; }
+		fold();
 
-	const GdkRGBA& getGridColor() const { return gridColor; }
+		return nrecords < count;
+	}
 
-	const GdkRGBA& getCandleColor() const { return candleColor; }
-	
-	AppliedParallelComputingColorScheme()
+	// Fold the next batch of trades published on the bus, returning true, if there are more to read.
+	bool readBus()
 	{
-		backgroundColor.red = 256 / 256.0;
-		backgroundColor.green = 256 / 256.0;
-		backgroundColor.blue = 256 / 256.0;
-		backgroundColor.alpha = 1.0;
+		trades.resize(szbatch);
+		tradeSymbols.resize(szbatch);
 
-		gridColor.red = 49 / 256.0;
-		gridColor.green = 58 / 256.0;
-		gridColor.blue = 66 / 256.0;
-		gridColor.alpha = 0.0625;
+		size_t count = 0;
+		for (int g = 0; (g < subscribers.size()) && (count < szbatch); g++)
+		{
+			bus::Subscriber& subscriber = *subscribers[g];
 
-		candleColor.red = 38 / 256.0;
-		candleColor.green = 73 / 256.0;
-		candleColor.blue = 158 / 256.0;
-		candleColor.alpha = 1.0;
-	}
-};
+			uint64_t nlost = 0;
+			const size_t n = subscriber.poll(&trades[count], szbatch - count, nlost);
+			if (nlost)
+				fprintf(stderr, "Bus group %d : %lu trades lost\n", g, (unsigned long)nlost);
 
-static AppliedParallelComputingColorScheme colorScheme;
+			for (size_t i = count; i < count + n; i++)
+			{
+				history::Trade& trade = trades[i];
 
-class CandleDrawer
-{
-	const Viewport& viewport;
+				pair<bool, Symbol*>& resolved = symbolsByBusId[trade.symbol];
+				if (!resolved.first)
+				{
+					map<string, Symbol>::iterator symbol = symbols.find(subscriber.getSymbol(trade.symbol));
+					resolved = make_pair(true, (symbol == symbols.end()) ? (Symbol*)NULL : &symbol->second);
+				}
 
-	void drawLine(cairo_t* cr, uint32_t position, uint32_t top, uint32_t bottom)
-	{
-		cairo_move_to(cr, position * CANDLE_WIDTH + CANDLE_WIDTH / 2, viewport.height - top);
-		cairo_line_to(cr, position * CANDLE_WIDTH + CANDLE_WIDTH / 2, viewport.height - bottom);
-		cairo_close_path(cr);
-		cairo_stroke(cr);
-	}
+				tradeSymbols[i] = resolved.second;
+				if (resolved.second && (trade.id <= lastIds[resolved.second]))
+					tradeSymbols[i] = NULL;
+			}
+			count += n;
+		}
 
-	void drawRectangle(cairo_t* cr, uint32_t position, uint32_t top, uint32_t bottom, bool filled)
-	{
-		cairo_rectangle(cr, position * CANDLE_WIDTH + 1, viewport.height - top, CANDLE_WIDTH - 2, top - bottom);
-		if (filled) 
-			cairo_fill(cr);
-		else
-			cairo_stroke(cr);
-	}
+		trades.resize(count);
+		tradeSymbols.resize(count);
+		if (!count) return false;
 
-public :
+		fold();
 
-	static const uint32_t CANDLE_WIDTH = 10;
-	
-	void draw(cairo_t* cr, uint32_t position, uint32_t open, uint32_t high, uint32_t low, uint32_t close)
+		return count == szbatch;
+	}
+
+	// Read the new trades for at most the time slice.
+	bool poll()
 	{
-		drawRectangle(cr, position, open, close, close > open);
+		gint64 deadline = g_get_monotonic_time() + TIME_SLICE_MS * 1000;
+		while (onBus ? readBus() : readBatch())
+			if (g_get_monotonic_time() > deadline)
+				return true;
 
-		if (open > close)
-		{
-			drawLine(cr, position, close, low);
-			drawLine(cr, position, high, open);
-		}
-		else
+		// The file is caught up, switch to the bus.
+		if (!onBus && subscribers.size())
 		{
-			drawLine(cr, position, open, low);
-			drawLine(cr, position, high, close);
+			cout << "Following the market data bus" << endl;
+			onBus = true;
 		}
-	}
-	
-	CandleDrawer(const Viewport& viewport_) : viewport(viewport_) { }
-};
-
-class ChartDrawer
-{
-	const Viewport& viewport;
 
-public :
+		return false;
+	}
 
-	void draw(cairo_t* cr, size_t& position, const vector<OHLC>& candles, size_t szcandles)
+	static gboolean onCatchUp(gpointer data)
 	{
-		GdkRGBA color = colorScheme.getBackgroundColor();
-		gdk_cairo_set_source_rgba(cr, &color);
+		LiveTail* live = (LiveTail*)data;
+
+		if (live->poll())
+			return G_SOURCE_CONTINUE;
 
-		cairo_rectangle(cr, 0, 0, viewport.width, viewport.height);
-		cairo_fill(cr);
+		live->catchingUp = false;
+		return G_SOURCE_REMOVE;
+	}
 
-		cairo_set_line_width (cr, 1);
-		color = colorScheme.getGridColor();
-		gdk_cairo_set_source_rgba(cr, &color);
+	static gboolean onTimer(gpointer data)
+	{
+		LiveTail* live = (LiveTail*)data;
 
-		const uint32_t ngridlines = 10;
-		uint32_t step = viewport.height / ngridlines;
-		for (uint32_t i = 0; i < ngridlines; i++)
+		if (!live->catchingUp && live->poll())
 		{
-			cairo_move_to(cr, 0, i * step);
-			cairo_line_to(cr, viewport.width, i * step);
-			cairo_close_path(cr);
-			cairo_stroke(cr);
+			live->catchingUp = true;
+			g_idle_add(onCatchUp, live);
 		}
 
-		color = colorScheme.getCandleColor();
-		gdk_cairo_set_source_rgba(cr, &color);
+		return G_SOURCE_CONTINUE;
+	}
 
-		uint32_t ncandles = viewport.width / CandleDrawer::CANDLE_WIDTH;
-		if (viewport.width % CandleDrawer::CANDLE_WIDTH) ncandles++;
+public :
 
-		CandleDrawer candleDrawer(viewport);
-		
-		// Do not allow position to shrink the last right-most visible candles window.
-		position = min(position, szcandles - ncandles);
+	LiveTail(DashboardObject& dashboard_) : file(liveHistoryPath), nrecords(0), dashboard(dashboard_),
+		symbolsByBusId(bus::maxSymbols, pair<bool, Symbol*>(false, NULL)), onBus(false), catchingUp(false) { }
 
-		double minval = HUGE_VAL, maxval = -HUGE_VAL;
-		for (uint32_t e = szcandles, i = e - ncandles; i < e; i++)
+	// Start following the history file.
+	bool start()
+	{
+		struct stat st;
+		if (stat(liveHistoryPath.c_str(), &st))
 		{
-			const OHLC& candle = candles[i - position];
+			fprintf(stderr, "Cannot find history file %s\n", liveHistoryPath.c_str());
+			return false;
+		}
 
-			if (!isfinite(candle.low)) continue;
-			if (!isfinite(candle.high)) continue;
-		
-			minval = fmin(minval, candle.low);
-			maxval = fmax(maxval, candle.high);
+		history::historyError_t status = file.open();
+		if (status != history::historySuccess)
+		{
+			fprintf(stderr, "Cannot open history file %s: %s\n", liveHistoryPath.c_str(),
+				history::historyGetErrorString(status));
+			return false;
+		}
+		resolveSymbols();
+
+		// Subscribe before the catch up, so that the trades published meanwhile are kept.
+		for (int g = 0; g < bus::defaultGroups; g++)
+		{
+			subscribers.push_back(unique_ptr<bus::Subscriber>(new bus::Subscriber(g)));
+			if (subscribers.back()->open() != bus::busSuccess)
+			{
+				subscribers.clear();
+				break;
+			}
 		}
-		
-		double scale = (maxval - minval) / viewport.height;
 
-		for (size_t e = szcandles, i = e - ncandles, ii = 0; i < e; i++, ii++)
+		// The tails start from the last mapped candle, which may be still open.
+		const vector<int64_t>& timeframes = getTimeframes();
+		for (map<string, Symbol>::iterator i = symbols.begin(), e = symbols.end(); i != e; i++)
 		{
-			const OHLC& candle = candles[i - position];
+			Symbol& symbol = i->second;
 
-			if (!isfinite(candle.low)) continue;
-			if (!isfinite(candle.high)) continue;
-			
-			candleDrawer.draw(cr, ii,
-				(candle.open - minval) / scale, (candle.high - minval) / scale,
-				(candle.low - minval) / scale, (candle.close - minval) / scale);
-		}		
+			lock_guard<mutex> lock(symbol.tailsMutex);
+			for (int j = 0; j < timeframes.size(); j++)
+			{
+				const int64_t timeframe = timeframes[j];
+				const Mapping& mapping = symbol.candles[timeframe];
 
-		cairo_set_line_width(cr, 2);
-		color = colorScheme.getGridColor();
-		gdk_cairo_set_source_rgba(cr, &color);
-		cairo_rectangle(cr, 0, 0, viewport.width, viewport.height);
-		cairo_stroke(cr);
-	}
+				Series& tail = symbol.tails[timeframe] = Series(timeframe);
+				if (mapping.size())
+					tail.merge(mapping.getStartTime() + (mapping.size() - 1) * timeframe,
+						mapping.getCandles()[mapping.size() - 1]);
+			}
+		}
 
-	ChartDrawer(const Viewport& viewport_) : viewport(viewport_) { }
-};
+		catchingUp = true;
+		g_idle_add(onCatchUp, this);
+		g_timeout_add(POLL_INTERVAL_MS, onTimer, this);
 
-class AnnotatedChartObject;
+		return true;
+	}
+};
 
-class ChartObject
+// Map the candles of all timeframes and the ticks built from the symbol history archive.
+// The candles are rebuilt only if the archive has been changed since; if it has
+// just grown, only the trades newer than the stored candles are folded in.
+// The candles imported by biimporter are merged with the ones built anew, which
+// take over the minutes they cover. Without the archive, the imported candles
+// are mapped as they are, with no ticks.
+static bool loadCandles(const string& name, const string& historyFile, Symbol& symbol)
 {
-	bool isScrolling;
-	gdouble start;
-	size_t position;
-
-	static gboolean onDraw(GtkWidget* widget, cairo_t* cr, gpointer data)
+	Source source;
+	if ((historyFile != "") && (getSource(historyFile, source) != candlesSuccess))
 	{
-		ChartObject* chart = (ChartObject*)data;
+		fprintf(stderr, "Cannot access history file %s\n", historyFile.c_str());
+		return false;
+	}
 
-		guint width = gtk_widget_get_allocated_width(widget);
-		guint height = gtk_widget_get_allocated_height(widget);
-		Viewport viewport(width, height);
+	const vector<int64_t>& timeframes = getTimeframes();
+	const string minutesPath = getPath(historyPath, name, timeframes[0]);
+	const string ticksPath = profile::getPath(historyPath, name);
 
-		ChartDrawer chartDrawer(viewport);
-		chartDrawer.draw(cr, chart->position, symbols["BATBTC"].candles["1min"], symbols["BATBTC"].maxSecond + 1);
+	Mapping& minutesMapping = symbol.candles[timeframes[0]];
+	if ((historyFile != "") && (
+		(minutesMapping.open(minutesPath, timeframes[0]) != candlesSuccess) ||
+		(minutesMapping.getSource() != source) ||
+		(symbol.ticks.open(ticksPath) != profile::profileSuccess) ||
+		(symbol.ticks.getSource() != source)))
+	{
+		minutesMapping.close();
+		symbol.ticks.close();
 
-		return FALSE;
-	}
+		Series minutes(timeframes[0]), imported(timeframes[0]);
+		if (minutes.load(minutesPath) != candlesSuccess)
+			minutes = Series(timeframes[0]);
+		else if (minutes.isImported())
+		{
+			imported = minutes;
+			minutes = Series(timeframes[0]);
+		}
+		else if (minutes.getSource().size >= source.size)
+			minutes = Series(timeframes[0]);
+		bool incremental = minutes.size() > 0;
+
+		// The ticks are appended along with the candles, unless they
+		// do not end where the candles do, then both are rebuilt.
+		profile::Writer ticks;
+		if (incremental && (ticks.open(ticksPath, minutes.getWatermark()) != profile::profileSuccess))
+		{
+			minutes = Series(timeframes[0]);
+			incremental = false;
+		}
+		if (!incremental)
+		{
+			profile::profileError_t status = ticks.open(ticksPath, 0);
+			if (status != profile::profileSuccess)
+			{
+				fprintf(stderr, "Cannot write ticks of %s: %s\n", name.c_str(), profile::profileGetErrorString(status));
+				return false;
+			}
+		}
+		const int64_t watermark = minutes.getWatermark();
 
-	static gboolean onMouse(GtkWidget *widget, GdkEventButton* event, gpointer data)
-	{
-		if (event->button == 1)
+		cout << "Decompressing " << historyFile << (incremental ? " (incremental)" : "") << endl;
+
+		Archive archive(historyFile);
+		if (!archive.is_open())
 		{
-			ChartObject* chart = (ChartObject*)data;
+			fprintf(stderr, "Error opening compressed file %s\n", historyFile.c_str());
+			return false;
+		}
+		if (!archive.readNextHeader())
+		{
+			fprintf(stderr, "Error reading archive header from compressed file %s\n", historyFile.c_str());
+			return false;
+		}
+		
+		Buffer<Trade> trades(tradeBatches);
+		const size_t szbatch = trades.capacity();
 
-			if (event->type == GDK_BUTTON_PRESS)		
+		// Reads are not aligned to the records, so the trailing
+		// partial record is carried over to the next batch.
+		size_t szcarry = 0;
+		while (1)
+		{
+			ssize_t size = archive.readData((char*)&trades[0] + szcarry, szbatch * sizeof(Trade) - szcarry);
+			if (size < 0)
 			{
-				chart->isScrolling = true;
-				chart->start = event->x;
+				fprintf(stderr, "Error reading data from compressed file %s\n", historyFile.c_str());
+				return false;
 			}
-			else if (event->type = GDK_BUTTON_RELEASE)
+			if (size == 0) break;
+			
+			size += szcarry;
+			const size_t ntrades = size / sizeof(Trade);
+			for (size_t k = 0; k < ntrades; k++)
 			{
-				chart->isScrolling = false;
+				const Trade& trade = trades[k];
+
+				if (incremental && (trade.time <= watermark)) continue;
+				
+				minutes.add(trade.time, trade.price, trade.qty);
+				ticks.add(trade.time, trade.price, trade.qty);
 			}
+
+			szcarry = size % sizeof(Trade);
+			memmove(&trades[0], (char*)&trades[0] + ntrades * sizeof(Trade), szcarry);
 		}
-		
-		return TRUE;
-	}
 
-	static gboolean onMove(GtkWidget *widget, GdkEventMotion* event, gpointer data)
-	{
-		ChartObject* chart = (ChartObject*)data;
-		
-		if (chart->isScrolling)
+		profile::profileError_t ticksStatus = ticks.close(source);
+		if (ticksStatus != profile::profileSuccess)
 		{
-			if (chart->position >= chart->start - event->x)
-				chart->position -= chart->start - event->x;
-			else
-				chart->position = 0;
-				
-			chart->start = event->x;		
-			gtk_widget_queue_draw(widget);
+			fprintf(stderr, "Cannot save ticks of %s: %s\n", name.c_str(), profile::profileGetErrorString(ticksStatus));
+			return false;
 		}
-	
-		return TRUE;
-	}
-	
-public :
 
-	ChartObject(GtkWidget* window) : isScrolling(false), position(0)
-	{
-		GtkWidget* drawing_area = gtk_drawing_area_new();
-		gtk_container_add(GTK_CONTAINER(window), drawing_area);
-		gtk_widget_set_size_request(drawing_area, 800, 600);
+		if (imported.isImported())
+		{
+			minutes.fill(imported);
+			minutes.setImported(true);
+		}
 
-		gtk_widget_set_events(GTK_WIDGET(drawing_area), GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_POINTER_MOTION_MASK);
-		g_signal_connect(G_OBJECT(drawing_area), "draw", G_CALLBACK(ChartObject::onDraw), this);
-		g_signal_connect(G_OBJECT(drawing_area), "button_press_event", G_CALLBACK(ChartObject::onMouse), this);
-		g_signal_connect(G_OBJECT(drawing_area), "button_release_event", G_CALLBACK(ChartObject::onMouse), this);
-		g_signal_connect(G_OBJECT(drawing_area), "motion_notify_event", G_CALLBACK(ChartObject::onMove), this);
+		minutes.setSource(source);
+		candlesError_t status = saveTimeframes(historyPath, name, minutes);
+		if (status != candlesSuccess)
+		{
+			fprintf(stderr, "Cannot save candles of %s: %s\n", name.c_str(), candlesGetErrorString(status));
+			return false;
+		}
 	}
-	
-	friend class AnnotatedChartObject;
-};
-
-class AnnotatedChartObject
-{
-	ChartObject chart;
-	GtkWidget* grid;
 
-	static gboolean onDraw(GtkWidget* widget, cairo_t* cr, gpointer data)
+	for (int i = 0; i < timeframes.size(); i++)
 	{
-		AnnotatedChartObject* aco = (AnnotatedChartObject*)data;
-
-		guint width = gtk_widget_get_allocated_width(widget);
-		guint height = gtk_widget_get_allocated_height(widget);
-		Viewport viewport(width, height);
-
-		ChartDrawer chartDrawer(viewport);
-		chartDrawer.draw(cr, aco->chart.position, symbols["BATBTC"].candles["1min"], symbols["BATBTC"].maxSecond + 1);
-
-		return FALSE;
+		candlesError_t status = symbol.candles[timeframes[i]].open(getPath(historyPath, name, timeframes[i]), timeframes[i]);
+		if (status != candlesSuccess)
+		{
+			fprintf(stderr, "Cannot map candles of %s: %s\n", name.c_str(), candlesGetErrorString(status));
+			return false;
+		}
 	}
 
-public :
+	if (historyFile == "")
+		return true;
 
-	AnnotatedChartObject(GtkWidget* window) : chart(window)
+	profile::profileError_t status = symbol.ticks.open(ticksPath);
+	if (status != profile::profileSuccess)
 	{
-		grid = gtk_grid_new();
-		gtk_container_add(GTK_CONTAINER(window), grid);
-		gtk_widget_set_size_request(grid, 800, 600);
-
-		g_signal_connect(G_OBJECT(grid), "draw", G_CALLBACK(AnnotatedChartObject::onDraw), this);
-
-//		gtk_grid_attach(grid, chart.widget, 0, 0, 1, 1);
+		fprintf(stderr, "Cannot map ticks of %s: %s\n", name.c_str(), profile::profileGetErrorString(status));
+		return false;
 	}
-};
 
-class Archive
-{
-	archive* a;
-	bool isOpen;
+	return true;
+}
 
-public :
+// Time the heatmap of the full history of each symbol, binned as the tiles are,
+// against the target of a second; the synthetic ticks are timed, if there are no symbols.
+// Returns the number of the heatmaps over the target.
+static int bench()
+{
+	const size_t ncolumns = 1024, nrows = TileCache::TILE_HEIGHT;
 
-	bool is_open() const { return isOpen; }
+	map<string, pair<const profile::Tick*, size_t> > histories;
+	for (map<string, Symbol>::const_iterator i = symbols.begin(), e = symbols.end(); i != e; i++)
+		if (i->second.ticks.size())
+			histories[i->first] = make_pair(i->second.ticks.getTicks(), i->second.ticks.size());
 
-	bool readNextHeader()
+	// A busy symbol, traded every 10 ms around the random walk of the price.
+	vector<profile::Tick> synthetic;
+	if (histories.empty())
 	{
-		struct archive_entry *entry;
-		int r = archive_read_next_header(a, &entry);
-		cout << "Found entry " << archive_entry_pathname(entry) << endl;
-		return (r == ARCHIVE_OK);
+		synthetic.resize(32 * 1024 * 1024);
+		double price = 100;
+		for (size_t i = 0; i < synthetic.size(); i++)
+		{
+			price *= 1 + ((int)(i * 2654435761u % 2001) - 1000) * 1e-6;
+			synthetic[i].time = (int64_t)i * 10;
+			synthetic[i].price = price;
+			synthetic[i].qty = 1 + i % 7;
+		}
+		histories["synthetic"] = make_pair(&synthetic[0], synthetic.size());
 	}
 
-	ssize_t readData(char* buffer, size_t szbuffer)
+	int nslow = 0;
+	for (map<string, pair<const profile::Tick*, size_t> >::const_iterator i = histories.begin(), e = histories.end(); i != e; i++)
 	{
-		return archive_read_data(a, buffer, szbuffer);
-	}
+		const profile::Tick* ticks = i->second.first;
+		const size_t nticks = i->second.second;
 
-	Archive(const string& filename) : a(archive_read_new()), isOpen(false)
-	{
-		archive_read_support_format_tar(a);
-		archive_read_support_filter_bzip2(a); // TODO
-		int r = archive_read_open_filename(a, filename.c_str(), 16384);
-		isOpen = (r == ARCHIVE_OK);
-	}
-	
-	~Archive()
-	{
-		archive_read_free(a);
+		float minPrice = ticks[0].price, maxPrice = ticks[0].price;
+		for (size_t j = 1; j < nticks; j++)
+		{
+			minPrice = min(minPrice, ticks[j].price);
+			maxPrice = max(maxPrice, ticks[j].price);
+		}
+		double minval = minPrice, maxval = maxPrice;
+		alignRange(minval, maxval);
+
+		const int64_t startTime = ticks[0].time;
+		const int64_t timeframe = (ticks[nticks - 1].time - startTime) / ncolumns + 1;
+
+		vector<float> volumes;
+		const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+		profile::getHeatmap(ticks, nticks, startTime, timeframe, ncolumns, minval, maxval, nrows, volumes);
+		const double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+		const bool slow = seconds > 1;
+		printf("%s: %zu ticks into %zu x %zu bins in %.3f s, %.0f ticks/s%s\n", i->first.c_str(),
+			nticks, ncolumns, nrows, seconds, nticks / seconds, slow ? ", over a second" : "");
+		if (slow) nslow++;
 	}
-};
+
+	return nslow;
+}
 
 gint main(int argc, char *argv[])
 {
-	// Expand the history path.
+	// Live mode follows the history file, as it is appended.
+	const bool live = (argc > 1) && (string(argv[1]) == "live");
+
+	// Expand the history paths.
 	{
 		wordexp_t p;
 		char** w;
@@ -393,9 +1733,19 @@ gint main(int argc, char *argv[])
 		historyPath = w[0];
 		wordfree(&p);
 	}
+	{
+		wordexp_t p;
+		char** w;
+		wordexp(liveHistoryPath.c_str(), &p, 0);
+		w = p.we_wordv;
+		liveHistoryPath = w[0];
+		wordfree(&p);
+	}
 	
-	// Find all files in the history path.
-	vector<string> historyFiles;
+	// Find all files in the history path, and the candles of the symbols
+	// with no history file, imported from the price snapshots.
+	vector<string> historyFiles, candleSymbols;
+	const string candlesExtension = getPath("", "", getTimeframes()[0]).substr(1);
 	while (1)
 	{
 		dirent* dirEntry = NULL;
@@ -423,12 +1773,16 @@ gint main(int argc, char *argv[])
 				const string historyFilename = historyPath + "/" + dirEntry->d_name;
 				historyFiles.push_back(historyFilename);
 			}
+			else if ((name.size() > candlesExtension.size()) &&
+				!name.compare(name.size() - candlesExtension.size(), candlesExtension.size(), candlesExtension))
+				candleSymbols.push_back(name.substr(0, name.size() - candlesExtension.size()));
 		}
 		closedir(dir);
 		break;
 	}
 
 	// For each history file
+	set<string> archived;
 	for (int i = 0, e = historyFiles.size(); i < e; i++)
 	{
 		const string& historyFile = historyFiles[i];
@@ -449,9 +1803,6 @@ gint main(int argc, char *argv[])
 			break;
 		}
 
-		// XXX
-		if (name != "BATBTC") continue;
-		
 		if (name == "")
 		{
 			fprintf(stderr, "Cannot determine symbol name for file %s\n", historyFile.c_str());
@@ -459,73 +1810,42 @@ gint main(int argc, char *argv[])
 		}
 		
 		cout << "Loading historical data for symbol " << name << " ... " << endl;
+		archived.insert(name);
 		
-		Symbol& symbol = symbols[name];
+		if (!loadCandles(name, historyFile, symbols[name]))
+			symbols.erase(name);
+	}
 
-		cout << "Decompressing " << historyFile << endl;
+	for (int i = 0; i < candleSymbols.size(); i++)
+	{
+		const string& name = candleSymbols[i];
+		if (archived.count(name)) continue;
 
-		Archive archive(historyFile);
-		if (!archive.is_open())
-		{
-			fprintf(stderr, "Error opening compressed file %s\n", historyFile.c_str());
-			continue;
-		}
-		if (!archive.readNextHeader())
-		{
-			fprintf(stderr, "Error reading archive header from compressed file %s\n", historyFile.c_str());
-			continue;
-		}
-		
-		symbol.maxSecond = 0;
-		bool firstTrade = true;
-		const size_t szbatch = 1024 * 1024;
-		vector<OHLC>& candles = symbol.candles["1min"];
-		for (;;)
-		{
-			vector<Trade> trades(szbatch);
-			ssize_t size = archive.readData((char*)&trades[0], szbatch * sizeof(Trade));
-			if (size < 0)
-			{
-				fprintf(stderr, "Error reading data from compressed file %s\n", historyFile.c_str());
-				break;
-			}
-			if (size == 0) break;
-			
-			for (int k = 0, ke = min(szbatch, size / sizeof(Trade)); k < ke; k++)
-			{
-				const Trade& trade = trades[k];
-				
-				if (firstTrade)
-				{
-					symbol.startTime = trade.time;
-					firstTrade = false;
-				}
-				
-				const uint64_t second = (trade.time - symbol.startTime) / (1000 * 60 * 30);
-				symbol.maxSecond = max(symbol.maxSecond, second);
-				if (candles.size() <= second)
-					candles.resize(candles.size() + szbatch);
-				
-				OHLC& candle = candles[second];
-				candle.high = fmax(candle.high, trade.price);
-				candle.low = fmin(candle.low, trade.price);
-				if (candle.open == HUGE_VAL)
-					candle.open = trade.price;
-				candle.close = trade.price;
-			}
-		}
-		
-		// XXX
-		break;
+		cout << "Loading imported candles for symbol " << name << " ... " << endl;
+
+		if (!loadCandles(name, "", symbols[name]))
+			symbols.erase(name);
 	}
 
+	cout << "Trade batches: " << tradeBatches.getAllocated() << " allocated, " <<
+		tradeBatches.getReused() << " reused" << endl;
+
+	if ((argc > 1) && (string(argv[1]) == "bench"))
+		return bench();
+
 	gtk_init(&argc, &argv);
 	
 	GtkWidget* window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
 	gtk_window_set_icon_name(GTK_WINDOW(window), "binance");
 	g_signal_connect(window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
 
-	ChartObject chart(window);
+	gtk_window_set_title(GTK_WINDOW(window), "Dashboard");
+
+	DashboardObject dashboard(window);
+
+	LiveTail liveTail(dashboard);
+	if (live && !liveTail.start())
+		return -1;
 
 	gtk_widget_show_all(window);
 	gtk_main();
@@ -0,0 +1,273 @@
+#include "bus.h"
+
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace bus;
+using namespace std;
+
+#define BUS_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* bus::busGetErrorString(const busError_t err)
+{
+	switch (err)
+	{
+	BUS_CASE_STR(busSuccess);
+	BUS_CASE_STR(busErrorOpenFailed);
+	BUS_CASE_STR(busErrorMapFailed);
+	BUS_CASE_STR(busErrorInvalidFormat);
+	BUS_CASE_STR(busErrorSymbolOutOfRange);
+	}
+}
+
+static const uint64_t magic = 0x3273756272746962ULL; // "bitrbus2"
+
+bus::Region::Region(int group_) : data(NULL), length(0), group(group_), header(NULL), slots(NULL), mask(0) { }
+
+bus::Region::~Region()
+{
+	close();
+}
+
+string bus::Region::getName() const
+{
+	return "/bitrader.bus." + to_string(group);
+}
+
+busError_t bus::Region::map(int fd, bool writable)
+{
+	struct stat st;
+	if (fstat(fd, &st) || (st.st_size < sizeof(Header)))
+		return busErrorInvalidFormat;
+
+	void* mapped = mmap(NULL, st.st_size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED)
+		return busErrorMapFailed;
+
+	data = mapped;
+	length = st.st_size;
+	header = (Header*)data;
+	slots = (Slot*)((char*)data + sizeof(Header));
+
+	return busSuccess;
+}
+
+void bus::Region::close()
+{
+	if (data)
+		munmap(data, length);
+
+	data = NULL;
+	length = 0;
+	header = NULL;
+	slots = NULL;
+	mask = 0;
+}
+
+const char* bus::Region::getSymbol(uint16_t id) const
+{
+	if (!header || (id >= maxSymbols)) return "";
+
+	return header->names[id];
+}
+
+// Tell the subscribers of the region about to be replaced to attach anew.
+static void retire(int fd, size_t length)
+{
+	if (length < sizeof(Header)) return;
+
+	void* mapped = mmap(NULL, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED) return;
+
+	Header* header = (Header*)mapped;
+	if (header->magic == magic)
+		header->generation.store(0, memory_order_release);
+	munmap(mapped, sizeof(Header));
+}
+
+bus::Publisher::Publisher(int group, uint32_t capacity_) : Region(group), capacity(capacity_) { }
+
+bus::Publisher::~Publisher() { }
+
+busError_t bus::Publisher::open()
+{
+	close();
+
+	int fd = shm_open(getName().c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd == -1)
+		return busErrorOpenFailed;
+
+	// The region of a different layout is replaced by a new one: the subscribers keep
+	// mapping the old one, until they see it retired, and truncating it would fault them.
+	const size_t expected = sizeof(Header) + capacity * sizeof(Slot);
+	struct stat st;
+	bool fresh = false;
+	if (fstat(fd, &st) || (st.st_size != expected))
+	{
+		if (st.st_size)
+		{
+			retire(fd, st.st_size);
+			::close(fd);
+			shm_unlink(getName().c_str());
+
+			fd = shm_open(getName().c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+			if (fd == -1)
+				return busErrorOpenFailed;
+		}
+		if (ftruncate(fd, expected))
+		{
+			::close(fd);
+			return busErrorOpenFailed;
+		}
+		fresh = true;
+	}
+
+	busError_t status = map(fd, true);
+	::close(fd);
+	if (status != busSuccess)
+		return status;
+
+	if (fresh || (header->magic != magic) || (header->capacity != capacity) || (header->group != group))
+	{
+		memset(header->names, 0, sizeof(header->names));
+		for (uint32_t i = 0; i < capacity; i++)
+			slots[i].seq.store(0, memory_order_relaxed);
+		header->capacity = capacity;
+		header->group = group;
+		header->head.store(0, memory_order_relaxed);
+
+		// The generation is taken from the clock, as the one of the old region may be lost.
+		const uint64_t previous = header->generation.load(memory_order_relaxed);
+		uint64_t generation = chrono::system_clock::now().time_since_epoch().count();
+		if (!generation || (generation == previous))
+			generation = previous + 1;
+		header->generation.store(generation, memory_order_release);
+		header->magic = magic;
+	}
+
+	mask = capacity - 1;
+
+	return busSuccess;
+}
+
+busError_t bus::Publisher::addSymbol(uint16_t id, const string& name)
+{
+	if ((id >= maxSymbols) || (name.size() >= maxSymbolLength))
+		return busErrorSymbolOutOfRange;
+
+	// The name is published before any trade of the symbol,
+	// so the subscribers find it in place.
+	strncpy(header->names[id], name.c_str(), maxSymbolLength - 1);
+
+	return busSuccess;
+}
+
+void bus::Publisher::publish(const history::Trade* trades, size_t count)
+{
+	uint64_t head = header->head.load(memory_order_relaxed);
+	for (size_t i = 0; i < count; i++, head++)
+	{
+		Slot& slot = slots[head & mask];
+
+		// Mark the slot as being written, before the trade is changed.
+		slot.seq.store(0, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+
+		slot.trade = trades[i];
+
+		slot.seq.store(head + 1, memory_order_release);
+	}
+
+	header->head.store(head, memory_order_release);
+}
+
+bus::Subscriber::Subscriber(int group) : Region(group), position(0), generation(0) { }
+
+bus::Subscriber::~Subscriber() { }
+
+busError_t bus::Subscriber::open()
+{
+	close();
+
+	int fd = shm_open(getName().c_str(), O_RDONLY, 0);
+	if (fd == -1)
+		return busErrorOpenFailed;
+
+	busError_t status = map(fd, false);
+	::close(fd);
+	if (status != busSuccess)
+		return status;
+
+	if ((header->magic != magic) || (header->group != group) || (header->capacity & (header->capacity - 1)) ||
+		(length != sizeof(Header) + header->capacity * sizeof(Slot)))
+	{
+		close();
+		return busErrorInvalidFormat;
+	}
+
+	generation = header->generation.load(memory_order_acquire);
+	if (!generation)
+	{
+		close();
+		return busErrorInvalidFormat;
+	}
+
+	mask = header->capacity - 1;
+	position = header->head.load(memory_order_acquire);
+
+	return busSuccess;
+}
+
+size_t bus::Subscriber::poll(history::Trade* trades, size_t count, uint64_t& nlost)
+{
+	// The publisher has reset the region or replaced it, so the sequence starts over:
+	// attach anew, and read the new region from its start. Until the new region
+	// is in place, there is nothing to read.
+	if (!header || (header->generation.load(memory_order_acquire) != generation) ||
+		(header->head.load(memory_order_acquire) < position))
+	{
+		if (open() != busSuccess) return 0;
+		position = 0;
+	}
+
+	const uint64_t head = header->head.load(memory_order_acquire);
+
+	// Skip the trades already overwritten.
+	const uint64_t capacity = mask + 1;
+	if (head - position > capacity)
+	{
+		nlost += head - capacity - position;
+		position = head - capacity;
+	}
+
+	size_t n = 0;
+	for ( ; (position < head) && (n < count); position++)
+	{
+		const Slot& slot = slots[position & mask];
+
+		if (slot.seq.load(memory_order_acquire) != position + 1)
+		{
+			nlost++;
+			continue;
+		}
+
+		trades[n] = slot.trade;
+
+		// The slot could be overwritten during the copy.
+		atomic_thread_fence(memory_order_acquire);
+		if (slot.seq.load(memory_order_relaxed) != position + 1)
+		{
+			nlost++;
+			continue;
+		}
+
+		n++;
+	}
+
+	return n;
+}
+
@@ -0,0 +1,160 @@
+#ifndef BUS_H
+#define BUS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "history.h"
+
+namespace bus
+{
+	enum busError_t
+	{
+		busSuccess = 0,
+		busErrorOpenFailed,
+		busErrorMapFailed,
+		busErrorInvalidFormat,
+		busErrorSymbolOutOfRange,
+	};
+
+	const char* busGetErrorString(const busError_t err);
+
+	#define BUS_ERR_CHECK(x) \
+	do { \
+		bus::busError_t err = x; \
+		if (err != bus::busSuccess) \
+		{ \
+			fprintf(stderr, "%s:%d: bus error: %s\n", __FILE__, __LINE__, bus::busGetErrorString(err)); \
+			exit(1); \
+		} \
+	} while (0)
+
+	// Symbols are spread over the groups by id, each group having its own region,
+	// so that a consumer of a few symbols does not scan the trades of all.
+	const int defaultGroups = 4;
+
+	// The number of trades kept in the region ring; must be a power of two.
+	const uint32_t defaultCapacity = 64 * 1024;
+
+	// Symbol ids are assigned by the publisher, and the names are kept in the regions.
+	const uint32_t maxSymbols = history::File::maxSymbols;
+	const uint32_t maxSymbolLength = history::File::maxSymbolLength;
+
+	static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Lock-free 64-bit atomics are required for the shared memory bus");
+
+	// Trade in the ring, stamped with its sequence number + 1 once published,
+	// or 0 while being written.
+	struct Slot
+	{
+		std::atomic<uint64_t> seq;
+		history::Trade trade;
+	};
+
+	struct Header
+	{
+		uint64_t magic;
+		uint32_t capacity;
+		uint32_t group;
+
+		// Changed whenever the region is reset, so that the subscribers resynchronize;
+		// 0, once the region is replaced by the one of a different layout.
+		std::atomic<uint64_t> generation;
+
+		// Sequence number of the next trade to publish.
+		std::atomic<uint64_t> head;
+
+		// Keep the head, which is written by the publisher on every
+		// batch, apart from the read-mostly data.
+		char padding[64];
+
+		char names[maxSymbols][maxSymbolLength];
+	};
+
+	// Shared memory region of a symbol group: the header followed by the ring.
+	class Region
+	{
+		void* data;
+
+	protected :
+
+		size_t length;
+		const int group;
+
+		Header* header;
+		Slot* slots;
+		uint64_t mask;
+
+		Region(int group);
+
+		~Region();
+
+		std::string getName() const;
+
+		busError_t map(int fd, bool writable);
+
+	public :
+
+		int getGroup() const { return group; }
+
+		void close();
+
+		// Name of the symbol id, or empty string, if not known.
+		const char* getSymbol(uint16_t id) const;
+	};
+
+	// The only writer of the group region. Trades are published with a seqlock
+	// per slot, so the publisher never waits for the subscribers: the slow
+	// subscribers are lapped and detect the lost trades by the sequence numbers.
+	class Publisher : public Region
+	{
+		const uint32_t capacity;
+
+	public :
+
+		Publisher(int group, uint32_t capacity = defaultCapacity);
+
+		~Publisher();
+
+		// Create the region, or attach to the existing one, continuing its sequence,
+		// so that the subscribers survive the publisher restart. The region of
+		// a different layout is replaced, not truncated under the subscribers.
+		busError_t open();
+
+		busError_t addSymbol(uint16_t id, const std::string& name);
+
+		void publish(const history::Trade* trades, size_t count);
+	};
+
+	// Reader of the group region. Each subscriber keeps its own position,
+	// and reads the trades straight from the shared ring.
+	class Subscriber : public Region
+	{
+		uint64_t position;
+
+		// Generation of the region, the position belongs to.
+		uint64_t generation;
+
+	public :
+
+		Subscriber(int group);
+
+		~Subscriber();
+
+		// Attach to the region, starting from the trades published after now.
+		busError_t open();
+
+		// Sequence number of the next trade to read.
+		uint64_t getPosition() const { return position; }
+
+		// Read up to count of the published trades. The number of trades
+		// overwritten before they could be read is added to nlost. Once the region
+		// is reset or replaced, the subscriber attaches anew and reads it from the start.
+		size_t poll(history::Trade* trades, size_t count, uint64_t& nlost);
+	};
+}
+
+#endif // BUS_H
+
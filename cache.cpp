@@ -0,0 +1,347 @@
+#include "cache.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace cache;
+using namespace std;
+
+using history::Trade;
+
+namespace {
+
+class BitWriter
+{
+	vector<uint64_t>& words;
+	uint32_t nbits;
+
+public :
+
+	BitWriter(vector<uint64_t>& words_) : words(words_), nbits(0) { words.clear(); }
+
+	// Write the lower n bits of the value, most significant first.
+	void write(uint64_t value, uint32_t n)
+	{
+		if (!n) return;
+		if (n < 64) value &= (1ULL << n) - 1;
+
+		const uint32_t offset = nbits & 63;
+		if (!offset)
+			words.push_back(0);
+
+		const uint32_t free = 64 - offset;
+		if (n <= free)
+			words.back() |= value << (free - n);
+		else
+		{
+			words.back() |= value >> (n - free);
+			words.push_back(value << (64 - (n - free)));
+		}
+
+		nbits += n;
+	}
+};
+
+class BitReader
+{
+	const uint64_t* words;
+	uint64_t nbits;
+
+public :
+
+	BitReader(const uint64_t* words_) : words(words_), nbits(0) { }
+
+	uint64_t read(uint32_t n)
+	{
+		if (!n) return 0;
+
+		const uint64_t index = nbits >> 6;
+		const uint32_t offset = nbits & 63;
+		const uint32_t available = 64 - offset;
+
+		uint64_t value;
+		if (n <= available)
+			value = (words[index] << offset) >> (64 - n);
+		else
+			value = ((words[index] << offset) >> (64 - n)) | (words[index + 1] >> (64 - (n - available)));
+
+		nbits += n;
+		return value;
+	}
+
+	bool readBit()
+	{
+		const bool bit = (words[nbits >> 6] >> (63 - (nbits & 63))) & 1;
+		nbits++;
+		return bit;
+	}
+};
+
+// Write the small signed value into the fewest bits of the buckets:
+// 0, [-63, 64], [-255, 256], [-2047, 2048] or the whole 64 bits.
+static void writeBucketed(BitWriter& writer, int64_t value)
+{
+	if (value == 0)
+		writer.write(0, 1);
+	else if ((value >= -63) && (value <= 64))
+	{
+		writer.write(0x2, 2);
+		writer.write(value + 63, 7);
+	}
+	else if ((value >= -255) && (value <= 256))
+	{
+		writer.write(0x6, 3);
+		writer.write(value + 255, 9);
+	}
+	else if ((value >= -2047) && (value <= 2048))
+	{
+		writer.write(0xe, 4);
+		writer.write(value + 2047, 12);
+	}
+	else
+	{
+		writer.write(0xf, 4);
+		writer.write(value, 64);
+	}
+}
+
+static int64_t readBucketed(BitReader& reader)
+{
+	if (!reader.readBit())
+		return 0;
+	if (!reader.readBit())
+		return (int64_t)reader.read(7) - 63;
+	if (!reader.readBit())
+		return (int64_t)reader.read(9) - 255;
+	if (!reader.readBit())
+		return (int64_t)reader.read(12) - 2047;
+
+	return (int64_t)reader.read(64);
+}
+
+// Delta-of-delta of the nearly regular integers, such as times and ids.
+struct DeltaEncoder
+{
+	int64_t value, delta;
+
+	DeltaEncoder() : value(0), delta(0) { }
+
+	void write(BitWriter& writer, int64_t next)
+	{
+		const int64_t nextDelta = next - value;
+		writeBucketed(writer, nextDelta - delta);
+		value = next;
+		delta = nextDelta;
+	}
+
+	int64_t read(BitReader& reader)
+	{
+		delta += readBucketed(reader);
+		value += delta;
+		return value;
+	}
+};
+
+// Binance quotes prices and quantities with at most 8 decimals,
+// so they are kept as exact integers of 1e-8 units, if possible.
+static bool toUnits(double value, int64_t& units)
+{
+	if (!(fabs(value) < 9e10)) return false;
+
+	units = llround(value * 1e8);
+	return units / 1e8 == value;
+}
+
+// Prices as the delta of the 1e-8 units from the previous price: the price
+// mostly stays or moves by a few ticks. Other doubles are stored as is.
+struct PriceEncoder
+{
+	int64_t units;
+
+	PriceEncoder() : units(0) { }
+
+	void write(BitWriter& writer, double next)
+	{
+		int64_t nextUnits;
+		if (!toUnits(next, nextUnits))
+		{
+			uint64_t bits;
+			memcpy(&bits, &next, sizeof(bits));
+			writer.write(1, 1);
+			writer.write(bits, 64);
+			return;
+		}
+
+		writer.write(0, 1);
+		writeBucketed(writer, nextUnits - units);
+		units = nextUnits;
+	}
+
+	double read(BitReader& reader)
+	{
+		if (reader.readBit())
+		{
+			uint64_t bits = reader.read(64);
+			double value;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		units += readBucketed(reader);
+		return units / 1e8;
+	}
+};
+
+// Quantities as the XOR with the previous quantity does not work for the
+// decimals well, so they are kept as the mantissa of the meaningful bits
+// and the number of the trailing decimal zeros of the 1e-8 units: the
+// quantities are mostly round.
+struct QtyEncoder
+{
+	void write(BitWriter& writer, double next)
+	{
+		int64_t units;
+		if (!toUnits(next, units) || (units < 0))
+		{
+			uint64_t bits;
+			memcpy(&bits, &next, sizeof(bits));
+			writer.write(1, 1);
+			writer.write(bits, 64);
+			return;
+		}
+
+		uint32_t zeros = 0;
+		while (units && (units % 10 == 0) && (zeros < 15))
+		{
+			units /= 10;
+			zeros++;
+		}
+
+		const uint32_t length = units ? 64 - __builtin_clzll(units) : 0;
+		writer.write(0, 1);
+		writer.write(zeros, 4);
+		writer.write(length, 6);
+		writer.write(units, length);
+	}
+
+	double read(BitReader& reader)
+	{
+		if (reader.readBit())
+		{
+			uint64_t bits = reader.read(64);
+			double value;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		static const double powers[] = { 1e-8, 1e-7, 1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1,
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7 };
+
+		const uint32_t zeros = reader.read(4);
+		const uint32_t length = reader.read(6);
+		const int64_t units = reader.read(length);
+
+		// Scale by the exact integer power first, so that the value is restored exactly.
+		if (zeros <= 8)
+		{
+			int64_t scale = 1;
+			for (uint32_t i = 0; i < zeros; i++)
+				scale *= 10;
+			return (units * scale) / 1e8;
+		}
+
+		return units * powers[zeros];
+	}
+};
+
+} // namespace
+
+void cache::compress(const Trade* trades, uint32_t count, Chunk& chunk)
+{
+	chunk.count = count;
+	chunk.firstTime = count ? trades[0].time : 0;
+	chunk.lastTime = count ? trades[count - 1].time : 0;
+
+	BitWriter writer(chunk.bits);
+	DeltaEncoder times, ids;
+	PriceEncoder prices;
+	QtyEncoder qtys;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const Trade& trade = trades[i];
+
+		times.write(writer, trade.time);
+		ids.write(writer, trade.id);
+		prices.write(writer, trade.price);
+		qtys.write(writer, trade.qty);
+		writer.write(trade.isBuyerMaker, 1);
+		writer.write(trade.isBestMatch, 1);
+	}
+
+	chunk.bits.shrink_to_fit();
+}
+
+void cache::decompress(const Chunk& chunk, uint16_t symbol, Trade* trades)
+{
+	BitReader reader(chunk.bits.data());
+	DeltaEncoder times, ids;
+	PriceEncoder prices;
+	QtyEncoder qtys;
+	for (uint32_t i = 0; i < chunk.count; i++)
+	{
+		Trade& trade = trades[i];
+
+		trade.time = times.read(reader);
+		trade.id = ids.read(reader);
+		trade.price = prices.read(reader);
+		trade.qty = qtys.read(reader);
+		trade.isBuyerMaker = reader.readBit();
+		trade.isBestMatch = reader.readBit();
+		trade.symbol = symbol;
+	}
+}
+
+Trade* cache::getScratch()
+{
+	static thread_local vector<Trade> scratch(chunkSize);
+
+	return scratch.data();
+}
+
+cache::Series::Series(uint16_t symbol_, int64_t retention_) : symbol(symbol_), retention(retention_), szcompressed(0), lastId(-1)
+{
+	open.reserve(chunkSize);
+}
+
+void cache::Series::append(const Trade& trade)
+{
+	open.push_back(trade);
+	open.back().symbol = symbol;
+	lastId = trade.id;
+	if (open.size() < chunkSize) return;
+
+	chunks.push_back(Chunk());
+	compress(open.data(), open.size(), chunks.back());
+	szcompressed += chunks.back().bits.capacity() * sizeof(uint64_t);
+	open.clear();
+
+	while (chunks.size() && (chunks.front().lastTime < trade.time - retention))
+	{
+		szcompressed -= chunks.front().bits.capacity() * sizeof(uint64_t);
+		chunks.pop_front();
+	}
+}
+
+int64_t cache::Series::getFirstTime() const
+{
+	if (chunks.size()) return chunks.front().firstTime;
+	if (open.size()) return open.front().time;
+
+	return 0;
+}
+
+size_t cache::Series::getMemory() const
+{
+	return szcompressed + chunks.size() * sizeof(Chunk) + open.capacity() * sizeof(Trade);
+}
+
@@ -0,0 +1,109 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "history.h"
+
+namespace cache
+{
+	// Trades are compressed in chunks of a fixed count.
+	const uint32_t chunkSize = 1024;
+
+	// Chunk of the trades, compressed Gorilla-style into a single bit stream,
+	// trade by trade: time and id as the delta-of-delta, price as the delta
+	// of 1e-8 units, qty as the decimal mantissa and exponent, and the flags.
+	struct Chunk
+	{
+		int64_t firstTime, lastTime;
+		uint32_t count;
+		std::vector<uint64_t> bits;
+	};
+
+	// Compress the trades (at most chunkSize) into the chunk.
+	void compress(const history::Trade* trades, uint32_t count, Chunk& chunk);
+
+	// Decode all trades of the chunk; the symbol is set to the given one.
+	void decompress(const Chunk& chunk, uint16_t symbol, history::Trade* trades);
+
+	// Scratch space of the calling thread for a decoded chunk.
+	history::Trade* getScratch();
+
+	// Raw trades of a single symbol for the retention period, in the id order.
+	// The newest trades stay uncompressed in the open chunk for O(1) append,
+	// the older ones are kept compressed, 5-10 times smaller.
+	class Series
+	{
+		uint16_t symbol;
+		int64_t retention;
+
+		std::deque<Chunk> chunks;
+		std::vector<history::Trade> open;
+
+		size_t szcompressed;
+		int64_t lastId;
+
+	public :
+
+		Series(uint16_t symbol = 0, int64_t retention = 24 * 60 * 60 * 1000);
+
+		// Append the trade newer than the last one, dropping the chunks
+		// older than the retention period.
+		void append(const history::Trade& trade);
+
+		// The newest trade id, or -1 for the empty series.
+		int64_t getLastId() const { return lastId; }
+
+		// Time of the oldest trade kept, or the newest time for the empty series.
+		int64_t getFirstTime() const;
+
+		size_t size() const { return chunks.size() * chunkSize + open.size(); }
+
+		// Memory held by the trades, in bytes.
+		size_t getMemory() const;
+
+		// Visit the trades of times [from, to) in the time order, as the arrays
+		// of at most a chunk. The compressed chunks are decoded into the thread scratch.
+		template<typename Visitor>
+		void scan(int64_t from, int64_t to, Visitor visit) const
+		{
+			struct Less
+			{
+				bool operator()(const history::Trade& trade, int64_t time) const { return trade.time < time; }
+			};
+
+			history::Trade* scratch = getScratch();
+			for (size_t i = 0; i <= chunks.size(); i++)
+			{
+				const history::Trade* trades;
+				size_t count;
+				if (i < chunks.size())
+				{
+					const Chunk& chunk = chunks[i];
+					if (chunk.lastTime < from) continue;
+					if (chunk.firstTime >= to) return;
+
+					decompress(chunk, symbol, scratch);
+					trades = scratch;
+					count = chunk.count;
+				}
+				else
+				{
+					trades = open.data();
+					count = open.size();
+				}
+
+				const history::Trade* first = std::lower_bound(trades, trades + count, from, Less());
+				const history::Trade* last = std::lower_bound(first, trades + count, to, Less());
+				if (first != last)
+					visit(first, last - first);
+			}
+		}
+	};
+}
+
+#endif // CACHE_H
+
@@ -0,0 +1,399 @@
+#include "candles.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace candles;
+using namespace std;
+
+#define CANDLES_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* candles::candlesGetErrorString(const candlesError_t err)
+{
+	switch (err)
+	{
+	CANDLES_CASE_STR(candlesSuccess);
+	CANDLES_CASE_STR(candlesErrorOpenFailed);
+	CANDLES_CASE_STR(candlesErrorReadFailed);
+	CANDLES_CASE_STR(candlesErrorWriteFailed);
+	CANDLES_CASE_STR(candlesErrorInvalidFormat);
+	CANDLES_CASE_STR(candlesErrorTimeframeMismatch);
+	}
+}
+
+namespace
+{
+	const char magic[8] = { 'B', 'I', 'T', 'R', 'C', 'N', 'D', 'L' };
+
+	// Version 2 files are still read: their header ends before the flags,
+	// which are 0 for them.
+	const uint32_t version = 3;
+	const uint32_t version2 = 2;
+
+	enum Flags
+	{
+		FlagImported = 1,
+	};
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t recordSize;
+		int64_t timeframe;
+		int64_t startTime;
+		int64_t watermark;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t sourceChecksum;
+		uint64_t flags;
+	};
+
+	size_t getHeaderSize(const FileHeader& header)
+	{
+		return (header.version == version2) ? offsetof(FileHeader, flags) : sizeof(FileHeader);
+	}
+
+	uint64_t getFlags(const FileHeader& header)
+	{
+		return (header.version == version2) ? 0 : header.flags;
+	}
+
+	// Check the header, returning the number of candles in the file of the given length.
+	candlesError_t checkHeader(const FileHeader& header, uint64_t length, int64_t timeframe, size_t& ncandles)
+	{
+		if ((length < offsetof(FileHeader, flags)) || memcmp(header.magic, magic, sizeof(magic)) ||
+			((header.version != version) && (header.version != version2)) || (header.recordSize != sizeof(Candle)))
+			return candlesErrorInvalidFormat;
+
+		const size_t szheader = getHeaderSize(header);
+		if ((length < szheader) || ((length - szheader) % sizeof(Candle)))
+			return candlesErrorInvalidFormat;
+
+		if (header.timeframe != timeframe)
+			return candlesErrorTimeframeMismatch;
+
+		ncandles = (length - szheader) / sizeof(Candle);
+
+		return candlesSuccess;
+	}
+
+	// The amount of data checksummed at the head and the tail of the source.
+	const size_t szchecksum = 64 * 1024;
+
+	uint64_t fnv1a(const char* data, size_t size, uint64_t hash)
+	{
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ (uint8_t)data[i]) * 1099511628211ull;
+		return hash;
+	}
+}
+
+candlesError_t candles::getSource(const string& path, Source& source)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st))
+		return candlesErrorOpenFailed;
+
+	ifstream file(path.c_str(), ifstream::binary);
+	if (!file.is_open())
+		return candlesErrorOpenFailed;
+
+	source.size = st.st_size;
+	source.time = st.st_mtime;
+
+	vector<char> buffer(min((uint64_t)szchecksum, source.size));
+	uint64_t checksum = 14695981039346656037ull;
+	if (buffer.size())
+	{
+		file.read(&buffer[0], buffer.size());
+		checksum = fnv1a(&buffer[0], buffer.size(), checksum);
+
+		file.seekg(source.size - buffer.size(), file.beg);
+		file.read(&buffer[0], buffer.size());
+		checksum = fnv1a(&buffer[0], buffer.size(), checksum);
+	}
+	if (!file.good())
+		return candlesErrorReadFailed;
+
+	source.checksum = checksum;
+
+	return candlesSuccess;
+}
+
+candles::Series::Series(int64_t timeframe_) :
+
+timeframe(timeframe_), startTime(0), watermark(0), imported(false)
+
+{ }
+
+Candle& candles::Series::getCandle(int64_t time)
+{
+	// Align the series start to the timeframe boundary.
+	const int64_t aligned = time - time % timeframe;
+	if (candles.empty())
+		startTime = aligned;
+	else if (aligned < startTime)
+	{
+		// Trade is older than the first candle: prepend empty candles.
+		candles.insert(candles.begin(), (startTime - aligned) / timeframe, Candle());
+		startTime = aligned;
+	}
+
+	const size_t i = (aligned - startTime) / timeframe;
+	if (candles.size() <= i)
+		candles.resize(i + 1);
+
+	return candles[i];
+}
+
+void candles::Series::add(int64_t time, double price, double qty)
+{
+	getCandle(time).add(price, qty);
+
+	if (time > watermark)
+		watermark = time;
+}
+
+void candles::Series::merge(int64_t time, const Candle& candle)
+{
+	getCandle(time).merge(candle);
+}
+
+void candles::Series::fill(const Series& other)
+{
+	for (size_t i = 0; i < other.candles.size(); i++)
+	{
+		if (other.candles[i].empty()) continue;
+
+		const int64_t time = other.startTime + i * other.timeframe;
+		if (candles.size() && (time >= startTime) && (time < startTime + (int64_t)candles.size() * timeframe) &&
+			!candles[(time - startTime) / timeframe].empty())
+			continue;
+
+		getCandle(time).merge(other.candles[i]);
+	}
+}
+
+Series candles::Series::resample(int64_t timeframe) const
+{
+	Series result(timeframe);
+	for (size_t i = 0; i < candles.size(); i++)
+	{
+		if (candles[i].empty()) continue;
+
+		result.getCandle(startTime + i * this->timeframe).merge(candles[i]);
+	}
+
+	result.watermark = watermark;
+	result.source = source;
+	result.imported = imported;
+
+	return result;
+}
+
+candlesError_t candles::Series::load(const string& path)
+{
+	ifstream file(path.c_str(), ifstream::binary);
+	if (!file.is_open())
+		return candlesErrorOpenFailed;
+
+	file.seekg(0, file.end);
+	uint64_t length = file.tellg();
+	file.seekg(0, file.beg);
+
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	if (length < offsetof(FileHeader, flags))
+		return candlesErrorInvalidFormat;
+
+	file.read((char*)&header, min(length, (uint64_t)sizeof(header)));
+	if (!file.good())
+		return candlesErrorReadFailed;
+
+	size_t ncandles;
+	candlesError_t status = checkHeader(header, length, timeframe, ncandles);
+	if (status != candlesSuccess)
+		return status;
+
+	startTime = header.startTime;
+	watermark = header.watermark;
+	source.size = header.sourceSize;
+	source.time = header.sourceTime;
+	source.checksum = header.sourceChecksum;
+	imported = getFlags(header) & FlagImported;
+
+	file.seekg(getHeaderSize(header), file.beg);
+
+	candles.resize(ncandles);
+	if (candles.size())
+	{
+		file.read((char*)&candles[0], candles.size() * sizeof(Candle));
+		if (!file.good())
+			return candlesErrorReadFailed;
+	}
+
+	return candlesSuccess;
+}
+
+candlesError_t candles::Series::save(const string& path) const
+{
+	// Write into a temporary file first, so that readers never see
+	// a partially written series.
+	const string tmpPath = path + ".tmp";
+	ofstream file(tmpPath.c_str(), ofstream::binary | ofstream::trunc);
+	if (!file.is_open())
+		return candlesErrorOpenFailed;
+
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.recordSize = sizeof(Candle);
+	header.timeframe = timeframe;
+	header.startTime = startTime;
+	header.watermark = watermark;
+	header.sourceSize = source.size;
+	header.sourceTime = source.time;
+	header.sourceChecksum = source.checksum;
+	header.flags = imported ? FlagImported : 0;
+
+	file.write((char*)&header, sizeof(header));
+	if (candles.size())
+		file.write((char*)&candles[0], candles.size() * sizeof(Candle));
+	file.close();
+	if (!file.good())
+		return candlesErrorWriteFailed;
+
+	if (rename(tmpPath.c_str(), path.c_str()))
+		return candlesErrorWriteFailed;
+
+	return candlesSuccess;
+}
+
+candles::Mapping::Mapping() :
+
+data(NULL), length(0), timeframe(0), startTime(0), watermark(0), imported(false), candles(NULL), ncandles(0)
+
+{ }
+
+candles::Mapping::~Mapping()
+{
+	close();
+}
+
+candlesError_t candles::Mapping::open(const string& path, int64_t timeframe_)
+{
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		return candlesErrorOpenFailed;
+
+	struct stat st;
+	if (fstat(fd, &st) || (st.st_size < offsetof(FileHeader, flags)))
+	{
+		::close(fd);
+		return candlesErrorInvalidFormat;
+	}
+
+	void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED)
+		return candlesErrorReadFailed;
+
+	const FileHeader& header = *(const FileHeader*)mapped;
+
+	size_t size;
+	candlesError_t status = checkHeader(header, st.st_size, timeframe_, size);
+	if (status != candlesSuccess)
+	{
+		munmap(mapped, st.st_size);
+		return status;
+	}
+
+	data = mapped;
+	length = st.st_size;
+	timeframe = header.timeframe;
+	startTime = header.startTime;
+	watermark = header.watermark;
+	source.size = header.sourceSize;
+	source.time = header.sourceTime;
+	source.checksum = header.sourceChecksum;
+	imported = getFlags(header) & FlagImported;
+	candles = (const Candle*)((const char*)data + getHeaderSize(header));
+	ncandles = size;
+
+	return candlesSuccess;
+}
+
+void candles::Mapping::close()
+{
+	if (data)
+		munmap(data, length);
+
+	data = NULL;
+	length = 0;
+	candles = NULL;
+	ncandles = 0;
+}
+
+const vector<int64_t>& candles::getTimeframes()
+{
+	static const int64_t minute = 60 * 1000;
+	static const int64_t values[] =
+	{
+		minute, 5 * minute, 15 * minute, 30 * minute,
+		60 * minute, 4 * 60 * minute, 24 * 60 * minute
+	};
+	static const vector<int64_t> timeframes(values, values + sizeof(values) / sizeof(values[0]));
+
+	return timeframes;
+}
+
+string candles::getTimeframeName(int64_t timeframe)
+{
+	stringstream name;
+	if (timeframe % (24 * 60 * 60 * 1000) == 0)
+		name << timeframe / (24 * 60 * 60 * 1000) << "day";
+	else if (timeframe % (60 * 60 * 1000) == 0)
+		name << timeframe / (60 * 60 * 1000) << "hour";
+	else if (timeframe % (60 * 1000) == 0)
+		name << timeframe / (60 * 1000) << "min";
+	else
+		name << timeframe << "ms";
+
+	return name.str();
+}
+
+string candles::getPath(const string& dir, const string& symbol, int64_t timeframe)
+{
+	return dir + "/" + symbol + "." + getTimeframeName(timeframe) + ".candles";
+}
+
+candlesError_t candles::saveTimeframes(const string& dir, const string& symbol, const Series& minutes)
+{
+	const vector<int64_t>& timeframes = getTimeframes();
+	for (int i = 0; i < timeframes.size(); i++)
+	{
+		const int64_t timeframe = timeframes[i];
+
+		candlesError_t status;
+		if (timeframe == minutes.getTimeframe())
+			status = minutes.save(getPath(dir, symbol, timeframe));
+		else
+			status = minutes.resample(timeframe).save(getPath(dir, symbol, timeframe));
+
+		if (status != candlesSuccess)
+			return status;
+	}
+
+	return candlesSuccess;
+}
+
@@ -0,0 +1,218 @@
+#ifndef CANDLES_H
+#define CANDLES_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace candles
+{
+	enum candlesError_t
+	{
+		candlesSuccess = 0,
+		candlesErrorOpenFailed,
+		candlesErrorReadFailed,
+		candlesErrorWriteFailed,
+		candlesErrorInvalidFormat,
+		candlesErrorTimeframeMismatch,
+	};
+
+	const char* candlesGetErrorString(const candlesError_t err);
+
+	#define CANDLES_ERR_CHECK(x) \
+	do { \
+		candles::candlesError_t err = x; \
+		if (err != candles::candlesSuccess) \
+		{ \
+			fprintf(stderr, "%s:%d: candles error: %s\n", __FILE__, __LINE__, candles::candlesGetErrorString(err)); \
+			exit(1); \
+		} \
+	} while (0)
+
+	// OHLCV candle. Candles without trades have non-finite low and high.
+	struct Candle
+	{
+		double open;
+		double high;
+		double low;
+		double close;
+		double volume;
+
+		Candle() : open(HUGE_VAL), high(-HUGE_VAL), low(HUGE_VAL), close(HUGE_VAL), volume(0) { }
+
+		bool empty() const { return open == HUGE_VAL; }
+
+		void add(double price, double qty)
+		{
+			high = fmax(high, price);
+			low = fmin(low, price);
+			if (open == HUGE_VAL)
+				open = price;
+			close = price;
+			volume += qty;
+		}
+
+		// Merge the next candle in time into this one.
+		void merge(const Candle& next)
+		{
+			if (next.empty()) return;
+
+			high = fmax(high, next.high);
+			low = fmin(low, next.low);
+			if (open == HUGE_VAL)
+				open = next.open;
+			close = next.close;
+			volume += next.volume;
+		}
+	};
+
+	// Identity of the source trades file the candles are built from:
+	// candles are rebuilt, once the source is changed. The imported
+	// candles have no source, until merged with the built ones.
+	struct Source
+	{
+		uint64_t size;
+		int64_t time;
+
+		// Checksum of the file head and tail.
+		uint64_t checksum;
+
+		Source() : size(0), time(0), checksum(0) { }
+
+		bool operator==(const Source& other) const
+		{
+			return (size == other.size) && (time == other.time) && (checksum == other.checksum);
+		}
+
+		bool operator!=(const Source& other) const { return !(*this == other); }
+	};
+
+	candlesError_t getSource(const std::string& path, Source& source);
+
+	// Candles of a single symbol and timeframe, densely indexed
+	// by the time since the first candle.
+	class Series
+	{
+		// Timeframe and the start time of the first candle, in ms since epoch.
+		int64_t timeframe;
+		int64_t startTime;
+
+		// Time of the newest trade folded into the series.
+		int64_t watermark;
+
+		Source source;
+
+		// The series holds the candles imported from the price snapshots.
+		bool imported;
+
+		std::vector<Candle> candles;
+
+		Candle& getCandle(int64_t time);
+
+	public :
+
+		Series(int64_t timeframe = 60 * 1000);
+
+		int64_t getTimeframe() const { return timeframe; }
+
+		int64_t getStartTime() const { return startTime; }
+
+		int64_t getWatermark() const { return watermark; }
+
+		const Source& getSource() const { return source; }
+
+		void setSource(const Source& source_) { source = source_; }
+
+		bool isImported() const { return imported; }
+
+		void setImported(bool imported_) { imported = imported_; }
+
+		size_t size() const { return candles.size(); }
+
+		const Candle& operator[](size_t i) const { return candles[i]; }
+
+		const std::vector<Candle>& getCandles() const { return candles; }
+
+		// Fold a trade into the candle covering the trade time.
+		void add(int64_t time, double price, double qty);
+
+		// Merge the candle into the one covering the given time.
+		void merge(int64_t time, const Candle& candle);
+
+		// Merge the candles of the other series of the same timeframe into
+		// the empty candles of this one, which take over the candles they cover.
+		void fill(const Series& other);
+
+		// Aggregate the candles into a coarser timeframe.
+		Series resample(int64_t timeframe) const;
+
+		candlesError_t load(const std::string& path);
+
+		candlesError_t save(const std::string& path) const;
+	};
+
+	// Read-only memory mapping of the candle file, for instant access
+	// to the stored candles.
+	class Mapping
+	{
+		void* data;
+		size_t length;
+
+		int64_t timeframe;
+		int64_t startTime;
+		int64_t watermark;
+		Source source;
+		bool imported;
+
+		const Candle* candles;
+		size_t ncandles;
+
+		Mapping(const Mapping&);
+		Mapping& operator=(const Mapping&);
+
+	public :
+
+		Mapping();
+
+		~Mapping();
+
+		candlesError_t open(const std::string& path, int64_t timeframe);
+
+		void close();
+
+		bool is_open() const { return data != NULL; }
+
+		int64_t getTimeframe() const { return timeframe; }
+
+		int64_t getStartTime() const { return startTime; }
+
+		int64_t getWatermark() const { return watermark; }
+
+		const Source& getSource() const { return source; }
+
+		bool isImported() const { return imported; }
+
+		size_t size() const { return ncandles; }
+
+		const Candle* getCandles() const { return candles; }
+	};
+
+	// Timeframes of the stored candles, from 1min to 1day.
+	const std::vector<int64_t>& getTimeframes();
+
+	// Timeframe name used in candle file names, e.g. "1min".
+	std::string getTimeframeName(int64_t timeframe);
+
+	// Path of the candle file for the given symbol and timeframe,
+	// next to the symbol history files.
+	std::string getPath(const std::string& dir, const std::string& symbol, int64_t timeframe);
+
+	// Save 1min candles together with all coarser timeframes.
+	candlesError_t saveTimeframes(const std::string& dir, const std::string& symbol, const Series& minutes);
+}
+
+#endif // CANDLES_H
+
@@ -0,0 +1,315 @@
+#include "chart.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace candles;
+using namespace chart;
+using namespace std;
+
+#define CHART_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* chart::chartGetErrorString(const chartError_t err)
+{
+	switch (err)
+	{
+	CHART_CASE_STR(chartSuccess);
+	CHART_CASE_STR(chartErrorRenderFailed);
+	CHART_CASE_STR(chartErrorWriteFailed);
+	}
+}
+
+chart::BinanceColorScheme::BinanceColorScheme()
+{
+	backgroundColor.red = 21 / 256.0;
+	backgroundColor.green = 26 / 256.0;
+	backgroundColor.blue = 29 / 256.0;
+	backgroundColor.alpha = 1.0;
+
+	gridColor.red = 49 / 256.0;
+	gridColor.green = 58 / 256.0;
+	gridColor.blue = 66 / 256.0;
+	gridColor.alpha = 1.0;
+
+	candleColor.red = 240 / 256.0;
+	candleColor.green = 184 / 256.0;
+	candleColor.blue = 12 / 256.0;
+	candleColor.alpha = 1.0;
+
+	overlayColor.red = 132 / 256.0;
+	overlayColor.green = 142 / 256.0;
+	overlayColor.blue = 156 / 256.0;
+	overlayColor.alpha = 1.0;
+}
+
+chart::AppliedParallelComputingColorScheme::AppliedParallelComputingColorScheme()
+{
+	backgroundColor.red = 256 / 256.0;
+	backgroundColor.green = 256 / 256.0;
+	backgroundColor.blue = 256 / 256.0;
+	backgroundColor.alpha = 1.0;
+
+	gridColor.red = 49 / 256.0;
+	gridColor.green = 58 / 256.0;
+	gridColor.blue = 66 / 256.0;
+	gridColor.alpha = 0.0625;
+
+	candleColor.red = 38 / 256.0;
+	candleColor.green = 73 / 256.0;
+	candleColor.blue = 158 / 256.0;
+	candleColor.alpha = 1.0;
+
+	overlayColor.red = 230 / 256.0;
+	overlayColor.green = 120 / 256.0;
+	overlayColor.blue = 30 / 256.0;
+	overlayColor.alpha = 0.75;
+}
+
+static AppliedParallelComputingColorScheme colorScheme;
+
+static void setSourceColor(cairo_t* cr, const Color& color)
+{
+	cairo_set_source_rgba(cr, color.red, color.green, color.blue, color.alpha);
+}
+
+void chart::CandleDrawer::drawLine(cairo_t* cr, uint32_t position, uint32_t top, uint32_t bottom)
+{
+	cairo_move_to(cr, position * width + width / 2, viewport.height - top);
+	cairo_line_to(cr, position * width + width / 2, viewport.height - bottom);
+	cairo_close_path(cr);
+	cairo_stroke(cr);
+}
+
+void chart::CandleDrawer::drawRectangle(cairo_t* cr, uint32_t position, uint32_t top, uint32_t bottom, bool filled)
+{
+	cairo_rectangle(cr, position * width + 1, viewport.height - top, max(width, 3u) - 2, top - bottom);
+	if (filled)
+		cairo_fill(cr);
+	else
+		cairo_stroke(cr);
+}
+
+void chart::CandleDrawer::draw(cairo_t* cr, uint32_t position, uint32_t open, uint32_t high, uint32_t low, uint32_t close)
+{
+	drawRectangle(cr, position, open, close, close > open);
+
+	if (open > close)
+	{
+		drawLine(cr, position, close, low);
+		drawLine(cr, position, high, open);
+	}
+	else
+	{
+		drawLine(cr, position, open, low);
+		drawLine(cr, position, high, close);
+	}
+}
+
+void chart::ChartDrawer::drawBackground(cairo_t* cr)
+{
+	setSourceColor(cr, colorScheme.getBackgroundColor());
+
+	cairo_rectangle(cr, 0, 0, viewport.width, viewport.height);
+	cairo_fill(cr);
+
+	cairo_set_line_width (cr, 1);
+	setSourceColor(cr, colorScheme.getGridColor());
+
+	const uint32_t ngridlines = 10;
+	uint32_t step = viewport.height / ngridlines;
+	for (uint32_t i = 0; i < ngridlines; i++)
+	{
+		cairo_move_to(cr, 0, i * step);
+		cairo_line_to(cr, viewport.width, i * step);
+		cairo_close_path(cr);
+		cairo_stroke(cr);
+	}
+}
+
+void chart::ChartDrawer::drawFrame(cairo_t* cr)
+{
+	cairo_set_line_width(cr, 2);
+	setSourceColor(cr, colorScheme.getGridColor());
+	cairo_rectangle(cr, 0, 0, viewport.width, viewport.height);
+	cairo_stroke(cr);
+}
+
+void chart::ChartDrawer::drawTitle(cairo_t* cr, const string& title)
+{
+	Color color = colorScheme.getGridColor();
+	color.alpha = 1.0;
+	setSourceColor(cr, color);
+	cairo_set_font_size(cr, 12);
+	cairo_move_to(cr, 6, 16);
+	cairo_show_text(cr, title.c_str());
+}
+
+void chart::ChartDrawer::getRange(const Candles& candles, size_t first, size_t szcandles, double& minval, double& maxval)
+{
+	minval = HUGE_VAL;
+	maxval = -HUGE_VAL;
+	for (size_t i = 0; i < szcandles; i++)
+	{
+		const Candle& candle = candles[first + i];
+
+		if (!isfinite(candle.low)) continue;
+		if (!isfinite(candle.high)) continue;
+
+		minval = fmin(minval, candle.low);
+		maxval = fmax(maxval, candle.high);
+	}
+}
+
+void chart::ChartDrawer::drawCandles(cairo_t* cr, const Candles& candles, size_t first, size_t szcandles,
+	double minval, double maxval, uint32_t width)
+{
+	cairo_set_line_width (cr, 1);
+	setSourceColor(cr, colorScheme.getCandleColor());
+
+	CandleDrawer candleDrawer(viewport, width);
+
+	// Flat prices are drawn in the middle.
+	if (!(maxval > minval))
+	{
+		const double margin = fmax(fabs(minval) * 1e-3, 1e-8);
+		minval -= margin;
+		maxval += margin;
+	}
+
+	double scale = (maxval - minval) / viewport.height;
+
+	for (size_t i = 0; i < szcandles; i++)
+	{
+		const Candle& candle = candles[first + i];
+
+		if (!isfinite(candle.low)) continue;
+		if (!isfinite(candle.high)) continue;
+
+		candleDrawer.draw(cr, i,
+			(candle.open - minval) / scale, (candle.high - minval) / scale,
+			(candle.low - minval) / scale, (candle.close - minval) / scale);
+	}
+}
+
+void chart::ChartDrawer::drawOverlay(cairo_t* cr, const double* values, int64_t position, size_t nvalues,
+	double minval, double maxval, uint32_t width)
+{
+	cairo_set_line_width(cr, 1);
+	setSourceColor(cr, colorScheme.getOverlayColor());
+
+	if (!(maxval > minval))
+	{
+		const double margin = fmax(fabs(minval) * 1e-3, 1e-8);
+		minval -= margin;
+		maxval += margin;
+	}
+
+	double scale = (maxval - minval) / viewport.height;
+
+	bool drawing = false;
+	for (size_t i = 0; i < nvalues; i++)
+	{
+		if (!isfinite(values[i]))
+		{
+			drawing = false;
+			continue;
+		}
+
+		const double x = (position + (int64_t)i) * (double)width + width / 2;
+		const double y = viewport.height - (values[i] - minval) / scale;
+		if (drawing)
+			cairo_line_to(cr, x, y);
+		else
+		{
+			cairo_move_to(cr, x, y);
+			drawing = true;
+		}
+	}
+	cairo_stroke(cr);
+}
+
+void chart::ChartDrawer::draw(cairo_t* cr, size_t& position, const Candles& candles)
+{
+	drawBackground(cr);
+
+	const size_t szcandles = candles.size();
+
+	uint32_t ncandles = viewport.width / CandleDrawer::CANDLE_WIDTH;
+	if (viewport.width % CandleDrawer::CANDLE_WIDTH) ncandles++;
+	ncandles = min((size_t)ncandles, szcandles);
+
+	// Do not allow position to shrink the last right-most visible candles window.
+	position = min(position, szcandles - ncandles);
+
+	const size_t first = szcandles - ncandles - position;
+
+	double minval, maxval;
+	getRange(candles, first, ncandles, minval, maxval);
+	drawCandles(cr, candles, first, ncandles, minval, maxval);
+
+	drawFrame(cr);
+}
+
+// Render the chart on the new image surface, to be destroyed by the caller.
+static cairo_surface_t* render(const Candles& candles, uint32_t width, uint32_t height, const string& title)
+{
+	cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
+	{
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+
+	cairo_t* cr = cairo_create(surface);
+
+	Viewport viewport(width, height);
+	ChartDrawer chartDrawer(viewport);
+	size_t position = 0;
+	chartDrawer.draw(cr, position, candles);
+	if (title != "")
+		chartDrawer.drawTitle(cr, title);
+
+	cairo_destroy(cr);
+	cairo_surface_flush(surface);
+
+	return surface;
+}
+
+static cairo_status_t onWrite(void* closure, const unsigned char* data, unsigned int length)
+{
+	string* png = (string*)closure;
+	png->append((const char*)data, length);
+	return CAIRO_STATUS_SUCCESS;
+}
+
+chartError_t chart::renderPNG(const Candles& candles, uint32_t width, uint32_t height,
+	const string& title, string& png)
+{
+	cairo_surface_t* surface = render(candles, width, height, title);
+	if (!surface)
+		return chartErrorRenderFailed;
+
+	png.clear();
+	cairo_status_t status = cairo_surface_write_to_png_stream(surface, onWrite, &png);
+	cairo_surface_destroy(surface);
+	if (status != CAIRO_STATUS_SUCCESS)
+		return chartErrorWriteFailed;
+
+	return chartSuccess;
+}
+
+chartError_t chart::writePNG(const Candles& candles, uint32_t width, uint32_t height,
+	const string& title, const string& path)
+{
+	cairo_surface_t* surface = render(candles, width, height, title);
+	if (!surface)
+		return chartErrorRenderFailed;
+
+	cairo_status_t status = cairo_surface_write_to_png(surface, path.c_str());
+	cairo_surface_destroy(surface);
+	if (status != CAIRO_STATUS_SUCCESS)
+		return chartErrorWriteFailed;
+
+	return chartSuccess;
+}
+
@@ -0,0 +1,170 @@
+#ifndef CHART_H
+#define CHART_H
+
+#include <cairo/cairo.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "candles.h"
+
+namespace chart
+{
+	enum chartError_t
+	{
+		chartSuccess = 0,
+		chartErrorRenderFailed,
+		chartErrorWriteFailed,
+	};
+
+	const char* chartGetErrorString(const chartError_t err);
+
+	#define CHART_ERR_CHECK(x) \
+	do { \
+		chart::chartError_t err = x; \
+		if (err != chart::chartSuccess) \
+		{ \
+			fprintf(stderr, "%s:%d: chart error: %s\n", __FILE__, __LINE__, chart::chartGetErrorString(err)); \
+			exit(1); \
+		} \
+	} while (0)
+
+	struct Color
+	{
+		double red;
+		double green;
+		double blue;
+		double alpha;
+	};
+
+	class BinanceColorScheme
+	{
+		Color backgroundColor;
+		Color gridColor;
+		Color candleColor;
+		Color overlayColor;
+
+	public :
+
+		const Color& getBackgroundColor() const { return backgroundColor; }
+
+		const Color& getGridColor() const { return gridColor; }
+
+		const Color& getCandleColor() const { return candleColor; }
+
+		const Color& getOverlayColor() const { return overlayColor; }
+
+		BinanceColorScheme();
+	};
+
+	class AppliedParallelComputingColorScheme
+	{
+		Color backgroundColor;
+		Color gridColor;
+		Color candleColor;
+		Color overlayColor;
+
+	public :
+
+		const Color& getBackgroundColor() const { return backgroundColor; }
+
+		const Color& getGridColor() const { return gridColor; }
+
+		const Color& getCandleColor() const { return candleColor; }
+
+		const Color& getOverlayColor() const { return overlayColor; }
+
+		AppliedParallelComputingColorScheme();
+	};
+
+	struct Viewport
+	{
+		uint32_t width, height;
+
+		Viewport(uint32_t width_, uint32_t height_) : width(width_), height(height_) { }
+	};
+
+	// Candles to draw: the stored candles, optionally continued by the live tail,
+	// which starts in place of the last stored candle.
+	struct Candles
+	{
+		const candles::Candle* mapped;
+		size_t szmapped;
+		const candles::Candle* tail;
+		size_t sztail;
+
+		// Time of the newest trade in the candles.
+		int64_t watermark;
+
+		size_t size() const { return szmapped + sztail; }
+
+		const candles::Candle& operator[](size_t i) const { return (i < szmapped) ? mapped[i] : tail[i - szmapped]; }
+
+		Candles(const candles::Candle* mapped_ = NULL, size_t szmapped_ = 0, int64_t watermark_ = 0) :
+			mapped(mapped_), szmapped(szmapped_), tail(NULL), sztail(0), watermark(watermark_) { }
+	};
+
+	class CandleDrawer
+	{
+		const Viewport& viewport;
+		const uint32_t width;
+
+		void drawLine(cairo_t* cr, uint32_t position, uint32_t top, uint32_t bottom);
+
+		void drawRectangle(cairo_t* cr, uint32_t position, uint32_t top, uint32_t bottom, bool filled);
+
+	public :
+
+		static const uint32_t CANDLE_WIDTH = 10;
+
+		void draw(cairo_t* cr, uint32_t position, uint32_t open, uint32_t high, uint32_t low, uint32_t close);
+
+		CandleDrawer(const Viewport& viewport_, uint32_t width_ = CANDLE_WIDTH) : viewport(viewport_), width(width_) { }
+	};
+
+	// Draws the candle charts on any cairo surface, so that the same
+	// charts are shown in the viewer and rendered headless into images.
+	class ChartDrawer
+	{
+		const Viewport& viewport;
+
+	public :
+
+		void drawBackground(cairo_t* cr);
+
+		void drawFrame(cairo_t* cr);
+
+		// Draw the title in the top left corner.
+		void drawTitle(cairo_t* cr, const std::string& title);
+
+		// Price range of the candles, excluding the candles without trades.
+		static void getRange(const Candles& candles, size_t first, size_t szcandles, double& minval, double& maxval);
+
+		// Draw the candles from the left edge, with the given price range mapped to the viewport height.
+		void drawCandles(cairo_t* cr, const Candles& candles, size_t first, size_t szcandles, double minval, double maxval,
+			uint32_t width = CandleDrawer::CANDLE_WIDTH);
+
+		// Draw the indicator line through the candle centers, starting at the candle
+		// position, which is negative for the values left of the viewport. The line
+		// breaks at the NAN values.
+		void drawOverlay(cairo_t* cr, const double* values, int64_t position, size_t nvalues, double minval, double maxval,
+			uint32_t width = CandleDrawer::CANDLE_WIDTH);
+
+		// Draw the right-most candles fitting the viewport, shifted into the history by position.
+		void draw(cairo_t* cr, size_t& position, const Candles& candles);
+
+		ChartDrawer(const Viewport& viewport_) : viewport(viewport_) { }
+	};
+
+	// Render the newest candles into a PNG image in memory.
+	chartError_t renderPNG(const Candles& candles, uint32_t width, uint32_t height,
+		const std::string& title, std::string& png);
+
+	// Render the newest candles into a PNG file.
+	chartError_t writePNG(const Candles& candles, uint32_t width, uint32_t height,
+		const std::string& title, const std::string& path);
+}
+
+#endif // CHART_H
+
@@ -0,0 +1,382 @@
+#include "execution.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <wordexp.h>
+
+using namespace binance;
+using namespace execution;
+using namespace std;
+
+#define EXECUTION_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* execution::executionGetErrorString(const executionError_t err)
+{
+	switch (err)
+	{
+	EXECUTION_CASE_STR(executionSuccess);
+	EXECUTION_CASE_STR(executionErrorDisabled);
+	EXECUTION_CASE_STR(executionErrorMissingAccountKeys);
+	EXECUTION_CASE_STR(executionErrorCurlFailed);
+	EXECUTION_CASE_STR(executionErrorInvalidServerResponse);
+	EXECUTION_CASE_STR(executionErrorUnknownSymbol);
+	EXECUTION_CASE_STR(executionErrorBelowMinimum);
+	EXECUTION_CASE_STR(executionErrorOrderRejected);
+	EXECUTION_CASE_STR(executionErrorNotFilled);
+	}
+}
+
+const string execution::Executor::default_config_path = "$HOME/.bitrader/execution";
+
+execution::Signer::Signer(const string& key) : inner(EVP_MD_CTX_new()), outer(EVP_MD_CTX_new())
+{
+	unsigned char block[blockSize];
+	memset(block, 0, sizeof(block));
+
+	// Keys longer than the block are hashed first.
+	if (key.size() > sizeof(block))
+		EVP_Digest(key.c_str(), key.size(), block, NULL, EVP_sha256(), NULL);
+	else
+		memcpy(block, key.c_str(), key.size());
+
+	unsigned char pad[blockSize];
+
+	for (int i = 0; i < sizeof(pad); i++)
+		pad[i] = block[i] ^ 0x36;
+	EVP_DigestInit_ex(inner, EVP_sha256(), NULL);
+	EVP_DigestUpdate(inner, pad, sizeof(pad));
+
+	for (int i = 0; i < sizeof(pad); i++)
+		pad[i] = block[i] ^ 0x5c;
+	EVP_DigestInit_ex(outer, EVP_sha256(), NULL);
+	EVP_DigestUpdate(outer, pad, sizeof(pad));
+}
+
+execution::Signer::Signer(const Signer& other) : inner(EVP_MD_CTX_new()), outer(EVP_MD_CTX_new())
+{
+	EVP_MD_CTX_copy_ex(inner, other.inner);
+	EVP_MD_CTX_copy_ex(outer, other.outer);
+}
+
+execution::Signer& execution::Signer::operator=(const Signer& other)
+{
+	EVP_MD_CTX_copy_ex(inner, other.inner);
+	EVP_MD_CTX_copy_ex(outer, other.outer);
+	return *this;
+}
+
+execution::Signer::~Signer()
+{
+	EVP_MD_CTX_free(inner);
+	EVP_MD_CTX_free(outer);
+}
+
+// Context of the calling thread, the midstates are copied into.
+static EVP_MD_CTX* getScratch()
+{
+	struct Scratch
+	{
+		EVP_MD_CTX* ctx;
+
+		Scratch() : ctx(EVP_MD_CTX_new()) { }
+
+		~Scratch() { EVP_MD_CTX_free(ctx); }
+	};
+	static thread_local Scratch scratch;
+
+	return scratch.ctx;
+}
+
+void execution::Signer::sign(const char* message, size_t length, char* hex) const
+{
+	static const char digits[] = "0123456789abcdef";
+
+	unsigned char digest[digestSize];
+
+	EVP_MD_CTX* ctx = getScratch();
+	EVP_MD_CTX_copy_ex(ctx, inner);
+	EVP_DigestUpdate(ctx, message, length);
+	EVP_DigestFinal_ex(ctx, digest, NULL);
+
+	EVP_MD_CTX_copy_ex(ctx, outer);
+	EVP_DigestUpdate(ctx, digest, sizeof(digest));
+	EVP_DigestFinal_ex(ctx, digest, NULL);
+
+	for (int i = 0; i < digestSize; i++)
+	{
+		hex[2 * i] = digits[digest[i] >> 4];
+		hex[2 * i + 1] = digits[digest[i] & 0xf];
+	}
+}
+
+static string readKey(const string& path)
+{
+	string key;
+
+	wordexp_t p;
+	char** w;
+	wordexp(path.c_str(), &p, 0);
+	w = p.we_wordv;
+	ifstream file(w[0]);
+	if (file.is_open())
+	{
+		file >> key;
+		file.close();
+	}
+	wordfree(&p);
+
+	return key;
+}
+
+// The number of decimals in the filter value, e.g. 2 for "0.01000000".
+static int getDecimals(const string& value)
+{
+	string::size_type dot = value.find('.');
+	if (dot == string::npos)
+		return 0;
+
+	string::size_type last = value.find_last_not_of('0');
+	if ((last == string::npos) || (last <= dot))
+		return 0;
+
+	return last - dot;
+}
+
+execution::Executor::Executor(const Server& server, const string api_key_, const string secret_key_) :
+
+hostname(server.getHostname()), orderUrl(hostname + "/api/v3/order"), api_key(api_key_), orderValue(0), timeOffset(0), curl(NULL), headers(NULL)
+
+{
+	string secret_key = secret_key_;
+	if (api_key == "")
+		api_key = readKey(Account::default_api_key_path);
+	if (secret_key == "")
+		secret_key = readKey(Account::default_secret_key_path);
+
+	signer = Signer(secret_key);
+
+	// Execution is enabled only by the order value in the config file.
+	string value = readKey(default_config_path);
+	if (value != "")
+		orderValue = atof(value.c_str());
+}
+
+execution::Executor::~Executor()
+{
+	if (headers)
+		curl_slist_free_all(headers);
+	if (curl)
+		curl_easy_cleanup(curl);
+}
+
+size_t execution::Executor::onResponse(void* data, size_t size, size_t nmemb, void* user)
+{
+	string* response = (string*)user;
+	response->append((char*)data, size * nmemb);
+	return size * nmemb;
+}
+
+executionError_t execution::Executor::get(const string& path, Json::Value& result)
+{
+	const string url = hostname + path;
+
+	response.clear();
+	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+	curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+	if (curl_easy_perform(curl) != CURLE_OK)
+		return executionErrorCurlFailed;
+
+	Json::Reader reader;
+	if (!reader.parse(response, result))
+		return executionErrorInvalidServerResponse;
+
+	return executionSuccess;
+}
+
+executionError_t execution::Executor::initialize()
+{
+	if (orderValue <= 0)
+		return executionErrorDisabled;
+
+	if (api_key == "")
+		return executionErrorMissingAccountKeys;
+
+	lock_guard<mutex> lock(connectionMutex);
+
+	curl = curl_easy_init();
+	if (!curl)
+		return executionErrorCurlFailed;
+
+	headers = curl_slist_append(headers, ("X-MBX-APIKEY: " + api_key).c_str());
+
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, onResponse);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+	curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+	// Exchange info also opens the connection and completes
+	// the TLS handshake, which are reused by the orders.
+	Json::Value info;
+	executionError_t status = get("/api/v3/exchangeInfo", info);
+	if (status != executionSuccess)
+		return status;
+
+	const Json::Value& symbols = info["symbols"];
+	if (!symbols.isArray())
+		return executionErrorInvalidServerResponse;
+
+	for (Json::Value::ArrayIndex i = 0, e = symbols.size(); i < e; i++)
+	{
+		const Json::Value& symbol = symbols[i];
+		const string name = symbol["symbol"].asString();
+
+		Template t;
+		t.buy = "symbol=" + name + "&side=BUY&type=LIMIT&timeInForce=IOC&newOrderRespType=FULL&quantity=";
+		t.sell = "symbol=" + name + "&side=SELL&type=LIMIT&timeInForce=IOC&newOrderRespType=FULL&quantity=";
+		t.qtyDecimals = 8;
+		t.priceDecimals = 8;
+		t.stepSize = 0;
+		t.tickSize = 0;
+		t.minQty = 0;
+		t.minNotional = 0;
+
+		const Json::Value& filters = symbol["filters"];
+		for (Json::Value::ArrayIndex j = 0, je = filters.size(); j < je; j++)
+		{
+			const Json::Value& filter = filters[j];
+			const string type = filter["filterType"].asString();
+			if (type == "PRICE_FILTER")
+			{
+				t.tickSize = atof(filter["tickSize"].asCString());
+				t.priceDecimals = getDecimals(filter["tickSize"].asString());
+			}
+			else if (type == "LOT_SIZE")
+			{
+				t.stepSize = atof(filter["stepSize"].asCString());
+				t.minQty = atof(filter["minQty"].asCString());
+				t.qtyDecimals = getDecimals(filter["stepSize"].asString());
+			}
+			else if ((type == "MIN_NOTIONAL") || (type == "NOTIONAL"))
+				t.minNotional = atof(filter["minNotional"].asCString());
+		}
+
+		templates[name] = t;
+	}
+
+	Json::Value time;
+	status = get("/api/v3/time", time);
+	if (status != executionSuccess)
+		return status;
+
+	int64_t localTime = chrono::duration_cast<chrono::milliseconds>(
+		chrono::system_clock::now().time_since_epoch()).count();
+	timeOffset = time["serverTime"].asInt64() - localTime;
+
+	// Orders are posted from now on.
+	curl_easy_setopt(curl, CURLOPT_POST, 1L);
+
+	return executionSuccess;
+}
+
+executionError_t execution::Executor::sendOrder(const string& prefix, const Template& t,
+	double qty, double price, Time signaled, Fill& fill)
+{
+	// Round the quantity down to the lot step and the price to the tick.
+	if (t.stepSize > 0)
+		qty = floor(qty / t.stepSize + 1e-9) * t.stepSize;
+	if (t.tickSize > 0)
+		price = round(price / t.tickSize) * t.tickSize;
+
+	if ((qty <= 0) || (qty < t.minQty) || (qty * price < t.minNotional))
+		return executionErrorBelowMinimum;
+
+	const int64_t timestamp = chrono::duration_cast<chrono::milliseconds>(
+		chrono::system_clock::now().time_since_epoch()).count() + timeOffset;
+
+	// Body is small enough to be formatted on stack.
+	char body[512];
+	int length = prefix.size();
+	memcpy(body, prefix.c_str(), length);
+	length += snprintf(body + length, sizeof(body) - length,
+		"%.*f&price=%.*f&recvWindow=5000&timestamp=%lld",
+		t.qtyDecimals, qty, t.priceDecimals, price, (long long)timestamp);
+
+	char signature[2 * Signer::digestSize];
+	signer.sign(body, length, signature);
+	length += snprintf(body + length, sizeof(body) - length,
+		"&signature=%.*s", (int)sizeof(signature), signature);
+
+	lock_guard<mutex> lock(connectionMutex);
+
+	// The time since the signal counts, including the wait for the connection.
+	const double prepared = chrono::duration<double, micro>(chrono::steady_clock::now() - signaled).count();
+
+	response.clear();
+	curl_easy_setopt(curl, CURLOPT_URL, orderUrl.c_str());
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)length);
+	CURLcode code = curl_easy_perform(curl);
+
+	// The connection is reused, so the time until the transfer start
+	// is the time of writing out the request.
+	double pretransfer = 0;
+	curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+	fill.latency = prepared + pretransfer * 1e6;
+
+	if (code != CURLE_OK)
+		return executionErrorCurlFailed;
+
+	Json::Value result;
+	Json::Reader reader;
+	if (!reader.parse(response, result))
+		return executionErrorInvalidServerResponse;
+
+	if (!result.isMember("orderId"))
+	{
+		fprintf(stderr, "Order rejected: %s\n", response.c_str());
+		return executionErrorOrderRejected;
+	}
+
+	fill.orderId = result["orderId"].asInt64();
+	fill.status = result["status"].asString();
+	fill.time = result["transactTime"].asInt64();
+	fill.qty = atof(result["executedQty"].asCString());
+	fill.quoteQty = atof(result["cummulativeQuoteQty"].asCString());
+	fill.price = (fill.qty > 0) ? fill.quoteQty / fill.qty : 0;
+
+	// The IOC order finding no liquidity within its price expires as is.
+	if (fill.qty <= 0)
+		return executionErrorNotFilled;
+
+	return executionSuccess;
+}
+
+executionError_t execution::Executor::buy(const string& symbol, double price, Fill& fill, Time signaled)
+{
+	if (!isEnabled() || !curl)
+		return executionErrorDisabled;
+
+	map<string, Template>::const_iterator t = templates.find(symbol);
+	if (t == templates.end())
+		return executionErrorUnknownSymbol;
+
+	return sendOrder(t->second.buy, t->second, orderValue / price, price, signaled, fill);
+}
+
+executionError_t execution::Executor::sell(const string& symbol, double amount, double price, Fill& fill, Time signaled)
+{
+	if (!isEnabled() || !curl)
+		return executionErrorDisabled;
+
+	map<string, Template>::const_iterator t = templates.find(symbol);
+	if (t == templates.end())
+		return executionErrorUnknownSymbol;
+
+	return sendOrder(t->second.sell, t->second, amount, price, signaled, fill);
+}
+
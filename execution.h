@@ -0,0 +1,155 @@
+#ifndef EXECUTION_H
+#define EXECUTION_H
+
+#include <chrono>
+#include <cstdint>
+#include <curl/curl.h>
+#include <map>
+#include <mutex>
+#include <openssl/evp.h>
+#include <string>
+
+#include "binance.h"
+
+namespace execution
+{
+	enum executionError_t
+	{
+		executionSuccess = 0,
+		executionErrorDisabled,
+		executionErrorMissingAccountKeys,
+		executionErrorCurlFailed,
+		executionErrorInvalidServerResponse,
+		executionErrorUnknownSymbol,
+		executionErrorBelowMinimum,
+		executionErrorOrderRejected,
+		executionErrorNotFilled,
+	};
+
+	const char* executionGetErrorString(const executionError_t err);
+
+	// HMAC-SHA256 with the key schedule computed once: the inner and outer
+	// padded key blocks are hashed in advance, and each signature starts
+	// from the copies of these midstates.
+	class Signer
+	{
+		EVP_MD_CTX* inner;
+		EVP_MD_CTX* outer;
+
+	public :
+
+		static const int blockSize = 64;
+		static const int digestSize = 32;
+
+		Signer(const std::string& key = "");
+
+		Signer(const Signer& other);
+
+		Signer& operator=(const Signer& other);
+
+		~Signer();
+
+		// Write 2 * digestSize hex digits of the message signature.
+		void sign(const char* message, size_t length, char* hex) const;
+	};
+
+	// Result of the executed order.
+	struct Fill
+	{
+		int64_t orderId;
+		std::string status;
+
+		// Transaction time of the exchange, in ms.
+		int64_t time;
+
+		// Executed base quantity, spent or received quote quantity,
+		// and the average price.
+		double qty;
+		double quoteQty;
+		double price;
+
+		// Time from the signal to the request being written out to the
+		// exchange connection, in microseconds.
+		double latency;
+	};
+
+	// Opt-in execution of BUY/SELL recommendations as IOC limit orders.
+	//
+	// Keys are taken from the same files as binance::Account uses. Orders bypass
+	// Account::sendOrder to keep a single persistent connection and to build the
+	// requests from per-symbol templates computed on initialization.
+	class Executor
+	{
+	public :
+
+		typedef std::chrono::steady_clock::time_point Time;
+
+	private :
+
+		struct Template
+		{
+			// "symbol=...&side=BUY&type=LIMIT&timeInForce=IOC&quantity=" prefixes.
+			std::string buy, sell;
+
+			int qtyDecimals, priceDecimals;
+			double stepSize, tickSize;
+			double minQty, minNotional;
+		};
+
+		const std::string hostname;
+		const std::string orderUrl;
+		std::string api_key;
+		Signer signer;
+
+		// The amount of quote asset spent on each BUY; zero disables execution.
+		double orderValue;
+
+		std::map<std::string, Template> templates;
+
+		// Difference between the exchange and the local clock, in ms.
+		int64_t timeOffset;
+
+		// Single connection is kept alive and shared by the trading threads.
+		std::mutex connectionMutex;
+		CURL* curl;
+		curl_slist* headers;
+		std::string response;
+
+		static size_t onResponse(void* data, size_t size, size_t nmemb, void* user);
+
+		executionError_t get(const std::string& path, Json::Value& result);
+
+		executionError_t sendOrder(const std::string& prefix, const Template& t,
+			double qty, double price, Time signaled, Fill& fill);
+
+	public :
+
+		static const std::string default_config_path;
+
+		Executor(const binance::Server& server, const std::string api_key = "", const std::string secret_key = "");
+
+		~Executor();
+
+		bool isEnabled() const { return (orderValue > 0) && (api_key != ""); }
+
+		double getOrderValue() const { return orderValue; }
+
+		// Load the symbol filters, build the request templates, synchronize
+		// the clock and open the exchange connection.
+		executionError_t initialize();
+
+		// Buy for the configured order value, at most at the given price.
+		// The order expired with nothing executed is not filled. The latency
+		// is measured from the signal time, the call time by default.
+		executionError_t buy(const std::string& symbol, double price, Fill& fill,
+			Time signaled = std::chrono::steady_clock::now());
+
+		// Sell the given amount, at least at the given price.
+		// The order expired with nothing executed is not filled.
+		executionError_t sell(const std::string& symbol, double amount, double price, Fill& fill,
+			Time signaled = std::chrono::steady_clock::now());
+	};
+}
+
+#endif // EXECUTION_H
+
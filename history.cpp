@@ -0,0 +1,356 @@
+#include "history.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace history;
+using namespace std;
+
+#define HISTORY_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* history::historyGetErrorString(const historyError_t err)
+{
+	switch (err)
+	{
+	HISTORY_CASE_STR(historySuccess);
+	HISTORY_CASE_STR(historyErrorOpenFailed);
+	HISTORY_CASE_STR(historyErrorReadFailed);
+	HISTORY_CASE_STR(historyErrorWriteFailed);
+	HISTORY_CASE_STR(historyErrorInvalidFormat);
+	HISTORY_CASE_STR(historyErrorDictionaryFull);
+	HISTORY_CASE_STR(historyErrorSymbolTooLong);
+	HISTORY_CASE_STR(historyErrorLocked);
+	}
+}
+
+namespace
+{
+	const char magic[8] = { 'B', 'I', 'T', 'R', 'H', 'I', 'S', 'T' };
+
+	const uint32_t version = 1;
+
+	// Fixed part of the file header, followed by maxSymbols
+	// slots of maxSymbolLength chars each.
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t recordSize;
+		uint32_t nsymbols;
+		uint32_t maxSymbols;
+		uint32_t maxSymbolLength;
+		uint32_t reserved;
+	};
+
+	const char indexMagic[8] = { 'B', 'I', 'T', 'R', 'I', 'D', 'X', '1' };
+
+	struct IndexHeader
+	{
+		char magic[8];
+		uint32_t recordSize;
+		uint32_t nsymbols;
+		uint64_t inode;
+		uint64_t nrecords;
+	};
+}
+
+const uint64_t history::File::dataOffset = sizeof(FileHeader) +
+	(uint64_t)history::File::maxSymbols * history::File::maxSymbolLength;
+
+uint16_t history::SymbolDictionary::find(const string& name) const
+{
+	map<string, uint16_t>::const_iterator i = ids.find(name);
+	if (i == ids.end())
+		return invalid;
+
+	return i->second;
+}
+
+uint16_t history::SymbolDictionary::insert(const string& name)
+{
+	uint16_t id = find(name);
+	if (id != invalid)
+		return id;
+
+	id = names.size();
+	names.push_back(name);
+	ids[name] = id;
+
+	return id;
+}
+
+history::File::File(const string& path_) : path(path_), lockfd(-1) { }
+
+historyError_t history::File::writeHeader()
+{
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.recordSize = sizeof(Trade);
+	header.nsymbols = dictionary.size();
+	header.maxSymbols = maxSymbols;
+	header.maxSymbolLength = maxSymbolLength;
+
+	file.clear();
+	file.seekp(0, file.beg);
+	file.write((char*)&header, sizeof(header));
+	file.flush();
+	if (!file.good())
+		return historyErrorWriteFailed;
+
+	return historySuccess;
+}
+
+historyError_t history::File::open()
+{
+	close();
+
+	file.open(path.c_str(), fstream::in | fstream::out | fstream::binary);
+	if (!file.is_open())
+	{
+		// Create a new file.
+		ofstream created(path.c_str(), ofstream::binary);
+		if (!created.is_open())
+			return historyErrorOpenFailed;
+		created.close();
+
+		file.open(path.c_str(), fstream::in | fstream::out | fstream::binary);
+		if (!file.is_open())
+			return historyErrorOpenFailed;
+	}
+
+	dictionary = SymbolDictionary();
+
+	file.seekg(0, file.end);
+	uint64_t length = file.tellg();
+	if (length == 0)
+	{
+		// Reserve the whole dictionary area, so that the records
+		// always start at dataOffset.
+		historyError_t status = writeHeader();
+		if (status != historySuccess)
+			return status;
+
+		vector<char> slots(dataOffset - sizeof(FileHeader));
+		file.write(&slots[0], slots.size());
+		file.flush();
+		if (!file.good())
+			return historyErrorWriteFailed;
+
+		return historySuccess;
+	}
+
+	if (length < dataOffset)
+		return historyErrorInvalidFormat;
+
+	FileHeader header;
+	file.seekg(0, file.beg);
+	file.read((char*)&header, sizeof(header));
+	if (!file.good())
+		return historyErrorReadFailed;
+
+	if (memcmp(header.magic, magic, sizeof(magic)) || (header.version != version) ||
+		(header.recordSize != sizeof(Trade)) || (header.maxSymbols != maxSymbols) ||
+		(header.maxSymbolLength != maxSymbolLength) || (header.nsymbols > maxSymbols))
+		return historyErrorInvalidFormat;
+
+	if ((length - dataOffset) % sizeof(Trade))
+		return historyErrorInvalidFormat;
+
+	vector<char> slots(header.nsymbols * maxSymbolLength);
+	if (slots.size())
+	{
+		file.read(&slots[0], slots.size());
+		if (!file.good())
+			return historyErrorReadFailed;
+	}
+
+	for (uint32_t i = 0; i < header.nsymbols; i++)
+	{
+		const char* slot = &slots[i * maxSymbolLength];
+		dictionary.insert(string(slot, strnlen(slot, maxSymbolLength)));
+	}
+
+	if (dictionary.size() != header.nsymbols)
+		return historyErrorInvalidFormat;
+
+	return historySuccess;
+}
+
+void history::File::close()
+{
+	if (file.is_open())
+		file.close();
+
+	if (lockfd >= 0)
+	{
+		::close(lockfd);
+		lockfd = -1;
+	}
+}
+
+historyError_t history::File::lock()
+{
+	if (lockfd >= 0)
+		return historySuccess;
+
+	lockfd = ::open(path.c_str(), O_RDONLY);
+	if (lockfd < 0)
+		return historyErrorOpenFailed;
+
+	if (flock(lockfd, LOCK_EX | LOCK_NB))
+	{
+		::close(lockfd);
+		lockfd = -1;
+		return historyErrorLocked;
+	}
+
+	return historySuccess;
+}
+
+historyError_t history::File::addSymbol(const string& name, uint16_t& id)
+{
+	id = dictionary.find(name);
+	if (id != SymbolDictionary::invalid)
+		return historySuccess;
+
+	if (name.size() >= maxSymbolLength)
+		return historyErrorSymbolTooLong;
+
+	if (dictionary.size() >= maxSymbols)
+		return historyErrorDictionaryFull;
+
+	char slot[maxSymbolLength];
+	memset(slot, 0, sizeof(slot));
+	memcpy(slot, name.c_str(), name.size());
+
+	const uint32_t index = dictionary.size();
+
+	file.clear();
+	file.seekp(sizeof(FileHeader) + index * maxSymbolLength, file.beg);
+	file.write(slot, sizeof(slot));
+	if (!file.good())
+		return historyErrorWriteFailed;
+
+	id = dictionary.insert(name);
+
+	// Publish the new symbol only after its name has been written.
+	return writeHeader();
+}
+
+size_t history::File::getRecordsCount()
+{
+	file.clear();
+	file.seekg(0, file.end);
+	uint64_t length = file.tellg();
+
+	return (length - dataOffset) / sizeof(Trade);
+}
+
+historyError_t history::File::read(size_t first, size_t count, Trade* trades)
+{
+	if (count == 0)
+		return historySuccess;
+
+	file.clear();
+	file.seekg(dataOffset + first * sizeof(Trade), file.beg);
+	file.read((char*)trades, count * sizeof(Trade));
+	if (!file.good())
+		return historyErrorReadFailed;
+
+	return historySuccess;
+}
+
+historyError_t history::File::append(const Trade* trades, size_t count)
+{
+	if (count == 0)
+		return historySuccess;
+
+	file.clear();
+	file.seekp(0, file.end);
+	file.write((const char*)trades, count * sizeof(Trade));
+	file.flush();
+	if (!file.good())
+		return historyErrorWriteFailed;
+
+	return historySuccess;
+}
+
+
+historyError_t history::Index::load(const string& historyPath)
+{
+	struct stat st;
+	if (stat(historyPath.c_str(), &st))
+		return historyErrorOpenFailed;
+
+	ifstream file(getPath(historyPath).c_str(), ifstream::binary);
+	if (!file.is_open())
+		return historyErrorOpenFailed;
+
+	IndexHeader header;
+	file.read((char*)&header, sizeof(header));
+	if (!file.good())
+		return historyErrorReadFailed;
+
+	if (memcmp(header.magic, indexMagic, sizeof(indexMagic)) || (header.recordSize != sizeof(Trade)) ||
+		(header.nsymbols > File::maxSymbols) || (header.inode != st.st_ino) ||
+		(File::dataOffset + header.nrecords * sizeof(Trade) > (uint64_t)st.st_size))
+		return historyErrorInvalidFormat;
+
+	symbols.resize(header.nsymbols);
+	if (symbols.size())
+	{
+		file.read((char*)&symbols[0], symbols.size() * sizeof(Entry));
+		if (!file.good())
+			return historyErrorReadFailed;
+	}
+
+	inode = header.inode;
+	nrecords = header.nrecords;
+
+	return historySuccess;
+}
+
+historyError_t history::Index::save(const string& historyPath) const
+{
+	IndexHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, indexMagic, sizeof(indexMagic));
+	header.recordSize = sizeof(Trade);
+	header.nsymbols = symbols.size();
+	header.inode = inode;
+	header.nrecords = nrecords;
+
+	const string path = getPath(historyPath);
+	const string temporary = path + ".tmp";
+	{
+		ofstream file(temporary.c_str(), ofstream::binary | ofstream::trunc);
+		if (!file.is_open())
+			return historyErrorOpenFailed;
+
+		file.write((const char*)&header, sizeof(header));
+		if (symbols.size())
+			file.write((const char*)&symbols[0], symbols.size() * sizeof(Entry));
+		file.flush();
+		if (!file.good())
+			return historyErrorWriteFailed;
+	}
+
+	// Make the contents durable before they replace the previous index.
+	int fd = ::open(temporary.c_str(), O_RDONLY);
+	if ((fd < 0) || fsync(fd))
+	{
+		if (fd >= 0) ::close(fd);
+		return historyErrorWriteFailed;
+	}
+	::close(fd);
+
+	if (rename(temporary.c_str(), path.c_str()))
+		return historyErrorWriteFailed;
+
+	return historySuccess;
+}
@@ -0,0 +1,156 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace history
+{
+	enum historyError_t
+	{
+		historySuccess = 0,
+		historyErrorOpenFailed,
+		historyErrorReadFailed,
+		historyErrorWriteFailed,
+		historyErrorInvalidFormat,
+		historyErrorDictionaryFull,
+		historyErrorSymbolTooLong,
+		historyErrorLocked,
+	};
+
+	const char* historyGetErrorString(const historyError_t err);
+
+	#define HISTORY_ERR_CHECK(x) \
+	do { \
+		history::historyError_t err = x; \
+		if (err != history::historySuccess) \
+		{ \
+			fprintf(stderr, "%s:%d: history error: %s\n", __FILE__, __LINE__, history::historyGetErrorString(err)); \
+			exit(1); \
+		} \
+	} while (0)
+
+	// Trade record, as stored in the history file. The symbol is
+	// an index into the symbol dictionary kept in the file header.
+	struct Trade
+	{
+		double price;
+		double qty;
+		int64_t id, time;
+		uint16_t symbol;
+		bool isBestMatch;
+		bool isBuyerMaker;
+	};
+
+	static_assert(sizeof(Trade) == 40, "Unexpected history::Trade record size");
+
+	// Maps full symbol names to compact 16-bit ids.
+	// Ids are dense, so the names are resolved by a plain array index.
+	class SymbolDictionary
+	{
+		std::vector<std::string> names;
+		std::map<std::string, uint16_t> ids;
+
+	public :
+
+		static const uint16_t invalid = 0xffff;
+
+		size_t size() const { return names.size(); }
+
+		const std::string& getName(uint16_t id) const { return names[id]; }
+
+		// Returns invalid, if the name is not in dictionary.
+		uint16_t find(const std::string& name) const;
+
+		// Returns the id of existing or newly inserted name.
+		uint16_t insert(const std::string& name);
+	};
+
+	// Binary history file: the header with symbol dictionary
+	// is followed by the trade records.
+	class File
+	{
+		std::string path;
+		std::fstream file;
+		int lockfd;
+
+		SymbolDictionary dictionary;
+
+		historyError_t writeHeader();
+
+	public :
+
+		// The maximum number of symbols and the symbol name length (incl. '\0')
+		// reserved in the file header.
+		static const uint32_t maxSymbols = 8192;
+		static const uint32_t maxSymbolLength = 24;
+
+		static const uint64_t dataOffset;
+
+		File(const std::string& path);
+
+		// Open the existing file, or create a new empty one.
+		historyError_t open();
+
+		void close();
+
+		// Take the exclusive advisory lock of the file, held until it is closed,
+		// for the writers and the compaction not to run over each other.
+		historyError_t lock();
+
+		const SymbolDictionary& getDictionary() const { return dictionary; }
+
+		// Find the symbol id, adding the symbol to the file dictionary, if necessary.
+		historyError_t addSymbol(const std::string& name, uint16_t& id);
+
+		size_t getRecordsCount();
+
+		historyError_t read(size_t first, size_t count, Trade* trades);
+
+		historyError_t append(const Trade* trades, size_t count);
+	};
+
+	// Offsets of the symbols in the compacted history file, kept next to it in
+	// <history>.index. The records [0, nrecords) are sorted by the symbol and id,
+	// without duplicate ids, so that the records of each symbol are contiguous;
+	// the records appended after the compaction are not covered.
+	class Index
+	{
+	public :
+
+		struct Entry
+		{
+			uint64_t first, count;
+			int64_t firstId, lastId;
+			int64_t firstTime, lastTime;
+		};
+
+		// The inode of the compacted file, for the index not to be taken
+		// for the file replaced since.
+		uint64_t inode;
+
+		uint64_t nrecords;
+
+		// Entries by the symbol id, empty for the symbols without records.
+		std::vector<Entry> symbols;
+
+		Index() : inode(0), nrecords(0) { }
+
+		static std::string getPath(const std::string& historyPath) { return historyPath + ".index"; }
+
+		// Load the index of the history file, failing with historyErrorInvalidFormat,
+		// if it does not belong to the file as it is now.
+		historyError_t load(const std::string& historyPath);
+
+		// Write the index atomically, replacing the previous one.
+		historyError_t save(const std::string& historyPath) const;
+	};
+}
+
+#endif // HISTORY_H
+
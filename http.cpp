@@ -0,0 +1,268 @@
+#include "http.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+
+using namespace http;
+using namespace std;
+
+#define HTTP_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* http::httpGetErrorString(const httpError_t err)
+{
+	switch (err)
+	{
+	HTTP_CASE_STR(httpSuccess);
+	HTTP_CASE_STR(httpErrorCurlFailed);
+	HTTP_CASE_STR(httpErrorServerStatus);
+	HTTP_CASE_STR(httpErrorRateLimited);
+	}
+}
+
+namespace
+{
+	// libcurl is initialized once per process, before main starts any thread,
+	// as curl_global_init is not thread-safe, and is cleaned up at the exit.
+	struct Global
+	{
+		Global() { curl_global_init(CURL_GLOBAL_ALL); }
+
+		~Global() { curl_global_cleanup(); }
+	};
+
+	Global global;
+
+	// Pause of the requests on the rate limit without the Retry-After.
+	const int64_t defaultPauseMs = 60 * 1000;
+
+	const int64_t minRetryDelayMs = 500;
+	const int64_t maxRetryDelayMs = 60 * 1000;
+}
+
+http::Client::Client(const string& hostname_, int maxConnections, int maxInFlight_, const vector<string>& headers_) :
+
+hostname(hostname_), maxInFlight(maxInFlight_), headers(NULL), pending(0), stopping(false), ncompleted(0)
+
+{
+	for (int i = 0; i < headers_.size(); i++)
+		headers = curl_slist_append(headers, headers_[i].c_str());
+
+	multi = curl_multi_init();
+	curl_multi_setopt(multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+	curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)maxConnections);
+
+	loop = thread(&Client::run, this);
+}
+
+http::Client::~Client()
+{
+	{
+		lock_guard<mutex> lock(requestsMutex);
+		stopping = true;
+	}
+	curl_multi_wakeup(multi);
+	loop.join();
+
+	for (int i = 0; i < transfers.size(); i++)
+	{
+		curl_multi_remove_handle(multi, transfers[i]->curl);
+		curl_easy_cleanup(transfers[i]->curl);
+		delete transfers[i];
+	}
+
+	curl_multi_cleanup(multi);
+	curl_slist_free_all(headers);
+}
+
+size_t http::Client::onData(void* data, size_t size, size_t nmemb, void* user)
+{
+	string* body = (string*)user;
+	body->append((char*)data, size * nmemb);
+	return size * nmemb;
+}
+
+http::Client::Transfer* http::Client::getTransfer()
+{
+	if (freeTransfers.size())
+	{
+		Transfer* transfer = freeTransfers.back();
+		freeTransfers.pop_back();
+		return transfer;
+	}
+
+	Transfer* transfer = new Transfer();
+	transfer->curl = curl_easy_init();
+	transfers.push_back(transfer);
+
+	CURL* curl = transfer->curl;
+	curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, onData);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer->response.body);
+	curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+	curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+	curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, 10000L);
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 30000L);
+
+	return transfer;
+}
+
+void http::Client::run()
+{
+	int inFlight = 0;
+
+	while (1)
+	{
+		// Start the submitted requests, within the in-flight limit,
+		// unless paused, and the delayed ones, as they are due.
+		const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		int timeoutMs = 1000;
+		{
+			lock_guard<mutex> lock(requestsMutex);
+			if (stopping) break;
+
+			while (delayed.size() && (delayed.begin()->first <= now))
+			{
+				requests.push_back(delayed.begin()->second);
+				delayed.erase(delayed.begin());
+			}
+			if (delayed.size())
+				timeoutMs = min((int64_t)timeoutMs, chrono::duration_cast<chrono::milliseconds>(
+					delayed.begin()->first - now).count() + 1);
+			if (now < pausedUntil)
+				timeoutMs = min((int64_t)timeoutMs, chrono::duration_cast<chrono::milliseconds>(
+					pausedUntil - now).count() + 1);
+
+			while (requests.size() && (inFlight < maxInFlight) && (now >= pausedUntil))
+			{
+				Request& request = requests.front();
+
+				Transfer* transfer = getTransfer();
+				transfer->callback.swap(request.callback);
+				transfer->response.body.clear();
+
+				const string url = hostname + request.path;
+				curl_easy_setopt(transfer->curl, CURLOPT_URL, url.c_str());
+				curl_easy_setopt(transfer->curl, CURLOPT_HTTPHEADER, request.withHeaders ? headers : NULL);
+				curl_multi_add_handle(multi, transfer->curl);
+				inFlight++;
+
+				requests.pop_front();
+			}
+		}
+
+		int running = 0;
+		curl_multi_perform(multi, &running);
+
+		int nmessages = 0;
+		while (CURLMsg* message = curl_multi_info_read(multi, &nmessages))
+		{
+			if (message->msg != CURLMSG_DONE) continue;
+
+			Transfer* transfer = NULL;
+			curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &transfer);
+			curl_multi_remove_handle(multi, transfer->curl);
+			inFlight--;
+
+			Response& response = transfer->response;
+			response.code = 0;
+			response.retryAfter = 0;
+			if (message->data.result != CURLE_OK)
+				response.status = httpErrorCurlFailed;
+			else
+			{
+				curl_easy_getinfo(transfer->curl, CURLINFO_RESPONSE_CODE, &response.code);
+				response.status = (response.code == 200) ? httpSuccess : httpErrorServerStatus;
+
+				curl_off_t retryAfter = 0;
+				if (curl_easy_getinfo(transfer->curl, CURLINFO_RETRY_AFTER, &retryAfter) == CURLE_OK)
+					response.retryAfter = retryAfter;
+			}
+
+			// Pause all requests, for the server not to ban the IP, or to lift the ban.
+			if ((response.code == 429) || (response.code == 418))
+			{
+				response.status = httpErrorRateLimited;
+
+				const int64_t pauseMs = response.retryAfter ? response.retryAfter * 1000 : defaultPauseMs;
+				const chrono::steady_clock::time_point until = chrono::steady_clock::now() + chrono::milliseconds(pauseMs);
+
+				lock_guard<mutex> lock(requestsMutex);
+				if (until > pausedUntil)
+				{
+					fprintf(stderr, "%s : HTTP %ld, pausing all requests for %ld s\n",
+						hostname.c_str(), response.code, (long)(pauseMs / 1000));
+					pausedUntil = until;
+				}
+			}
+
+			transfer->callback(response);
+			transfer->callback = Callback();
+
+			// Keep the handle with its connection cache for the next request.
+			freeTransfers.push_back(transfer);
+
+			{
+				lock_guard<mutex> lock(requestsMutex);
+				pending--;
+				ncompleted++;
+			}
+			idle.notify_all();
+		}
+
+		curl_multi_poll(multi, NULL, 0, timeoutMs, NULL);
+	}
+}
+
+void http::Client::get(const string& path, const Callback& callback, bool withHeaders, int64_t delayMs)
+{
+	{
+		lock_guard<mutex> lock(requestsMutex);
+
+		Request request;
+		request.path = path;
+		request.callback = callback;
+		request.withHeaders = withHeaders;
+		if (delayMs > 0)
+			delayed.insert(make_pair(chrono::steady_clock::now() + chrono::milliseconds(delayMs), request));
+		else
+			requests.push_back(request);
+		pending++;
+	}
+
+	curl_multi_wakeup(multi);
+}
+
+int64_t http::Client::getRetryDelay(int nfailures)
+{
+	const int64_t delay = min(maxRetryDelayMs, minRetryDelayMs << min(max(nfailures - 1, 0), 16));
+
+	// The jitter of up to a quarter of the delay, by the generator of the calling
+	// thread, seeded apart, so that the threads retrying at once spread out.
+	static thread_local minstd_rand generator(random_device{}());
+	uniform_int_distribution<int64_t> jitter(0, delay / 2);
+	return delay - delay / 4 + jitter(generator);
+}
+
+void http::Client::wait()
+{
+	unique_lock<mutex> lock(requestsMutex);
+	idle.wait(lock, [this]() { return pending == 0; });
+}
+
+size_t http::Client::getPending()
+{
+	lock_guard<mutex> lock(requestsMutex);
+	return pending;
+}
+
+int64_t http::Client::getCompleted()
+{
+	lock_guard<mutex> lock(requestsMutex);
+	return ncompleted;
+}
+
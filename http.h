@@ -0,0 +1,134 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <curl/curl.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace http
+{
+	enum httpError_t
+	{
+		httpSuccess = 0,
+		httpErrorCurlFailed,
+		httpErrorServerStatus,
+		httpErrorRateLimited,
+	};
+
+	const char* httpGetErrorString(const httpError_t err);
+
+	struct Response
+	{
+		httpError_t status;
+
+		// HTTP status code, or 0 if the transfer failed.
+		long code;
+
+		// Seconds to wait by the Retry-After header, 0 if none.
+		int64_t retryAfter;
+
+		std::string body;
+	};
+
+	typedef std::function<void(Response& response)> Callback;
+
+	// Asynchronous HTTP client running many requests at once on a single
+	// event loop thread. Requests to the same host are multiplexed over
+	// a few pooled keep-alive connections (HTTP/2 where the server supports
+	// it), and transfer handles are recycled.
+	//
+	// Callbacks are called on the event loop thread, so they should only
+	// hand the response over to the decoding stage.
+	//
+	// When the server limits the rate (HTTP 429, or 418 for the banned IP),
+	// the client starts no requests, until the server allows; such responses
+	// are httpErrorRateLimited. The other failed requests are up to the user
+	// to be retried with the backoff of getRetryDelay, up to maxRetries.
+	class Client
+	{
+		struct Transfer
+		{
+			CURL* curl;
+			Callback callback;
+			Response response;
+		};
+
+		struct Request
+		{
+			std::string path;
+			Callback callback;
+			bool withHeaders;
+		};
+
+		const std::string hostname;
+
+		const int maxInFlight;
+
+		CURLM* multi;
+
+		// Headers of the requests asking for them, such as the API key.
+		curl_slist* headers;
+
+		std::vector<Transfer*> transfers, freeTransfers;
+
+		// Requests submitted by the user threads, not yet started, and the
+		// ones delayed, by the time they are due.
+		std::mutex requestsMutex;
+		std::condition_variable idle;
+		std::deque<Request> requests;
+		std::multimap<std::chrono::steady_clock::time_point, Request> delayed;
+		size_t pending;
+		bool stopping;
+
+		// No requests are started until then, by the rate limit of the server.
+		std::chrono::steady_clock::time_point pausedUntil;
+
+		int64_t ncompleted;
+
+		std::thread loop;
+
+		static size_t onData(void* data, size_t size, size_t nmemb, void* user);
+
+		Transfer* getTransfer();
+
+		void run();
+
+	public :
+
+		// Failed requests are retried this many times at most.
+		static const int maxRetries = 8;
+
+		// The headers, such as the API key, are given by the user, for the requests asking for them.
+		Client(const std::string& hostname, int maxConnections = 8, int maxInFlight = 256,
+			const std::vector<std::string>& headers = std::vector<std::string>());
+
+		~Client();
+
+		// Submit the GET request for the path (incl. the query), started after
+		// the delay. The headers of the client are added to the request, if requested.
+		void get(const std::string& path, const Callback& callback, bool withHeaders = false, int64_t delayMs = 0);
+
+		// Delay of the retry of the request failed the given times in a row:
+		// doubled with each failure up to a minute, with the jitter, for the
+		// retries of the many requests failed at once to spread out.
+		static int64_t getRetryDelay(int nfailures);
+
+		// Wait for all submitted requests to complete.
+		void wait();
+
+		size_t getPending();
+
+		int64_t getCompleted();
+	};
+}
+
+#endif // HTTP_H
+
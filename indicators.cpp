@@ -0,0 +1,265 @@
+#include "indicators.h"
+
+#include <algorithm>
+
+using namespace candles;
+using namespace indicators;
+using namespace std;
+
+// Mean and standard deviation of the window by its sums.
+static void getBands(double weight, double sum, double square, double origin, double width,
+	double& middle, double& upper, double& lower)
+{
+	const double mean = sum / weight;
+	const double deviation = sqrt(fmax(square / weight - mean * mean, 0));
+
+	middle = origin + mean;
+	upper = middle + width * deviation;
+	lower = middle - width * deviation;
+}
+
+void indicators::Bollinger::get(double* values) const
+{
+	if (!sums.full())
+	{
+		values[0] = values[1] = values[2] = NAN;
+		return;
+	}
+
+	getBands(sums.size(), sums.getSum(), squares.getSum(), origin, width, values[0], values[1], values[2]);
+}
+
+void indicators::ATR::add(const Candle& candle)
+{
+	// The candle without trades continues at the previous close: its true range is zero.
+	double range = 0;
+	if (!candle.empty())
+	{
+		range = isnan(close) ? candle.high - candle.low :
+			fmax(candle.high, close) - fmin(candle.low, close);
+		close = candle.close;
+	}
+	else if (isnan(close))
+		return;
+
+	if (count < period)
+	{
+		value = (count ? value : 0) + range / period;
+		count++;
+	}
+	else
+		value += (range - value) / period;
+}
+
+void indicators::OBV::add(const Candle& candle)
+{
+	if (candle.empty()) return;
+
+	if (isnan(close))
+		value = 0;
+	else if (candle.close > close)
+		value += candle.volume;
+	else if (candle.close < close)
+		value -= candle.volume;
+
+	close = candle.close;
+}
+
+void indicators::VWAPBands::add(const Candle& candle)
+{
+	const double close = closes.add(candle);
+	if (isnan(close)) return;
+
+	const double price = candle.empty() ? close : (candle.high + candle.low + candle.close) / 3;
+	const double volume = candle.empty() ? 0 : candle.volume;
+
+	if (isnan(origin)) origin = price;
+	volumes.add(volume);
+	sums.add((price - origin) * volume);
+	squares.add((price - origin) * (price - origin) * volume);
+}
+
+void indicators::VWAPBands::get(double* values) const
+{
+	if (!volumes.full() || !(volumes.getSum() > 0))
+	{
+		values[0] = values[1] = values[2] = NAN;
+		return;
+	}
+
+	getBands(volumes.getSum(), sums.getSum(), squares.getSum(), origin, width, values[0], values[1], values[2]);
+}
+
+Indicator* indicators::create(const Parameters& parameters)
+{
+	switch (parameters.type)
+	{
+	case Parameters::EMA : return new EMA(parameters.period);
+	case Parameters::RSI : return new RSI(parameters.period);
+	case Parameters::Bollinger : return new Bollinger(parameters.period, parameters.width);
+	case Parameters::ATR : return new ATR(parameters.period);
+	case Parameters::OBV : return new OBV();
+	case Parameters::VWAPBands : return new VWAPBands(parameters.period, parameters.width);
+	}
+
+	return NULL;
+}
+
+void indicators::ema(const double* close, size_t n, int period, double* result)
+{
+	EMA state(period);
+	for (size_t i = 0; i < n; i++)
+		result[i] = state.update(close[i]);
+}
+
+void indicators::rsi(const double* close, size_t n, int period, double* result)
+{
+	RSI state(period);
+	for (size_t i = 0; i < n; i++)
+		result[i] = state.update(close[i]);
+}
+
+// Prefix sums of the values relative to the origin, and of their squares, weighted.
+static void getPrefixSums(const double* x, const double* weight, size_t n, double origin,
+	vector<double>& weights, vector<double>& sums, vector<double>& squares)
+{
+	weights.resize(n + 1);
+	sums.resize(n + 1);
+	squares.resize(n + 1);
+	weights[0] = sums[0] = squares[0] = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		const double w = isnan(x[i]) ? 0 : (weight ? weight[i] : 1);
+		const double d = isnan(x[i]) ? 0 : x[i] - origin;
+		weights[i + 1] = weights[i] + w;
+		sums[i + 1] = sums[i] + d * w;
+		squares[i + 1] = squares[i] + d * d * w;
+	}
+}
+
+// Bands of the windows ending at each value, by the differences of the prefix sums.
+// The leading values without data and the windows without weight are NAN.
+static void getWindowBands(const double* x, const double* weight, size_t n, int period, double width,
+	double* middle, double* upper, double* lower)
+{
+	size_t start = 0;
+	while ((start < n) && isnan(x[start])) start++;
+
+	const size_t warmup = min(n, start + period - 1);
+	for (size_t i = 0; i < warmup; i++)
+		middle[i] = upper[i] = lower[i] = NAN;
+	if (warmup == n) return;
+
+	vector<double> weights, sums, squares;
+	getPrefixSums(x, weight, n, x[start], weights, sums, squares);
+
+	const double origin = x[start];
+	#pragma omp simd
+	for (size_t i = warmup; i < n; i++)
+	{
+		const double w = weights[i + 1] - weights[i + 1 - period];
+		const double mean = (sums[i + 1] - sums[i + 1 - period]) / w;
+		const double deviation = sqrt(fmax((squares[i + 1] - squares[i + 1 - period]) / w - mean * mean, 0));
+		const double valid = (w > 0) ? 1 : NAN;
+
+		middle[i] = (origin + mean) * valid;
+		upper[i] = (origin + mean + width * deviation) * valid;
+		lower[i] = (origin + mean - width * deviation) * valid;
+	}
+}
+
+void indicators::bollinger(const double* close, size_t n, int period, double width,
+	double* middle, double* upper, double* lower)
+{
+	getWindowBands(close, NULL, n, period, width, middle, upper, lower);
+}
+
+void indicators::atr(const double* high, const double* low, const double* close, size_t n, int period, double* result)
+{
+	ATR state(period);
+	for (size_t i = 0; i < n; i++)
+	{
+		Candle candle;
+		if (!isnan(high[i]) && (high[i] >= low[i]))
+		{
+			candle.add(low[i], 0);
+			candle.add(high[i], 0);
+			candle.close = close[i];
+		}
+		state.add(candle);
+		state.get(&result[i]);
+	}
+}
+
+void indicators::obv(const double* close, const double* volume, size_t n, double* result)
+{
+	double value = NAN, previous = NAN;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!isnan(close[i]) && (volume[i] > 0))
+		{
+			if (isnan(previous))
+				value = 0;
+			else if (close[i] > previous)
+				value += volume[i];
+			else if (close[i] < previous)
+				value -= volume[i];
+			previous = close[i];
+		}
+		result[i] = value;
+	}
+}
+
+void indicators::vwapBands(const double* high, const double* low, const double* close, const double* volume,
+	size_t n, int period, double width, double* middle, double* upper, double* lower)
+{
+	vector<double> typical(n);
+	#pragma omp simd
+	for (size_t i = 0; i < n; i++)
+		typical[i] = (volume[i] > 0) ? (high[i] + low[i] + close[i]) / 3 : close[i];
+
+	getWindowBands(&typical[0], volume, n, period, width, middle, upper, lower);
+}
+
+Cache::Entry& indicators::Cache::getEntry(const string& symbol, int64_t timeframe, const Parameters& parameters)
+{
+	Key key;
+	key.symbol = symbol;
+	key.timeframe = timeframe;
+	key.parameters = parameters;
+
+	Entry& entry = entries[key];
+	if (!entry.state)
+	{
+		entry.state.reset(create(parameters));
+		entry.values.resize(entry.state->getOutputs());
+		entry.nclosed = 0;
+	}
+
+	return entry;
+}
+
+void indicators::Cache::fold(Entry& entry, const Candle& candle, bool closed)
+{
+	double values[3];
+	if (closed)
+	{
+		entry.state->add(candle);
+		entry.state->get(values);
+	}
+	else
+	{
+		unique_ptr<Indicator> open(entry.state->clone());
+		open->add(candle);
+		open->get(values);
+	}
+
+	for (int k = 0; k < entry.values.size(); k++)
+	{
+		entry.values[k].resize(entry.nclosed + 1);
+		entry.values[k][entry.nclosed] = values[k];
+	}
+
+	entry.nclosed += closed;
+}
+
@@ -0,0 +1,386 @@
+#ifndef INDICATORS_H
+#define INDICATORS_H
+
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "candles.h"
+
+namespace indicators
+{
+	// Streaming indicator over the candles, updated in O(1) per candle.
+	// Candles without trades continue at the previous close with no volume,
+	// and the values are NAN until the indicator is warmed up.
+	class Indicator
+	{
+	public :
+
+		virtual ~Indicator() { }
+
+		virtual Indicator* clone() const = 0;
+
+		// Number of the values, e.g. 3 for the middle, upper and lower bands.
+		virtual int getOutputs() const { return 1; }
+
+		// Fold the next candle.
+		virtual void add(const candles::Candle& candle) = 0;
+
+		// The values after the last candle.
+		virtual void get(double* values) const = 0;
+	};
+
+	// Close of the candle, or the previous close for the candle without trades.
+	class Closes
+	{
+		double close;
+
+	public :
+
+		Closes() : close(NAN) { }
+
+		double add(const candles::Candle& candle)
+		{
+			if (!candle.empty()) close = candle.close;
+			return close;
+		}
+	};
+
+	// Sum of the window of the last values, with the sum recomputed on every wrap,
+	// so that the rounding errors do not accumulate.
+	class Window
+	{
+		std::vector<double> values;
+		size_t next, count;
+		double sum;
+
+	public :
+
+		Window(int period) : values(period), next(0), count(0), sum(0) { }
+
+		size_t size() const { return values.size(); }
+
+		bool full() const { return count == values.size(); }
+
+		double getSum() const { return sum; }
+
+		void add(double value)
+		{
+			if (full()) sum -= values[next];
+			values[next] = value;
+			sum += value;
+			count += !full();
+
+			if (++next == values.size())
+			{
+				next = 0;
+				sum = 0;
+				for (size_t i = 0; i < count; i++)
+					sum += values[i];
+			}
+		}
+	};
+
+	// Exponential moving average of the closes, starting at the first close.
+	class EMA : public Indicator
+	{
+		const double alpha;
+		double value;
+		Closes closes;
+
+	public :
+
+		EMA(int period) : alpha(2.0 / (period + 1)), value(NAN) { }
+
+		Indicator* clone() const { return new EMA(*this); }
+
+		double update(double x)
+		{
+			if (std::isnan(x)) return value;
+			value = std::isnan(value) ? x : value + alpha * (x - value);
+			return value;
+		}
+
+		void add(const candles::Candle& candle) { update(closes.add(candle)); }
+
+		void get(double* values) const { values[0] = value; }
+	};
+
+	// Relative strength index with the Wilder smoothing of the gains and losses.
+	class RSI : public Indicator
+	{
+		const int period;
+		int count;
+		double previous, gain, loss, value;
+		Closes closes;
+
+	public :
+
+		RSI(int period_) : period(period_), count(0), previous(NAN), gain(0), loss(0), value(NAN) { }
+
+		Indicator* clone() const { return new RSI(*this); }
+
+		double update(double x)
+		{
+			if (std::isnan(x)) return value;
+			if (std::isnan(previous))
+			{
+				previous = x;
+				return value;
+			}
+
+			const double change = x - previous;
+			previous = x;
+
+			// The first averages are simple, the next ones are smoothed.
+			const double up = fmax(change, 0), down = fmax(-change, 0);
+			if (count < period)
+			{
+				gain += up / period;
+				loss += down / period;
+				if (++count < period) return value;
+			}
+			else
+			{
+				gain += (up - gain) / period;
+				loss += (down - loss) / period;
+			}
+
+			value = (gain + loss > 0) ? 100 * gain / (gain + loss) : 50;
+			return value;
+		}
+
+		void add(const candles::Candle& candle) { update(closes.add(candle)); }
+
+		void get(double* values) const { values[0] = value; }
+	};
+
+	// Moving average of the closes with the bands of the width in standard deviations.
+	class Bollinger : public Indicator
+	{
+		const double width;
+		Window sums, squares;
+		double origin;
+		Closes closes;
+
+	public :
+
+		Bollinger(int period, double width_) : width(width_), sums(period), squares(period), origin(NAN) { }
+
+		Indicator* clone() const { return new Bollinger(*this); }
+
+		int getOutputs() const { return 3; }
+
+		void update(double x)
+		{
+			if (std::isnan(x)) return;
+
+			// The sums are taken relative to the first close, for the precision of the variance.
+			if (std::isnan(origin)) origin = x;
+			sums.add(x - origin);
+			squares.add((x - origin) * (x - origin));
+		}
+
+		void add(const candles::Candle& candle) { update(closes.add(candle)); }
+
+		// The middle, upper and lower bands.
+		void get(double* values) const;
+	};
+
+	// Average true range with the Wilder smoothing.
+	class ATR : public Indicator
+	{
+		const int period;
+		int count;
+		double close, value;
+
+	public :
+
+		ATR(int period_) : period(period_), count(0), close(NAN), value(NAN) { }
+
+		Indicator* clone() const { return new ATR(*this); }
+
+		void add(const candles::Candle& candle);
+
+		void get(double* values) const { values[0] = (count < period) ? NAN : value; }
+	};
+
+	// On-balance volume: the volume accumulated with the sign of the close change.
+	class OBV : public Indicator
+	{
+		double close, value;
+
+	public :
+
+		OBV() : close(NAN), value(NAN) { }
+
+		Indicator* clone() const { return new OBV(*this); }
+
+		void add(const candles::Candle& candle);
+
+		void get(double* values) const { values[0] = value; }
+	};
+
+	// Volume-weighted average of the typical prices over the window of the candles,
+	// with the bands of the width in volume-weighted standard deviations.
+	class VWAPBands : public Indicator
+	{
+		const double width;
+		Window volumes, sums, squares;
+		double origin;
+		Closes closes;
+
+	public :
+
+		VWAPBands(int period, double width_) : width(width_), volumes(period), sums(period), squares(period), origin(NAN) { }
+
+		Indicator* clone() const { return new VWAPBands(*this); }
+
+		int getOutputs() const { return 3; }
+
+		void add(const candles::Candle& candle);
+
+		// The middle, upper and lower bands.
+		void get(double* values) const;
+	};
+
+	struct Parameters
+	{
+		enum Type { EMA, RSI, Bollinger, ATR, OBV, VWAPBands };
+
+		Type type;
+		int period;
+		double width;
+
+		Parameters(Type type_ = EMA, int period_ = 20, double width_ = 2) : type(type_), period(period_), width(width_) { }
+
+		bool operator<(const Parameters& other) const
+		{
+			return std::tie(type, period, width) < std::tie(other.type, other.period, other.width);
+		}
+	};
+
+	Indicator* create(const Parameters& parameters);
+
+	// Batch kernels over the whole columns of the candles, for the backtests and
+	// the reports. The windowed ones are the differences of the prefix sums,
+	// which are vectorized; the recurrences are single passes. Columns are of
+	// the same length n, with the same conventions as the streaming indicators.
+
+	enum Field { Open, High, Low, Close, Volume };
+
+	// Take the column of the candles (any container of candles::Candle with the
+	// operator[]): the prices of the candles without trades are the previous close.
+	template<typename Candles>
+	void getColumn(const Candles& candles, size_t first, size_t n, Field field, double* column)
+	{
+		double close = NAN;
+		for (size_t i = 0; i < n; i++)
+		{
+			const candles::Candle& candle = candles[first + i];
+			if (candle.empty())
+			{
+				column[i] = (field == Volume) ? 0 : close;
+				continue;
+			}
+
+			close = candle.close;
+			switch (field)
+			{
+			case Open : column[i] = candle.open; break;
+			case High : column[i] = candle.high; break;
+			case Low : column[i] = candle.low; break;
+			case Close : column[i] = candle.close; break;
+			case Volume : column[i] = candle.volume; break;
+			}
+		}
+	}
+
+	void ema(const double* close, size_t n, int period, double* result);
+
+	void rsi(const double* close, size_t n, int period, double* result);
+
+	void bollinger(const double* close, size_t n, int period, double width,
+		double* middle, double* upper, double* lower);
+
+	void atr(const double* high, const double* low, const double* close, size_t n, int period, double* result);
+
+	void obv(const double* close, const double* volume, size_t n, double* result);
+
+	void vwapBands(const double* high, const double* low, const double* close, const double* volume,
+		size_t n, int period, double width, double* middle, double* upper, double* lower);
+
+	// Values of the indicators of the candles of the symbols and timeframes, kept
+	// for all candles computed so far, so that scrolling through the history never
+	// recomputes them. The new candles are folded on the request; the last candle
+	// is taken as still open, so it is folded into a copy of the state.
+	class Cache
+	{
+		struct Key
+		{
+			std::string symbol;
+			int64_t timeframe;
+			Parameters parameters;
+
+			bool operator<(const Key& other) const
+			{
+				return std::tie(symbol, timeframe, parameters) < std::tie(other.symbol, other.timeframe, other.parameters);
+			}
+		};
+
+		struct Entry
+		{
+			// The state after the closed candles, and the values of all candles,
+			// output after output.
+			std::unique_ptr<Indicator> state;
+			std::vector<std::vector<double> > values;
+			size_t nclosed;
+		};
+
+		std::mutex cacheMutex;
+		std::map<Key, Entry> entries;
+
+		Entry& getEntry(const std::string& symbol, int64_t timeframe, const Parameters& parameters);
+
+		void fold(Entry& entry, const candles::Candle& candle, bool closed);
+
+	public :
+
+		// Values of the indicator for the candles [first, first + n), the output
+		// after the output in the values. The candles (any container of candles::Candle
+		// with the operator[] and size()) must be the same series, growing.
+		template<typename Candles>
+		void get(const std::string& symbol, int64_t timeframe, const Parameters& parameters,
+			const Candles& candles, size_t first, size_t n, std::vector<double>& values)
+		{
+			std::lock_guard<std::mutex> lock(cacheMutex);
+
+			Entry& entry = getEntry(symbol, timeframe, parameters);
+
+			// The series has been replaced.
+			const size_t size = candles.size();
+			if (size < entry.nclosed)
+			{
+				entry.state.reset(create(parameters));
+				entry.nclosed = 0;
+			}
+
+			for (size_t i = entry.nclosed; i < size; i++)
+				fold(entry, candles[i], i + 1 < size);
+
+			const int noutputs = entry.values.size();
+			values.resize(noutputs * n);
+			for (int k = 0; k < noutputs; k++)
+				for (size_t i = 0; i < n; i++)
+					values[k * n + i] = (first + i < size) ? entry.values[k][first + i] : NAN;
+		}
+	};
+}
+
+#endif // INDICATORS_H
+
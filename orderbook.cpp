@@ -0,0 +1,325 @@
+#include "orderbook.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace orderbook;
+using namespace std;
+
+#define ORDERBOOK_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* orderbook::orderbookGetErrorString(const orderbookError_t err)
+{
+	switch (err)
+	{
+	ORDERBOOK_CASE_STR(orderbookSuccess);
+	ORDERBOOK_CASE_STR(orderbookErrorNotSynchronized);
+	ORDERBOOK_CASE_STR(orderbookErrorOutOfSequence);
+	ORDERBOOK_CASE_STR(orderbookErrorInvalidMessage);
+	ORDERBOOK_CASE_STR(orderbookErrorNoTickSize);
+	ORDERBOOK_CASE_STR(orderbookErrorOffTick);
+	}
+}
+
+// Convert the quoted price string into integer units of 1e-8.
+static int64_t toUnits(const char* price)
+{
+	return llround(atof(price) * 1e8);
+}
+
+static int64_t toUnits(const Json::Value& price)
+{
+	return toUnits(price.asCString());
+}
+
+orderbook::Book::Book(size_t levels) :
+
+tick(0), lo(0), bids(levels), asks(levels), bidBits(levels / 64), askBits(levels / 64),
+bestBid(-1), bestAsk(-1), lastUpdateId(0), synchronized(false)
+
+{
+	if ((levels & (levels - 1)) || (levels < 64))
+	{
+		fprintf(stderr, "The number of order book levels %zu is not a power of two of at least 64\n", levels);
+		exit(1);
+	}
+}
+
+void orderbook::Book::clear()
+{
+	fill(bids.begin(), bids.end(), 0.0);
+	fill(asks.begin(), asks.end(), 0.0);
+	fill(bidBits.begin(), bidBits.end(), 0);
+	fill(askBits.begin(), askBits.end(), 0);
+	bestBid = -1;
+	bestAsk = -1;
+}
+
+void orderbook::Book::setLevel(vector<double>& levels, vector<uint64_t>& bits, int64_t ticks, double qty)
+{
+	const size_t slot = getSlot(ticks);
+	levels[slot] = qty;
+	if (qty > 0)
+		bits[slot >> 6] |= 1ULL << (slot & 63);
+	else
+		bits[slot >> 6] &= ~(1ULL << (slot & 63));
+}
+
+int64_t orderbook::Book::findBelow(const vector<uint64_t>& bits, int64_t ticks) const
+{
+	// The words are aligned to the slots, and the window wraps at a word boundary.
+	for (int64_t t = ticks; t >= lo; )
+	{
+		const size_t slot = getSlot(t);
+		const int bit = slot & 63;
+		const uint64_t word = bits[slot >> 6] & (~0ULL >> (63 - bit));
+		if (word)
+		{
+			t -= bit - (63 - __builtin_clzll(word));
+			return (t >= lo) ? t : -1;
+		}
+		t -= bit + 1;
+	}
+
+	return -1;
+}
+
+int64_t orderbook::Book::findAbove(const vector<uint64_t>& bits, int64_t ticks) const
+{
+	const int64_t hi = lo + (int64_t)bids.size();
+	for (int64_t t = ticks; t < hi; )
+	{
+		const size_t slot = getSlot(t);
+		const int bit = slot & 63;
+		const uint64_t word = bits[slot >> 6] & (~0ULL << bit);
+		if (word)
+		{
+			t += __builtin_ctzll(word) - bit;
+			return (t < hi) ? t : -1;
+		}
+		t += 64 - bit;
+	}
+
+	return -1;
+}
+
+void orderbook::Book::moveWindow(int64_t newLo)
+{
+	const int64_t size = bids.size();
+
+	if (abs(newLo - lo) >= size)
+	{
+		fill(bids.begin(), bids.end(), 0.0);
+		fill(asks.begin(), asks.end(), 0.0);
+		fill(bidBits.begin(), bidBits.end(), 0);
+		fill(askBits.begin(), askBits.end(), 0);
+	}
+	else if (newLo > lo)
+	{
+		for (int64_t t = lo; t < newLo; t++)
+		{
+			setLevel(bids, bidBits, t, 0);
+			setLevel(asks, askBits, t, 0);
+		}
+	}
+	else
+	{
+		for (int64_t t = newLo + size; t < lo + size; t++)
+		{
+			setLevel(bids, bidBits, t, 0);
+			setLevel(asks, askBits, t, 0);
+		}
+	}
+
+	lo = newLo;
+
+	// Best levels could leave the window: find the new ones.
+	if ((bestBid >= 0) && !inWindow(bestBid))
+		bestBid = findBelow(bidBits, min(bestBid, lo + size - 1));
+	if ((bestAsk >= 0) && !inWindow(bestAsk))
+		bestAsk = findAbove(askBits, max(bestAsk, lo));
+}
+
+void orderbook::Book::recenter(int64_t ticks)
+{
+	moveWindow(ticks - (int64_t)bids.size() / 2);
+}
+
+void orderbook::Book::setBid(int64_t ticks, double qty)
+{
+	if (!inWindow(ticks))
+	{
+		// Deep levels below the window are not tracked.
+		if ((qty == 0) || (ticks < lo)) return;
+
+		recenter(ticks);
+	}
+
+	setLevel(bids, bidBits, ticks, qty);
+
+	if (qty > 0)
+	{
+		if (ticks > bestBid)
+			bestBid = ticks;
+	}
+	else if (ticks == bestBid)
+		bestBid = findBelow(bidBits, ticks - 1);
+}
+
+void orderbook::Book::setAsk(int64_t ticks, double qty)
+{
+	const int64_t hi = lo + (int64_t)asks.size();
+
+	if (!inWindow(ticks))
+	{
+		// Deep levels above the window are not tracked.
+		if ((qty == 0) || (ticks >= hi)) return;
+
+		recenter(ticks);
+	}
+
+	setLevel(asks, askBits, ticks, qty);
+
+	if (qty > 0)
+	{
+		if ((bestAsk < 0) || (ticks < bestAsk))
+			bestAsk = ticks;
+	}
+	else if (ticks == bestAsk)
+		bestAsk = findAbove(askBits, ticks + 1);
+}
+
+orderbookError_t orderbook::Book::applyLevels(const Json::Value& bidLevels, const Json::Value& askLevels)
+{
+	if (!bidLevels.isArray() || !askLevels.isArray())
+		return orderbookErrorInvalidMessage;
+
+	// A price off the tick means the book is not of the symbol's tick
+	// any longer, e.g. the filter changed: nothing of it is applied.
+	for (Json::Value::ArrayIndex i = 0, e = bidLevels.size(); i < e; i++)
+		if (toUnits(bidLevels[i][0]) % tick)
+			return orderbookErrorOffTick;
+	for (Json::Value::ArrayIndex i = 0, e = askLevels.size(); i < e; i++)
+		if (toUnits(askLevels[i][0]) % tick)
+			return orderbookErrorOffTick;
+
+	for (Json::Value::ArrayIndex i = 0, e = bidLevels.size(); i < e; i++)
+		setBid(toUnits(bidLevels[i][0]) / tick, atof(bidLevels[i][1].asCString()));
+	for (Json::Value::ArrayIndex i = 0, e = askLevels.size(); i < e; i++)
+		setAsk(toUnits(askLevels[i][0]) / tick, atof(askLevels[i][1].asCString()));
+
+	// Keep the top of the book in the central half of the window,
+	// so that the levels next to it are tracked on both sides.
+	if ((bestBid >= 0) && (bestAsk >= 0))
+	{
+		const int64_t quarter = bids.size() / 4;
+		const int64_t mid = (bestBid + bestAsk) / 2;
+		if ((mid < lo + quarter) || (mid >= lo + 3 * quarter))
+			recenter(mid);
+	}
+
+	return orderbookSuccess;
+}
+
+orderbookError_t orderbook::Book::setTickSize(const string& tickSize)
+{
+	const int64_t units = toUnits(tickSize.c_str());
+	if (units <= 0)
+		return orderbookErrorInvalidMessage;
+
+	if (units != tick)
+	{
+		// The levels of the old tick are not comparable to the new ones.
+		tick = units;
+		clear();
+		synchronized = false;
+	}
+
+	return orderbookSuccess;
+}
+
+orderbookError_t orderbook::Book::applySnapshot(const Json::Value& snapshot)
+{
+	const Json::Value& bidLevels = snapshot["bids"];
+	const Json::Value& askLevels = snapshot["asks"];
+	if (!bidLevels.isArray() || !askLevels.isArray() || !snapshot.isMember("lastUpdateId"))
+		return orderbookErrorInvalidMessage;
+
+	synchronized = false;
+	if (snapshot.isMember("tickSize"))
+	{
+		orderbookError_t status = setTickSize(snapshot["tickSize"].asString());
+		if (status != orderbookSuccess)
+			return status;
+	}
+	if (!tick)
+		return orderbookErrorNoTickSize;
+
+	clear();
+	if (bidLevels.size())
+		recenter(toUnits(bidLevels[0][0]) / tick);
+	else if (askLevels.size())
+		recenter(toUnits(askLevels[0][0]) / tick);
+
+	orderbookError_t status = applyLevels(bidLevels, askLevels);
+	if (status != orderbookSuccess)
+		return status;
+
+	lastUpdateId = snapshot["lastUpdateId"].asInt64();
+	synchronized = true;
+
+	return orderbookSuccess;
+}
+
+orderbookError_t orderbook::Book::applyUpdate(const Json::Value& update)
+{
+	if (!synchronized)
+		return orderbookErrorNotSynchronized;
+
+	if (!update.isMember("U") || !update.isMember("u"))
+		return orderbookErrorInvalidMessage;
+
+	const int64_t firstUpdateId = update["U"].asInt64();
+	const int64_t finalUpdateId = update["u"].asInt64();
+
+	// Already accounted in the snapshot.
+	if (finalUpdateId <= lastUpdateId)
+		return orderbookSuccess;
+
+	if (firstUpdateId > lastUpdateId + 1)
+	{
+		synchronized = false;
+		return orderbookErrorOutOfSequence;
+	}
+
+	orderbookError_t status = applyLevels(update["b"], update["a"]);
+	if (status != orderbookSuccess)
+	{
+		synchronized = false;
+		return status;
+	}
+
+	lastUpdateId = finalUpdateId;
+
+	return orderbookSuccess;
+}
+
+double orderbook::Book::getImbalance(int n) const
+{
+	double bidQty = 0, askQty = 0;
+
+	// Only the n non-empty levels from the best ones are visited.
+	for (int64_t t = bestBid, i = 0; (t >= 0) && (i < n); t = findBelow(bidBits, t - 1), i++)
+		bidQty += bids[getSlot(t)];
+
+	for (int64_t t = bestAsk, i = 0; (t >= 0) && (i < n); t = findAbove(askBits, t + 1), i++)
+		askQty += asks[getSlot(t)];
+
+	if (bidQty + askQty == 0)
+		return 0;
+
+	return (bidQty - askQty) / (bidQty + askQty);
+}
+
@@ -0,0 +1,203 @@
+#ifndef ORDERBOOK_H
+#define ORDERBOOK_H
+
+#include <cstdint>
+#include <jsoncpp/json/json.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "binance.h"
+
+namespace orderbook
+{
+	enum orderbookError_t
+	{
+		orderbookSuccess = 0,
+		orderbookErrorNotSynchronized,
+		orderbookErrorOutOfSequence,
+		orderbookErrorInvalidMessage,
+		orderbookErrorNoTickSize,
+		orderbookErrorOffTick,
+	};
+
+	const char* orderbookGetErrorString(const orderbookError_t err);
+
+	// Local L2 order book of a single symbol, maintained from the depth snapshot
+	// and the subsequent diff updates.
+	//
+	// Price levels are kept in a flat circular array of quantities indexed by
+	// the price in ticks, covering a window of levels around the mid price.
+	// The window follows the market; levels outside of it (far from the top)
+	// are dropped. The non-empty levels are marked in the bitmaps of the slots,
+	// so the next level from the best one is found by a word at a time,
+	// not walking the empty slots.
+	class Book
+	{
+		// Prices are converted to integer units of 1e-8, as quoted by Binance,
+		// and the tick size of the symbol is in these units, 0 until it is set.
+		int64_t tick;
+
+		// The window of levels covers ticks [lo, lo + levels.size()).
+		int64_t lo;
+		std::vector<double> bids, asks;
+
+		// Bits of the slots of the non-empty levels.
+		std::vector<uint64_t> bidBits, askBits;
+
+		// Best levels in ticks, or -1 for the empty side.
+		int64_t bestBid, bestAsk;
+
+		int64_t lastUpdateId;
+		bool synchronized;
+
+		size_t getSlot(int64_t ticks) const { return ticks & (bids.size() - 1); }
+
+		bool inWindow(int64_t ticks) const { return (ticks >= lo) && (ticks < lo + (int64_t)bids.size()); }
+
+		void setLevel(std::vector<double>& levels, std::vector<uint64_t>& bits, int64_t ticks, double qty);
+
+		// The highest non-empty level at or below the ticks, or -1.
+		int64_t findBelow(const std::vector<uint64_t>& bits, int64_t ticks) const;
+
+		// The lowest non-empty level at or above the ticks, or -1.
+		int64_t findAbove(const std::vector<uint64_t>& bits, int64_t ticks) const;
+
+		void clear();
+
+		// Move the window to start at the new lo, clearing the levels left behind.
+		void moveWindow(int64_t newLo);
+
+		void recenter(int64_t ticks);
+
+		void setBid(int64_t ticks, double qty);
+
+		void setAsk(int64_t ticks, double qty);
+
+		// Apply the levels, unless any of their prices is off the tick.
+		orderbookError_t applyLevels(const Json::Value& bidLevels, const Json::Value& askLevels);
+
+	public :
+
+		// The number of price levels in the window; must be a power of two, at least 64.
+		static const size_t defaultLevels = 4096;
+
+		Book(size_t levels = defaultLevels);
+
+		bool isSynchronized() const { return synchronized; }
+
+		int64_t getLastUpdateId() const { return lastUpdateId; }
+
+		// Set the tick size of the symbol, as quoted by the PRICE_FILTER of the exchange info.
+		orderbookError_t setTickSize(const std::string& tickSize);
+
+		// Reset the book from the REST depth snapshot
+		// {"lastUpdateId", "bids" : [[price, qty], ...], "asks"}, with the optional
+		// "tickSize" of the recorded journals. The tick size must be known.
+		orderbookError_t applySnapshot(const Json::Value& snapshot);
+
+		// Apply the diff depth stream event {"U", "u", "b", "a"}. Events older than
+		// the snapshot are ignored; a gap in update ids or a price off the tick
+		// unsynchronizes the book, until the next snapshot.
+		orderbookError_t applyUpdate(const Json::Value& update);
+
+		bool hasBid() const { return bestBid >= 0; }
+
+		bool hasAsk() const { return bestAsk >= 0; }
+
+		double getBestBid() const { return bestBid * tick * 1e-8; }
+
+		double getBestAsk() const { return bestAsk * tick * 1e-8; }
+
+		double getBestBidQty() const { return bids[getSlot(bestBid)]; }
+
+		double getBestAskQty() const { return asks[getSlot(bestAsk)]; }
+
+		double getSpread() const { return (bestAsk - bestBid) * tick * 1e-8; }
+
+		double getMidPrice() const { return (bestAsk + bestBid) * tick * 0.5e-8; }
+
+		// Imbalance of the bid and ask quantities within the top n levels on each side,
+		// from -1 (asks only) to 1 (bids only).
+		double getImbalance(int n) const;
+	};
+
+	// Books of the watched symbols, fed by the diff depth websocket streams.
+	// Books are synchronized from REST snapshots on demand of the reader.
+	class Feed
+	{
+	public :
+
+		typedef int (*Callback)(Json::Value& event);
+
+	private :
+
+		struct Entry
+		{
+			std::mutex mutex;
+			Book book;
+
+			// Diff events received while the book awaits its snapshot.
+			std::vector<Json::Value> pending;
+
+			// Tick size of the exchange info, recorded with the snapshots.
+			std::string tickSize;
+		};
+
+		std::map<std::string, std::unique_ptr<Entry> > entries;
+
+		// Other streams served by the same event loop, as the websocket
+		// client is a singleton.
+		std::vector<std::pair<Callback, std::string> > endpoints;
+
+		// Optional journal of the received snapshots and events,
+		// one JSON message per line, for the offline replay.
+		std::ostream* journal;
+		std::mutex journalMutex;
+
+		void record(const Json::Value& message);
+
+		static Feed* instance;
+
+		static int onDepth(Json::Value& event);
+
+		void dispatch(const Json::Value& event);
+
+	public :
+
+		Feed(const std::vector<std::string>& symbols, std::ostream* journal = NULL);
+
+		// Set the tick sizes of the symbols by the PRICE_FILTER of the exchange info,
+		// before the start; the books of the symbols without one are not synchronized.
+		orderbookError_t setTickSizes(const Json::Value& exchangeInfo);
+
+		// Connect the other stream on start, e.g. the user data stream.
+		void addEndpoint(Callback callback, const std::string& path);
+
+		~Feed();
+
+		// Connect to the diff depth streams of all symbols and run the
+		// websocket event loop in a background thread.
+		void start();
+
+		// Synchronize the book with a REST snapshot, if needed. Returns false,
+		// if no depth is available for the symbol.
+		bool synchronize(binance::Market& market, const std::string& symbol);
+
+		struct Quote
+		{
+			double bestBid, bestAsk;
+			double spread;
+			double imbalance;
+		};
+
+		// Get the top of the book and the imbalance within the top n levels.
+		bool getQuote(const std::string& symbol, int n, Quote& quote);
+	};
+}
+
+#endif // ORDERBOOK_H
+
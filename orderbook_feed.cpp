@@ -0,0 +1,220 @@
+#include "orderbook.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace binance;
+using namespace orderbook;
+using namespace std;
+
+// Binance limits the number of streams per combined stream connection.
+static const size_t maxStreamsPerConnection = 200;
+
+// Cap of events buffered for the book awaiting its snapshot;
+// the older ones are dropped, as the snapshot supersedes them anyway.
+static const size_t maxPendingEvents = 1024;
+
+Feed* orderbook::Feed::instance = NULL;
+
+orderbook::Feed::Feed(const vector<string>& symbols, ostream* journal_) : journal(journal_)
+{
+	for (int i = 0; i < symbols.size(); i++)
+		entries[symbols[i]].reset(new Entry());
+
+	// Websocket callbacks carry no user data, so the feed is a singleton.
+	instance = this;
+}
+
+orderbook::Feed::~Feed()
+{
+	instance = NULL;
+}
+
+orderbookError_t orderbook::Feed::setTickSizes(const Json::Value& exchangeInfo)
+{
+	const Json::Value& symbols = exchangeInfo["symbols"];
+	if (!symbols.isArray())
+		return orderbookErrorInvalidMessage;
+
+	for (Json::Value::ArrayIndex i = 0, e = symbols.size(); i < e; i++)
+	{
+		const Json::Value& symbol = symbols[i];
+		map<string, unique_ptr<Entry> >::iterator entry = entries.find(symbol["symbol"].asString());
+		if (entry == entries.end()) continue;
+
+		const Json::Value& filters = symbol["filters"];
+		for (Json::Value::ArrayIndex j = 0, je = filters.size(); j < je; j++)
+		{
+			const Json::Value& filter = filters[j];
+			if (filter["filterType"].asString() != "PRICE_FILTER") continue;
+
+			Entry& value = *entry->second;
+			lock_guard<mutex> lock(value.mutex);
+			orderbookError_t status = value.book.setTickSize(filter["tickSize"].asString());
+			if (status != orderbookSuccess)
+				return status;
+			value.tickSize = filter["tickSize"].asString();
+		}
+	}
+
+	for (map<string, unique_ptr<Entry> >::iterator i = entries.begin(), e = entries.end(); i != e; i++)
+		if (i->second->tickSize == "")
+			fprintf(stderr, "%s : no price filter, the book is not synchronized\n", i->first.c_str());
+
+	return orderbookSuccess;
+}
+
+void orderbook::Feed::record(const Json::Value& message)
+{
+	if (!journal) return;
+
+	Json::FastWriter writer;
+	const string line = writer.write(message);
+
+	lock_guard<mutex> lock(journalMutex);
+	*journal << line;
+}
+
+int orderbook::Feed::onDepth(Json::Value& message)
+{
+	if (instance)
+		instance->dispatch(message);
+
+	return 0;
+}
+
+void orderbook::Feed::dispatch(const Json::Value& message)
+{
+	// Combined streams wrap the event payload.
+	const Json::Value& event = message.isMember("data") ? message["data"] : message;
+
+	map<string, unique_ptr<Entry> >::iterator i = entries.find(event["s"].asString());
+	if (i == entries.end()) return;
+
+	record(event);
+
+	Entry& entry = *i->second;
+	lock_guard<mutex> lock(entry.mutex);
+
+	if (entry.book.isSynchronized())
+	{
+		orderbookError_t status = entry.book.applyUpdate(event);
+		if (status == orderbookSuccess)
+			return;
+
+		// The gap or the price off the tick is only recoverable with a new
+		// snapshot, which the event could still follow, if it is in the tick.
+		entry.pending.clear();
+		if (status != orderbookErrorOutOfSequence)
+		{
+			fprintf(stderr, "%s : %s, awaiting a new snapshot\n", i->first.c_str(), orderbookGetErrorString(status));
+			return;
+		}
+	}
+
+	if (entry.pending.size() >= maxPendingEvents)
+		entry.pending.erase(entry.pending.begin(), entry.pending.begin() + maxPendingEvents / 2);
+	entry.pending.push_back(event);
+}
+
+void orderbook::Feed::addEndpoint(Callback callback, const string& path)
+{
+	endpoints.push_back(make_pair(callback, path));
+}
+
+void orderbook::Feed::start()
+{
+	Websocket::init();
+
+	vector<string> streams;
+	for (map<string, unique_ptr<Entry> >::iterator i = entries.begin(), e = entries.end(); i != e; i++)
+	{
+		string stream = i->first;
+		transform(stream.begin(), stream.end(), stream.begin(), ::tolower);
+		streams.push_back(stream + "@depth@100ms");
+	}
+
+	for (size_t i = 0; i < streams.size(); i += maxStreamsPerConnection)
+	{
+		string path = "/stream?streams=";
+		for (size_t j = i, je = min(i + maxStreamsPerConnection, streams.size()); j < je; j++)
+		{
+			if (j != i) path += "/";
+			path += streams[j];
+		}
+
+		Websocket::connect_endpoint(onDepth, path.c_str());
+	}
+
+	for (int i = 0; i < endpoints.size(); i++)
+		Websocket::connect_endpoint(endpoints[i].first, endpoints[i].second.c_str());
+
+	// All books are maintained by a single thread.
+	thread([]() { Websocket::enter_event_loop(); }).detach();
+}
+
+bool orderbook::Feed::synchronize(Market& market, const string& symbol)
+{
+	map<string, unique_ptr<Entry> >::iterator i = entries.find(symbol);
+	if (i == entries.end()) return false;
+
+	Entry& entry = *i->second;
+	{
+		lock_guard<mutex> lock(entry.mutex);
+		if (entry.book.isSynchronized()) return true;
+	}
+
+	// Fetch the snapshot without holding the lock, so that the events
+	// keep buffering meanwhile.
+	Json::Value snapshot;
+	binanceError_t status = market.getDepth(snapshot, symbol.c_str(), 1000);
+	if (status != binanceSuccess)
+	{
+		fprintf(stderr, "%s\n", binanceGetErrorString(status));
+		return false;
+	}
+
+	snapshot["s"] = symbol;
+	if (entry.tickSize != "")
+		snapshot["tickSize"] = entry.tickSize;
+	record(snapshot);
+
+	lock_guard<mutex> lock(entry.mutex);
+
+	orderbookError_t applied = entry.book.applySnapshot(snapshot);
+	if (applied != orderbookSuccess)
+	{
+		fprintf(stderr, "%s : %s\n", symbol.c_str(), orderbookGetErrorString(applied));
+		return false;
+	}
+
+	for (int j = 0; j < entry.pending.size(); j++)
+	{
+		if (entry.book.applyUpdate(entry.pending[j]) != orderbookSuccess)
+			break;
+	}
+	entry.pending.clear();
+
+	return entry.book.isSynchronized();
+}
+
+bool orderbook::Feed::getQuote(const string& symbol, int n, Quote& quote)
+{
+	map<string, unique_ptr<Entry> >::iterator i = entries.find(symbol);
+	if (i == entries.end()) return false;
+
+	Entry& entry = *i->second;
+	lock_guard<mutex> lock(entry.mutex);
+
+	const Book& book = entry.book;
+	if (!book.isSynchronized() || !book.hasBid() || !book.hasAsk())
+		return false;
+
+	quote.bestBid = book.getBestBid();
+	quote.bestAsk = book.getBestAsk();
+	quote.spread = book.getSpread();
+	quote.imbalance = book.getImbalance(n);
+
+	return true;
+}
+
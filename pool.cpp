@@ -0,0 +1,101 @@
+#include "pool.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace pool;
+using namespace std;
+
+#define POOL_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* pool::poolGetErrorString(const poolError_t err)
+{
+	switch (err)
+	{
+	POOL_CASE_STR(poolSuccess);
+	POOL_CASE_STR(poolErrorOutOfMemory);
+	}
+}
+
+int pool::getThreadIndex()
+{
+	static atomic<int> nthreads(0);
+	static thread_local int index = nthreads++;
+
+	return index;
+}
+
+// Huge page size on x86_64.
+static const size_t szhuge = 2 * 1024 * 1024;
+
+pool::Pool::Pool(size_t size_, bool huge_) : size(size_), huge(huge_), nallocated(0), nreused(0) { }
+
+pool::Pool::~Pool()
+{
+	for (int i = 0; i < mappings.size(); i++)
+		munmap(mappings[i].first, mappings[i].second);
+}
+
+poolError_t pool::Pool::allocate(void*& block)
+{
+	const size_t szpage = sysconf(_SC_PAGESIZE);
+
+	size_t length = (size + szpage - 1) / szpage * szpage;
+	block = MAP_FAILED;
+	if (huge)
+	{
+		// Explicit huge pages are available only if reserved by the system,
+		// otherwise ask for the transparent huge pages.
+		const size_t hugeLength = (size + szhuge - 1) / szhuge * szhuge;
+		block = mmap(NULL, hugeLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (block != MAP_FAILED)
+			length = hugeLength;
+	}
+	if (block == MAP_FAILED)
+	{
+		block = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (block == MAP_FAILED)
+			return poolErrorOutOfMemory;
+
+		if (huge)
+			madvise(block, length, MADV_HUGEPAGE);
+	}
+
+	{
+		lock_guard<mutex> lock(mappingsMutex);
+		mappings.push_back(make_pair(block, length));
+	}
+	nallocated++;
+
+	return poolSuccess;
+}
+
+poolError_t pool::Pool::acquire(void*& block)
+{
+	// Buffers released by other threads are taken, once the own list is empty.
+	const int index = getThreadIndex();
+	for (int i = 0; i < maxThreads; i++)
+	{
+		FreeList& list = lists[(index + i) % maxThreads];
+
+		lock_guard<mutex> lock(list.listMutex);
+		if (list.blocks.size())
+		{
+			block = list.blocks.back();
+			list.blocks.pop_back();
+			nreused++;
+			return poolSuccess;
+		}
+	}
+
+	return allocate(block);
+}
+
+void pool::Pool::release(void* block)
+{
+	FreeList& list = lists[getThreadIndex() % maxThreads];
+
+	lock_guard<mutex> lock(list.listMutex);
+	list.blocks.push_back(block);
+}
+
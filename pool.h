@@ -0,0 +1,184 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pool
+{
+	enum poolError_t
+	{
+		poolSuccess = 0,
+		poolErrorOutOfMemory,
+	};
+
+	const char* poolGetErrorString(const poolError_t err);
+
+	#define POOL_ERR_CHECK(x) \
+	do { \
+		pool::poolError_t err = x; \
+		if (err != pool::poolSuccess) \
+		{ \
+			fprintf(stderr, "%s:%d: pool error: %s\n", __FILE__, __LINE__, pool::poolGetErrorString(err)); \
+			exit(1); \
+		} \
+	} while (0)
+
+	// Index of the calling thread, for picking its own free list.
+	int getThreadIndex();
+
+	// Number of the free lists per pool: the threads beyond it share the lists.
+	const int maxThreads = 64;
+
+	// Pool of the fixed-size batch buffers. The buffers are never returned
+	// to the system until the pool is destroyed, so the steady-state batch
+	// processing does no heap allocation. Each thread releases buffers into
+	// and acquires from its own free list first, so the lists are not contended.
+	// Large buffers could be backed by huge pages, to save on TLB misses.
+	class Pool
+	{
+		struct FreeList
+		{
+			std::mutex listMutex;
+			std::vector<void*> blocks;
+
+			// Keep the lists of different threads on different cache lines.
+			char padding[64];
+		};
+
+		const size_t size;
+		const bool huge;
+
+		FreeList lists[maxThreads];
+
+		std::mutex mappingsMutex;
+		std::vector<std::pair<void*, size_t> > mappings;
+
+		std::atomic<uint64_t> nallocated, nreused;
+
+		Pool(const Pool&);
+		Pool& operator=(const Pool&);
+
+		poolError_t allocate(void*& block);
+
+	public :
+
+		Pool(size_t size, bool huge = false);
+
+		~Pool();
+
+		size_t getBlockSize() const { return size; }
+
+		poolError_t acquire(void*& block);
+
+		void release(void* block);
+
+		// Number of the buffers allocated from the system.
+		uint64_t getAllocated() const { return nallocated; }
+
+		// Number of the buffers acquired from the free lists.
+		uint64_t getReused() const { return nreused; }
+	};
+
+	// Array of T in the buffer acquired from the pool for the lifetime of the object.
+	// The contents are not initialized.
+	template<typename T>
+	class Buffer
+	{
+		Pool& pool;
+		T* data_;
+
+		Buffer(const Buffer&);
+		Buffer& operator=(const Buffer&);
+
+	public :
+
+		Buffer(Pool& pool_) : pool(pool_)
+		{
+			void* block;
+			POOL_ERR_CHECK(pool.acquire(block));
+			data_ = (T*)block;
+		}
+
+		~Buffer() { pool.release(data_); }
+
+		T* data() { return data_; }
+
+		const T* data() const { return data_; }
+
+		size_t capacity() const { return pool.getBlockSize() / sizeof(T); }
+
+		T& operator[](size_t i) { return data_[i]; }
+
+		const T& operator[](size_t i) const { return data_[i]; }
+	};
+
+	// Per-thread free lists of the reusable objects, such as strings or
+	// decode scratch space, which keep their capacity between the uses.
+	// Objects are exchanged by swap(), so no copying takes place.
+	template<typename T>
+	class Recycler
+	{
+		struct FreeList
+		{
+			std::mutex listMutex;
+			std::vector<T> objects;
+
+			char padding[64];
+		};
+
+		FreeList lists[maxThreads];
+
+		std::atomic<uint64_t> ncreated, nreused;
+
+	public :
+
+		// Swap a spare object into the given one; a fresh object is
+		// taken, if there are no spare objects yet.
+		void acquire(T& object)
+		{
+			// Objects released by other threads are taken, once the own list is empty.
+			const int index = getThreadIndex();
+			for (int i = 0; i < maxThreads; i++)
+			{
+				FreeList& list = lists[(index + i) % maxThreads];
+
+				std::lock_guard<std::mutex> lock(list.listMutex);
+				if (list.objects.size())
+				{
+					std::swap(object, list.objects.back());
+					list.objects.pop_back();
+					nreused++;
+					return;
+				}
+			}
+
+			object = T();
+			ncreated++;
+		}
+
+		// Swap the object into the free list, keeping its storage.
+		void release(T& object)
+		{
+			FreeList& list = lists[getThreadIndex() % maxThreads];
+
+			std::lock_guard<std::mutex> lock(list.listMutex);
+			list.objects.push_back(T());
+			std::swap(object, list.objects.back());
+		}
+
+		uint64_t getCreated() const { return ncreated; }
+
+		uint64_t getReused() const { return nreused; }
+
+		Recycler() : ncreated(0), nreused(0) { }
+	};
+}
+
+#endif // POOL_H
+
@@ -0,0 +1,61 @@
+#include "portfolio.h"
+
+#include <algorithm>
+
+using namespace portfolio;
+using namespace std;
+
+portfolio::Book::Book(size_t npositions, int nshards) : positions(npositions), shards(max(1, nshards))
+{
+	for (int i = 0; i < positions.size(); i++)
+		positions[i] = { 0, 0, 0 };
+	for (int s = 0; s < shards.size(); s++)
+		shards[s].totals = { 0, 0, 0 };
+}
+
+void portfolio::Book::set(int i, double amount, double value)
+{
+	Position& position = positions[i];
+	Totals& totals = shards[getShard(i)].totals;
+
+	totals.value += value - position.value;
+	totals.marked += (amount - position.amount) * position.price;
+	totals.npositions += (amount != 0);
+	totals.npositions -= (position.amount != 0);
+
+	position.amount = amount;
+	position.value = value;
+}
+
+void portfolio::Book::mark(int i, double price)
+{
+	Position& position = positions[i];
+	if (position.amount != 0)
+		shards[getShard(i)].totals.marked += position.amount * (price - position.price);
+
+	position.price = price;
+}
+
+void portfolio::Book::buy(int i, double qty, double quoteQty)
+{
+	const Position& position = positions[i];
+	set(i, position.amount + qty, position.value + quoteQty);
+}
+
+void portfolio::Book::sell(int i, double qty)
+{
+	const Position& position = positions[i];
+	if (position.amount <= 0) return;
+
+	set(i, max(0.0, position.amount - qty), position.value * (1 - min(1.0, qty / position.amount)));
+}
+
+void portfolio::Book::update(int i, double amount)
+{
+	const Position& position = positions[i];
+	if (amount < position.amount)
+		sell(i, position.amount - amount);
+	else if (amount > position.amount)
+		set(i, amount, position.value + (amount - position.amount) * position.price);
+}
+
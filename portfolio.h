@@ -0,0 +1,82 @@
+#ifndef PORTFOLIO_H
+#define PORTFOLIO_H
+
+#include <cstddef>
+#include <vector>
+
+namespace portfolio
+{
+	struct Position
+	{
+		// Amount in currency.
+		double amount;
+
+		// The purchase value of amount, in the quote asset.
+		double value;
+
+		// The last price traded, the amount is marked to.
+		double price;
+	};
+
+	struct Totals
+	{
+		// Purchase and marked values of the positions.
+		double value, marked;
+
+		size_t npositions;
+	};
+
+	// Positions marked to the last prices traded. The totals of each shard of
+	// the positions are kept up to date by every change, so that marking the
+	// position to the new price is O(1), and so is reading the valuation. The
+	// positions and the totals of a shard are changed by its owner thread only.
+	class Book
+	{
+		std::vector<Position> positions;
+
+		// The totals of the shards are written by the different threads,
+		// so they are kept on the separate cache lines.
+		struct Shard
+		{
+			Totals totals;
+			char padding[64 - sizeof(Totals) % 64];
+		};
+
+		std::vector<Shard> shards;
+
+		// Set the position, accounting the change into the totals of its shard.
+		void set(int i, double amount, double value);
+
+	public :
+
+		Book(size_t npositions, int nshards = 1);
+
+		size_t size() const { return positions.size(); }
+
+		int getShard(int i) const { return i % shards.size(); }
+
+		const Position& operator[](int i) const { return positions[i]; }
+
+		const Totals& getTotals(int shard) const { return shards[shard].totals; }
+
+		// Seed the position, e.g. from the trading history.
+		void seed(int i, double amount, double value) { set(i, amount, value); }
+
+		// Mark the position to the price traded.
+		void mark(int i, double price);
+
+		// Account the bought amount and the quote quantity spent.
+		void buy(int i, double qty, double quoteQty);
+
+		// Account the sold amount, releasing its part of the purchase value.
+		void sell(int i, double qty);
+
+		// Take the amount reported by the account. The amount decreased releases
+		// its part of the purchase value, and the amount increased by the other
+		// means than the orders accounted is valued at the last price.
+		void update(int i, double amount);
+	};
+}
+
+#endif // PORTFOLIO_H
+
@@ -0,0 +1,379 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <omp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace profile;
+using namespace std;
+
+#define PROFILE_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* profile::profileGetErrorString(const profileError_t err)
+{
+	switch (err)
+	{
+	PROFILE_CASE_STR(profileSuccess);
+	PROFILE_CASE_STR(profileErrorOpenFailed);
+	PROFILE_CASE_STR(profileErrorReadFailed);
+	PROFILE_CASE_STR(profileErrorWriteFailed);
+	PROFILE_CASE_STR(profileErrorInvalidFormat);
+	PROFILE_CASE_STR(profileErrorWatermarkMismatch);
+	}
+}
+
+namespace
+{
+	const char magic[8] = { 'B', 'I', 'T', 'R', 'T', 'I', 'C', 'K' };
+
+	const uint32_t version = 1;
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t recordSize;
+		uint64_t count;
+		int64_t watermark;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t sourceChecksum;
+	};
+
+	bool checkHeader(const FileHeader& header, uint64_t length)
+	{
+		return (length >= sizeof(header)) && !memcmp(header.magic, magic, sizeof(magic)) &&
+			(header.version == version) && (header.recordSize == sizeof(Tick)) &&
+			(header.count <= (length - sizeof(header)) / sizeof(Tick));
+	}
+
+	// Parts of the ticks smaller than that are not worth a thread.
+	const size_t minTicksPerThread = 64 * 1024;
+}
+
+string profile::getPath(const string& dir, const string& symbol)
+{
+	return dir + "/" + symbol + ".ticks";
+}
+
+profile::Writer::Writer() : file(NULL), count(0), watermark(0), anew(false) { }
+
+profile::Writer::~Writer()
+{
+	if (file)
+		fclose(file);
+}
+
+profileError_t profile::Writer::open(const string& path_, int64_t watermark_)
+{
+	path = path_;
+	count = 0;
+	watermark = 0;
+
+	// The new file is written aside, so that readers never see it partially written.
+	anew = !watermark_;
+	if (anew)
+	{
+		file = fopen((path + ".tmp").c_str(), "wb");
+		if (!file)
+			return profileErrorOpenFailed;
+
+		FileHeader header;
+		memset(&header, 0, sizeof(header));
+		if (fwrite(&header, sizeof(header), 1, file) != 1)
+			return profileErrorWriteFailed;
+
+		return profileSuccess;
+	}
+
+	file = fopen(path.c_str(), "r+b");
+	if (!file)
+		return profileErrorOpenFailed;
+
+	struct stat st;
+	FileHeader header;
+	if (fstat(fileno(file), &st) || (fread(&header, sizeof(header), 1, file) != 1) || !checkHeader(header, st.st_size))
+	{
+		fclose(file);
+		file = NULL;
+		return profileErrorInvalidFormat;
+	}
+	if (header.watermark != watermark_)
+	{
+		fclose(file);
+		file = NULL;
+		return profileErrorWatermarkMismatch;
+	}
+
+	// Drop the ticks of the interrupted append, not counted in the header.
+	count = header.count;
+	watermark = header.watermark;
+	const off_t end = sizeof(header) + count * sizeof(Tick);
+	if (ftruncate(fileno(file), end) || fseeko(file, end, SEEK_SET))
+	{
+		fclose(file);
+		file = NULL;
+		return profileErrorWriteFailed;
+	}
+
+	return profileSuccess;
+}
+
+void profile::Writer::add(int64_t time, double price, double qty)
+{
+	Tick tick;
+	tick.time = time;
+	tick.price = price;
+	tick.qty = qty;
+	fwrite(&tick, sizeof(tick), 1, file);
+
+	count++;
+	watermark = max(watermark, time);
+}
+
+profileError_t profile::Writer::close(const candles::Source& source)
+{
+	if (!file)
+		return profileErrorWriteFailed;
+
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.recordSize = sizeof(Tick);
+	header.count = count;
+	header.watermark = watermark;
+	header.sourceSize = source.size;
+	header.sourceTime = source.time;
+	header.sourceChecksum = source.checksum;
+
+	// The header is written last, so that it counts only the ticks written.
+	bool written = !fflush(file) && !fseeko(file, 0, SEEK_SET) && (fwrite(&header, sizeof(header), 1, file) == 1);
+	written = !fclose(file) && written;
+	file = NULL;
+	if (!written)
+		return profileErrorWriteFailed;
+
+	if (anew && rename((path + ".tmp").c_str(), path.c_str()))
+		return profileErrorWriteFailed;
+
+	return profileSuccess;
+}
+
+profile::Mapping::Mapping() : data(NULL), length(0), watermark(0), ticks(NULL), nticks(0) { }
+
+profile::Mapping::~Mapping()
+{
+	close();
+}
+
+profileError_t profile::Mapping::open(const string& path)
+{
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		return profileErrorOpenFailed;
+
+	struct stat st;
+	if (fstat(fd, &st) || (st.st_size < sizeof(FileHeader)))
+	{
+		::close(fd);
+		return profileErrorInvalidFormat;
+	}
+
+	void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED)
+		return profileErrorReadFailed;
+
+	const FileHeader& header = *(const FileHeader*)mapped;
+	if (!checkHeader(header, st.st_size))
+	{
+		munmap(mapped, st.st_size);
+		return profileErrorInvalidFormat;
+	}
+
+	data = mapped;
+	length = st.st_size;
+	watermark = header.watermark;
+	source.size = header.sourceSize;
+	source.time = header.sourceTime;
+	source.checksum = header.sourceChecksum;
+	ticks = (const Tick*)((const char*)data + sizeof(FileHeader));
+	nticks = header.count;
+
+	return profileSuccess;
+}
+
+void profile::Mapping::close()
+{
+	if (data)
+		munmap(data, length);
+
+	data = NULL;
+	length = 0;
+	watermark = 0;
+	source = candles::Source();
+	ticks = NULL;
+	nticks = 0;
+}
+
+size_t profile::find(const Tick* ticks, size_t nticks, int64_t time)
+{
+	struct Less
+	{
+		bool operator()(const Tick& tick, int64_t time) const { return tick.time < time; }
+	};
+
+	return lower_bound(ticks, ticks + nticks, time, Less()) - ticks;
+}
+
+void profile::getHeatmap(const Tick* ticks, size_t nticks, int64_t startTime, int64_t timeframe, size_t ncolumns,
+	double minval, double maxval, size_t nrows, vector<float>& volumes)
+{
+	volumes.assign(ncolumns * nrows, 0);
+	if (!nticks || !ncolumns || !nrows || !(maxval > minval)) return;
+
+	const double scale = nrows / (maxval - minval);
+	const int64_t endTime = startTime + (int64_t)ncolumns * timeframe;
+
+	const int nthreads = max(1, min(omp_get_max_threads(), (int)(nticks / minTicksPerThread)));
+
+	// The bins of each thread, and the first column they start from.
+	vector<vector<float> > bins(nthreads);
+	vector<size_t> firstColumns(nthreads);
+
+	#pragma omp parallel num_threads(nthreads)
+	{
+		const int t = omp_get_thread_num();
+		const size_t first = nticks * t / nthreads, last = nticks * (t + 1) / nthreads;
+		if (first < last)
+		{
+			const int64_t firstTime = max(startTime, ticks[first].time);
+			const int64_t lastTime = min(endTime - 1, ticks[last - 1].time);
+			if (firstTime <= lastTime)
+			{
+				const size_t firstColumn = (firstTime - startTime) / timeframe;
+				const size_t lastColumn = (lastTime - startTime) / timeframe;
+
+				vector<float>& volumes = bins[t];
+				volumes.assign((lastColumn - firstColumn + 1) * nrows, 0);
+				firstColumns[t] = firstColumn;
+
+				for (size_t i = first; i < last; i++)
+				{
+					const Tick& tick = ticks[i];
+					if ((tick.time < firstTime) || (tick.time > lastTime)) continue;
+
+					const double row = (tick.price - minval) * scale;
+					if ((row < 0) || (row >= nrows)) continue;
+
+					const size_t column = (tick.time - startTime) / timeframe - firstColumn;
+					volumes[column * nrows + (size_t)row] += tick.qty;
+				}
+			}
+		}
+	}
+
+	for (int t = 0; t < nthreads; t++)
+	{
+		const vector<float>& partial = bins[t];
+		float* merged = &volumes[firstColumns[t] * nrows];
+		for (size_t i = 0; i < partial.size(); i++)
+			merged[i] += partial[i];
+	}
+}
+
+void profile::addProfile(const float* heatmap, size_t ncolumns, size_t nrows, double minval, double maxval,
+	double viewMin, double viewMax, vector<double>& volumes)
+{
+	const size_t nviews = volumes.size();
+	if (!nviews || (maxval <= minval) || (viewMax <= viewMin)) return;
+
+	// Each heatmap row goes into the volumes row of its price center.
+	const double step = (maxval - minval) / nrows;
+	const double scale = nviews / (viewMax - viewMin);
+	for (size_t row = 0; row < nrows; row++)
+	{
+		const double position = (minval + (row + 0.5) * step - viewMin) * scale;
+		if ((position < 0) || (position >= nviews)) continue;
+
+		double volume = 0;
+		for (size_t column = 0; column < ncolumns; column++)
+			volume += heatmap[column * nrows + row];
+		volumes[(size_t)position] += volume;
+	}
+}
+
+// The heat from the low to the high volume, blended over the background.
+static const unsigned char coldColor[3] = { 0x20, 0x50, 0xb0 };
+static const unsigned char hotColor[3] = { 0xff, 0xd0, 0x20 };
+static const double maxOpacity = 0.8;
+
+void profile::renderHeatmap(const float* volumes, size_t ncolumns, size_t nrows, uint32_t width,
+	unsigned char* data, int stride)
+{
+	for (size_t column = 0; column < ncolumns; column++)
+	{
+		const float* bins = &volumes[column * nrows];
+
+		float maxVolume = 0;
+		for (size_t row = 0; row < nrows; row++)
+			maxVolume = max(maxVolume, bins[row]);
+		if (maxVolume <= 0) continue;
+
+		for (size_t row = 0; row < nrows; row++)
+		{
+			if (bins[row] <= 0) continue;
+
+			const double heat = sqrt(bins[row] / maxVolume);
+			const double opacity = maxOpacity * heat;
+			unsigned char color[3];
+			for (int k = 0; k < 3; k++)
+				color[k] = coldColor[k] + (hotColor[k] - coldColor[k]) * heat;
+
+			// The pixels are premultiplied, so the color goes over them as is.
+			uint32_t* pixels = (uint32_t*)(data + (nrows - 1 - row) * stride) + column * width;
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const uint32_t pixel = pixels[x];
+				const unsigned char alpha = pixel >> 24, red = (pixel >> 16) & 0xff,
+					green = (pixel >> 8) & 0xff, blue = pixel & 0xff;
+				pixels[x] = ((uint32_t)(alpha + (0xff - alpha) * opacity) << 24) |
+					((uint32_t)(red + (color[0] - red) * opacity) << 16) |
+					((uint32_t)(green + (color[1] - green) * opacity) << 8) |
+					(uint32_t)(blue + (color[2] - blue) * opacity);
+			}
+		}
+	}
+}
+
+void profile::renderProfile(const vector<double>& volumes, uint32_t width, unsigned char* data, int stride)
+{
+	const size_t nrows = volumes.size();
+	double maxVolume = 0;
+	for (size_t row = 0; row < nrows; row++)
+		maxVolume = max(maxVolume, volumes[row]);
+
+	// The premultiplied translucent bars, the price of the maximal volume stands out.
+	for (size_t row = 0; row < nrows; row++)
+	{
+		uint32_t* pixels = (uint32_t*)(data + (nrows - 1 - row) * stride);
+		memset(pixels, 0, width * sizeof(uint32_t));
+		if (maxVolume <= 0) continue;
+
+		const uint32_t length = width * (volumes[row] / maxVolume);
+		const double opacity = (volumes[row] == maxVolume) ? 0.9 : 0.5;
+		const uint32_t pixel = ((uint32_t)(0xff * opacity) << 24) |
+			((uint32_t)(hotColor[0] * opacity) << 16) | ((uint32_t)(hotColor[1] * opacity) << 8) | (uint32_t)(hotColor[2] * opacity);
+		for (uint32_t x = width - length; x < width; x++)
+			pixels[x] = pixel;
+	}
+}
+
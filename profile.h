@@ -0,0 +1,143 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "candles.h"
+
+namespace profile
+{
+	enum profileError_t
+	{
+		profileSuccess = 0,
+		profileErrorOpenFailed,
+		profileErrorReadFailed,
+		profileErrorWriteFailed,
+		profileErrorInvalidFormat,
+		profileErrorWatermarkMismatch,
+	};
+
+	const char* profileGetErrorString(const profileError_t err);
+
+	#define PROFILE_ERR_CHECK(x) \
+	do { \
+		profile::profileError_t err = x; \
+		if (err != profile::profileSuccess) \
+		{ \
+			fprintf(stderr, "%s:%d: profile error: %s\n", __FILE__, __LINE__, profile::profileGetErrorString(err)); \
+			exit(1); \
+		} \
+	} while (0)
+
+	// Trade reduced to what the volume by price needs, a third of the full record,
+	// so that the full history of a busy symbol is scanned at the memory speed.
+	struct Tick
+	{
+		int64_t time;
+		float price, qty;
+	};
+
+	// Path of the ticks file of the symbol, next to its candle files.
+	std::string getPath(const std::string& dir, const std::string& symbol);
+
+	// Writes the ticks of a symbol in the time order, anew or appending
+	// the ones newer than the file already has.
+	class Writer
+	{
+		FILE* file;
+		std::string path;
+		uint64_t count;
+		int64_t watermark;
+
+		// The file is written anew aside, and renamed into place on close.
+		bool anew;
+
+		Writer(const Writer&);
+		Writer& operator=(const Writer&);
+
+	public :
+
+		Writer();
+
+		~Writer();
+
+		// Open the file to append the ticks newer than the watermark, which
+		// must be the one of the file, or to write the file anew for zero.
+		profileError_t open(const std::string& path, int64_t watermark);
+
+		void add(int64_t time, double price, double qty);
+
+		// Complete the file, recording the source, the ticks are taken from.
+		profileError_t close(const candles::Source& source);
+	};
+
+	// Read-only memory mapping of the ticks file.
+	class Mapping
+	{
+		void* data;
+		size_t length;
+
+		int64_t watermark;
+		candles::Source source;
+
+		const Tick* ticks;
+		size_t nticks;
+
+		Mapping(const Mapping&);
+		Mapping& operator=(const Mapping&);
+
+	public :
+
+		Mapping();
+
+		~Mapping();
+
+		profileError_t open(const std::string& path);
+
+		void close();
+
+		bool is_open() const { return data != NULL; }
+
+		int64_t getWatermark() const { return watermark; }
+
+		const candles::Source& getSource() const { return source; }
+
+		size_t size() const { return nticks; }
+
+		const Tick* getTicks() const { return ticks; }
+	};
+
+	// Index of the first tick at or after the time, the ticks sorted by time.
+	size_t find(const Tick* ticks, size_t nticks, int64_t time);
+
+	// Volumes of the ticks binned by time and by price, ncolumns of nrows each,
+	// the first row at the lowest price. The ticks sorted by time are split between
+	// the threads, so each thread bins its part into its own bins of the columns
+	// the part spans, and the bins are merged at the end, only the boundary
+	// columns of the parts overlapping.
+	void getHeatmap(const Tick* ticks, size_t nticks, int64_t startTime, int64_t timeframe, size_t ncolumns,
+		double minval, double maxval, size_t nrows, std::vector<float>& volumes);
+
+	// Add the volumes of the heatmap columns by price, the rows over the price range
+	// binned into the volumes over the view range.
+	void addProfile(const float* heatmap, size_t ncolumns, size_t nrows, double minval, double maxval,
+		double viewMin, double viewMax, std::vector<double>& volumes);
+
+	// Blend the heatmap over the premultiplied 32-bit pixels of the image, each column the given
+	// width of pixels, and each row a pixel, from the bottom of the image. Each
+	// column is scaled by its own maximal volume, so that the separately rendered
+	// parts of the heatmap match.
+	void renderHeatmap(const float* volumes, size_t ncolumns, size_t nrows, uint32_t width,
+		unsigned char* data, int stride);
+
+	// Render the volumes by price as the bars from the right edge of the image
+	// of the given width, each row a pixel, from the bottom of the image.
+	void renderProfile(const std::vector<double>& volumes, uint32_t width, unsigned char* data, int stride);
+}
+
+#endif // PROFILE_H
+
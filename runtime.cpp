@@ -0,0 +1,94 @@
+#include "runtime.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+using namespace runtime;
+using namespace std;
+
+#define RUNTIME_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* runtime::runtimeGetErrorString(const runtimeError_t err)
+{
+	switch (err)
+	{
+	RUNTIME_CASE_STR(runtimeSuccess);
+	RUNTIME_CASE_STR(runtimeErrorAffinityFailed);
+	}
+}
+
+int runtime::getCores()
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set))
+		return max(1u, thread::hardware_concurrency());
+
+	return max(1, CPU_COUNT(&set));
+}
+
+runtimeError_t runtime::pinThread(int core)
+{
+	// The cores available to the process are not necessarily the first ones.
+	cpu_set_t available;
+	CPU_ZERO(&available);
+	if (sched_getaffinity(0, sizeof(available), &available))
+		return runtimeErrorAffinityFailed;
+
+	for (int cpu = 0, index = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		if (!CPU_ISSET(cpu, &available)) continue;
+		if (index++ != core) continue;
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+			return runtimeErrorAffinityFailed;
+
+		return runtimeSuccess;
+	}
+
+	return runtimeErrorAffinityFailed;
+}
+
+runtime::Serial::Serial() : stopping(false)
+{
+	thread = std::thread(&Serial::run, this);
+}
+
+runtime::Serial::~Serial()
+{
+	{
+		lock_guard<mutex> lock(actionsMutex);
+		stopping = true;
+	}
+	actionsReady.notify_one();
+	thread.join();
+}
+
+void runtime::Serial::run()
+{
+	function<void()> action;
+	while (1)
+	{
+		{
+			unique_lock<mutex> lock(actionsMutex);
+			actionsReady.wait(lock, [&]() { return stopping || !actions.empty(); });
+			if (actions.empty()) return;
+			action.swap(actions.front());
+			actions.pop_front();
+		}
+		action();
+	}
+}
+
+void runtime::Serial::post(function<void()>& action)
+{
+	{
+		lock_guard<mutex> lock(actionsMutex);
+		actions.push_back(function<void()>());
+		actions.back().swap(action);
+	}
+	actionsReady.notify_one();
+}
@@ -0,0 +1,315 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace runtime
+{
+	enum runtimeError_t
+	{
+		runtimeSuccess = 0,
+		runtimeErrorAffinityFailed,
+	};
+
+	const char* runtimeGetErrorString(const runtimeError_t err);
+
+	#define RUNTIME_ERR_CHECK(x) \
+	do { \
+		runtime::runtimeError_t err = x; \
+		if (err != runtime::runtimeSuccess) \
+		{ \
+			fprintf(stderr, "%s:%d: runtime error: %s\n", __FILE__, __LINE__, runtime::runtimeGetErrorString(err)); \
+			exit(1); \
+		} \
+	} while (0)
+
+	// Number of the cores available to the process.
+	int getCores();
+
+	// Pin the calling thread to the core.
+	runtimeError_t pinThread(int core);
+
+	// Bounded lock-free queue of a single producer and a single consumer.
+	// The values are swapped in and out, so their buffers are reused.
+	template<typename T>
+	class Queue
+	{
+		std::vector<T> values;
+		const size_t mask;
+
+		// The positions are advanced by their own threads only, and are kept
+		// on different cache lines, not to bounce between the cores.
+		char padding0[64];
+		std::atomic<size_t> head;
+		char padding1[64];
+		std::atomic<size_t> tail;
+		char padding2[64];
+
+		static size_t getCapacity(size_t capacity)
+		{
+			size_t result = 1;
+			while (result < capacity) result *= 2;
+			return result;
+		}
+
+	public :
+
+		Queue(size_t capacity) : values(getCapacity(capacity)), mask(values.size() - 1), head(0), tail(0) { }
+
+		bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+
+		// Swap the value into the queue; false, if the queue is full.
+		bool push(T& value)
+		{
+			const size_t position = tail.load(std::memory_order_relaxed);
+			if (position - head.load(std::memory_order_acquire) == values.size())
+				return false;
+
+			std::swap(values[position & mask], value);
+			tail.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Swap the value out of the queue; false, if the queue is empty.
+		bool pop(T& value)
+		{
+			const size_t position = head.load(std::memory_order_relaxed);
+			if (position == tail.load(std::memory_order_acquire))
+				return false;
+
+			std::swap(values[position & mask], value);
+			head.store(position + 1, std::memory_order_release);
+			return true;
+		}
+	};
+
+	// Thread doing the posted actions in turn, for the blocking work the workers
+	// must not wait for. The urgent work is given its own thread, not to wait
+	// behind the slow one.
+	class Serial
+	{
+		std::mutex actionsMutex;
+		std::condition_variable actionsReady;
+		std::deque<std::function<void()> > actions;
+		bool stopping;
+
+		std::thread thread;
+
+		Serial(const Serial&);
+		Serial& operator=(const Serial&);
+
+		void run();
+
+	public :
+
+		Serial();
+
+		// Do the actions posted so far, and stop the thread.
+		~Serial();
+
+		// Swap the action into the queue, from any thread.
+		void post(std::function<void()>& action);
+	};
+
+	// Workers pinned to the cores, each owning a fixed shard of the keys with
+	// their state, so that the state is never shared, and needs no locks. The
+	// messages of a key are routed to its owner through the queue of each
+	// producer thread to each worker, and handled in the order of sending.
+	// Instead of the barriers, the workers schedule their own timers, so a slow
+	// key delays only itself. Idle workers sleep until the next timer or message.
+	template<typename Message>
+	class Runtime
+	{
+	public :
+
+		typedef std::chrono::steady_clock::time_point Time;
+
+		typedef std::function<void(int worker, int key, Message& message)> MessageHandler;
+		typedef std::function<void(int worker, int key)> TimerHandler;
+
+	private :
+
+		struct Envelope
+		{
+			int key;
+			Message message;
+		};
+
+		struct Timer
+		{
+			Time time;
+			int key;
+
+			bool operator<(const Timer& other) const { return time > other.time; }
+		};
+
+		struct Worker
+		{
+			std::vector<std::unique_ptr<Queue<Envelope> > > queues;
+			std::priority_queue<Timer> timers;
+
+			std::mutex sleepMutex;
+			std::condition_variable wakeup;
+			std::atomic<bool> sleeping;
+
+			std::thread thread;
+
+			Worker() : sleeping(false) { }
+		};
+
+		std::vector<std::unique_ptr<Worker> > workers;
+
+		// Spins of the idle worker before it sleeps.
+		static const int nspins = 1000;
+
+		// Messages taken from a queue at once.
+		static const int maxBatch = 256;
+
+		bool pollQueues(int w, Envelope& envelope, const MessageHandler& onMessage)
+		{
+			Worker& worker = *workers[w];
+
+			// A flood from one producer should not hold the timers and the others.
+			bool handled = false;
+			for (int p = 0; p < worker.queues.size(); p++)
+				for (int i = 0; (i < maxBatch) && worker.queues[p]->pop(envelope); i++)
+				{
+					onMessage(w, envelope.key, envelope.message);
+					handled = true;
+				}
+
+			return handled;
+		}
+
+		bool isIdle(int w)
+		{
+			Worker& worker = *workers[w];
+			for (int p = 0; p < worker.queues.size(); p++)
+				if (!worker.queues[p]->empty()) return false;
+			return true;
+		}
+
+		void run(int w, int core, MessageHandler onMessage, TimerHandler onTimer)
+		{
+			if (core >= 0)
+			{
+				runtimeError_t status = pinThread(core);
+				if (status != runtimeSuccess)
+					fprintf(stderr, "Cannot pin worker %d to core %d: %s\n", w, core, runtimeGetErrorString(status));
+			}
+
+			Worker& worker = *workers[w];
+			Envelope envelope;
+			for (int idle = 0; ; )
+			{
+				bool handled = pollQueues(w, envelope, onMessage);
+
+				const Time now = std::chrono::steady_clock::now();
+				while (worker.timers.size() && (worker.timers.top().time <= now))
+				{
+					const int key = worker.timers.top().key;
+					worker.timers.pop();
+					onTimer(w, key);
+					handled = true;
+				}
+
+				if (handled || (++idle < nspins))
+				{
+					if (handled) idle = 0;
+					continue;
+				}
+				idle = 0;
+
+				// The producers notify only the sleeping worker, after the push,
+				// so the queues are checked again once it is marked sleeping.
+				std::unique_lock<std::mutex> lock(worker.sleepMutex);
+				worker.sleeping = true;
+				if (isIdle(w))
+				{
+					const Time until = worker.timers.size() ? worker.timers.top().time : now + std::chrono::seconds(1);
+					worker.wakeup.wait_until(lock, until);
+				}
+				worker.sleeping = false;
+			}
+		}
+
+	public :
+
+		Runtime(int nworkers, int nproducers, size_t capacity = 64 * 1024)
+		{
+			for (int w = 0; w < nworkers; w++)
+			{
+				workers.push_back(std::unique_ptr<Worker>(new Worker()));
+				for (int p = 0; p < nproducers; p++)
+					workers.back()->queues.push_back(std::unique_ptr<Queue<Envelope> >(new Queue<Envelope>(capacity)));
+			}
+		}
+
+		int size() const { return workers.size(); }
+
+		int getOwner(int key) const { return key % (int)workers.size(); }
+
+		// Send the message to the owner of the key, from the producer thread only.
+		// The message is swapped with a spare one. Waits while the queue is full.
+		void send(int producer, int key, Message& message)
+		{
+			Worker& worker = *workers[getOwner(key)];
+			Queue<Envelope>& queue = *worker.queues[producer];
+
+			Envelope envelope;
+			envelope.key = key;
+			std::swap(envelope.message, message);
+			while (!queue.push(envelope))
+				std::this_thread::yield();
+			std::swap(envelope.message, message);
+
+			// The push must be seen before the sleeping flag is read.
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (worker.sleeping)
+			{
+				std::lock_guard<std::mutex> lock(worker.sleepMutex);
+				worker.wakeup.notify_one();
+			}
+		}
+
+		// Call the timer handler of the key at the time, from the worker thread only.
+		void schedule(int worker, Time time, int key)
+		{
+			Timer timer;
+			timer.time = time;
+			timer.key = key;
+			workers[worker]->timers.push(timer);
+		}
+
+		// Start the workers, pinned to the cores in turn from the first core given,
+		// or not pinned, if it is negative. The timers to start with are scheduled
+		// by the handlers of the first messages.
+		void start(const MessageHandler& onMessage, const TimerHandler& onTimer, int firstCore = 0)
+		{
+			const int ncores = getCores();
+			for (int w = 0; w < workers.size(); w++)
+			{
+				const int core = (firstCore < 0) ? -1 : (firstCore + w) % ncores;
+				workers[w]->thread = std::thread(&Runtime::run, this, w, core, onMessage, onTimer);
+				workers[w]->thread.detach();
+			}
+		}
+	};
+}
+
+#endif // RUNTIME_H
+
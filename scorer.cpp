@@ -0,0 +1,303 @@
+#include "scorer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <wordexp.h>
+
+using namespace scorer;
+using namespace std;
+
+#define SCORER_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* scorer::scorerGetErrorString(const scorerError_t err)
+{
+	switch (err)
+	{
+	SCORER_CASE_STR(scorerSuccess);
+	SCORER_CASE_STR(scorerErrorOpenFailed);
+	SCORER_CASE_STR(scorerErrorWriteFailed);
+	SCORER_CASE_STR(scorerErrorInvalidFormat);
+	}
+}
+
+const char* scorer::featureNames[nfeatures] =
+{
+	"return1m", "return5m", "return15m", "volume_surge", "trade_rate", "buy_imbalance"
+};
+
+const string scorer::Model::default_path = "$HOME/.bitrader/model";
+
+void scorer::Activity::clear()
+{
+	for (int i = 0; i <= nminutes; i++)
+		minutes[i].minute = -1;
+	first = -1;
+	last = -1;
+}
+
+const scorer::Activity::Minute* scorer::Activity::get(int64_t minute) const
+{
+	const Minute& bin = minutes[minute % (nminutes + 1)];
+	return (bin.minute == minute) ? &bin : NULL;
+}
+
+void scorer::Activity::add(const history::Trade& trade)
+{
+	const int64_t minute = trade.time / (60 * 1000);
+	Minute& bin = minutes[minute % (nminutes + 1)];
+	if (minute > last)
+	{
+		// The quiet minutes in between are left stale, and told by their minute.
+		bin.minute = minute;
+		bin.volume = 0;
+		bin.buyVolume = 0;
+		bin.ntrades = 0;
+		bin.close = trade.price;
+		if (first < 0) first = minute;
+		last = minute;
+	}
+	else if (bin.minute != minute)
+		return;
+
+	// The buyer is the taker, unless it is the maker.
+	const double volume = trade.price * trade.qty;
+	bin.volume += volume;
+	if (!trade.isBuyerMaker)
+		bin.buyVolume += volume;
+	bin.ntrades++;
+	if (minute == last)
+		bin.close = trade.price;
+}
+
+bool scorer::Activity::getFeatures(float* features) const
+{
+	if ((last < 0) || (last - first < warmup)) return false;
+
+	// The closes are carried forward over the quiet minutes, and the first
+	// close seen back to the minutes before it.
+	const int64_t from = max(first, last - nminutes);
+	double closes[nminutes + 1];
+	double close = 0;
+	for (int64_t m = from; m <= last; m++)
+	{
+		const Minute* bin = get(m);
+		if (bin)
+		{
+			if (close == 0)
+				fill(closes, closes + (m - from), bin->close);
+			close = bin->close;
+		}
+		closes[m - from] = close;
+	}
+
+	const double last1 = closes[last - from];
+	features[Return1m] = log(last1 / closes[last - 1 - from]);
+	features[Return5m] = log(last1 / closes[last - 5 - from]);
+	features[Return15m] = log(last1 / closes[last - 15 - from]);
+
+	// The last 5 minutes, including the current one, against the minutes before.
+	double volume = 0, buyVolume = 0, baseVolume = 0;
+	double ntrades = 0, baseTrades = 0;
+	for (int64_t m = from; m <= last; m++)
+	{
+		const Minute* bin = get(m);
+		if (!bin) continue;
+
+		if (m > last - 5)
+		{
+			volume += bin->volume;
+			buyVolume += bin->buyVolume;
+			ntrades += bin->ntrades;
+		}
+		else
+		{
+			baseVolume += bin->volume;
+			baseTrades += bin->ntrades;
+		}
+	}
+
+	features[BuyImbalance] = (volume > 0) ? (2 * buyVolume - volume) / volume : 0;
+
+	const double nbase = last - 5 - from + 1;
+	volume /= 5;
+	baseVolume /= nbase;
+	features[VolumeSurge] = (volume + baseVolume > 0) ? volume / (volume + baseVolume) : 0.5;
+	ntrades /= 5;
+	baseTrades /= nbase;
+	features[TradeRate] = (ntrades + baseTrades > 0) ? ntrades / (ntrades + baseTrades) : 0.5;
+
+	return true;
+}
+
+void scorer::Batch::resize(size_t nrows)
+{
+	for (int f = 0; f < nfeatures; f++)
+		columns[f].resize(nrows);
+}
+
+void scorer::Batch::set(size_t row, const float* features)
+{
+	for (int f = 0; f < nfeatures; f++)
+		columns[f][row] = features[f];
+}
+
+scorer::Model::Model() : bias(0), rawBias(0), horizon(0), gain(0), loaded(false)
+{
+	for (int f = 0; f < nfeatures; f++)
+	{
+		mean[f] = 0;
+		scale[f] = 1;
+		weights[f] = 0;
+		rawWeights[f] = 0;
+	}
+}
+
+void scorer::Model::fold()
+{
+	rawBias = bias;
+	for (int f = 0; f < nfeatures; f++)
+	{
+		rawWeights[f] = weights[f] / scale[f];
+		rawBias -= rawWeights[f] * mean[f];
+	}
+}
+
+void scorer::Model::set(const float* mean_, const float* scale_, const float* weights_, float bias_, int64_t horizon_, double gain_)
+{
+	for (int f = 0; f < nfeatures; f++)
+	{
+		mean[f] = mean_[f];
+		scale[f] = scale_[f];
+		weights[f] = weights_[f];
+	}
+	bias = bias_;
+	horizon = horizon_;
+	gain = gain_;
+	fold();
+	loaded = true;
+}
+
+static string expandPath(const string& path)
+{
+	wordexp_t p;
+	wordexp(path.c_str(), &p, 0);
+	const string result = p.we_wordv[0];
+	wordfree(&p);
+
+	return result;
+}
+
+scorerError_t scorer::Model::load(const string& path_)
+{
+	const string path = expandPath(path_);
+	ifstream file(path.c_str());
+	if (!file.is_open())
+		return scorerErrorOpenFailed;
+
+	// Each line is the parameter name and its values.
+	float mean_[nfeatures], scale_[nfeatures], weights_[nfeatures], bias_ = 0;
+	int64_t horizon_ = 0;
+	double gain_ = 0;
+	bool seen[nfeatures] = { };
+	string text;
+	for (int line = 1; getline(file, text); line++)
+	{
+		stringstream fields(text);
+		string name;
+		if (!(fields >> name) || (name[0] == '#'))
+			continue;
+
+		bool parsed;
+		if (name == "horizon")
+			parsed = (bool)(fields >> horizon_);
+		else if (name == "gain")
+			parsed = (bool)(fields >> gain_);
+		else if (name == "bias")
+			parsed = (bool)(fields >> bias_);
+		else
+		{
+			const int f = find(featureNames, featureNames + nfeatures, name) - featureNames;
+			parsed = (f < nfeatures) && (fields >> mean_[f] >> scale_[f] >> weights_[f]) && (scale_[f] > 0);
+			if (parsed)
+				seen[f] = true;
+		}
+		if (!parsed)
+		{
+			fprintf(stderr, "%s:%d: unexpected %s\n", path.c_str(), line, name.c_str());
+			return scorerErrorInvalidFormat;
+		}
+	}
+
+	for (int f = 0; f < nfeatures; f++)
+		if (!seen[f])
+		{
+			fprintf(stderr, "%s: missing %s\n", path.c_str(), featureNames[f]);
+			return scorerErrorInvalidFormat;
+		}
+	if ((horizon_ <= 0) || (gain_ <= 0))
+	{
+		fprintf(stderr, "%s: missing horizon or gain\n", path.c_str());
+		return scorerErrorInvalidFormat;
+	}
+
+	set(mean_, scale_, weights_, bias_, horizon_, gain_);
+
+	return scorerSuccess;
+}
+
+scorerError_t scorer::Model::save(const string& path_) const
+{
+	const string path = expandPath(path_);
+	ofstream file(path.c_str());
+	if (!file.is_open())
+		return scorerErrorOpenFailed;
+
+	file.precision(9);
+	file << "# Pump probability: the gain within the horizon, in ms" << endl;
+	file << "horizon " << horizon << endl;
+	file << "gain " << gain << endl;
+	file << "bias " << bias << endl;
+	file << "# feature mean scale weight" << endl;
+	for (int f = 0; f < nfeatures; f++)
+		file << featureNames[f] << " " << mean[f] << " " << scale[f] << " " << weights[f] << endl;
+
+	file.close();
+	if (file.fail())
+		return scorerErrorWriteFailed;
+
+	return scorerSuccess;
+}
+
+float scorer::Model::score(const float* features) const
+{
+	float z = rawBias;
+	for (int f = 0; f < nfeatures; f++)
+		z += rawWeights[f] * features[f];
+
+	return 1 / (1 + expf(-z));
+}
+
+void scorer::Model::score(const Batch& batch, size_t first, size_t count, float* probabilities) const
+{
+	// The rows are scored by the columns, each pass the vector multiply-add.
+	float* z = probabilities;
+	#pragma omp simd
+	for (size_t r = 0; r < count; r++)
+		z[r] = rawBias;
+
+	for (int f = 0; f < nfeatures; f++)
+	{
+		const float weight = rawWeights[f];
+		const float* column = batch.getColumn(f) + first;
+		#pragma omp simd
+		for (size_t r = 0; r < count; r++)
+			z[r] += weight * column[r];
+	}
+
+	#pragma omp simd
+	for (size_t r = 0; r < count; r++)
+		z[r] = 1 / (1 + expf(-z[r]));
+}
+
@@ -0,0 +1,163 @@
+#ifndef SCORER_H
+#define SCORER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "history.h"
+
+namespace scorer
+{
+	enum scorerError_t
+	{
+		scorerSuccess = 0,
+		scorerErrorOpenFailed,
+		scorerErrorWriteFailed,
+		scorerErrorInvalidFormat,
+	};
+
+	const char* scorerGetErrorString(const scorerError_t err);
+
+	#define SCORER_ERR_CHECK(x) \
+	do { \
+		scorer::scorerError_t err = x; \
+		if (err != scorer::scorerSuccess) \
+		{ \
+			fprintf(stderr, "%s:%d: scorer error: %s\n", __FILE__, __LINE__, scorer::scorerGetErrorString(err)); \
+			exit(1); \
+		} \
+	} while (0)
+
+	// Features of the pair activity, the pump probability is scored on.
+	enum Feature
+	{
+		// Log returns of the last price against the closes 1, 5 and 15 minutes ago.
+		Return1m,
+		Return5m,
+		Return15m,
+
+		// Volume and trade rate of the last 5 minutes against the hour before, as
+		// x / (x + baseline), 0.5 for the usual activity.
+		VolumeSurge,
+		TradeRate,
+
+		// (buys - sells) / (buys + sells) of the taker volume of the last 5 minutes.
+		BuyImbalance,
+
+		nfeatures
+	};
+
+	extern const char* featureNames[nfeatures];
+
+	// Trading activity of a pair by the minute, over the last hour, updated
+	// by the trades as they come. The trainer replays the history through it,
+	// so the model is trained on the same features, as it is scored on.
+	class Activity
+	{
+	public :
+
+		// Minutes of the baseline, and the minutes seen at least, for the features.
+		static const int nminutes = 60;
+		static const int warmup = 15;
+
+	private :
+
+		struct Minute
+		{
+			int64_t minute;
+			double volume, buyVolume, close;
+			uint32_t ntrades;
+		};
+
+		// Ring of the minutes, including the current one.
+		Minute minutes[nminutes + 1];
+
+		// The first and the last minutes seen, -1 if none.
+		int64_t first, last;
+
+		const Minute* get(int64_t minute) const;
+
+	public :
+
+		Activity() { clear(); }
+
+		void clear();
+
+		// Add the trade, in the time order; the trades older than the ring are dropped.
+		void add(const history::Trade& trade);
+
+		int64_t getLastMinute() const { return last; }
+
+		// Features as of the last trade; false, if less than the warmup minutes are seen.
+		bool getFeatures(float* features) const;
+	};
+
+	// Features of the rows by the columns, so that the consecutive rows
+	// fill the vector lanes of the scoring.
+	class Batch
+	{
+		std::vector<float> columns[nfeatures];
+
+	public :
+
+		Batch(size_t nrows = 0) { resize(nrows); }
+
+		void resize(size_t nrows);
+
+		size_t size() const { return columns[0].size(); }
+
+		void set(size_t row, const float* features);
+
+		const float* getColumn(int feature) const { return columns[feature].data(); }
+	};
+
+	// Logistic regression of the pump on the standardized features: the probability
+	// of the price to gain at least the gain within the horizon. The standardization
+	// is folded into the weights on the raw features, so the scoring is the single
+	// multiply-add per feature.
+	class Model
+	{
+		float mean[nfeatures], scale[nfeatures], weights[nfeatures], bias;
+
+		// The weights and the bias on the raw features.
+		float rawWeights[nfeatures], rawBias;
+
+		int64_t horizon;
+		double gain;
+
+		bool loaded;
+
+		void fold();
+
+	public :
+
+		static const std::string default_path;
+
+		Model();
+
+		bool is_loaded() const { return loaded; }
+
+		int64_t getHorizon() const { return horizon; }
+
+		double getGain() const { return gain; }
+
+		// Set the fitted model: the weights and the bias apply to (x - mean) / scale.
+		void set(const float* mean, const float* scale, const float* weights, float bias, int64_t horizon, double gain);
+
+		scorerError_t load(const std::string& path);
+
+		scorerError_t save(const std::string& path) const;
+
+		// Probability of the single row of the features.
+		float score(const float* features) const;
+
+		// Probabilities of the count rows of the batch from the first one.
+		void score(const Batch& batch, size_t first, size_t count, float* probabilities) const;
+	};
+}
+
+#endif // SCORER_H
+
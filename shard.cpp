@@ -0,0 +1,284 @@
+#include "shard.h"
+
+#include <chrono>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace shard;
+using namespace std;
+
+#define SHARD_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* shard::shardGetErrorString(const shardError_t err)
+{
+	switch (err)
+	{
+	SHARD_CASE_STR(shardSuccess);
+	SHARD_CASE_STR(shardErrorSocketFailed);
+	SHARD_CASE_STR(shardErrorConnectFailed);
+	SHARD_CASE_STR(shardErrorDisconnected);
+	SHARD_CASE_STR(shardErrorInvalidMessage);
+	}
+}
+
+const string shard::default_socket_path = "$HOME/.bitrader/notifier.sock";
+
+uint64_t shard::Ring::hash(const string& key)
+{
+	// FNV-1a, finalized with the splitmix64 mixer, so that the similar
+	// symbol names land far apart on the ring.
+	uint64_t h = 14695981039346656037ULL;
+	for (int i = 0; i < key.size(); i++)
+	{
+		h ^= (unsigned char)key[i];
+		h *= 1099511628211ULL;
+	}
+
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+
+	return h;
+}
+
+void shard::Ring::setMembers(const vector<string>& members)
+{
+	points.clear();
+	for (int i = 0; i < members.size(); i++)
+		for (int j = 0; j < replicas; j++)
+			points[hash(members[i] + "#" + to_string(j))] = members[i];
+}
+
+const string& shard::Ring::getOwner(const string& key) const
+{
+	static const string none;
+	if (points.empty()) return none;
+
+	map<uint64_t, string>::const_iterator point = points.lower_bound(hash(key));
+	if (point == points.end())
+		point = points.begin();
+
+	return point->second;
+}
+
+static bool readAll(int fd, void* data, size_t size)
+{
+	char* ptr = (char*)data;
+	while (size)
+	{
+		ssize_t n = read(fd, ptr, size);
+		if (n <= 0) return false;
+		ptr += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+static bool writeAll(int fd, const void* data, size_t size)
+{
+	const char* ptr = (const char*)data;
+	while (size)
+	{
+		ssize_t n = send(fd, ptr, size, MSG_NOSIGNAL);
+		if (n <= 0) return false;
+		ptr += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+// Upper bounds of the fields of the message, their sizes and the whole message,
+// for the garbage not to be allocated: the largest field is the chart PNG.
+static const uint32_t maxFields = 1024;
+static const uint32_t maxFieldSize = 8 * 1024 * 1024;
+static const uint64_t maxMessageSize = 16 * 1024 * 1024;
+
+shardError_t shard::readMessage(int fd, Message& message)
+{
+	uint32_t header[2];
+	if (!readAll(fd, header, sizeof(header)))
+		return shardErrorDisconnected;
+	if (header[1] > maxFields)
+		return shardErrorInvalidMessage;
+
+	message.type = header[0];
+	message.fields.resize(header[1]);
+	uint64_t total = 0;
+	for (int i = 0; i < message.fields.size(); i++)
+	{
+		uint32_t size;
+		if (!readAll(fd, &size, sizeof(size)))
+			return shardErrorDisconnected;
+		total += size;
+		if ((size > maxFieldSize) || (total > maxMessageSize))
+			return shardErrorInvalidMessage;
+
+		string& field = message.fields[i];
+		field.resize(size);
+		if (size && !readAll(fd, &field[0], size))
+			return shardErrorDisconnected;
+	}
+
+	return shardSuccess;
+}
+
+shardError_t shard::writeMessage(int fd, const Message& message)
+{
+	// Frame the whole message first, so that it is sent at once.
+	string frame;
+	uint32_t header[2] = { message.type, (uint32_t)message.fields.size() };
+	frame.append((const char*)header, sizeof(header));
+	for (int i = 0; i < message.fields.size(); i++)
+	{
+		uint32_t size = message.fields[i].size();
+		frame.append((const char*)&size, sizeof(size));
+		frame.append(message.fields[i]);
+	}
+
+	if (!writeAll(fd, frame.data(), frame.size()))
+		return shardErrorDisconnected;
+
+	return shardSuccess;
+}
+
+shard::Client::Client(const string& path_, const string& name_) : path(path_), name(name_), fd(-1), version(0), stopping(false),
+	sequence(chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count()) { }
+
+shard::Client::~Client()
+{
+	{
+		lock_guard<mutex> lock(membersMutex);
+		stopping = true;
+		if (fd >= 0)
+			shutdown(fd, SHUT_RDWR);
+	}
+
+	if (reader.joinable())
+		reader.join();
+
+	if (fd >= 0)
+		close(fd);
+}
+
+shardError_t shard::Client::connect()
+{
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+		return shardErrorSocketFailed;
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	if (::connect(sock, (sockaddr*)&addr, sizeof(addr)))
+	{
+		close(sock);
+		return shardErrorConnectFailed;
+	}
+
+	Message hello;
+	hello.type = Message::Hello;
+	hello.fields.push_back(name);
+	shardError_t status = writeMessage(sock, hello);
+	if (status != shardSuccess)
+	{
+		close(sock);
+		return status;
+	}
+
+	lock_guard<mutex> lock(membersMutex);
+	if (fd >= 0)
+		close(fd);
+	fd = sock;
+
+	return shardSuccess;
+}
+
+shardError_t shard::Client::start()
+{
+	shardError_t status = connect();
+	if (status != shardSuccess)
+		return status;
+
+	reader = thread(&Client::run, this);
+
+	unique_lock<mutex> lock(membersMutex);
+	membersReady.wait(lock, [&]() { return version > 0; });
+
+	return shardSuccess;
+}
+
+void shard::Client::run()
+{
+	while (1)
+	{
+		int sock;
+		{
+			lock_guard<mutex> lock(membersMutex);
+			if (stopping) return;
+			sock = fd;
+		}
+
+		Message message;
+		shardError_t status = readMessage(sock, message);
+		if (status == shardSuccess)
+		{
+			if (message.type != Message::Members) continue;
+
+			{
+				lock_guard<mutex> lock(membersMutex);
+				members = message.fields;
+				version++;
+			}
+			membersReady.notify_all();
+			continue;
+		}
+
+		{
+			lock_guard<mutex> lock(membersMutex);
+			if (stopping) return;
+		}
+
+		// Keep the last members, until the notifier is back.
+		fprintf(stderr, "Notifier connection lost: %s, reconnecting ...\n", shardGetErrorString(status));
+		while (connect() != shardSuccess)
+		{
+			this_thread::sleep_for(chrono::seconds(1));
+
+			lock_guard<mutex> lock(membersMutex);
+			if (stopping) return;
+		}
+	}
+}
+
+bool shard::Client::getMembers(uint64_t& version_, vector<string>& members_)
+{
+	lock_guard<mutex> lock(membersMutex);
+	if (version_ == version) return false;
+
+	version_ = version;
+	members_ = members;
+	return true;
+}
+
+shardError_t shard::Client::sendAlert(const string& key, AlertKind kind, const string& caption, const string& png)
+{
+	Message alert;
+	alert.type = Message::Alert;
+	alert.fields.push_back(key);
+	alert.fields.push_back(to_string(kind));
+	alert.fields.push_back(name);
+
+	lock_guard<mutex> lock(membersMutex);
+	alert.fields.push_back(to_string(sequence++));
+	alert.fields.push_back(caption);
+	alert.fields.push_back(png);
+	return writeMessage(fd, alert);
+}
+
@@ -0,0 +1,145 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace shard
+{
+	enum shardError_t
+	{
+		shardSuccess = 0,
+		shardErrorSocketFailed,
+		shardErrorConnectFailed,
+		shardErrorDisconnected,
+		shardErrorInvalidMessage,
+	};
+
+	const char* shardGetErrorString(const shardError_t err);
+
+	#define SHARD_ERR_CHECK(x) \
+	do { \
+		shard::shardError_t err = x; \
+		if (err != shard::shardSuccess) \
+		{ \
+			fprintf(stderr, "%s:%d: shard error: %s\n", __FILE__, __LINE__, shard::shardGetErrorString(err)); \
+			exit(1); \
+		} \
+	} while (0)
+
+	// Default path of the notifier socket.
+	extern const std::string default_socket_path;
+
+	// Consistent hash ring of the instances: each instance is placed onto
+	// the ring at many points, and a symbol belongs to the first instance
+	// point following the symbol hash. When an instance joins or leaves,
+	// only the symbols between its points and their predecessors move.
+	class Ring
+	{
+		std::map<uint64_t, std::string> points;
+
+	public :
+
+		// Points per instance, to even out the partitions.
+		static const int replicas = 128;
+
+		static uint64_t hash(const std::string& key);
+
+		void setMembers(const std::vector<std::string>& members);
+
+		bool empty() const { return points.empty(); }
+
+		// Instance owning the key, or empty string for the empty ring.
+		const std::string& getOwner(const std::string& key) const;
+	};
+
+	// Kind of the alert. The signals of the same pair sent by the different instances,
+	// while the pair moves between them, are the duplicates; the triggers and the
+	// executed orders are the facts of the sender, and are always delivered.
+	enum AlertKind
+	{
+		SignalAlert = 1,
+		TriggerAlert,
+		ExecutionAlert,
+	};
+
+	// Message of the notifier protocol, framed on the stream socket as
+	// the type and the number of fields, followed by the length-prefixed fields.
+	struct Message
+	{
+		enum Type
+		{
+			// Instance joins the ring: {name}.
+			Hello = 1,
+
+			// Current ring members, sent to all instances on a change: {name, ...}.
+			Members,
+
+			// Alert: {key, kind, sender, sequence, caption, png}. The sequence numbers
+			// the alerts of the sender. The png could be empty.
+			Alert,
+		};
+
+		uint32_t type;
+		std::vector<std::string> fields;
+	};
+
+	// Read the message; shardErrorInvalidMessage, if it exceeds the bounds
+	// of the fields, then the connection is to be dropped.
+	shardError_t readMessage(int fd, Message& message);
+
+	shardError_t writeMessage(int fd, const Message& message);
+
+	// Connection of a trading instance to the notifier. The ring members are
+	// received in the background; the connection is re-established, if the
+	// notifier restarts.
+	class Client
+	{
+		const std::string path;
+		const std::string name;
+
+		int fd;
+
+		std::mutex membersMutex;
+		std::condition_variable membersReady;
+		std::vector<std::string> members;
+		uint64_t version;
+		bool stopping;
+
+		// Sequence number of the next alert, starting from the time of the start,
+		// so that it keeps growing across the restarts of the instance.
+		uint64_t sequence;
+
+		std::thread reader;
+
+		shardError_t connect();
+
+		void run();
+
+	public :
+
+		Client(const std::string& path, const std::string& name);
+
+		~Client();
+
+		const std::string& getName() const { return name; }
+
+		// Connect and wait for the first members list.
+		shardError_t start();
+
+		// Get the members, if changed since the given version.
+		bool getMembers(uint64_t& version, std::vector<std::string>& members);
+
+		shardError_t sendAlert(const std::string& key, AlertKind kind, const std::string& caption, const std::string& png);
+	};
+}
+
+#endif // SHARD_H
+
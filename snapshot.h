@@ -0,0 +1,78 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+
+namespace snapshot
+{
+	// Read-only snapshots of the state, published by a single writer and read
+	// by any number of readers, none of them ever taking a lock. There are three
+	// copies: the writer fills the one, which is neither published nor pinned by
+	// a reader, and publishes it by the index. The reader pins the published copy
+	// by its counter, and takes another one, if it has been replaced meanwhile.
+	// The copies are reused, so the steady-state publishing does no allocation.
+	template<typename T>
+	class Snapshots
+	{
+		static const int ncopies = 3;
+
+		T copies[ncopies];
+
+		std::atomic<int> current;
+		mutable std::atomic<int> readers[ncopies];
+
+		Snapshots(const Snapshots&);
+		Snapshots& operator=(const Snapshots&);
+
+	public :
+
+		Snapshots() : current(-1)
+		{
+			for (int i = 0; i < ncopies; i++)
+				readers[i] = 0;
+		}
+
+		// Fill the free copy by fill(T&) and publish it. The copy keeps the contents
+		// of its previous publication. Returns false without publishing, if all copies
+		// are busy with the slow readers, so the writer never waits.
+		template<typename Fill>
+		bool publish(Fill fill)
+		{
+			const int published = current.load();
+			for (int i = 0; i < ncopies; i++)
+			{
+				if ((i == published) || readers[i].load()) continue;
+
+				fill(copies[i]);
+				current.store(i);
+				return true;
+			}
+
+			return false;
+		}
+
+		// Read the last published copy by read(const T&). Returns false, if there
+		// is nothing published yet.
+		template<typename Read>
+		bool read(Read read) const
+		{
+			while (1)
+			{
+				const int i = current.load();
+				if (i < 0) return false;
+
+				readers[i]++;
+				if (current.load() == i)
+				{
+					read(copies[i]);
+					readers[i]--;
+					return true;
+				}
+				readers[i]--;
+			}
+		}
+	};
+}
+
+#endif // SNAPSHOT_H
+
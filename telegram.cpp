@@ -15,6 +15,8 @@ const char* telegram::telegramGetErrorString(const telegramError_t err)
 	TELEGRAM_CASE_STR(telegramErrorInitializationFailed);
 	TELEGRAM_CASE_STR(telegramErrorMissingAccountKeys);
 	TELEGRAM_CASE_STR(telegramErrorSendMessageFailed);
+	TELEGRAM_CASE_STR(telegramErrorSendPhotoFailed);
+	TELEGRAM_CASE_STR(telegramErrorReceiveFailed);
 	}
 }
 
@@ -1,10 +1,15 @@
 #ifndef TELEGRAM_H
 #define TELEGRAM_H
 
+#include <cstdint>
+#include <jsoncpp/json/json.h>
 #include <memory>
 #include <queue>
 #include <string>
 #include <tgbot/tgbot.h>
+#include <vector>
+
+#include "http.h"
 
 namespace telegram
 {
@@ -14,6 +19,8 @@ namespace telegram
 		telegramErrorInitializationFailed,
 		telegramErrorMissingAccountKeys,
 		telegramErrorSendMessageFailed,
+		telegramErrorSendPhotoFailed,
+		telegramErrorReceiveFailed,
 	};
 
 	const char* telegramGetErrorString(const telegramError_t err);
@@ -37,9 +44,52 @@ namespace telegram
 
 		bool keysAreSet() const;
 
+		const std::string& getToken() const { return token; }
+
+		unsigned long getChatId() const { return chatid; }
+
 		telegramError_t initialize();
 
 		telegramError_t sendMessage(std::string message);
+
+		// Send the PNG image with the HTML caption.
+		telegramError_t sendPhoto(const std::string& png, std::string caption);
+	};
+
+	// Command of the chat, e.g. "/symbol XRP": the name without the slash
+	// and the bot name, and the arguments.
+	struct Command
+	{
+		std::string name;
+		std::vector<std::string> args;
+	};
+
+	// Inbound commands of the bot chat, long-polled from the Bot API. Only the
+	// messages of the configured chat are taken, and the replies go back to it.
+	// The API server could be replaced by the local stand-in (see bitelegram).
+	class Commands
+	{
+		std::string token;
+		unsigned long chatid;
+
+		http::Client client;
+
+		// The next update to receive.
+		int64_t offset;
+
+		bool request(const std::string& path, Json::Value& result);
+
+	public :
+
+		static const std::string default_server;
+
+		Commands(const Bot& bot, const std::string& server = default_server);
+
+		// Wait for the new commands, up to the timeout in seconds.
+		telegramError_t receive(std::vector<Command>& commands, int timeout = 25);
+
+		// Send the HTML reply to the chat.
+		telegramError_t reply(const std::string& text);
 	};
 }
 
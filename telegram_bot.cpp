@@ -100,3 +100,40 @@ telegramError_t telegram::Bot::sendMessage(string message)
 	}
 }
 
+telegramError_t telegram::Bot::sendPhoto(const string& png, string caption)
+{
+	telegramError_t status = initialize();
+	
+	if (status != telegramSuccess)
+		return status;
+
+	try
+	{
+		// First, send queued messages, if any.
+		if (msgQueue.size())
+		{
+			for (int i = 0, e = msgQueue.size(); i < e; i++)
+			{
+				bot->getApi().sendMessage(chatid, msgQueue.front(), false, 0, TgBot::GenericReply::Ptr(), "HTML");
+				msgQueue.pop();
+			}
+		}
+
+		TgBot::InputFile::Ptr photo(new TgBot::InputFile);
+		photo->data = png;
+		photo->mimeType = "image/png";
+		photo->fileName = "chart.png";
+
+		bot->getApi().sendPhoto(chatid, photo, caption, 0, TgBot::GenericReply::Ptr(), "HTML");
+	}
+	catch (TgBot::TgException& e)
+	{
+		status = telegramErrorSendPhotoFailed;
+
+		// Store the caption in the queue to send it at least
+		// as the message next time.
+		msgQueue.push(caption);
+	}
+
+	return status;
+}
@@ -0,0 +1,95 @@
+#include "telegram.h"
+
+#include <cctype>
+#include <cstdio>
+#include <sstream>
+
+using namespace std;
+using namespace telegram;
+
+const string telegram::Commands::default_server = "https://api.telegram.org";
+
+// Percent-encode the query parameter value.
+static string escape(const string& value)
+{
+	static const char digits[] = "0123456789ABCDEF";
+
+	string result;
+	for (int i = 0; i < value.size(); i++)
+	{
+		const unsigned char c = value[i];
+		if (isalnum(c) || (c == '-') || (c == '_') || (c == '.') || (c == '~'))
+			result += c;
+		else
+		{
+			result += '%';
+			result += digits[c >> 4];
+			result += digits[c & 15];
+		}
+	}
+
+	return result;
+}
+
+telegram::Commands::Commands(const Bot& bot, const string& server) :
+
+token(bot.getToken()), chatid(bot.getChatId()), client(server, 1), offset(0)
+
+{ }
+
+bool telegram::Commands::request(const string& path, Json::Value& result)
+{
+	bool succeeded = false;
+	client.get("/bot" + token + path, [&](http::Response& response)
+	{
+		Json::Reader reader;
+		succeeded = (response.status == http::httpSuccess) &&
+			reader.parse(response.body, result) && result["ok"].asBool();
+	});
+	client.wait();
+
+	return succeeded;
+}
+
+telegramError_t telegram::Commands::receive(vector<Command>& commands, int timeout)
+{
+	commands.clear();
+
+	Json::Value result;
+	if (!request("/getUpdates?offset=" + to_string(offset) + "&timeout=" + to_string(timeout), result))
+		return telegramErrorReceiveFailed;
+
+	const Json::Value& updates = result["result"];
+	for (Json::Value::ArrayIndex i = 0, e = updates.size(); i < e; i++)
+	{
+		const Json::Value& update = updates[i];
+		offset = max(offset, update["update_id"].asInt64() + 1);
+
+		// Anyone could write to the bot, but only the owner chat is answered.
+		const Json::Value& message = update["message"];
+		if (message["chat"]["id"].asInt64() != (int64_t)chatid) continue;
+
+		const string text = message["text"].asString();
+		if ((text.size() < 2) || (text[0] != '/')) continue;
+
+		Command command;
+		stringstream words(text.substr(1));
+		words >> command.name;
+		command.name = command.name.substr(0, command.name.find('@'));
+		for (string arg; words >> arg; )
+			command.args.push_back(arg);
+
+		commands.push_back(command);
+	}
+
+	return telegramSuccess;
+}
+
+telegramError_t telegram::Commands::reply(const string& text)
+{
+	Json::Value result;
+	if (!request("/sendMessage?chat_id=" + to_string(chatid) + "&parse_mode=HTML&text=" + escape(text), result))
+		return telegramErrorSendMessageFailed;
+
+	return telegramSuccess;
+}
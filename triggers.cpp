@@ -0,0 +1,140 @@
+#include "triggers.h"
+
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <wordexp.h>
+
+using namespace std;
+using namespace triggers;
+
+#define TRIGGERS_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* triggers::triggersGetErrorString(const triggersError_t err)
+{
+	switch (err)
+	{
+	TRIGGERS_CASE_STR(triggersSuccess);
+	TRIGGERS_CASE_STR(triggersErrorInvalidLine);
+	TRIGGERS_CASE_STR(triggersErrorUnknownSymbol);
+	}
+}
+
+const string triggers::Index::default_path = "$HOME/.bitrader/triggers";
+
+void triggers::Levels::add(const Trigger& trigger)
+{
+	if (trigger.kind == StopLoss)
+		stops.insert(make_pair(trigger.price, trigger));
+	else
+		takes.insert(make_pair(trigger.price, trigger));
+}
+
+void triggers::Levels::check(double low, double high, vector<Trigger>& fired)
+{
+	// The highest stop and the lowest take are the nearest ones.
+	if (stops.size() && (stops.rbegin()->first >= low))
+	{
+		multimap<double, Trigger>::iterator first = stops.lower_bound(low);
+		for (multimap<double, Trigger>::iterator i = first; i != stops.end(); i++)
+			fired.push_back(i->second);
+		stops.erase(first, stops.end());
+	}
+
+	if (takes.size() && (takes.begin()->first <= high))
+	{
+		multimap<double, Trigger>::iterator last = takes.upper_bound(high);
+		for (multimap<double, Trigger>::iterator i = takes.begin(); i != last; i++)
+			fired.push_back(i->second);
+		takes.erase(takes.begin(), last);
+	}
+}
+
+bool triggers::Levels::remove(Kind kind, double price)
+{
+	multimap<double, Trigger>& side = (kind == StopLoss) ? stops : takes;
+	return side.erase(price) > 0;
+}
+
+void triggers::Levels::swap(Levels& other)
+{
+	stops.swap(other.stops);
+	takes.swap(other.takes);
+}
+
+static string expandPath(const string& path)
+{
+	wordexp_t p;
+	wordexp(path.c_str(), &p, 0);
+	const string result = p.we_wordv[0];
+	wordfree(&p);
+
+	return result;
+}
+
+static time_t getModified(const string& path)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st))
+		return 0;
+
+	return st.st_mtime;
+}
+
+triggersError_t triggers::Index::load(const string& path_, const vector<string>& symbols, const string& quote)
+{
+	const string path = expandPath(path_);
+
+	unordered_map<string, int> indexes;
+	for (int i = 0; i < symbols.size(); i++)
+		indexes[symbols[i]] = i;
+
+	vector<Levels> result(symbols.size());
+
+	// The time is taken before the file is read, so that a save after it is seen as
+	// a change, and is recorded only once the file is parsed, so that a save caught
+	// halfway is loaded again.
+	const time_t mtime = getModified(path);
+	ifstream file(path.c_str());
+	string text;
+	for (int line = 1; getline(file, text); line++)
+	{
+		stringstream fields(text);
+		string symbol, kind;
+		Trigger trigger;
+		trigger.line = line;
+		if (!(fields >> symbol) || (symbol[0] == '#'))
+			continue;
+
+		if (!(fields >> kind >> trigger.price) || ((kind != "stop") && (kind != "take")) || (trigger.price <= 0))
+		{
+			fprintf(stderr, "%s:%d: expected <currency> stop|take <price>\n", path.c_str(), line);
+			return triggersErrorInvalidLine;
+		}
+		trigger.kind = (kind == "stop") ? StopLoss : TakeProfit;
+
+		// The currency is traded against the quote asset.
+		unordered_map<string, int>::const_iterator index = indexes.find(symbol);
+		if (index == indexes.end())
+			index = indexes.find(symbol + quote);
+		if (index == indexes.end())
+		{
+			fprintf(stderr, "%s:%d: unknown symbol %s\n", path.c_str(), line, symbol.c_str());
+			return triggersErrorUnknownSymbol;
+		}
+
+		result[index->second].add(trigger);
+	}
+
+	levels.swap(result);
+	modified = mtime;
+
+	return triggersSuccess;
+}
+
+bool triggers::Index::isModified(const string& path) const
+{
+	return getModified(expandPath(path)) != modified;
+}
+
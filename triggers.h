@@ -0,0 +1,108 @@
+#ifndef TRIGGERS_H
+#define TRIGGERS_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace triggers
+{
+	enum triggersError_t
+	{
+		triggersSuccess = 0,
+		triggersErrorInvalidLine,
+		triggersErrorUnknownSymbol,
+	};
+
+	const char* triggersGetErrorString(const triggersError_t err);
+
+	#define TRIGGERS_ERR_CHECK(x) \
+	do { \
+		triggers::triggersError_t err = x; \
+		if (err != triggers::triggersSuccess) \
+		{ \
+			fprintf(stderr, "%s:%d: triggers error: %s\n", __FILE__, __LINE__, triggers::triggersGetErrorString(err)); \
+			exit(1); \
+		} \
+	} while (0)
+
+	enum Kind
+	{
+		// Fires, once the price falls to the level or below.
+		StopLoss,
+
+		// Fires, once the price rises to the level or above.
+		TakeProfit,
+	};
+
+	struct Trigger
+	{
+		Kind kind;
+		double price;
+
+		// Line of the triggers file, to be told in the alert.
+		int line;
+	};
+
+	// Price levels of a single symbol, sorted, so that a price checks only
+	// the levels it has crossed: O(log n + k) for k levels fired, and O(1)
+	// when none is crossed, as the nearest levels are at the ends. The fired
+	// levels are removed.
+	class Levels
+	{
+		std::multimap<double, Trigger> stops, takes;
+
+	public :
+
+		bool empty() const { return stops.empty() && takes.empty(); }
+
+		size_t size() const { return stops.size() + takes.size(); }
+
+		void add(const Trigger& trigger);
+
+		// Take the triggers crossed by the prices traded, from the lowest to
+		// the highest one, appending them to the fired.
+		void check(double low, double high, std::vector<Trigger>& fired);
+
+		// Remove the triggers of the kind at the level; false, if there are none.
+		bool remove(Kind kind, double price);
+
+		void swap(Levels& other);
+	};
+
+	// Levels of all symbols, by the symbol index, so that each symbol could
+	// be checked by its own thread. The triggers file has a line per trigger:
+	//
+	// <currency or pair> stop|take <price>
+	//
+	// with the price in the quote asset, and the lines starting with # ignored.
+	class Index
+	{
+		std::vector<Levels> levels;
+
+		time_t modified;
+
+	public :
+
+		static const std::string default_path;
+
+		Index() : modified(0) { }
+
+		size_t size() const { return levels.size(); }
+
+		Levels& operator[](int i) { return levels[i]; }
+
+		// Load the triggers of the symbols, all of the given quote asset.
+		// The missing file means no triggers. The invalid line is reported.
+		triggersError_t load(const std::string& path, const std::vector<std::string>& symbols, const std::string& quote);
+
+		// Whether the file has been modified since the last load.
+		bool isModified(const std::string& path) const;
+	};
+}
+
+#endif // TRIGGERS_H
+
@@ -0,0 +1,172 @@
+#include "universe.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace universe;
+
+#define UNIVERSE_CASE_STR(err) case err : { static const string str_##err = #err; return str_##err.c_str(); }
+
+const char* universe::universeGetErrorString(const universeError_t err)
+{
+	switch (err)
+	{
+	UNIVERSE_CASE_STR(universeSuccess);
+	UNIVERSE_CASE_STR(universeErrorInvalidExchangeInfo);
+	}
+}
+
+bool universe::Changes::set(int64_t time, double value, int64_t lookback)
+{
+	if (!values.empty() && (values.back().second == value))
+		return false;
+
+	values.push_back(make_pair(time, value));
+
+	// The change before the lookback start is the value at the lookback start.
+	while ((values.size() > 1) && (values[1].first <= time - lookback))
+		values.pop_front();
+
+	return true;
+}
+
+double universe::Changes::get(int64_t time) const
+{
+	struct Less
+	{
+		bool operator()(int64_t time, const pair<int64_t, double>& change) const { return time < change.first; }
+	};
+
+	deque<pair<int64_t, double> >::const_iterator i = upper_bound(values.begin(), values.end(), time, Less());
+	if (i == values.begin()) return values.front().second;
+
+	return (--i)->second;
+}
+
+universe::Universe::Universe(const string& reference_, const string& bridge_, int64_t lookback_) :
+	reference(reference_), bridge(bridge_), lookback(lookback_) { }
+
+universeError_t universe::Universe::load(const Json::Value& exchangeInfo)
+{
+	const Json::Value& symbols = exchangeInfo["symbols"];
+	if (!symbols.isArray())
+		return universeErrorInvalidExchangeInfo;
+
+	markets.clear();
+	indexes.clear();
+	quotes.clear();
+	rates.clear();
+
+	unordered_map<string, int> quoteIndexes;
+	for (Json::Value::ArrayIndex i = 0, e = symbols.size(); i < e; i++)
+	{
+		const Json::Value& symbol = symbols[i];
+		if (symbol["status"].asString() != "TRADING") continue;
+
+		Market market;
+		market.symbol = symbol["symbol"].asString();
+		market.base = symbol["baseAsset"].asString();
+		market.quote = symbol["quoteAsset"].asString();
+		if ((market.symbol == "") || (market.base == "") || (market.quote == ""))
+			return universeErrorInvalidExchangeInfo;
+
+		unordered_map<string, int>::iterator quote = quoteIndexes.find(market.quote);
+		if (quote == quoteIndexes.end())
+		{
+			quote = quoteIndexes.insert(make_pair(market.quote, (int)quotes.size())).first;
+			quotes.push_back(market.quote);
+		}
+		market.quoteIndex = quote->second;
+
+		indexes[market.symbol] = markets.size();
+		markets.push_back(market);
+	}
+
+	rates.resize(quotes.size());
+
+	return universeSuccess;
+}
+
+double universe::Universe::getDirectRate(const string& asset, const string& target) const
+{
+	if (asset == target) return 1.0;
+
+	unordered_map<string, int>::const_iterator i = indexes.find(asset + target);
+	if ((i != indexes.end()) && !markets[i->second].prices.empty())
+		return markets[i->second].prices.getLast();
+
+	i = indexes.find(target + asset);
+	if ((i != indexes.end()) && !markets[i->second].prices.empty())
+	{
+		const double price = markets[i->second].prices.getLast();
+		if (price > 0) return 1.0 / price;
+	}
+
+	return 0;
+}
+
+// There are only a few dozens of quote assets, so all rates are refreshed on every tick.
+void universe::Universe::updateRates(int64_t time)
+{
+	for (int q = 0; q < quotes.size(); q++)
+	{
+		double rate = getDirectRate(quotes[q], reference);
+		if ((rate == 0) && (bridge != reference))
+			rate = getDirectRate(quotes[q], bridge) * getDirectRate(bridge, reference);
+
+		if (rate > 0)
+			rates[q].set(time, rate, lookback);
+	}
+}
+
+bool universe::Universe::setPrice(int i, double price, int64_t time)
+{
+	if (price <= 0) return false;
+
+	return markets[i].prices.set(time, price, lookback);
+}
+
+void universe::Universe::update(const Json::Value& prices, int64_t time, vector<int>& changed,
+	const char* symbolKey, const char* priceKey)
+{
+	for (Json::Value::ArrayIndex i = 0, e = prices.size(); i < e; i++)
+	{
+		const Json::Value& price = prices[i];
+
+		unordered_map<string, int>::const_iterator index = indexes.find(price[symbolKey].asString());
+		if (index == indexes.end()) continue;
+
+		if (setPrice(index->second, atof(price[priceKey].asCString()), time))
+			changed.push_back(index->second);
+	}
+
+	updateRates(time);
+}
+
+double universe::Universe::getRate(int quoteIndex) const
+{
+	const Changes& rate = rates[quoteIndex];
+	if (rate.empty()) return 0;
+
+	return rate.getLast();
+}
+
+double universe::Universe::getNormalizedPrice(int i) const
+{
+	const Market& market = markets[i];
+	if (market.prices.empty()) return 0;
+
+	return market.prices.getLast() * getRate(market.quoteIndex);
+}
+
+double universe::Universe::getChange(int i, int64_t time) const
+{
+	const Market& market = markets[i];
+	const Changes& rate = rates[market.quoteIndex];
+	if (market.prices.empty() || rate.empty()) return 0;
+
+	// The pump is the move of the price itself, and of the quote asset against the reference.
+	const int64_t start = time - lookback;
+	return market.prices.getLast() / market.prices.get(start) * rate.getLast() / rate.get(start);
+}
+
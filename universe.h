@@ -0,0 +1,123 @@
+#ifndef UNIVERSE_H
+#define UNIVERSE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <jsoncpp/json/json.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace universe
+{
+	enum universeError_t
+	{
+		universeSuccess = 0,
+		universeErrorInvalidExchangeInfo,
+	};
+
+	const char* universeGetErrorString(const universeError_t err);
+
+	#define UNIVERSE_ERR_CHECK(x) \
+	do { \
+		universe::universeError_t err = x; \
+		if (err != universe::universeSuccess) \
+		{ \
+			fprintf(stderr, "%s:%d: universe error: %s\n", __FILE__, __LINE__, universe::universeGetErrorString(err)); \
+			exit(1); \
+		} \
+	} while (0)
+
+	// Values of the recent changes, enough to look back for the period:
+	// the oldest change is kept at or before the lookback start.
+	class Changes
+	{
+		std::deque<std::pair<int64_t, double> > values;
+
+	public :
+
+		bool empty() const { return values.empty(); }
+
+		double getLast() const { return values.back().second; }
+
+		// Record the value, if changed, dropping the changes older than the lookback.
+		bool set(int64_t time, double value, int64_t lookback);
+
+		// The value at the time, or the oldest one known.
+		double get(int64_t time) const;
+	};
+
+	struct Market
+	{
+		std::string symbol, base, quote;
+
+		// Index of the quote asset in the rates.
+		int quoteIndex;
+
+		Changes prices;
+	};
+
+	// All trading pairs of all quote assets. Prices are normalized to the common
+	// reference asset by the cross rates of the quote assets, taken from the
+	// same snapshot, so that a quote asset move alone does not look like a pump.
+	//
+	// The per-tick work is proportional to the number of the changed prices:
+	// the markets are found by hash, and only the changed ones are evaluated.
+	class Universe
+	{
+		const std::string reference;
+
+		// The intermediate asset for the quote assets not traded against the reference.
+		const std::string bridge;
+
+		std::vector<Market> markets;
+		std::unordered_map<std::string, int> indexes;
+
+		// Quote assets and their rates in the reference asset.
+		std::vector<std::string> quotes;
+		std::vector<Changes> rates;
+
+		int64_t lookback;
+
+		// Value of the asset in the reference asset by the current prices, or 0.
+		double getDirectRate(const std::string& asset, const std::string& target) const;
+
+		void updateRates(int64_t time);
+
+	public :
+
+		Universe(const std::string& reference = "BTC", const std::string& bridge = "USDT", int64_t lookback = 60 * 1000);
+
+		// Take the trading symbols from the exchange info {"symbols" : [{"symbol", "status", "baseAsset", "quoteAsset"}]}.
+		universeError_t load(const Json::Value& exchangeInfo);
+
+		size_t size() const { return markets.size(); }
+
+		const std::string& getReference() const { return reference; }
+
+		const Market& operator[](int i) const { return markets[i]; }
+
+		// Apply the prices [{"symbol", "price"}] of the REST snapshot, or the like
+		// of the ticker stream by the other keys, collecting the markets with
+		// the changed prices.
+		void update(const Json::Value& prices, int64_t time, std::vector<int>& changed,
+			const char* symbolKey = "symbol", const char* priceKey = "price");
+
+		// Apply the price of the single market.
+		bool setPrice(int i, double price, int64_t time);
+
+		// Value of the quote asset in the reference asset, or 0 if unknown.
+		double getRate(int quoteIndex) const;
+
+		// Price of the market in the reference asset, or 0 if unknown.
+		double getNormalizedPrice(int i) const;
+
+		// Change of the normalized price over the lookback, or 0 if unknown.
+		double getChange(int i, int64_t time) const;
+	};
+}
+
+#endif // UNIVERSE_H
+